@@ -0,0 +1,229 @@
+/**
+ * @file compile_bench.cpp
+ * @brief Compiler throughput benchmark: generates a program and times each phase of its
+ * compilation in-process.
+ *
+ * Every iteration runs the phases of `./compiler --codegen` (plus the encoder of the
+ * integrated assembler) on the same source, in a fresh symbol table, and the report
+ * gives the mean time of each phase with its throughput in tokens and lines per second.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "program_generator.hpp"
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "validate.hpp"
+#include "lowerer.hpp"
+#include "optimize.hpp"
+#include "asdl.hpp"
+#include "regalloc.hpp"
+#include "peephole.hpp"
+#include "x86encoder.hpp"
+#include "stats.hpp"
+#include "symbol.hpp"
+
+namespace {
+
+void printHelp() {
+    std::cout << "Usage: compile_bench [options]\n";
+    std::cout << "  --shape=<shape>      # expressions, straight, scopes, loops or mixed (default: mixed)\n";
+    std::cout << "  --scale=<n>          # Statements, declarations or loop nests to generate (default: 2000)\n";
+    std::cout << "  --depth=<n>          # Nesting depth of expressions, blocks and loops (default: 16)\n";
+    std::cout << "  --seed=<n>           # Seed of the generator (default: 1)\n";
+    std::cout << "  --iterations=<n>     # Timed compilations (default: 10)\n";
+    std::cout << "  -O0, -O1             # Optimization level (default: -O1)\n";
+    std::cout << "  --json               # Print the report as JSON\n";
+    std::cout << "  --emit=<file>        # Only write the generated program to <file>\n";
+}
+
+/**
+ * @brief Reads the number of `--name=<n>`.
+ * @return False if `arg` is not that option; exits on a malformed number.
+ */
+bool numberOption(const std::string& arg, const std::string& name, unsigned& value) {
+    if (arg.rfind(name + "=", 0) != 0) return false;
+    const std::string text = arg.substr(name.size() + 1);
+    char* end = nullptr;
+    unsigned long n = std::strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0') {
+        std::cerr << "Invalid value for " << name << ": " << text << "\n";
+        std::exit(1);
+    }
+    value = static_cast<unsigned>(n);
+    return true;
+}
+
+/**
+ * @brief Compiles `source` once, adding the time of each phase to `report`.
+ * @return Number of tokens of the source.
+ */
+size_t compileOnce(const SourceBuffer& source, int optLevel, CompileReport& report) {
+    SymbolTableScope symbolScope;
+
+    PhaseTimer timer(report, "lex");
+    std::vector<Lex> tokens = lexer(source, false);
+
+    timer.next("parse");
+    Parser parser(tokens, false);
+    auto ast = parser.parseProgram();
+
+    timer.next("validate");
+    ValidationContext validation;
+    resolve_program(ast.get(), validation);
+
+    timer.next("lower");
+    Lowerer lowerer(optLevel >= 1);
+    tacky::FlatProgram tackyProgram = lowerer.lower(ast.get());
+
+    timer.next("optimize");
+    optimizeProgram(tackyProgram, optLevel);
+
+    timer.next("select");
+    ASDLProgram asdlProgram = convertTackyToASDL(tackyProgram);
+
+    timer.next("assign-pseudos");
+    int stackOffset = optLevel >= 1 ? allocateRegisters(asdlProgram) : replacePseudosWithStack(asdlProgram);
+
+    timer.next("legalize");
+    insertAllocateStack(asdlProgram, -stackOffset);
+    legalizeMovMemoryToMemory(asdlProgram);
+
+    if (optLevel >= 1) {
+        timer.next("peephole");
+        PeepholeOptimizer peephole;
+        peephole.run(asdlProgram);
+    }
+
+    timer.next("emit");
+    std::ostringstream assembly;
+    asdlProgram.emit(assembly);
+
+    timer.next("encode");
+    MachineCode code = encodeProgram(asdlProgram);
+    timer.stop();
+    return tokens.size();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ProgramShape shape = ProgramShape::Mixed;
+    unsigned scale = 2000;
+    unsigned depth = 16;
+    unsigned seed = 1;
+    unsigned iterations = 10;
+    int optLevel = 1;
+    bool json = false;
+    std::string emitPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            printHelp();
+            return 0;
+        } else if (arg.rfind("--shape=", 0) == 0) {
+            if (!parseProgramShape(arg.substr(8), shape)) {
+                std::cerr << "Unknown shape: " << arg.substr(8) << "\n";
+                return 1;
+            }
+        } else if (numberOption(arg, "--scale", scale) || numberOption(arg, "--depth", depth) ||
+                   numberOption(arg, "--seed", seed) || numberOption(arg, "--iterations", iterations)) {
+            continue;
+        } else if (arg == "-O0" || arg == "-O1") {
+            optLevel = arg[2] - '0';
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg.rfind("--emit=", 0) == 0) {
+            emitPath = arg.substr(7);
+        } else {
+            std::cerr << "Unexpected argument: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+
+    const std::string text = generateProgram(shape, scale, depth, seed);
+    if (!emitPath.empty()) {
+        std::ofstream file(emitPath);
+        file << text;
+        if (!file) {
+            std::cerr << "Failed to write " << emitPath << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    size_t lines = 0;
+    for (char c : text) lines += c == '\n';
+    SourceBuffer source(SourceBuffer::InMemory{}, text);
+    if (iterations == 0) iterations = 1;
+
+    // One untimed compilation first, so that the caches and the allocator are warm
+    CompileReport report;
+    size_t tokens = 0;
+    try {
+        tokens = compileOnce(source, optLevel, report);
+        report.timePasses = true;
+        for (unsigned i = 0; i < iterations; ++i) compileOnce(source, optLevel, report);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    // Phases run in the same order every time: sum them by name
+    std::vector<CompileReport::Phase> phases;
+    for (const CompileReport::Phase& phase : report.phases) {
+        size_t p = 0;
+        while (p < phases.size() && std::string(phases[p].name) != phase.name) ++p;
+        if (p == phases.size()) phases.push_back({phase.name, 0, 0});
+        phases[p].wallMs += phase.wallMs / iterations;
+        phases[p].cpuMs += phase.cpuMs / iterations;
+    }
+    double totalMs = 0;
+    for (const CompileReport::Phase& phase : phases) totalMs += phase.wallMs;
+    auto perSecond = [](double count, double ms) { return ms > 0 ? count * 1000.0 / ms : 0.0; };
+
+    char line[128];
+    if (json) {
+        std::cout << "{\"shape\":\"" << programShapeName(shape) << "\",\"scale\":" << scale << ",\"depth\":" << depth
+                  << ",\"seed\":" << seed << ",\"opt_level\":" << optLevel << ",\"lines\":" << lines
+                  << ",\"tokens\":" << tokens << ",\"bytes\":" << text.size() << ",\"iterations\":" << iterations
+                  << ",\"phases\":[";
+        for (size_t p = 0; p < phases.size(); ++p) {
+            std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ms\":%.4f,\"tokens_per_s\":%.0f,\"lines_per_s\":%.0f}",
+                          p ? "," : "", phases[p].name, phases[p].wallMs, perSecond(tokens, phases[p].wallMs),
+                          perSecond(lines, phases[p].wallMs));
+            std::cout << line;
+        }
+        std::snprintf(line, sizeof(line), "],\"total_ms\":%.4f,\"tokens_per_s\":%.0f,\"lines_per_s\":%.0f", totalMs,
+                      perSecond(tokens, totalMs), perSecond(lines, totalMs));
+        std::cout << line << ",\"peak_rss_kb\":" << peakResidentKilobytes() << "}\n";
+        return 0;
+    }
+
+    std::cout << programShapeName(shape) << " program, scale " << scale << ", depth " << depth << ", seed " << seed
+              << ", -O" << optLevel << ": " << lines << " lines, " << tokens << " tokens, " << text.size()
+              << " bytes; mean of " << iterations << " compilations\n";
+    std::snprintf(line, sizeof(line), "  %-16s %10s %10s %14s %14s\n", "phase", "wall ms", "cpu ms", "tokens/s",
+                  "lines/s");
+    std::cout << line;
+    for (const CompileReport::Phase& phase : phases) {
+        std::snprintf(line, sizeof(line), "  %-16s %10.3f %10.3f %14.0f %14.0f\n", phase.name, phase.wallMs,
+                      phase.cpuMs, perSecond(tokens, phase.wallMs), perSecond(lines, phase.wallMs));
+        std::cout << line;
+    }
+    std::snprintf(line, sizeof(line), "  %-16s %10.3f %10s %14.0f %14.0f\n", "total", totalMs, "",
+                  perSecond(tokens, totalMs), perSecond(lines, totalMs));
+    std::cout << line;
+    std::cout << "  peak RSS: " << peakResidentKilobytes() << " KB\n";
+    return 0;
+}
@@ -0,0 +1,238 @@
+/**
+ * @file program_generator.cpp
+ * @brief Implementation of the benchmark program generator.
+ */
+
+#include "program_generator.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Writes one program; every variable it reads holds a small value except `acc`.
+ */
+class ProgramWriter {
+    std::mt19937 random;
+    std::string text;
+    unsigned indent = 1;
+    unsigned nextName = 0;
+    std::vector<std::string> visible;  ///< Variables in scope, innermost last
+    unsigned depth;
+
+    unsigned pick(unsigned n) { return static_cast<unsigned>(random() % n); }
+
+    std::string freshName(const char* prefix) { return prefix + std::to_string(nextName++); }
+
+    void line(const std::string& code) {
+        text.append(4 * indent, ' ');
+        text += code;
+        text += '\n';
+    }
+
+    void open(const std::string& code) {
+        line(code);
+        ++indent;
+    }
+
+    void close(const std::string& code = "}") {
+        --indent;
+        line(code);
+    }
+
+    std::string operand() {
+        if (!visible.empty() && pick(3) != 0) return visible[pick(static_cast<unsigned>(visible.size()))];
+        return std::to_string(1 + pick(99));
+    }
+
+    /**
+     * @brief Returns an expression nested `levels` deep.
+     */
+    std::string expression(unsigned levels) {
+        if (levels == 0) return operand();
+        static const char* const binary[] = {"+", "-", "<", "<=", ">", ">=", "==", "!=", "&&", "||"};
+        switch (pick(9)) {
+            case 0:
+                return "(" + expression(levels - 1) + " / " + std::to_string(1 + pick(9)) + ")";
+            case 1:
+                return "(" + expression(levels - 1) + " % " + std::to_string(2 + pick(9)) + ")";
+            case 2: {
+                static const char* const unary[] = {"-", "~", "!"};
+                return std::string(unary[pick(3)]) + "(" + expression(levels - 1) + ")";
+            }
+            case 3:
+                return "(" + operand() + " ? " + expression(levels - 1) + " : " + operand() + ")";
+            case 4:
+                // Products of small factors only, so that no value overflows
+                return "(" + operand() + " * (" + expression(levels - 1) + " % 100))";
+            default:
+                // Keep one side shallow so that the size grows linearly with the depth
+                if (pick(2) == 0) {
+                    return "(" + expression(levels - 1) + " " + binary[pick(10)] + " " + operand() + ")";
+                }
+                return "(" + operand() + " " + binary[pick(10)] + " " + expression(levels - 1) + ")";
+        }
+    }
+
+    /**
+     * @brief Adds `acc = (acc + <value>) % 1000;`, which keeps every result live.
+     */
+    void accumulate(const std::string& value) { line("acc = (acc + " + value + ") % 1000;"); }
+
+    /**
+     * @brief Declares a variable holding a small value and makes it visible.
+     */
+    void declare(const std::string& name) {
+        // `int x = x` would read the new, uninitialized x instead of the one it shadows
+        std::string init = operand();
+        if (init == name) init = std::to_string(1 + pick(99));
+        line("int " + name + " = " + init + " % 100;");
+        visible.push_back(name);
+    }
+
+    void expressions(unsigned count) {
+        const size_t scope = visible.size();
+        for (unsigned i = 0; i < 4; ++i) declare(freshName("e"));
+        for (unsigned i = 0; i < count; ++i) accumulate(expression(depth) + " % 100");
+        visible.resize(scope);
+    }
+
+    void straightLine(unsigned count) {
+        const size_t scope = visible.size();
+        std::vector<std::string> names;
+        for (unsigned i = 0; i < 8; ++i) {
+            names.push_back(freshName("s"));
+            declare(names.back());
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            line(names[pick(8)] + " = (" + expression(2) + ") % 100;");
+        }
+        for (const std::string& name : names) accumulate(name);
+        visible.resize(scope);
+    }
+
+    /**
+     * @brief Writes nested blocks holding up to `budget` declarations.
+     * @return Number of declarations written.
+     */
+    unsigned scopeBlock(unsigned budget, unsigned level) {
+        open("{");
+        const size_t scope = visible.size();
+        std::vector<std::string> local;
+        unsigned declared = 0;
+        while (declared < budget) {
+            // Names repeat across blocks, so inner declarations shadow outer ones
+            unsigned choice = pick(4);
+            if (choice < 2) {
+                std::string name = "d" + std::to_string(pick(16));
+                if (std::find(local.begin(), local.end(), name) != local.end()) name = freshName("u");
+                local.push_back(name);
+                declare(name);
+                ++declared;
+            } else if (choice == 2 && level < std::min(depth, 32u)) {
+                declared += scopeBlock(std::min(budget - declared, 1 + pick(12)), level + 1);
+            } else {
+                accumulate(expression(2) + " % 100");
+                if (pick(4) == 0) break;
+            }
+        }
+        visible.resize(scope);
+        close();
+        return declared;
+    }
+
+    void scopes(unsigned count) {
+        for (unsigned declared = 0; declared < count;) {
+            declared += scopeBlock(std::min(count - declared, 8 + pick(32)), 0);
+        }
+    }
+
+    /**
+     * @brief Writes a loop nest `levels` deep whose counters count to at most 5.
+     */
+    void loopNest(unsigned levels) {
+        const std::string counter = freshName("c");
+        const std::string bound = std::to_string(2 + pick(4));
+        const unsigned kind = pick(3);
+        if (kind == 0) {
+            open("for (int " + counter + " = 0; " + counter + " < " + bound + "; " + counter + " = " + counter +
+                 " + 1) {");
+        } else {
+            open("{");
+            line("int " + counter + " = 0;");
+            open(kind == 1 ? "while (" + counter + " < " + bound + ") {" : "do {");
+            line(counter + " = " + counter + " + 1;");
+        }
+        visible.push_back(counter);
+
+        if (pick(3) == 0) line("if (" + counter + " % 3 == 1) continue;");
+        accumulate(expression(2) + " % 100");
+        if (levels > 1) loopNest(levels - 1);
+        if (pick(3) == 0) line("if (acc % 7 == " + std::to_string(pick(7)) + ") break;");
+
+        visible.pop_back();
+        if (kind == 0) {
+            close();
+        } else {
+            close(kind == 1 ? "}" : "} while (" + counter + " < " + bound + ");");
+            close();
+        }
+    }
+
+    void loops(unsigned count) {
+        for (unsigned i = 0; i < count; ++i) loopNest(1 + pick(std::max(1u, std::min(depth, 4u))));
+    }
+
+public:
+    ProgramWriter(uint32_t seed, unsigned depth) : random(seed), depth(depth) {}
+
+    std::string write(ProgramShape shape, unsigned scale) {
+        text = "int main(void) {\n";
+        line("int acc = 0;");
+        switch (shape) {
+            case ProgramShape::Expressions: expressions(scale); break;
+            case ProgramShape::StraightLine: straightLine(scale); break;
+            case ProgramShape::Scopes: scopes(scale); break;
+            case ProgramShape::Loops: loops(scale); break;
+            case ProgramShape::Mixed:
+                expressions(scale / 4);
+                straightLine(scale / 4);
+                scopes(scale / 4);
+                loops(scale / 4);
+                break;
+        }
+        line("return (acc % 256 + 256) % 256;");
+        text += "}\n";
+        return text;
+    }
+};
+
+} // namespace
+
+bool parseProgramShape(const std::string& name, ProgramShape& shape) {
+    for (ProgramShape candidate : {ProgramShape::Expressions, ProgramShape::StraightLine, ProgramShape::Scopes,
+                                   ProgramShape::Loops, ProgramShape::Mixed}) {
+        if (name == programShapeName(candidate)) {
+            shape = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* programShapeName(ProgramShape shape) {
+    switch (shape) {
+        case ProgramShape::Expressions: return "expressions";
+        case ProgramShape::StraightLine: return "straight";
+        case ProgramShape::Scopes: return "scopes";
+        case ProgramShape::Loops: return "loops";
+        case ProgramShape::Mixed: return "mixed";
+    }
+    return "";
+}
+
+std::string generateProgram(ProgramShape shape, unsigned scale, unsigned depth, uint32_t seed) {
+    return ProgramWriter(seed, depth).write(shape, scale);
+}
@@ -0,0 +1,48 @@
+/**
+ * @file program_generator.hpp
+ * @brief Generates valid programs of the supported C subset at a chosen scale, for the
+ * compiler benchmarks.
+ */
+
+#ifndef PROGRAM_GENERATOR_HPP
+#define PROGRAM_GENERATOR_HPP
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Kinds of generated programs, each stressing a different part of the compiler.
+ */
+enum class ProgramShape {
+    Expressions,   ///< Statements whose expressions are nested `depth` levels deep
+    StraightLine,  ///< One long block of assignments
+    Scopes,        ///< Thousands of declarations in nested blocks, shadowing each other
+    Loops,         ///< Nested for/while/do loops with break and continue
+    Mixed          ///< A quarter of the scale of each shape above
+};
+
+/**
+ * @brief Parses a shape name: `expressions`, `straight`, `scopes`, `loops` or `mixed`.
+ * @return False if the name is unknown.
+ */
+bool parseProgramShape(const std::string& name, ProgramShape& shape);
+
+/**
+ * @brief Returns the name parseProgramShape accepts for a shape.
+ */
+const char* programShapeName(ProgramShape shape);
+
+/**
+ * @brief Generates `int main(void) { ... }` with the given shape.
+ *
+ * The program only divides by non-zero constants and returns a value in 0..255, so it
+ * can also be compiled and run.
+ *
+ * @param shape Kind of program.
+ * @param scale Number of statements (for Scopes: declarations, for Loops: loop nests).
+ * @param depth Nesting depth of expressions, and bound on the nesting of blocks and loops.
+ * @param seed Seed of the random choices; the same arguments give the same program.
+ */
+std::string generateProgram(ProgramShape shape, unsigned scale, unsigned depth, uint32_t seed);
+
+#endif // PROGRAM_GENERATOR_HPP
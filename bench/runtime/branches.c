@@ -0,0 +1,11 @@
+int main(void) {
+    /* FizzBuzz-style classification with short-circuit conditions and continue */
+    int score = 0;
+    for (int i = 0; i < 10000000; i = i + 1) {
+        if (i % 15 == 0 && i % 2)
+            continue;
+        int kind = (i % 3 == 0) ? 1 : (i % 5 == 0 || i % 7 == 0) ? 2 : 3;
+        score = (score + kind * (i % 11 > 5 ? 2 : 1)) % 99991;
+    }
+    return score % 256;
+}
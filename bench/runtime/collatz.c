@@ -0,0 +1,15 @@
+int main(void) {
+    /* Total number of Collatz steps for every start below 100000 (values stay below 2^31) */
+    int total = 0;
+    for (int n = 1; n < 100000; n = n + 1) {
+        int x = n;
+        while (x != 1) {
+            if (x % 2 == 0)
+                x = x / 2;
+            else
+                x = 3 * x + 1;
+            total = total + 1;
+        }
+    }
+    return total % 256;
+}
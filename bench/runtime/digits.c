@@ -0,0 +1,14 @@
+int main(void) {
+    /* Sum of the digits of every number below 3000001 */
+    int sum = 0;
+    int n = 0;
+    while (n < 3000001) {
+        int x = n;
+        do {
+            sum = sum + x % 10;
+            x = x / 10;
+        } while (x > 0);
+        n = n + 1;
+    }
+    return sum % 256;
+}
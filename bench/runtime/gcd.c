@@ -0,0 +1,17 @@
+int main(void) {
+    /* Sum of gcd(i, j) over 1 <= i, j < 1500, by Euclid's algorithm */
+    int sum = 0;
+    for (int i = 1; i < 1500; i = i + 1) {
+        for (int j = 1; j < 1500; j = j + 1) {
+            int a = i;
+            int b = j;
+            while (b != 0) {
+                int t = a % b;
+                a = b;
+                b = t;
+            }
+            sum = (sum + a) % 1000003;
+        }
+    }
+    return sum % 256;
+}
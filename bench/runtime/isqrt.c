@@ -0,0 +1,14 @@
+int main(void) {
+    /* Integer square roots by Newton's method for every number below 2000000 */
+    int sum = 0;
+    for (int n = 1; n < 2000000; n = n + 1) {
+        int r = n;
+        int next = (r + n / r) / 2;
+        while (next < r) {
+            r = next;
+            next = (r + n / r) / 2;
+        }
+        sum = (sum + r) % 65521;
+    }
+    return sum % 256;
+}
@@ -0,0 +1,16 @@
+int main(void) {
+    /* Walks a 6000 x 1000 grid; the row offset and the weights only change per row */
+    int rows = 6000;
+    int cols = 1000;
+    int seed = 17;
+    int sum = 0;
+    for (int r = 0; r < rows; r = r + 1) {
+        for (int c = 0; c < cols; c = c + 1) {
+            int index = r * cols + c;
+            int weight = ((seed * r) % 97 * 13 + r * r % 89) % 101;
+            int bias = (r % 7 == 3) ? weight / 3 : weight % 5;
+            sum = (sum + index % 53 * weight + bias + c * 7) % 1000003;
+        }
+    }
+    return sum % 256;
+}
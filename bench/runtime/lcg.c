@@ -0,0 +1,14 @@
+int main(void) {
+    /* Counts low and odd outputs of a linear congruential generator */
+    int x = 12345;
+    int low = 0;
+    int odd = 0;
+    for (int i = 0; i < 20000000; i = i + 1) {
+        x = (x * 1103 + 12345) % 65536;
+        if (x < 32768)
+            low = low + 1;
+        if (x % 2)
+            odd = odd + 1;
+    }
+    return (low - odd + x) % 256;
+}
@@ -0,0 +1,15 @@
+int main(void) {
+    /* Counts the primes below 300000 by trial division */
+    int count = 0;
+    for (int n = 2; n < 300000; n = n + 1) {
+        int prime = 1;
+        for (int d = 2; d * d <= n; d = d + 1) {
+            if (n % d == 0) {
+                prime = 0;
+                break;
+            }
+        }
+        count = count + prime;
+    }
+    return count % 256;
+}
@@ -0,0 +1,16 @@
+int main(void) {
+    /* Minimum, maximum and a sum of values picked by pseudo-random bits: the choices are unpredictable */
+    int x = 4321;
+    int lo = 65536;
+    int hi = 0;
+    int sum = 0;
+    for (int i = 0; i < 20000000; i = i + 1) {
+        x = (x * 1103 + 12345) % 65536;
+        lo = x < lo ? x : lo;
+        hi = x > hi ? x : hi;
+        int clamped = x > 40000 ? 40000 : x;
+        int pick = x % 64 < 32 ? clamped : i;
+        sum = (sum + pick) % 1000003;
+    }
+    return (sum + lo + hi) % 256;
+}
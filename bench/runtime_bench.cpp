@@ -0,0 +1,288 @@
+/**
+ * @file runtime_bench.cpp
+ * @brief Generated-code benchmark: runs programs built by this compiler and by clang,
+ * checks that they agree and compares their run times.
+ *
+ * Each program is built with `compiler -O0`, `compiler -O1`, `clang -O0` and
+ * `clang -O2`. The return value of main is the only output of a program, so the exit
+ * codes of the four binaries must be equal; the report gives the median run time of
+ * each binary and its ratio to clang -O2. Programs from the generator of
+ * program_generator.hpp can be added as a differential test, without timing.
+ *
+ * Runs the tools through std::system and reads exit codes with the POSIX wait macros.
+ */
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "program_generator.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void printHelp() {
+    std::cout << "Usage: runtime_bench [options] [program.c ...]\n";
+    std::cout << "  --compiler=<path>    # Compiler under test (default: ./compiler)\n";
+    std::cout << "  --cc=<path>          # Reference compiler (default: clang)\n";
+    std::cout << "  --runs=<n>           # Runs of each binary; the median is reported (default: 5)\n";
+    std::cout << "  --generated=<n>      # Also check the exit codes of n generated programs\n";
+    std::cout << "  --work-dir=<dir>     # Where binaries are built (default: bench_runtime_out)\n";
+    std::cout << "  --json               # Print the report as JSON\n";
+    std::cout << "Without programs, runs every .c file of bench/runtime.\n";
+}
+
+/**
+ * @brief A way of building a program.
+ */
+struct Config {
+    std::string name;       ///< Column title, e.g. "clang -O2"
+    std::string tool;       ///< Compiler to run
+    std::string flags;      ///< Its options
+    bool ours;              ///< The compiler under test (which prints progress to stdout)
+};
+
+/**
+ * @brief Quotes a path for the shell.
+ */
+std::string quote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') {
+            quoted += "'\\''";
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "'";
+}
+
+/**
+ * @brief Runs a shell command.
+ * @return Its exit code, or -1 if it did not exit normally.
+ */
+int run(const std::string& command) {
+    int status = std::system(command.c_str());
+    if (status == -1 || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+/**
+ * @brief Builds `source` into `binary` with `config`.
+ * @return False if the compiler failed.
+ */
+bool build(const Config& config, const std::string& source, const std::string& binary) {
+    std::string command = quote(config.tool) + " " + config.flags + " -o " + quote(binary) + " " + quote(source);
+    command += config.ours ? " > /dev/null" : " -w";
+    return run(command) == 0;
+}
+
+/**
+ * @brief Result of one program under one config.
+ */
+struct Measure {
+    bool built = false;
+    int exitCode = -1;
+    double ms = 0;  ///< Median run time
+};
+
+/**
+ * @brief Builds and runs a program with every config.
+ * @param runs Number of timed runs (0 to only check the exit code).
+ */
+std::vector<Measure> measure(const std::vector<Config>& configs, const std::string& source,
+                             const std::string& workDir, unsigned runs) {
+    std::vector<Measure> measures(configs.size());
+    const std::string stem = fs::path(source).stem().string();
+    for (size_t c = 0; c < configs.size(); ++c) {
+        const std::string binary = workDir + "/" + stem + "-" + std::to_string(c);
+        Measure& m = measures[c];
+        m.built = build(configs[c], source, binary);
+        if (!m.built) continue;
+
+        std::vector<double> times;
+        for (unsigned r = 0; r < std::max(runs, 1u); ++r) {
+            auto start = std::chrono::steady_clock::now();
+            m.exitCode = run(quote(binary));
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                                .count());
+        }
+        std::sort(times.begin(), times.end());
+        m.ms = times[times.size() / 2];
+    }
+    return measures;
+}
+
+/**
+ * @brief Prints the configs whose exit code differs from the reference (the last config).
+ * @return True if every config built and agreed.
+ */
+bool check(const std::vector<Config>& configs, const std::vector<Measure>& measures, const std::string& program) {
+    bool agree = true;
+    const Measure& reference = measures.back();
+    for (size_t c = 0; c < configs.size(); ++c) {
+        if (!measures[c].built) {
+            std::cerr << "BUILD FAILED " << program << ": " << configs[c].name << "\n";
+            agree = false;
+        } else if (reference.built && measures[c].exitCode != reference.exitCode) {
+            std::cerr << "MISMATCH " << program << ": " << configs[c].name << " exited with " << measures[c].exitCode
+                      << ", " << configs.back().name << " with " << reference.exitCode << "\n";
+            agree = false;
+        }
+    }
+    return agree;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string compiler = "./compiler";
+    std::string cc = "clang";
+    std::string workDir = "bench_runtime_out";
+    unsigned runs = 5;
+    unsigned generated = 0;
+    bool json = false;
+    std::vector<std::string> programs;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            printHelp();
+            return 0;
+        } else if (arg.rfind("--compiler=", 0) == 0) {
+            compiler = arg.substr(11);
+        } else if (arg.rfind("--cc=", 0) == 0) {
+            cc = arg.substr(5);
+        } else if (arg.rfind("--runs=", 0) == 0) {
+            runs = static_cast<unsigned>(std::strtoul(arg.c_str() + 7, nullptr, 10));
+        } else if (arg.rfind("--generated=", 0) == 0) {
+            generated = static_cast<unsigned>(std::strtoul(arg.c_str() + 12, nullptr, 10));
+        } else if (arg.rfind("--work-dir=", 0) == 0) {
+            workDir = arg.substr(11);
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg[0] != '-') {
+            programs.push_back(arg);
+        } else {
+            std::cerr << "Unexpected argument: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    if (programs.empty()) {
+        for (const auto& entry : fs::directory_iterator("bench/runtime", error)) {
+            if (entry.path().extension() == ".c") programs.push_back(entry.path().string());
+        }
+        std::sort(programs.begin(), programs.end());
+    }
+    fs::create_directories(workDir, error);
+    if (!fs::is_directory(workDir)) {
+        std::cerr << "Failed to create " << workDir << "\n";
+        return 1;
+    }
+
+    // The last config is the reference the exit codes are checked against
+    const std::vector<Config> configs = {
+        {"ours -O0", compiler, "-O0", true},
+        {"ours -O1", compiler, "-O1", true},
+        {"clang -O2", cc, "-O2", false},
+        {"clang -O0", cc, "-O0", false},
+    };
+    const size_t baseline = 2;  // Run times are given relative to clang -O2
+    bool agree = true;
+
+    std::vector<std::vector<Measure>> results;
+    for (const std::string& program : programs) {
+        results.push_back(measure(configs, program, workDir, runs));
+        agree = check(configs, results.back(), fs::path(program).filename().string()) && agree;
+    }
+
+    unsigned generatedAgree = 0;
+    for (unsigned seed = 1; seed <= generated; ++seed) {
+        const ProgramShape shape = static_cast<ProgramShape>(seed % 5);
+        const std::string source = workDir + "/generated" + std::to_string(seed) + ".c";
+        std::ofstream(source) << generateProgram(shape, 60, 6, seed);
+        if (check(configs, measure(configs, source, workDir, 0), fs::path(source).filename().string())) {
+            ++generatedAgree;
+        } else {
+            agree = false;
+        }
+    }
+
+    auto ratio = [&](const std::vector<Measure>& m, size_t c) {
+        return m[baseline].ms > 0 ? m[c].ms / m[baseline].ms : 0.0;
+    };
+    std::vector<double> logSums(configs.size(), 0);
+    for (const std::vector<Measure>& m : results) {
+        for (size_t c = 0; c < configs.size(); ++c) logSums[c] += std::log(std::max(ratio(m, c), 1e-9));
+    }
+
+    char cell[64];
+    if (json) {
+        std::cout << "{\"runs\":" << runs << ",\"programs\":[";
+        for (size_t p = 0; p < programs.size(); ++p) {
+            std::cout << (p ? "," : "") << "{\"name\":\"" << fs::path(programs[p]).filename().string()
+                      << "\",\"exit_code\":" << results[p].back().exitCode << ",\"ms\":{";
+            for (size_t c = 0; c < configs.size(); ++c) {
+                std::snprintf(cell, sizeof(cell), "%s\"%s\":%.3f", c ? "," : "", configs[c].name.c_str(),
+                              results[p][c].ms);
+                std::cout << cell;
+            }
+            std::cout << "}}";
+        }
+        std::cout << "],\"geomean_ratio_to_clang_O2\":{";
+        for (size_t c = 0; c < configs.size(); ++c) {
+            double mean = programs.empty() ? 0 : std::exp(logSums[c] / programs.size());
+            std::snprintf(cell, sizeof(cell), "%s\"%s\":%.3f", c ? "," : "", configs[c].name.c_str(), mean);
+            std::cout << cell;
+        }
+        std::cout << "},\"generated\":" << generated << ",\"generated_agree\":" << generatedAgree
+                  << ",\"all_agree\":" << (agree ? "true" : "false") << "}\n";
+        return agree ? 0 : 1;
+    }
+
+    std::cout << "Median of " << runs << " runs, in ms (ratio to clang -O2)\n";
+    std::snprintf(cell, sizeof(cell), "%-16s %5s", "program", "exit");
+    std::cout << cell;
+    for (const Config& config : configs) {
+        std::snprintf(cell, sizeof(cell), " %20s", config.name.c_str());
+        std::cout << cell;
+    }
+    std::cout << "\n";
+    for (size_t p = 0; p < programs.size(); ++p) {
+        std::snprintf(cell, sizeof(cell), "%-16s %5d", fs::path(programs[p]).filename().string().c_str(),
+                      results[p].back().exitCode);
+        std::cout << cell;
+        for (size_t c = 0; c < configs.size(); ++c) {
+            std::snprintf(cell, sizeof(cell), " %11.1f (%5.2fx)", results[p][c].ms, ratio(results[p], c));
+            std::cout << cell;
+        }
+        std::cout << "\n";
+    }
+    if (!programs.empty()) {
+        std::snprintf(cell, sizeof(cell), "%-16s %5s", "geomean", "");
+        std::cout << cell;
+        for (size_t c = 0; c < configs.size(); ++c) {
+            std::snprintf(cell, sizeof(cell), " %11s (%5.2fx)", "", std::exp(logSums[c] / programs.size()));
+            std::cout << cell;
+        }
+        std::cout << "\n";
+    }
+    if (generated > 0) {
+        std::cout << generatedAgree << " of " << generated << " generated programs agree\n";
+    }
+    std::cout << (agree ? "All exit codes match.\n" : "Exit codes differ, see above.\n");
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,522 @@
+/**
+ * @file aarch64.cpp
+ * @brief Implementation of the AArch64 backend.
+ */
+
+#include "aarch64.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace aarch64 {
+
+namespace {
+
+/** Registers used by legalize(): one per read operand, and one for the result. */
+constexpr int ScratchRead[] = {9, 10, 11};
+constexpr int ScratchWrite = 12;
+
+Operand convertValue(tacky::Value val) {
+    switch (val.kind) {
+        case tacky::Value::Kind::Imm: return Operand::imm(val.immValue());
+        case tacky::Value::Kind::Reg: return Operand::pseudo(val.regIndex());
+        default: throw std::runtime_error("Unsupported tacky::Value kind");
+    }
+}
+
+Cond convertCondition(tacky::BinaryOp op) {
+    switch (op) {
+        case tacky::BinaryOp::EQUAL:       return Cond::EQ;
+        case tacky::BinaryOp::NOTEQUAL:    return Cond::NE;
+        case tacky::BinaryOp::LESSTHAN:    return Cond::LT;
+        case tacky::BinaryOp::LESSEQ:      return Cond::LE;
+        case tacky::BinaryOp::GREATERTHAN: return Cond::GT;
+        case tacky::BinaryOp::GREATEREQ:   return Cond::GE;
+        default: throw std::runtime_error("Unknown RelationOp in BinaryOp");
+    }
+}
+
+const char* condToASM(Cond cond) {
+    switch (cond) {
+        case Cond::EQ: return "eq";
+        case Cond::NE: return "ne";
+        case Cond::LT: return "lt";
+        case Cond::LE: return "le";
+        case Cond::GT: return "gt";
+        case Cond::GE: return "ge";
+    }
+    return "";
+}
+
+Instr make(Opcode op, Operand a = {}, Operand b = {}, Operand c = {}, Operand d = {}) {
+    Instr instr{};
+    instr.op = op;
+    instr.a = a;
+    instr.b = b;
+    instr.c = c;
+    instr.d = d;
+    return instr;
+}
+
+Instr makeJump(Opcode op, Symbol target, Operand a = {}) {
+    Instr instr = make(op, a);
+    instr.label = target;
+    return instr;
+}
+
+bool isArithImm(const Operand& op) {
+    return op.isImm() && op.value >= 0 && op.value <= 4095;
+}
+
+/**
+ * @brief Builds the legalized code one instruction at a time.
+ */
+class Legalizer {
+    std::vector<Instr>& out;
+    size_t nextScratch = 0;
+
+public:
+    explicit Legalizer(std::vector<Instr>& out) : out(out) {}
+
+    /** Returns a register holding the value of `op`, loading it if needed. */
+    Operand read(const Operand& op) {
+        if (op.isReg()) return op;
+        Operand scratch = Operand::reg(ScratchRead[nextScratch++]);
+        if (op.isImm()) {
+            out.push_back(make(Opcode::Mov, scratch, op));
+        } else if (op.isStack()) {
+            out.push_back(make(Opcode::Ldr, scratch, op));
+        } else {
+            throw std::runtime_error("Pseudo operand left after replacePseudosWithStack");
+        }
+        return scratch;
+    }
+
+    /** Like read(), but keeps immediates that fit the add/sub/cmp immediate form. */
+    Operand readArith(const Operand& op) {
+        return isArithImm(op) ? op : read(op);
+    }
+
+    /** Emits `instr`, with its result stored to `dst` if that is a stack slot. */
+    void write(Instr instr, const Operand& dst) {
+        nextScratch = 0;
+        if (!dst.isStack()) {
+            out.push_back(instr);
+            return;
+        }
+        instr.a = Operand::reg(ScratchWrite);
+        out.push_back(instr);
+        out.push_back(make(Opcode::Str, instr.a, dst));
+    }
+
+    void emit(const Instr& instr) {
+        nextScratch = 0;
+        out.push_back(instr);
+    }
+};
+
+// --- Emission ---
+
+void emitRegister(std::ostream& os, const Operand& op) {
+    if (!op.isReg()) throw std::runtime_error("Operand was not legalized");
+    os << 'w' << op.value;
+}
+
+void emitOperand(std::ostream& os, const Operand& op) {
+    if (op.isImm()) {
+        os << '#' << op.value;
+    } else {
+        emitRegister(os, op);
+    }
+}
+
+/** Moves any 32-bit (or 64-bit with `x`) constant into register `reg`. */
+void emitMoveImm(std::ostream& os, const std::string& reg, int64_t value, bool wide) {
+    uint64_t bits = wide ? static_cast<uint64_t>(value) : static_cast<uint32_t>(value);
+    if (value >= -65536 && value <= 65535) {
+        os << "mov " << reg << ", #" << value;
+        return;
+    }
+    os << "movz " << reg << ", #" << (bits & 0xffff);
+    for (int shift = 16; shift < (wide ? 64 : 32); shift += 16) {
+        uint64_t part = (bits >> shift) & 0xffff;
+        if (part != 0) os << "\n  movk " << reg << ", #" << part << ", lsl #" << shift;
+    }
+}
+
+void emitMemory(std::ostream& os, const char* mnemonic, const Operand& reg, const Operand& slot) {
+    if (!slot.isStack()) throw std::runtime_error("Expected a stack slot");
+    if (slot.value > 16380) {
+        emitMoveImm(os, "x16", slot.value, true);
+        os << "\n  " << mnemonic << ' ';
+        emitRegister(os, reg);
+        os << ", [sp, x16]";
+        return;
+    }
+    os << mnemonic << ' ';
+    emitRegister(os, reg);
+    os << ", [sp, #" << slot.value << ']';
+}
+
+void emitLabel(std::ostream& os, Symbol name, bool machO) {
+    os << (machO ? "L" : ".L");
+    symbols().writeName(os, name);
+}
+
+void emitEpilogue(std::ostream& os) {
+    os << "  mov sp, x29\n  ldp x29, x30, [sp], #16\n  ret\n";
+}
+
+void emitInstr(std::ostream& os, const Instr& instr, bool machO) {
+    auto three = [&](const char* mnemonic) {
+        os << "  " << mnemonic << ' ';
+        emitRegister(os, instr.a);
+        os << ", ";
+        emitRegister(os, instr.b);
+        os << ", ";
+        emitOperand(os, instr.c);
+        os << '\n';
+    };
+    auto two = [&](const char* mnemonic) {
+        os << "  " << mnemonic << ' ';
+        emitRegister(os, instr.a);
+        os << ", ";
+        emitOperand(os, instr.b);
+        os << '\n';
+    };
+
+    switch (instr.op) {
+        case Opcode::Mov:
+            if (instr.b.isImm()) {
+                os << "  ";
+                emitMoveImm(os, "w" + std::to_string(instr.a.value), instr.b.value, false);
+                os << '\n';
+            } else {
+                two("mov");
+            }
+            break;
+        case Opcode::Ldr:
+        case Opcode::Str:
+            os << "  ";
+            emitMemory(os, instr.op == Opcode::Ldr ? "ldr" : "str", instr.a, instr.b);
+            os << '\n';
+            break;
+        case Opcode::Add:  three("add"); break;
+        case Opcode::Sub:  three("sub"); break;
+        case Opcode::Mul:  three("mul"); break;
+        case Opcode::Sdiv: three("sdiv"); break;
+        case Opcode::Msub:
+            os << "  msub ";
+            emitRegister(os, instr.a);
+            os << ", ";
+            emitRegister(os, instr.b);
+            os << ", ";
+            emitRegister(os, instr.c);
+            os << ", ";
+            emitRegister(os, instr.d);
+            os << '\n';
+            break;
+        case Opcode::Neg: two("neg"); break;
+        case Opcode::Mvn: two("mvn"); break;
+        case Opcode::Cmp:
+            os << "  cmp ";
+            emitRegister(os, instr.a);
+            os << ", ";
+            emitOperand(os, instr.b);
+            os << '\n';
+            break;
+        case Opcode::Cset:
+            os << "  cset ";
+            emitRegister(os, instr.a);
+            os << ", " << condToASM(instr.cond) << '\n';
+            break;
+        case Opcode::Csel:
+            os << "  csel ";
+            emitRegister(os, instr.a);
+            os << ", ";
+            emitRegister(os, instr.b);
+            os << ", ";
+            emitRegister(os, instr.c);
+            os << ", " << condToASM(instr.cond) << '\n';
+            break;
+        case Opcode::B:
+        case Opcode::BCond:
+            os << "  b";
+            if (instr.op == Opcode::BCond) os << '.' << condToASM(instr.cond);
+            os << ' ';
+            emitLabel(os, instr.label, machO);
+            os << '\n';
+            break;
+        case Opcode::Cbz:
+        case Opcode::Cbnz:
+            os << (instr.op == Opcode::Cbz ? "  cbz " : "  cbnz ");
+            emitRegister(os, instr.a);
+            os << ", ";
+            emitLabel(os, instr.label, machO);
+            os << '\n';
+            break;
+        case Opcode::Label:
+            os << '\n';
+            emitLabel(os, instr.label, machO);
+            os << ":\n\n";
+            break;
+        case Opcode::AllocateStack:
+            if (instr.a.value <= 4095) {
+                os << "  sub sp, sp, #" << instr.a.value << '\n';
+            } else {
+                os << "  ";
+                emitMoveImm(os, "x16", instr.a.value, true);
+                os << "\n  sub sp, sp, x16\n";
+            }
+            break;
+        case Opcode::Ret:
+            emitEpilogue(os);
+            break;
+    }
+}
+
+} // namespace
+
+// --- convertTackyToAArch64 ---
+
+Program convertTackyToAArch64(const tacky::FlatProgram& tackyProgram) {
+    const tacky::FlatFunction& fn = tackyProgram.function;
+    Program program;
+    program.function.name = fn.name;
+    program.function.pseudoCount = static_cast<uint32_t>(fn.registers.size());
+    std::vector<Instr>& code = program.function.code;
+    const Operand w0 = Operand::reg(0);
+
+    for (const tacky::Instr& instr : fn.code) {
+        switch (instr.op) {
+            case tacky::Opcode::Return:
+                code.push_back(make(Opcode::Mov, w0, convertValue(instr.src1)));
+                code.push_back(make(Opcode::Ret));
+                break;
+
+            case tacky::Opcode::Jump:
+                code.push_back(makeJump(Opcode::B, instr.label));
+                break;
+
+            case tacky::Opcode::JumpIfZero:
+            case tacky::Opcode::JumpIfNotZero:
+                code.push_back(makeJump(instr.op == tacky::Opcode::JumpIfZero ? Opcode::Cbz : Opcode::Cbnz,
+                                        instr.label, convertValue(instr.src1)));
+                break;
+
+            case tacky::Opcode::JumpIfCompare: {
+                code.push_back(make(Opcode::Cmp, convertValue(instr.src1), convertValue(instr.src2)));
+                Instr branch = makeJump(Opcode::BCond, instr.label);
+                branch.cond = convertCondition(instr.binaryOp());
+                code.push_back(branch);
+                break;
+            }
+
+            case tacky::Opcode::Copy:
+                code.push_back(make(Opcode::Mov, convertValue(instr.dst), convertValue(instr.src1)));
+                break;
+
+            case tacky::Opcode::CopyIfNotZero: {
+                // dst = cond != 0 ? src : dst
+                Operand dst = convertValue(instr.dst);
+                code.push_back(make(Opcode::Cmp, convertValue(instr.src1), Operand::imm(0)));
+                Instr select = make(Opcode::Csel, dst, convertValue(instr.src2), dst);
+                select.cond = Cond::NE;
+                code.push_back(select);
+                break;
+            }
+
+            case tacky::Opcode::Label:
+                code.push_back(makeJump(Opcode::Label, instr.label));
+                break;
+
+            case tacky::Opcode::Unary: {
+                Operand src = convertValue(instr.src1);
+                Operand dst = convertValue(instr.dst);
+                switch (instr.unaryOp()) {
+                    case tacky::UnaryOp::Negate:
+                        code.push_back(make(Opcode::Neg, dst, src));
+                        break;
+                    case tacky::UnaryOp::Complement:
+                        code.push_back(make(Opcode::Mvn, dst, src));
+                        break;
+                    case tacky::UnaryOp::Not: {
+                        code.push_back(make(Opcode::Cmp, src, Operand::imm(0)));
+                        Instr set = make(Opcode::Cset, dst);
+                        set.cond = Cond::EQ;
+                        code.push_back(set);
+                        break;
+                    }
+                }
+                break;
+            }
+
+            case tacky::Opcode::Binary: {
+                Operand src1 = convertValue(instr.src1);
+                Operand src2 = convertValue(instr.src2);
+                Operand dst = convertValue(instr.dst);
+                switch (instr.binaryOp()) {
+                    case tacky::BinaryOp::ADD:
+                        code.push_back(make(Opcode::Add, dst, src1, src2));
+                        break;
+                    case tacky::BinaryOp::SUBTRACT:
+                        code.push_back(make(Opcode::Sub, dst, src1, src2));
+                        break;
+                    case tacky::BinaryOp::MULTIPLY:
+                        code.push_back(make(Opcode::Mul, dst, src1, src2));
+                        break;
+                    case tacky::BinaryOp::DIVIDE:
+                        code.push_back(make(Opcode::Sdiv, dst, src1, src2));
+                        break;
+                    case tacky::BinaryOp::REMAINDER: {
+                        // dst = src1 - (src1 / src2) * src2
+                        Operand quotient = Operand::pseudo(program.function.pseudoCount++);
+                        code.push_back(make(Opcode::Sdiv, quotient, src1, src2));
+                        code.push_back(make(Opcode::Msub, dst, quotient, src2, src1));
+                        break;
+                    }
+                    default: {
+                        code.push_back(make(Opcode::Cmp, src1, src2));
+                        Instr set = make(Opcode::Cset, dst);
+                        set.cond = convertCondition(instr.binaryOp());
+                        code.push_back(set);
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    return program;
+}
+
+// --- replacePseudosWithStack ---
+
+int replacePseudosWithStack(Program& program) {
+    Function& fn = program.function;
+    for (Instr& instr : fn.code) {
+        instr.forEachOperand([](Operand& op, bool) {
+            if (op.kind == Operand::Kind::Pseudo) op = Operand::stack(4 * op.value);
+        });
+    }
+    return static_cast<int>((4 * fn.pseudoCount + 15) / 16 * 16);
+}
+
+// --- legalize ---
+
+void legalize(Program& program, int stackSize) {
+    std::vector<Instr>& code = program.function.code;
+    std::vector<Instr> out;
+    out.reserve(code.size() * 2 + 1);
+    Legalizer l(out);
+
+    if (stackSize > 0) l.emit(make(Opcode::AllocateStack, Operand::imm(stackSize)));
+
+    for (Instr instr : code) {
+        switch (instr.op) {
+            case Opcode::Mov:
+                if (instr.a.isStack()) {
+                    Operand src = l.read(instr.b);
+                    l.emit(make(Opcode::Str, src, instr.a));
+                } else if (instr.b.isStack()) {
+                    l.emit(make(Opcode::Ldr, instr.a, instr.b));
+                } else {
+                    l.emit(instr);
+                }
+                break;
+
+            case Opcode::Add:
+            case Opcode::Sub: {
+                // An immediate on the left of an add goes to the right
+                if (instr.op == Opcode::Add && instr.b.isImm() && !instr.c.isImm()) std::swap(instr.b, instr.c);
+                // add x, -k is sub x, k
+                if (instr.c.isImm() && instr.c.value < 0 && instr.c.value >= -4095) {
+                    instr.op = instr.op == Opcode::Add ? Opcode::Sub : Opcode::Add;
+                    instr.c.value = -instr.c.value;
+                }
+                Operand dst = instr.a;
+                instr.b = l.read(instr.b);
+                instr.c = l.readArith(instr.c);
+                l.write(instr, dst);
+                break;
+            }
+
+            case Opcode::Mul:
+            case Opcode::Sdiv:
+            case Opcode::Msub:
+            case Opcode::Neg:
+            case Opcode::Mvn:
+            case Opcode::Csel: {
+                Operand dst = instr.a;
+                instr.b = l.read(instr.b);
+                if (instr.c.kind != Operand::Kind::None) instr.c = l.read(instr.c);
+                if (instr.d.kind != Operand::Kind::None) instr.d = l.read(instr.d);
+                l.write(instr, dst);
+                break;
+            }
+
+            case Opcode::Cmp:
+                instr.a = l.read(instr.a);
+                instr.b = l.readArith(instr.b);
+                l.emit(instr);
+                break;
+
+            case Opcode::Cset: {
+                Operand dst = instr.a;
+                l.write(instr, dst);
+                break;
+            }
+
+            case Opcode::Cbz:
+            case Opcode::Cbnz:
+                instr.a = l.read(instr.a);
+                l.emit(instr);
+                break;
+
+            default:
+                l.emit(instr);
+                break;
+        }
+    }
+
+    code = std::move(out);
+}
+
+// --- Program ---
+
+void Program::emit(std::ostream& os, bool machO) const {
+    const std::string symbol = (machO ? "_" : "") + function.name;
+    os << ".globl " << symbol << "\n.p2align 2\n" << symbol << ":\n";
+    os << "  stp x29, x30, [sp, #-16]!\n";
+    os << "  mov x29, sp\n";
+
+    for (const Instr& instr : function.code) emitInstr(os, instr, machO);
+
+    // Without a final return, the function returns 0
+    if (function.code.empty() || function.code.back().op != Opcode::Ret) {
+        os << "  mov w0, #0\n";
+        emitEpilogue(os);
+    }
+    if (!machO) os << ".section .note.GNU-stack,\"\",@progbits\n";
+}
+
+// --- writeAssemblyToFile ---
+
+void writeAssemblyToFile(const Program& program, bool machO, const std::string& filename) {
+    std::vector<char> buffer(1 << 16);
+    std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    ofs.open(filename);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + filename);
+    }
+
+    program.emit(ofs, machO);
+    ofs.close();
+    if (!ofs) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+}
+
+} // namespace aarch64
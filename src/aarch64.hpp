@@ -0,0 +1,200 @@
+/**
+ * @file aarch64.hpp
+ * @brief AArch64 backend: instruction selection from TACKY, stack slots, legalization
+ * and assembly output.
+ *
+ * The pipeline mirrors the x86-64 one in asdl.hpp:
+ * convertTackyToAArch64 → replacePseudosWithStack → legalize → emit.
+ *
+ * Instructions are plain structs in a vector, like the flat TACKY IR. Selection works on
+ * pseudos (the virtual registers of TACKY) and immediates; legalization then turns the
+ * code into valid AArch64, where only loads and stores access memory and most
+ * immediates must first be moved into a register.
+ */
+
+#ifndef AARCH64_HPP
+#define AARCH64_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "symbol.hpp"
+#include "tacky.hpp"
+
+namespace aarch64 {
+
+/**
+ * @brief Operand of an AArch64 instruction.
+ *
+ * Registers are numbered as in the architecture and always used as their 32-bit `w`
+ * view, except for the frame set up by the prologue.
+ */
+struct Operand {
+    enum class Kind : uint8_t {
+        None,    ///< Unused operand slot
+        Imm,     ///< Integer constant
+        Reg,     ///< Hardware register w0..w30
+        Pseudo,  ///< TACKY virtual register, or a temporary made by selection
+        Stack    ///< 4-byte slot at [sp, #value]
+    };
+
+    Kind kind = Kind::None;
+    int32_t value = 0;
+
+    static Operand imm(int32_t v) { return {Kind::Imm, v}; }
+    static Operand reg(int r) { return {Kind::Reg, r}; }
+    static Operand pseudo(uint32_t p) { return {Kind::Pseudo, static_cast<int32_t>(p)}; }
+    static Operand stack(int32_t offset) { return {Kind::Stack, offset}; }
+
+    bool isImm() const { return kind == Kind::Imm; }
+    bool isReg() const { return kind == Kind::Reg; }
+    bool isStack() const { return kind == Kind::Stack; }
+};
+
+/**
+ * @brief Condition codes used by cset, csel and b.cond.
+ */
+enum class Cond : uint8_t { EQ, NE, LT, LE, GT, GE };
+
+/**
+ * @brief Opcode of an AArch64 instruction.
+ *
+ * Operands are named after their position in the assembly syntax.
+ */
+enum class Opcode : uint8_t {
+    Mov,            ///< mov a, b
+    Ldr,            ///< ldr a, b (b is a stack slot)
+    Str,            ///< str a, b (b is a stack slot)
+    Add,            ///< add a, b, c
+    Sub,            ///< sub a, b, c
+    Mul,            ///< mul a, b, c
+    Sdiv,           ///< sdiv a, b, c
+    Msub,           ///< msub a, b, c, d: a = d - b * c
+    Neg,            ///< neg a, b
+    Mvn,            ///< mvn a, b
+    Cmp,            ///< cmp a, b
+    Cset,           ///< cset a, cond
+    Csel,           ///< csel a, b, c, cond: a = cond ? b : c
+    B,              ///< b label
+    BCond,          ///< b.cond label
+    Cbz,            ///< cbz a, label
+    Cbnz,           ///< cbnz a, label
+    Label,          ///< label:
+    AllocateStack,  ///< sub sp, sp, #a
+    Ret             ///< epilogue and ret
+};
+
+/**
+ * @brief An AArch64 instruction; which fields are meaningful depends on the opcode.
+ */
+struct Instr {
+    Opcode op;
+    Cond cond = Cond::EQ;
+    Operand a, b, c, d;
+    Symbol label = NoSymbol;
+
+    /** @brief Calls f(operand, isWritten) on each operand slot in use. */
+    template <typename F>
+    void forEachOperand(F&& f);
+};
+
+/**
+ * @brief An AArch64 function.
+ */
+struct Function {
+    std::string name;           ///< Name of the function, without the symbol prefix
+    std::vector<Instr> code;    ///< Instructions in order
+    uint32_t pseudoCount = 0;   ///< Pseudos are numbered 0..pseudoCount-1
+};
+
+/**
+ * @brief An AArch64 program ready to be printed.
+ */
+struct Program {
+    Function function;
+
+    /**
+     * @brief Writes the program as assembly.
+     * @param os Output stream.
+     * @param machO Use Mach-O conventions (`_` symbol prefix, `L` local labels)
+     * instead of ELF ones.
+     */
+    void emit(std::ostream& os, bool machO) const;
+};
+
+/**
+ * @brief Selects AArch64 instructions for a TACKY program.
+ *
+ * Comparisons become cmp + cset, conditional jumps cbz/cbnz or cmp + b.cond, conditional
+ * copies cmp + csel, and remainders sdiv + msub.
+ * Operands are still pseudos and immediates anywhere.
+ */
+Program convertTackyToAArch64(const tacky::FlatProgram& program);
+
+/**
+ * @brief Gives each pseudo its own 4-byte stack slot.
+ * @return Frame size in bytes, rounded up to the 16 bytes sp must stay aligned to.
+ */
+int replacePseudosWithStack(Program& program);
+
+/**
+ * @brief Rewrites the code so that every instruction can be encoded.
+ *
+ * Stack operands are loaded into scratch registers before the instruction and stored
+ * back after it; immediates are moved into a register unless the instruction has an
+ * immediate form that fits them (e.g. add/sub/cmp with 0..4095). Also inserts the
+ * AllocateStack for the frame.
+ *
+ * @param program Output of replacePseudosWithStack.
+ * @param stackSize Frame size returned by replacePseudosWithStack.
+ */
+void legalize(Program& program, int stackSize);
+
+/**
+ * @brief Writes the assembly of a program to a file.
+ * @throws std::runtime_error If the file cannot be written.
+ */
+void writeAssemblyToFile(const Program& program, bool machO, const std::string& filename);
+
+// --- Instr ---
+
+template <typename F>
+void Instr::forEachOperand(F&& f) {
+    switch (op) {
+        case Opcode::Mov:
+        case Opcode::Neg:
+        case Opcode::Mvn:
+            f(a, true); f(b, false); break;
+        case Opcode::Ldr:
+            f(a, true); break;
+        case Opcode::Str:
+            f(a, false); break;
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Sdiv:
+        case Opcode::Csel:
+            f(a, true); f(b, false); f(c, false); break;
+        case Opcode::Msub:
+            f(a, true); f(b, false); f(c, false); f(d, false); break;
+        case Opcode::Cmp:
+            f(a, false); f(b, false); break;
+        case Opcode::Cset:
+            f(a, true); break;
+        case Opcode::Cbz:
+        case Opcode::Cbnz:
+            f(a, false); break;
+        case Opcode::B:
+        case Opcode::BCond:
+        case Opcode::Label:
+        case Opcode::AllocateStack:
+        case Opcode::Ret:
+            break;
+    }
+}
+
+} // namespace aarch64
+
+#endif // AARCH64_HPP
@@ -0,0 +1,143 @@
+/**
+ * @file arena.hpp
+ * @brief Bump-pointer arena allocator.
+ *
+ * Objects are carved out of large blocks by advancing a pointer, so allocation is a few
+ * instructions and nodes allocated together sit next to each other in memory. Objects
+ * are never destroyed individually: all memory is released at once when the arena is
+ * destroyed (or reset), which is why only trivially destructible types may be placed in it.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A fixed-size array living in an Arena (pointer + length, no ownership).
+ */
+template <typename T>
+struct ArenaArray {
+    T* data = nullptr;
+    size_t size = 0;
+
+    T* begin() const { return data; }
+    T* end() const { return data + size; }
+    bool empty() const { return size == 0; }
+    T& operator[](size_t i) const { return data[i]; }
+};
+
+/**
+ * @class Arena
+ * @brief Owns a list of memory blocks and hands out memory from them in order.
+ */
+class Arena {
+    static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;  /**< Every block allocated so far */
+    char* cursor = nullptr;                       /**< Next free byte in the current block */
+    char* limit = nullptr;                        /**< End of the current block */
+    size_t blockSize;                             /**< Size of regular blocks */
+    size_t used = 0;                              /**< Bytes handed out since the last reset */
+    size_t objects = 0;                           /**< Objects made since the last reset */
+    size_t firstCapacity = 0;                     /**< Size of blocks[0], kept by reset() */
+
+    /**
+     * @brief Starts a new block large enough for `size` bytes at alignment `align`.
+     */
+    void grow(size_t size, size_t align) {
+        size_t capacity = size + align > blockSize ? size + align : blockSize;
+        if (blocks.empty()) firstCapacity = capacity;
+        blocks.push_back(std::unique_ptr<char[]>(new char[capacity]));
+        cursor = blocks.back().get();
+        limit = cursor + capacity;
+    }
+
+public:
+    explicit Arena(size_t blockSize = DefaultBlockSize) : blockSize(blockSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Returns `size` bytes of uninitialized memory aligned to `align`.
+     */
+    void* allocate(size_t size, size_t align) {
+        size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        if (!cursor || padding + size > static_cast<size_t>(limit - cursor)) {
+            grow(size, align);
+            padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        }
+        char* result = cursor + padding;
+        cursor = result + size;
+        used += padding + size;
+        return result;
+    }
+
+    /**
+     * @brief Constructs a T in the arena.
+     * @return Pointer to the new object, valid until the arena is released.
+     */
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        ++objects;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Copies the elements of a vector into the arena.
+     */
+    template <typename T>
+    ArenaArray<T> copyArray(const std::vector<T>& items) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena arrays hold plain data");
+        ArenaArray<T> array;
+        array.size = items.size();
+        if (!items.empty()) {
+            array.data = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+            std::memcpy(static_cast<void*>(array.data), items.data(), sizeof(T) * items.size());
+        }
+        return array;
+    }
+
+    /**
+     * @brief Copies a string into the arena and returns a view of the copy.
+     */
+    std::string_view copyString(std::string_view text) {
+        if (text.empty()) return std::string_view();
+        char* copy = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(copy, text.data(), text.size());
+        return std::string_view(copy, text.size());
+    }
+
+    /**
+     * @brief Releases everything allocated so far. The first block is kept and reused.
+     */
+    void reset() {
+        if (blocks.size() > 1) blocks.resize(1);
+        cursor = blocks.empty() ? nullptr : blocks[0].get();
+        limit = cursor ? cursor + firstCapacity : nullptr;
+        used = 0;
+        objects = 0;
+    }
+
+    /**
+     * @brief Returns the number of bytes handed out so far.
+     */
+    size_t bytesUsed() const { return used; }
+
+    /**
+     * @brief Returns the number of objects made with make() so far (for the AST, its nodes).
+     */
+    size_t objectCount() const { return objects; }
+};
+
+#endif // ARENA_HPP
@@ -1,11 +1,22 @@
 #include "asdl.hpp"
+#include "dataflow.hpp"
+#include "objectfile.hpp"
+#include <cstdint>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <iostream>
-#include <cctype>  // for std::tolower
+
+// --- ASDLNode ---
+
+std::string ASDLNode::toASM() const {
+    std::ostringstream os;
+    emit(os);
+    return os.str();
+}
 
 // --- Idiv ---
-Idiv::Idiv(std::unique_ptr<Operand> d) : dst(std::move(d)) {}
+Idiv::Idiv(std::unique_ptr<Operand> d) : Instruction(Kind), dst(std::move(d)) {}
 
 // --- Imm ---
 
@@ -13,8 +24,8 @@ std::string Imm::toString() const {
     return "Imm(" + std::to_string(value) + ")";
 }
 
-std::string Imm::toASM() const {
-    return "$" + std::to_string(value);
+void Imm::emit(std::ostream& os) const {
+    os << '$' << value;
 }
 
 // --- Register ---
@@ -23,24 +34,18 @@ std::string Register::toString() const {
     return "Register(" + regToString(reg) + ")";
 }
 
-std::string Register::toASM() const {
-    switch (reg) {
-        case Reg::AX: return "%eax";
-        case Reg::DX: return "%edx";
-        case Reg::R10: return "%r10d";
-        case Reg::R11: return "%r11d";
-        default: return "%UNKNOWN_REG";
-    }
+void Register::emit(std::ostream& os) const {
+    os << regToASM(reg);
 }
 
 // --- Pseudo ---
 
 std::string Pseudo::toString() const {
-    return "Pseudo(" + identifier + ")";
+    return "Pseudo(" + symbols().name(identifier) + ")";
 }
 
-std::string Pseudo::toASM() const {
-    return identifier;
+void Pseudo::emit(std::ostream& os) const {
+    symbols().writeName(os, identifier);
 }
 
 // --- Stack ---
@@ -49,42 +54,55 @@ std::string Stack::toString() const {
     return "Stack(" + std::to_string(value) + ")";
 }
 
-std::string Stack::toASM() const {
-    return std::to_string(value) + "(%rbp)";
+void Stack::emit(std::ostream& os) const {
+    os << value << "(%rbp)";
+}
+
+// --- sameOperand ---
+
+bool sameOperand(const Operand& a, const Operand& b) {
+    if (a.kind() != b.kind()) return false;
+    switch (a.kind()) {
+        case OperandKind::Imm:      return static_cast<const Imm&>(a).getValue() == static_cast<const Imm&>(b).getValue();
+        case OperandKind::Register: return static_cast<const Register&>(a).getReg() == static_cast<const Register&>(b).getReg();
+        case OperandKind::Pseudo:   return static_cast<const Pseudo&>(a).getIdentifier() == static_cast<const Pseudo&>(b).getIdentifier();
+        case OperandKind::Stack:    return static_cast<const Stack&>(a).getValue() == static_cast<const Stack&>(b).getValue();
+    }
+    return false;
 }
 
 // --- Mov ---
 
 Mov::Mov(std::unique_ptr<Operand> s, std::unique_ptr<Operand> d)
-    : src(std::move(s)), dst(std::move(d)) {}
+    : Instruction(Kind), src(std::move(s)), dst(std::move(d)) {}
 
 std::string Mov::toString() const {
     return "Mov(src=" + src->toString() + ", dst=" + dst->toString() + ")";
 }
 
-std::string Mov::toASM() const {
-    return "movl " + src->toASM() + ", " + dst->toASM();
+void Mov::emit(std::ostream& os) const {
+    os << "movl ";
+    src->emit(os);
+    os << ", ";
+    dst->emit(os);
 }
 
 // --- Unary ---
 
 Unary::Unary(UnaryOperator u, std::unique_ptr<Operand> d)
-    : unary_operator(u), dst(std::move(d)) {}
+    : Instruction(Kind), unary_operator(u), dst(std::move(d)) {}
 
 std::string Unary::toString() const {
     std::string opStr = (unary_operator == UnaryOperator::NEG) ? "NEG" : "NOT";
     return "Unary(" + opStr + ", dst=" + dst->toString() + ")";
 }
 
-std::string Unary::toASM() const {
+void Unary::emit(std::ostream& os) const {
     switch (unary_operator) {
-        case UnaryOperator::NEG:
-            return "negl " + dst->toASM();
-        case UnaryOperator::NOT:
-            return "notl " + dst->toASM();
-        default:
-            return "UNKNOWN_UNARY_OP";
+        case UnaryOperator::NEG: os << "negl "; break;
+        case UnaryOperator::NOT: os << "notl "; break;
     }
+    dst->emit(os);
 }
 
 // --- Cdq ---
@@ -92,33 +110,35 @@ std::string Cdq::toString() const {
     return "Cdq";
 }
 
-std::string Cdq::toASM() const {
-    return "cdq";
+void Cdq::emit(std::ostream& os) const {
+    os << "cdq";
 }
 
 
 // --- Jmp ---
 std::string Jmp::toString() const {
-    return "Jmp(id= " + name + ")";
+    return "Jmp(id= " + symbols().name(name) + ")";
 }
 
-std::string Jmp::toASM() const {
-    return "jmp L" + name;
+void Jmp::emit(std::ostream& os) const {
+    os << "jmp L";
+    symbols().writeName(os, name);
 }
 
-Jmp::Jmp(std::string target) : name(std::move(target)) {
+Jmp::Jmp(Symbol target) : Instruction(Kind), name(target) {
 }
 
 // --- JmpCC ---
 std::string JmpCC::toString() const {
-    return "JmpCC(cond=" + condNodeToString(cond_node) + ", id=" + name + ")";
+    return "JmpCC(cond=" + condNodeToString(cond_node) + ", id=" + symbols().name(name) + ")";
 }
 
-std::string JmpCC::toASM() const {
-    return "j" + condNodeToASM(cond_node) + " L" + name;
+void JmpCC::emit(std::ostream& os) const {
+    os << 'j' << condNodeToASM(cond_node) << " L";
+    symbols().writeName(os, name);
 }
 
-JmpCC::JmpCC(CondNode cond, std::string target) : cond_node(cond), name(std::move(target)) {
+JmpCC::JmpCC(CondNode cond, Symbol target) : Instruction(Kind), cond_node(cond), name(target) {
 }
 
 // --- Cmp ---
@@ -126,8 +146,11 @@ std::string Cmp::toString() const {
     return "Cmp(e1=" + rhs->toString() + ", e2=" + lhs->toString() + ")";
 }
 
-std::string Cmp::toASM() const {
-    return "cmpl " + rhs->toASM() + ", " + lhs->toASM();
+void Cmp::emit(std::ostream& os) const {
+    os << "cmpl ";
+    rhs->emit(os);
+    os << ", ";
+    lhs->emit(os);
 }
 
 // --- Idiv ---
@@ -135,8 +158,9 @@ std::string Idiv::toString() const {
     return "Idiv(dst= " + dst->toString() + ")";
 }
 
-std::string Idiv::toASM() const {
-    return "idivl " + dst->toASM();
+void Idiv::emit(std::ostream& os) const {
+    os << "idivl ";
+    dst->emit(os);
 }
 
 // --- SetCC ---
@@ -144,62 +168,128 @@ std::string SetCC::toString() const {
     return "SetCC(cond=" + condNodeToString(cond_node) + ", op=" + op->toString() + ")";
 }
 
-std::string SetCC::toASM() const {
-    return "set" + condNodeToASM(cond_node) + " " + op->toASM();
+void SetCC::emit(std::ostream& os) const {
+    os << "set" << condNodeToASM(cond_node) << ' ';
+    if (auto reg = as<Register>(op.get())) {
+        os << regToByteASM(reg->getReg());
+    } else {
+        op->emit(os);
+    }
 }
 
 SetCC::SetCC(CondNode cond, std::unique_ptr<Operand> dst)
-    : cond_node(cond), op(std::move(dst)) {}
+    : Instruction(Kind), cond_node(cond), op(std::move(dst)) {}
+
+// --- Cmov ---
+std::string Cmov::toString() const {
+    return "Cmov(cond=" + condNodeToString(cond_node) + ", src=" + src->toString() + ", dst=" + dst->toString() + ")";
+}
+
+void Cmov::emit(std::ostream& os) const {
+    os << "cmov" << condNodeToASM(cond_node) << "l ";
+    src->emit(os);
+    os << ", ";
+    dst->emit(os);
+}
+
+Cmov::Cmov(CondNode cond, std::unique_ptr<Operand> s, std::unique_ptr<Operand> d)
+    : Instruction(Kind), cond_node(cond), src(std::move(s)), dst(std::move(d)) {}
 
 // --- Label ---
 std::string Label::toString() const {
-    return "Label(" + name + ")";
+    return "Label(" + symbols().name(name) + ")";
 }
 
-std::string Label::toASM() const {
-    return "L" + name + ":";
+void Label::emit(std::ostream& os) const {
+    os << 'L';
+    symbols().writeName(os, name);
+    os << ':';
 }
 
-Label::Label(std::string name) : Instruction(), name(std::move(name)) {
+Label::Label(Symbol name) : Instruction(Kind), name(name) {
 }
 
 // --- Binary ---
 std::string Binary::toString() const {
     std::string opStr;
-    if (isBinaryOperator() && (getBinaryOperator() == BinaryOperator::ADD)) {
-        opStr = "ADD";
-    } else if (isBinaryOperator() && (getBinaryOperator() == BinaryOperator::SUB)) {
-        opStr = "SUB";
-    } else {
-        opStr = "MULT";
+    switch (getBinaryOperator()) {
+        case BinaryOperator::ADD:  opStr = "ADD"; break;
+        case BinaryOperator::SUB:  opStr = "SUB"; break;
+        case BinaryOperator::MULT: opStr = "MULT"; break;
+        case BinaryOperator::XOR:  opStr = "XOR"; break;
+        case BinaryOperator::AND:  opStr = "AND"; break;
+        case BinaryOperator::SHL:  opStr = "SHL"; break;
+        case BinaryOperator::SAR:  opStr = "SAR"; break;
+        case BinaryOperator::SHR:  opStr = "SHR"; break;
     }
 
     return "Binary(" + opStr + ", " + src->toString() + ", " + dst->toString() + ")";
 }
 
-std::string Binary::toASM() const {
+void Binary::emit(std::ostream& os) const {
     switch (getBinaryOperator()) {
-        case BinaryOperator::ADD:
-            return "addl " + src->toASM() + ", " + dst->toASM();
-        case BinaryOperator::SUB:
-            return "subl " + src->toASM() + ", " + dst->toASM();
-        case BinaryOperator::MULT:
-            return "imull " + src->toASM() + ", " + dst->toASM();
-        default:
-            return "UNKNOWN_BINARY_OP";
+        case BinaryOperator::ADD:  os << "addl "; break;
+        case BinaryOperator::SUB:  os << "subl "; break;
+        case BinaryOperator::MULT: os << "imull "; break;
+        case BinaryOperator::XOR:  os << "xorl "; break;
+        case BinaryOperator::AND:  os << "andl "; break;
+        case BinaryOperator::SHL:  os << "shll "; break;
+        case BinaryOperator::SAR:  os << "sarl "; break;
+        case BinaryOperator::SHR:  os << "shrl "; break;
     }
+    src->emit(os);
+    os << ", ";
+    dst->emit(os);
+}
+
+// --- Imul ---
+Imul::Imul(std::unique_ptr<Operand> s) : Instruction(Kind), src(std::move(s)) {}
+
+std::string Imul::toString() const {
+    return "Imul(src= " + src->toString() + ")";
+}
+
+void Imul::emit(std::ostream& os) const {
+    os << "imull ";
+    src->emit(os);
+}
+
+// --- Lea ---
+Lea::Lea(std::unique_ptr<Operand> b, std::unique_ptr<Operand> i, int scale, std::unique_ptr<Operand> d)
+    : Instruction(Kind), base(std::move(b)), index(std::move(i)), scale(scale), dst(std::move(d)) {}
+
+std::string Lea::toString() const {
+    return "Lea(base=" + base->toString() + ", index=" + index->toString() + ", scale=" +
+           std::to_string(scale) + ", dst=" + dst->toString() + ")";
+}
+
+void Lea::emit(std::ostream& os) const {
+    // Addresses use the 64-bit names of the registers
+    auto address = [&](const Operand* op) {
+        if (auto reg = as<Register>(op)) {
+            os << regToQuadASM(reg->getReg());
+        } else {
+            op->emit(os);
+        }
+    };
+    os << "leal (";
+    address(base.get());
+    os << ", ";
+    address(index.get());
+    os << ", " << scale << "), ";
+    dst->emit(os);
 }
 
 // --- AllocateStack ---
 
-AllocateStack::AllocateStack(int n) : value(n) {}
+AllocateStack::AllocateStack(int n) : Instruction(Kind), value(n) {}
 
 std::string AllocateStack::toString() const {
     return "AllocateStack(" + std::to_string(value) + ")";
 }
 
-std::string AllocateStack::toASM() const {
-    return "subq $" + std::to_string(value) + ", %rsp";
+void AllocateStack::emit(std::ostream& os) const {
+    os << "subq $" << value << ", %rsp";
 }
 
 // --- Ret ---
@@ -208,11 +298,10 @@ std::string Ret::toString() const {
     return "Ret";
 }
 
-std::string Ret::toASM() const {
-    std::string codeRet = "movq %rbp, %rsp\n";
-    codeRet += std::string("  ") + "popq %rbp\n";
-    codeRet += std::string("  ") + "ret";
-    return codeRet;
+void Ret::emit(std::ostream& os) const {
+    os << "movq %rbp, %rsp\n";
+    os << "  popq %rbp\n";
+    os << "  ret";
 }
 
 // --- FunctionDefinition ---
@@ -237,26 +326,35 @@ std::string FunctionDefinition::toString() const {
     return result;
 }
 
-std::string FunctionDefinition::toASM() const {
-    std::string asmCode = ".globl _" + name + "\n_" + name + ":\n";
-    asmCode += "  pushq %rbp\n";
-    asmCode += "  movq %rsp, %rbp\n";
+void FunctionDefinition::emit(std::ostream& os) const {
+    emit(os, hostObjectFormat() == ObjectFormat::MachO);
+}
+
+void FunctionDefinition::emit(std::ostream& os, bool machO) const {
+    const char* prefix = machO ? "_" : "";
+    os << ".globl " << prefix << name << "\n" << prefix << name << ":\n";
+    os << "  pushq %rbp\n";
+    os << "  movq %rsp, %rbp\n";
 
     for (const auto& instr : instructions) {
-        if (dynamic_cast<Label*>(instr.get())) {
-            // Saut de ligne avant le label
-            asmCode += "\n";
-            // Label sans indentation
-            asmCode += instr->toASM() + "\n";
-            // Saut de ligne après le label
-            asmCode += "\n";
+        if (instr->kind() == InstructionKind::Label) {
+            // Saut de ligne avant et après le label, label sans indentation
+            os << '\n';
+            instr->emit(os);
+            os << "\n\n";
         } else {
             // Instruction classique avec indentation
-            asmCode += "  " + instr->toASM() + "\n";
+            os << "  ";
+            instr->emit(os);
+            os << '\n';
         }
     }
 
-    return asmCode;
+    // Without a final return, the function returns 0
+    if (instructions.empty() || instructions.back()->kind() != InstructionKind::Ret) {
+        os << "  movq %rbp, %rsp\n  popq %rbp\n  movl $0, %eax\n  ret\n";
+    }
+    if (!machO) os << ".section .note.GNU-stack,\"\",@progbits\n";
 }
 
 // --- ASDLProgram ---
@@ -268,231 +366,437 @@ std::string ASDLProgram::toString() const {
     return "ASDLProgram(" + functionDefinition->toString() + ")";
 }
 
-std::string ASDLProgram::toASM() const {
-    return functionDefinition->toASM();
+void ASDLProgram::emit(std::ostream& os) const {
+    functionDefinition->emit(os);
 }
 
-std::unique_ptr<Operand> convertValToOperand(const std::unique_ptr<tacky::Val>& val) {
-    if (auto c = dynamic_cast<const tacky::Constant*>(val.get())) {
-        return std::make_unique<Imm>(c->value);
-    } else if (auto v = dynamic_cast<const tacky::Var*>(val.get())) {
-        return std::make_unique<Pseudo>(v->name);
-    } else {
-        throw std::runtime_error("Unsupported tacky::Val type");
-    }
+void ASDLProgram::emit(std::ostream& os, bool machO) const {
+    functionDefinition->emit(os, machO);
 }
 
-// --- convertTackyToASDL
-ASDLProgram convertTackyToASDL(const tacky::Program& tackyProgram) {
-    std::vector<std::unique_ptr<Instruction>> asdlInstructions;
-
-    for (const auto& instr : tackyProgram.function->body) {
-        // Handle Return
-        if (auto ret = dynamic_cast<const tacky::Return*>(instr.get())) {
-            if (auto c = dynamic_cast<const tacky::Constant*>(ret->value.get())) {
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Imm>(c->value),
-                    std::make_unique<Register>(Reg::AX)
-                ));
-            } else if (auto v = dynamic_cast<const tacky::Var*>(ret->value.get())) {
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Pseudo>(v->name),
-                    std::make_unique<Register>(Reg::AX)
-                ));
-            }
-            asdlInstructions.push_back(std::make_unique<Ret>());
-        }
+std::unique_ptr<Operand> convertValToOperand(const tacky::FlatFunction& fn, tacky::Value val) {
+    switch (val.kind) {
+        case tacky::Value::Kind::Imm:
+            return std::make_unique<Imm>(val.immValue());
+        case tacky::Value::Kind::Reg:
+            return std::make_unique<Pseudo>(fn.registers[val.regIndex()]);
+        default:
+            throw std::runtime_error("Unsupported tacky::Value kind");
+    }
+}
 
-        //Handle Jmp
-        else if (auto jmp = dynamic_cast<const tacky::Jump*>(instr.get())) {
-            asdlInstructions.push_back(std::make_unique<Jmp>(jmp->target));
+// --- Strength reduction ---
+
+namespace {
+
+/**
+ * @brief Magic multiplier and shift of signed 32-bit division by a constant.
+ */
+struct DivisionMagic {
+    int multiplier;
+    int shift;
+};
+
+/**
+ * @brief Computes the magic number of division by `d` (Hacker's Delight, figure 10-1).
+ *
+ * `d` must not be 0, 1, -1 or a power of two in magnitude.
+ */
+DivisionMagic divisionMagic(int d) {
+    const uint32_t two31 = 0x80000000u;
+    const uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+    const uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+    const uint32_t anc = t - 1 - t % ad;  // |nc|, largest dividend with n % d == d - 1
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
         }
-
-        //Handle JmpIfZero
-        else if (auto jmpiz = dynamic_cast<const tacky::JumpIfZero*>(instr.get())) {
-            asdlInstructions.push_back(std::make_unique<Cmp>(
-                std::make_unique<Imm>(0),
-                convertValToOperand(jmpiz->condition)
-            ));
-
-            asdlInstructions.push_back(std::make_unique<JmpCC>(
-                CondNode::E,
-                jmpiz->target
-            ));
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
         }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
 
-        //Handle JmpIfNotZero
-        else if (auto jmpinz = dynamic_cast<const tacky::JumpIfNotZero*>(instr.get())) {
-            asdlInstructions.push_back(std::make_unique<Cmp>(
-                std::make_unique<Imm>(0),
-                convertValToOperand(jmpinz->condition)
-            ));
-
-            asdlInstructions.push_back(std::make_unique<JmpCC>(
-                CondNode::NE,
-                jmpinz->target
-            ));
-        }
+    const uint32_t m = q2 + 1;
+    return {static_cast<int>(d < 0 ? 0u - m : m), p - 32};
+}
 
-        //Handle Copy
-        else if (auto copy = dynamic_cast<const tacky::Copy*>(instr.get())) {
-            asdlInstructions.push_back(std::make_unique<Mov>(
-                convertValToOperand(copy->src),
-                convertValToOperand(copy->dst)
-            ));
-        }
+/**
+ * @brief Returns k if `v` is 2^k, else -1.
+ */
+int exactLog2(uint32_t v) {
+    if (v == 0 || (v & (v - 1)) != 0) return -1;
+    int k = 0;
+    while (v >>= 1) ++k;
+    return k;
+}
 
-        //Handle Label
-        else if (auto label = dynamic_cast<const tacky::Label*>(instr.get())) {
-            asdlInstructions.push_back(std::make_unique<Label>(
-                label->name
-            ));
-        }
+/**
+ * @brief Selects shifts, lea and multiply-high for arithmetic by a constant, which is
+ * several times cheaper than imul and idiv.
+ *
+ * Like the idiv sequence, the division sequences compute in AX and DX.
+ */
+class ConstantArithmetic {
+    const tacky::FlatFunction& fn;
+    std::vector<std::unique_ptr<Instruction>>& out;
 
-        // Handle Unary
-        else if (auto unary = dynamic_cast<const tacky::Unary*>(instr.get())) {
-            UnaryOperator op;
+    void emit(std::unique_ptr<Instruction> instr) { out.push_back(std::move(instr)); }
 
-            if (unary->op == tacky::UnaryOp::Not) {
-                asdlInstructions.push_back(std::make_unique<Cmp>(
-                    std::make_unique<Imm>(0),
-                    convertValToOperand(unary->src)
-                ));
+    void binary(BinaryOperator op, std::unique_ptr<Operand> src, std::unique_ptr<Operand> dst) {
+        emit(std::make_unique<Binary>(op, std::move(src), std::move(dst)));
+    }
 
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Imm>(0),
-                    convertValToOperand(unary->dst)
-                ));
+    static std::unique_ptr<Operand> imm(int value) { return std::make_unique<Imm>(value); }
+    static std::unique_ptr<Operand> reg(Reg r) { return std::make_unique<Register>(r); }
+
+    std::unique_ptr<Operand> operand(tacky::Value value) const { return convertValToOperand(fn, value); }
+
+public:
+    ConstantArithmetic(const tacky::FlatFunction& fn, std::vector<std::unique_ptr<Instruction>>& out)
+        : fn(fn), out(out) {}
+
+    /**
+     * @brief Lowers `dst = src1 / src2` or `dst = src1 % src2` when src2 is a constant.
+     * @return False if the divisor is not a constant, or is 0 or INT_MIN (left to idiv).
+     */
+    bool divide(const tacky::Instr& instr, bool remainder) {
+        if (instr.src2.kind != tacky::Value::Kind::Imm) return false;
+        const int d = instr.src2.immValue();
+        if (d == 0 || d == INT32_MIN) return false;
+        const uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+
+        if (ad == 1) {
+            if (remainder) {
+                emit(std::make_unique<Mov>(imm(0), operand(instr.dst)));
+                return true;
+            }
+            emit(std::make_unique<Mov>(operand(instr.src1), operand(instr.dst)));
+            if (d < 0) emit(std::make_unique<Unary>(UnaryOperator::NEG, operand(instr.dst)));
+            return true;
+        }
 
-                asdlInstructions.push_back(std::make_unique<SetCC>(
-                    CondNode::E,
-                    convertValToOperand(unary->dst)
-                ));
+        const int k = exactLog2(ad);
+        if (k > 0) {
+            // bias = n < 0 ? 2^k - 1 : 0, so that the shift and the mask round toward zero
+            emit(std::make_unique<Mov>(operand(instr.src1), reg(Reg::DX)));
+            if (k > 1) binary(BinaryOperator::SAR, imm(31), reg(Reg::DX));
+            binary(BinaryOperator::SHR, imm(32 - k), reg(Reg::DX));
+
+            if (remainder) {
+                // n % 2^k == ((n + bias) & (2^k - 1)) - bias, whatever the sign of d
+                emit(std::make_unique<Mov>(operand(instr.src1), reg(Reg::AX)));
+                binary(BinaryOperator::ADD, reg(Reg::DX), reg(Reg::AX));
+                binary(BinaryOperator::AND, imm(static_cast<int>(ad - 1)), reg(Reg::AX));
+                binary(BinaryOperator::SUB, reg(Reg::DX), reg(Reg::AX));
+                emit(std::make_unique<Mov>(reg(Reg::AX), operand(instr.dst)));
             } else {
-                switch (unary->op) {
-                    case tacky::UnaryOp::Complement: op = UnaryOperator::NOT; break;
-                    case tacky::UnaryOp::Negate:     op = UnaryOperator::NEG; break;
-                    default: throw std::runtime_error("Unknown UnaryOp");
-                }
-
-                std::unique_ptr<Operand> src;
-                if (auto c = dynamic_cast<const tacky::Constant*>(unary->src.get())) {
-                    src = std::make_unique<Imm>(c->value);
-                } else if (auto v = dynamic_cast<const tacky::Var*>(unary->src.get())) {
-                    src = std::make_unique<Pseudo>(v->name);
-                }
-
-                std::string dstName = dynamic_cast<const tacky::Var*>(unary->dst.get())->name;
-                auto dst = std::make_unique<Pseudo>(dstName);
-
-                // First: mov src, dst
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::move(src),
-                    std::make_unique<Pseudo>(dst->getIdentifier())
-                ));
-
-                // Then: unary op dst
-                asdlInstructions.push_back(std::make_unique<Unary>(
-                    op,
-                    std::move(dst)
-                ));
+                binary(BinaryOperator::ADD, operand(instr.src1), reg(Reg::DX));
+                binary(BinaryOperator::SAR, imm(k), reg(Reg::DX));
+                if (d < 0) emit(std::make_unique<Unary>(UnaryOperator::NEG, reg(Reg::DX)));
+                emit(std::make_unique<Mov>(reg(Reg::DX), operand(instr.dst)));
             }
+            return true;
         }
 
-        // Handle Binary
-        else if (auto binary = dynamic_cast<const tacky::Binary*>(instr.get())) {
-            std::unique_ptr<Operand> src1;
-            if (auto c = dynamic_cast<const tacky::Constant*>(binary->src1.get())) {
-                src1 = std::make_unique<Imm>(c->value);
-            } else if (auto v = dynamic_cast<const tacky::Var*>(binary->src1.get())) {
-                src1 = std::make_unique<Pseudo>(v->name);
-            }
+        // q = high half of M * n, corrected by n when M has the wrong sign, shifted, plus
+        // one when negative so that it rounds toward zero
+        const DivisionMagic magic = divisionMagic(d);
+        emit(std::make_unique<Mov>(imm(magic.multiplier), reg(Reg::AX)));
+        emit(std::make_unique<Imul>(operand(instr.src1)));
+        if (d > 0 && magic.multiplier < 0) binary(BinaryOperator::ADD, operand(instr.src1), reg(Reg::DX));
+        if (d < 0 && magic.multiplier > 0) binary(BinaryOperator::SUB, operand(instr.src1), reg(Reg::DX));
+        if (magic.shift > 0) binary(BinaryOperator::SAR, imm(magic.shift), reg(Reg::DX));
+        emit(std::make_unique<Mov>(reg(Reg::DX), reg(Reg::AX)));
+        binary(BinaryOperator::SHR, imm(31), reg(Reg::AX));
+        binary(BinaryOperator::ADD, reg(Reg::AX), reg(Reg::DX));
+
+        if (remainder) {
+            // n % d == n - q * d
+            binary(BinaryOperator::MULT, imm(d), reg(Reg::DX));
+            emit(std::make_unique<Mov>(operand(instr.src1), operand(instr.dst)));
+            binary(BinaryOperator::SUB, reg(Reg::DX), operand(instr.dst));
+        } else {
+            emit(std::make_unique<Mov>(reg(Reg::DX), operand(instr.dst)));
+        }
+        return true;
+    }
 
-            std::unique_ptr<Operand> src2;
-            if (auto c = dynamic_cast<const tacky::Constant*>(binary->src2.get())) {
-                src2 = std::make_unique<Imm>(c->value);
-            } else if (auto v = dynamic_cast<const tacky::Var*>(binary->src2.get())) {
-                src2 = std::make_unique<Pseudo>(v->name);
-            }
-            
-            std::string dstName = dynamic_cast<const tacky::Var*>(binary->dst.get())->name;
-            auto dst = std::make_unique<Pseudo>(dstName);
+    /**
+     * @brief Lowers `dst = src1 * src2` when exactly one operand is a constant that a
+     * move, neg, shift or lea multiplies by.
+     * @return False if imul should be used.
+     */
+    bool multiply(const tacky::Instr& instr) {
+        const bool constant1 = instr.src1.kind == tacky::Value::Kind::Imm;
+        const bool constant2 = instr.src2.kind == tacky::Value::Kind::Imm;
+        if (constant1 == constant2) return false;
+        const tacky::Value x = constant1 ? instr.src2 : instr.src1;
+        const int c = constant1 ? instr.src1.immValue() : instr.src2.immValue();
+        const uint32_t magnitude = c < 0 ? 0u - static_cast<uint32_t>(c) : static_cast<uint32_t>(c);
+        const int k = exactLog2(magnitude);
+
+        if (c == 0) {
+            emit(std::make_unique<Mov>(imm(0), operand(instr.dst)));
+        } else if (k >= 0) {
+            // x * -2^k == -(x << k); x * INT_MIN == x << 31
+            emit(std::make_unique<Mov>(operand(x), operand(instr.dst)));
+            if (k > 0) binary(BinaryOperator::SHL, imm(k), operand(instr.dst));
+            if (c < 0 && c != INT32_MIN) emit(std::make_unique<Unary>(UnaryOperator::NEG, operand(instr.dst)));
+        } else if (c == 3 || c == 5 || c == 9) {
+            emit(std::make_unique<Lea>(operand(x), operand(x), c - 1, operand(instr.dst)));
+        } else {
+            return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Condition code of a relational operator, for SetCC and JmpCC after a Cmp.
+ */
+CondNode relationCondition(tacky::BinaryOp op) {
+    switch (op) {
+        case tacky::BinaryOp::EQUAL:       return CondNode::E;
+        case tacky::BinaryOp::NOTEQUAL:    return CondNode::NE;
+        case tacky::BinaryOp::LESSTHAN:    return CondNode::L;
+        case tacky::BinaryOp::LESSEQ:      return CondNode::LE;
+        case tacky::BinaryOp::GREATERTHAN: return CondNode::G;
+        case tacky::BinaryOp::GREATEREQ:   return CondNode::GE;
+        default: throw std::runtime_error("Unknown RelationOp in BinaryOp");
+    }
+}
 
-            if (binary->op == tacky::BinaryOp::DIVIDE || binary->op == tacky::BinaryOp::REMAINDER) {
-                // mov src1, %eax
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::move(src1),
-                    std::make_unique<Register>(Reg::AX)
-                ));
+} // namespace
 
-                // cdq
-                asdlInstructions.push_back(std::make_unique<Cdq>());
+// --- convertTackyToASDL
+ASDLProgram convertTackyToASDL(const tacky::FlatProgram& tackyProgram) {
+    const tacky::FlatFunction& fn = tackyProgram.function;
+    std::vector<std::unique_ptr<Instruction>> asdlInstructions;
+    ConstantArithmetic constants(fn, asdlInstructions);
 
-                // idiv src2
-                asdlInstructions.push_back(std::make_unique<Idiv>(
-                    std::move(src2)
-                ));
+    std::vector<uint32_t> uses(fn.registers.size(), 0);
+    for (const tacky::Instr& instr : fn.code) tacky::forEachUse(instr, [&](uint32_t reg) { ++uses[reg]; });
 
-                // mov %eax or %edx -> dst
+    for (size_t i = 0; i < fn.code.size(); ++i) {
+        const tacky::Instr& instr = fn.code[i];
+        switch (instr.op) {
+            case tacky::Opcode::Return:
                 asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Register>(
-                        binary->op == tacky::BinaryOp::DIVIDE ? Reg::AX : Reg::DX
-                    ),
-                    std::move(dst)
+                    convertValToOperand(fn, instr.src1),
+                    std::make_unique<Register>(Reg::AX)
                 ));
-            } else if (binary->op == tacky::BinaryOp::ADD || binary->op == tacky::BinaryOp::SUBTRACT || binary->op == tacky::BinaryOp::MULTIPLY) {
-                BinaryOperator op;
-                switch (binary->op) {
-                    case tacky::BinaryOp::ADD:      op = BinaryOperator::ADD; break;
-                    case tacky::BinaryOp::SUBTRACT: op = BinaryOperator::SUB; break;
-                    case tacky::BinaryOp::MULTIPLY: op = BinaryOperator::MULT; break;
-                    default: throw std::runtime_error("Unknown BinaryOp");
-                }
+                asdlInstructions.push_back(std::make_unique<Ret>());
+                break;
 
-                // mov src1, dst
-                asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::move(src1),
-                    std::make_unique<Pseudo>(dst->getIdentifier())
+            case tacky::Opcode::Jump:
+                asdlInstructions.push_back(std::make_unique<Jmp>(instr.label));
+                break;
+
+            case tacky::Opcode::JumpIfZero:
+            case tacky::Opcode::JumpIfNotZero:
+                asdlInstructions.push_back(std::make_unique<Cmp>(
+                    std::make_unique<Imm>(0),
+                    convertValToOperand(fn, instr.src1)
                 ));
 
-                // op src2, dst
-                asdlInstructions.push_back(std::make_unique<Binary>(
-                    op,
-                    std::move(src2),
-                    std::move(dst)
+                asdlInstructions.push_back(std::make_unique<JmpCC>(
+                    instr.op == tacky::Opcode::JumpIfZero ? CondNode::E : CondNode::NE,
+                    instr.label
                 ));
-            } else {
-                CondNode op;
-                switch (binary->op) {
-                    case tacky::BinaryOp::EQUAL:      op = CondNode::E; break;
-                    case tacky::BinaryOp::NOTEQUAL: op = CondNode::NE; break;
-                    case tacky::BinaryOp::LESSTHAN: op = CondNode::L; break;
-                    case tacky::BinaryOp::LESSEQ:      op = CondNode::LE; break;
-                    case tacky::BinaryOp::GREATERTHAN: op = CondNode::G; break;
-                    case tacky::BinaryOp::GREATEREQ: op = CondNode::GE; break;
-                    default: throw std::runtime_error("Unknown RelationOp in BinaryOp");
-                }
+                break;
 
+            case tacky::Opcode::JumpIfCompare:
+                // Cmp(a, b) sets the flags of a - b
                 asdlInstructions.push_back(std::make_unique<Cmp>(
-                    std::move(src1),
-                    std::move(src2)
+                    convertValToOperand(fn, instr.src1),
+                    convertValToOperand(fn, instr.src2)
                 ));
+                asdlInstructions.push_back(std::make_unique<JmpCC>(relationCondition(instr.binaryOp()), instr.label));
+                break;
 
+            case tacky::Opcode::Copy:
                 asdlInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Imm>(0),
-                    convertValToOperand(binary->dst)
+                    convertValToOperand(fn, instr.src1),
+                    convertValToOperand(fn, instr.dst)
                 ));
+                break;
 
-                asdlInstructions.push_back(std::make_unique<SetCC>(
-                    op,
-                    convertValToOperand(binary->dst)
-                ));
+            case tacky::Opcode::CopyIfNotZero:
+                asdlInstructions.push_back(std::make_unique<Cmp>(
+                    convertValToOperand(fn, instr.src1),
+                    std::make_unique<Imm>(0)
+                ));
+                asdlInstructions.push_back(std::make_unique<Cmov>(
+                    CondNode::NE,
+                    convertValToOperand(fn, instr.src2),
+                    convertValToOperand(fn, instr.dst)
+                ));
+                break;
+
+            case tacky::Opcode::Label:
+                asdlInstructions.push_back(std::make_unique<Label>(instr.label));
+                break;
+
+            case tacky::Opcode::Unary: {
+                UnaryOperator op;
+
+                if (instr.unaryOp() == tacky::UnaryOp::Not) {
+                    asdlInstructions.push_back(std::make_unique<Cmp>(
+                        std::make_unique<Imm>(0),
+                        convertValToOperand(fn, instr.src1)
+                    ));
+
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        std::make_unique<Imm>(0),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+
+                    asdlInstructions.push_back(std::make_unique<SetCC>(
+                        CondNode::E,
+                        convertValToOperand(fn, instr.dst)
+                    ));
+                } else {
+                    switch (instr.unaryOp()) {
+                        case tacky::UnaryOp::Complement: op = UnaryOperator::NOT; break;
+                        case tacky::UnaryOp::Negate:     op = UnaryOperator::NEG; break;
+                        default: throw std::runtime_error("Unknown UnaryOp");
+                    }
+
+                    // First: mov src, dst
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        convertValToOperand(fn, instr.src1),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+
+                    // Then: unary op dst
+                    asdlInstructions.push_back(std::make_unique<Unary>(
+                        op,
+                        convertValToOperand(fn, instr.dst)
+                    ));
+                }
+                break;
+            }
+
+            case tacky::Opcode::Binary: {
+                tacky::BinaryOp binaryOp = instr.binaryOp();
+                if ((binaryOp == tacky::BinaryOp::DIVIDE || binaryOp == tacky::BinaryOp::REMAINDER) &&
+                    constants.divide(instr, binaryOp == tacky::BinaryOp::REMAINDER)) {
+                    break;
+                }
+                if (binaryOp == tacky::BinaryOp::MULTIPLY && constants.multiply(instr)) break;
+
+                auto src1 = convertValToOperand(fn, instr.src1);
+                auto src2 = convertValToOperand(fn, instr.src2);
+
+                if (binaryOp == tacky::BinaryOp::DIVIDE || binaryOp == tacky::BinaryOp::REMAINDER) {
+                    // mov src1, %eax
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        std::move(src1),
+                        std::make_unique<Register>(Reg::AX)
+                    ));
+
+                    // cdq
+                    asdlInstructions.push_back(std::make_unique<Cdq>());
+
+                    // idiv src2
+                    asdlInstructions.push_back(std::make_unique<Idiv>(
+                        std::move(src2)
+                    ));
+
+                    // mov %eax or %edx -> dst
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        std::make_unique<Register>(
+                            binaryOp == tacky::BinaryOp::DIVIDE ? Reg::AX : Reg::DX
+                        ),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+                } else if (binaryOp == tacky::BinaryOp::ADD || binaryOp == tacky::BinaryOp::SUBTRACT || binaryOp == tacky::BinaryOp::MULTIPLY) {
+                    BinaryOperator op;
+                    switch (binaryOp) {
+                        case tacky::BinaryOp::ADD:      op = BinaryOperator::ADD; break;
+                        case tacky::BinaryOp::SUBTRACT: op = BinaryOperator::SUB; break;
+                        case tacky::BinaryOp::MULTIPLY: op = BinaryOperator::MULT; break;
+                        default: throw std::runtime_error("Unknown BinaryOp");
+                    }
+
+                    // mov src1, dst
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        std::move(src1),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+
+                    // op src2, dst
+                    asdlInstructions.push_back(std::make_unique<Binary>(
+                        op,
+                        std::move(src2),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+                } else {
+                    CondNode op = relationCondition(binaryOp);
+
+                    // A comparison only read by the CopyIfNotZero after it (past the Copy
+                    // that sets the destination when the condition fails) leaves its result
+                    // in the flags: mov init, d; cmp; cmovCC src, d. The Copy moves before
+                    // the compare, so it must not write the compared values
+                    size_t select = i + 1;
+                    const tacky::Instr* init = nullptr;
+                    if (select < fn.code.size() && fn.code[select].op == tacky::Opcode::Copy) {
+                        init = &fn.code[select++];
+                    }
+                    if (select < fn.code.size() && fn.code[select].op == tacky::Opcode::CopyIfNotZero &&
+                        fn.code[select].src1 == instr.dst && uses[instr.dst.regIndex()] == 1 &&
+                        (!init || (init->dst != instr.src1 && init->dst != instr.src2 && init->dst != instr.dst))) {
+                        const tacky::Instr& copy = fn.code[select];
+                        if (init) {
+                            asdlInstructions.push_back(std::make_unique<Mov>(
+                                convertValToOperand(fn, init->src1),
+                                convertValToOperand(fn, init->dst)
+                            ));
+                        }
+                        asdlInstructions.push_back(std::make_unique<Cmp>(std::move(src1), std::move(src2)));
+                        asdlInstructions.push_back(std::make_unique<Cmov>(
+                            op,
+                            convertValToOperand(fn, copy.src2),
+                            convertValToOperand(fn, copy.dst)
+                        ));
+                        i = select;
+                        break;
+                    }
+
+                    asdlInstructions.push_back(std::make_unique<Cmp>(
+                        std::move(src1),
+                        std::move(src2)
+                    ));
+
+                    asdlInstructions.push_back(std::make_unique<Mov>(
+                        std::make_unique<Imm>(0),
+                        convertValToOperand(fn, instr.dst)
+                    ));
+
+                    asdlInstructions.push_back(std::make_unique<SetCC>(
+                        op,
+                        convertValToOperand(fn, instr.dst)
+                    ));
+                }
+                break;
             }
         }
     }
 
     auto funcDef = std::make_unique<FunctionDefinition>(
-        tackyProgram.function->name,
+        fn.name,
         std::move(asdlInstructions)
     );
 
@@ -503,95 +807,23 @@ FunctionDefinition* ASDLProgram::getFunctionDefinition() const {
     return functionDefinition.get();
 }
 
-std::unique_ptr<Operand> replaceIfPseudo(Operand* op, std::unordered_map<std::string, int>& offsets, int& stackOffset) {
-    if (auto pseudo = dynamic_cast<Pseudo*>(op)) {
-        const std::string& name = pseudo->getIdentifier();
-        auto it = offsets.find(name);
-        if (it == offsets.end()) {
-            offsets[name] = stackOffset;
-            stackOffset -= 4;
-            return std::make_unique<Stack>(offsets[name]);
-        } else {
-            return std::make_unique<Stack>(it->second);
-        }
-    }
-    return nullptr;
-}
-
 int replacePseudosWithStack(ASDLProgram& program) {
     int stackOffset = -4;
-    std::unordered_map<std::string, int> pseudoOffsets;
+    // Offsets are indexed by symbol; 0 marks a pseudo that has no slot yet
+    std::vector<int> pseudoOffsets(symbols().size(), 0);
     auto& instructions = program.getFunctionDefinition()->getInstructions();
 
     for (auto& instr : instructions) {
-        if (auto unary = dynamic_cast<Unary*>(instr.get())) {
-            auto dst = unary->releaseDst();
-            if (auto replaced = replaceIfPseudo(dst.get(), pseudoOffsets, stackOffset))
-                unary->setDst(std::move(replaced));
-            else
-                unary->setDst(std::move(dst));
-        }
-
-        else if (auto mov = dynamic_cast<Mov*>(instr.get())) {
-            auto dst = mov->releaseDst();
-            auto src = mov->releaseSrc();
-
-            if (auto replaced = replaceIfPseudo(dst.get(), pseudoOffsets, stackOffset))
-                mov->setDst(std::move(replaced));
-            else
-                mov->setDst(std::move(dst));
-
-            if (auto replaced = replaceIfPseudo(src.get(), pseudoOffsets, stackOffset))
-                mov->setSrc(std::move(replaced));
-            else
-                mov->setSrc(std::move(src));
-        }
-
-        else if (auto binary = dynamic_cast<Binary*>(instr.get())) {
-            auto dst = binary->releaseDst();
-            auto src = binary->releaseSrc();
-
-            if (auto replaced = replaceIfPseudo(dst.get(), pseudoOffsets, stackOffset))
-                binary->setDst(std::move(replaced));
-            else
-                binary->setDst(std::move(dst));
-
-            if (auto replaced = replaceIfPseudo(src.get(), pseudoOffsets, stackOffset))
-                binary->setSrc(std::move(replaced));
-            else
-                binary->setSrc(std::move(src));
-        }
-
-        else if (auto cmp = dynamic_cast<Cmp*>(instr.get())) {
-            auto lhs = cmp->releaseLHS();
-            auto rhs = cmp->releaseRHS();
-
-            if (auto replaced = replaceIfPseudo(lhs.get(), pseudoOffsets, stackOffset))
-                cmp->setLHS(std::move(replaced));
-            else
-                cmp->setLHS(std::move(lhs));
-
-            if (auto replaced = replaceIfPseudo(rhs.get(), pseudoOffsets, stackOffset))
-                cmp->setRHS(std::move(replaced));
-            else
-                cmp->setRHS(std::move(rhs));
-        }
-
-        else if (auto setcc = dynamic_cast<SetCC*>(instr.get())) {
-            auto dst = setcc->releaseDst();
-            if (auto replaced = replaceIfPseudo(dst.get(), pseudoOffsets, stackOffset))
-                setcc->setDst(std::move(replaced));
-            else
-                setcc->setDst(std::move(dst));
-        }
-
-        else if (auto idiv = dynamic_cast<Idiv*>(instr.get())) {
-            auto dst = idiv->releaseDst();
-            if (auto replaced = replaceIfPseudo(dst.get(), pseudoOffsets, stackOffset))
-                idiv->setDst(std::move(replaced));
-            else
-                idiv->setDst(std::move(dst));
-        }
+        forEachOperand(*instr, [&](std::unique_ptr<Operand>& operand, OperandRole) {
+            auto pseudo = as<Pseudo>(operand.get());
+            if (!pseudo) return;
+            int& offset = pseudoOffsets[pseudo->getIdentifier()];
+            if (offset == 0) {
+                offset = stackOffset;
+                stackOffset -= 4;
+            }
+            operand = std::make_unique<Stack>(offset);
+        });
     }
 
     return -stackOffset; 
@@ -613,157 +845,131 @@ void insertAllocateStack(ASDLProgram& program, int stackSize) {
 void legalizeMovMemoryToMemory(ASDLProgram& program) {
     auto& instructions = program.getFunctionDefinition()->getInstructions();
     std::vector<std::unique_ptr<Instruction>> legalizedInstructions;
+    legalizedInstructions.reserve(instructions.size());
 
-    for (auto& instr : instructions) {
-
-        if (auto mov = dynamic_cast<Mov*>(instr.get())) {
-            Operand* src = mov->getSrc();
-            Operand* dst = mov->getDst();
+    auto isMem = [](const Operand* op) { return op->kind() == OperandKind::Stack; };
+    auto isImm = [](const Operand* op) { return op->kind() == OperandKind::Imm; };
+    auto isReg = [](const Operand* op) { return op->kind() == OperandKind::Register; };
+    auto copy = [](const Operand* op) { return std::unique_ptr<Operand>(op->clone()); };
+    auto reg = [](Reg r) { return std::make_unique<Register>(r); };
+    auto emit = [&](std::unique_ptr<Instruction> i) { legalizedInstructions.push_back(std::move(i)); };
 
-            bool srcIsMem = dynamic_cast<Stack*>(src);
-            bool dstIsMem = dynamic_cast<Stack*>(dst);
-
-            if (srcIsMem && dstIsMem) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(src->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Register>(Reg::R10),
-                    std::unique_ptr<Operand>(dst->clone())
-                ));
-            } else {
-                legalizedInstructions.push_back(std::move(instr));
+    for (auto& instr : instructions) {
+        switch (instr->kind()) {
+            case InstructionKind::Mov: {
+                auto mov = static_cast<Mov*>(instr.get());
+                if (isMem(mov->getSrc()) && isMem(mov->getDst())) {
+                    emit(std::make_unique<Mov>(mov->releaseSrc(), reg(Reg::R10)));
+                    mov->setSrc(reg(Reg::R10));
+                }
+                break;
             }
 
-        } else if (auto idiv = dynamic_cast<Idiv*>(instr.get())) {
-            Operand* operand = idiv->getDst();
-
-            if (dynamic_cast<Imm*>(operand)) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(operand->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Idiv>(
-                    std::make_unique<Register>(Reg::R10)
-                ));
-            } else {
-                legalizedInstructions.push_back(std::move(instr));
+            case InstructionKind::Idiv: {
+                auto idiv = static_cast<Idiv*>(instr.get());
+                if (isImm(idiv->getDst())) {
+                    emit(std::make_unique<Mov>(idiv->releaseDst(), reg(Reg::R10)));
+                    idiv->setDst(reg(Reg::R10));
+                }
+                break;
             }
 
-        } else if (auto bin = dynamic_cast<Binary*>(instr.get())) {
-            Operand* src = bin->getSrc();
-            Operand* dst = bin->getDst();
-            BinaryOperator op = bin->getBinaryOperator();
-
-            bool srcIsMem = dynamic_cast<Stack*>(src);
-            bool dstIsMem = dynamic_cast<Stack*>(dst);
-            bool srcIsImm = dynamic_cast<Imm*>(src);
-
-            if ((op == BinaryOperator::ADD || op == BinaryOperator::SUB) && srcIsMem && dstIsMem) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(src->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Binary>(
-                    op,
-                    std::make_unique<Register>(Reg::R10),
-                    std::unique_ptr<Operand>(dst->clone())
-                ));
-            } else if (op == BinaryOperator::MULT && srcIsImm && dstIsMem) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(dst->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Binary>(
-                    op,
-                    std::unique_ptr<Operand>(src->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Register>(Reg::R11),
-                    std::unique_ptr<Operand>(dst->clone())
-                ));
-            } else if (op == BinaryOperator::MULT && srcIsMem && dstIsMem) {
-                // Ex: imull -8(%rbp), -12(%rbp) → temp = [dst]; temp *= [src]; dst = temp
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(dst->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(src->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Binary>(
-                    op,
-                    std::make_unique<Register>(Reg::R10),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::make_unique<Register>(Reg::R11),
-                    std::unique_ptr<Operand>(dst->clone())
-                ));
+            case InstructionKind::Imul: {
+                auto imul = static_cast<Imul*>(instr.get());
+                if (isImm(imul->getSrc())) {
+                    emit(std::make_unique<Mov>(imul->releaseSrc(), reg(Reg::R10)));
+                    imul->setSrc(reg(Reg::R10));
+                }
+                break;
             }
-            else {
-                legalizedInstructions.push_back(std::move(instr));
+
+            case InstructionKind::Lea: {
+                // An address is made of registers, and leal can only write a register
+                auto lea = static_cast<Lea*>(instr.get());
+                if (!isReg(lea->getBase())) {
+                    bool sameIndex = sameOperand(*lea->getBase(), *lea->getIndex());
+                    emit(std::make_unique<Mov>(lea->releaseBase(), reg(Reg::R10)));
+                    lea->setBase(reg(Reg::R10));
+                    if (sameIndex) lea->setIndex(reg(Reg::R10));
+                }
+                if (!isReg(lea->getIndex())) {
+                    emit(std::make_unique<Mov>(lea->releaseIndex(), reg(Reg::R11)));
+                    lea->setIndex(reg(Reg::R11));
+                }
+                if (!isReg(lea->getDst())) {
+                    auto dst = lea->releaseDst();
+                    lea->setDst(reg(Reg::R11));
+                    emit(std::move(instr));
+                    emit(std::make_unique<Mov>(reg(Reg::R11), std::move(dst)));
+                    continue;
+                }
+                break;
             }
 
-        } else if (auto cmp = dynamic_cast<Cmp*>(instr.get())) {
-            Operand* lhs = cmp->getLHS();
-            Operand* rhs = cmp->getRHS();
+            case InstructionKind::Binary: {
+                auto bin = static_cast<Binary*>(instr.get());
+                Operand* src = bin->getSrc();
+                Operand* dst = bin->getDst();
+                BinaryOperator op = bin->getBinaryOperator();
+
+                if ((op == BinaryOperator::ADD || op == BinaryOperator::SUB || op == BinaryOperator::AND) &&
+                    isMem(src) && isMem(dst)) {
+                    emit(std::make_unique<Mov>(bin->releaseSrc(), reg(Reg::R10)));
+                    bin->setSrc(reg(Reg::R10));
+                } else if (op == BinaryOperator::MULT && isMem(dst)) {
+                    // imull cannot write to memory: temp = [dst]; temp *= src; [dst] = temp
+                    // (a memory source is fine for imull, so it is used as is)
+                    emit(std::make_unique<Mov>(copy(dst), reg(Reg::R11)));
+                    emit(std::make_unique<Binary>(op, bin->releaseSrc(), reg(Reg::R11)));
+                    emit(std::make_unique<Mov>(reg(Reg::R11), bin->releaseDst()));
+                    continue;
+                }
+                break;
+            }
 
-            bool lhsIsMem = dynamic_cast<Stack*>(lhs);
-            bool rhsIsMem = dynamic_cast<Stack*>(rhs);
-            bool lhsIsImm = dynamic_cast<Imm*>(lhs);
-            bool rhsIsImm = dynamic_cast<Imm*>(rhs);
+            case InstructionKind::Cmp: {
+                auto cmp = static_cast<Cmp*>(instr.get());
+                Operand* lhs = cmp->getLHS();
+                Operand* rhs = cmp->getRHS();
+
+                if (isMem(lhs) && isMem(rhs)) {
+                    // mem vs mem → use temp register
+                    emit(std::make_unique<Mov>(cmp->releaseLHS(), reg(Reg::R10)));
+                    cmp->setLHS(reg(Reg::R10));
+                } else if (isMem(lhs) && isImm(rhs)) {
+                    emit(std::make_unique<Mov>(cmp->releaseRHS(), reg(Reg::R11)));
+                    cmp->setRHS(reg(Reg::R11));
+                } else if (isImm(lhs)) {
+                    // the second operand of cmpl cannot be an immediate
+                    emit(std::make_unique<Mov>(cmp->releaseLHS(), reg(isImm(rhs) ? Reg::R10 : Reg::R11)));
+                    cmp->setLHS(reg(isImm(rhs) ? Reg::R10 : Reg::R11));
+                }
+                break;
+            }
 
-            if (lhsIsMem && rhsIsMem) {
-                // mem vs mem → use temp register
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(lhs->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Cmp>(
-                    std::make_unique<Register>(Reg::R10),
-                    std::unique_ptr<Operand>(rhs->clone())
-                ));
-            } else if (lhsIsMem && rhsIsImm) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(rhs->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Cmp>(
-                    std::unique_ptr<Operand>(lhs->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-            } else if (lhsIsImm && rhsIsMem) {
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(lhs->clone()),
-                    std::make_unique<Register>(Reg::R11)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Cmp>(
-                    std::make_unique<Register>(Reg::R11),
-                    std::unique_ptr<Operand>(rhs->clone())
-                ));
-            } else if (lhsIsImm && rhsIsImm) {
-                // illegal: imm vs imm, must legalize
-                legalizedInstructions.push_back(std::make_unique<Mov>(
-                    std::unique_ptr<Operand>(lhs->clone()),
-                    std::make_unique<Register>(Reg::R10)
-                ));
-                legalizedInstructions.push_back(std::make_unique<Cmp>(
-                    std::make_unique<Register>(Reg::R10),
-                    std::unique_ptr<Operand>(rhs->clone())
-                ));
-            } else {
-                // already legal (e.g., reg vs imm)
-                legalizedInstructions.push_back(std::move(instr));
+            case InstructionKind::Cmov: {
+                // cmovl has no immediate form and can only write a register
+                auto cmov = static_cast<Cmov*>(instr.get());
+                if (isImm(cmov->getSrc())) {
+                    emit(std::make_unique<Mov>(cmov->releaseSrc(), reg(Reg::R10)));
+                    cmov->setSrc(reg(Reg::R10));
+                }
+                if (!isReg(cmov->getDst())) {
+                    auto dst = cmov->releaseDst();
+                    emit(std::make_unique<Mov>(copy(dst.get()), reg(Reg::R11)));
+                    cmov->setDst(reg(Reg::R11));
+                    emit(std::move(instr));
+                    emit(std::make_unique<Mov>(reg(Reg::R11), std::move(dst)));
+                    continue;
+                }
+                break;
             }
 
-        } else {
-            // All other instructions passed through
-            legalizedInstructions.push_back(std::move(instr));
+            default:
+                // All other instructions passed through
+                break;
         }
+        emit(std::move(instr));
     }
 
     instructions = std::move(legalizedInstructions);
@@ -772,37 +978,18 @@ void legalizeMovMemoryToMemory(ASDLProgram& program) {
 
 
 // --- writeASMToFile ---
-void writeASMToFile(const ASDLProgram& program, const std::string& filename) {
-    std::ofstream ofs(filename);
+void writeASMToFile(const ASDLProgram& program, bool machO, const std::string& filename) {
+    std::vector<char> buffer(1 << 16);
+    std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    ofs.open(filename);
     if (!ofs.is_open()) {
         throw std::runtime_error("Failed to open output file: " + filename);
     }
 
-    std::string asmCode = program.toASM();
-
-    // Trim trailing whitespace
-    while (!asmCode.empty() && std::isspace(asmCode.back())) {
-        asmCode.pop_back();
-    }
-
-    // Get the last non-empty line
-    size_t lastLineStart = asmCode.find_last_of('\n');
-    std::string lastLine = asmCode.substr(lastLineStart + 1);
-    while (lastLine.empty() && lastLineStart != std::string::npos) {
-        asmCode.erase(lastLineStart);
-        lastLineStart = asmCode.find_last_of('\n');
-        lastLine = asmCode.substr(lastLineStart + 1);
-    }
-
-    bool endsWithRet = lastLine.find("ret") != std::string::npos;
-
-    if (!endsWithRet) {
-        // Add return sequence only if no unconditional ret at end
-        asmCode += "\n  movq %rbp, %rsp\n  popq %rbp\n  movl $0, %eax\n  ret";
-    }
-
-    ofs << asmCode;
+    program.emit(ofs, machO);
     ofs.close();
+    if (!ofs) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
 }
-
-
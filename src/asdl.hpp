@@ -2,12 +2,14 @@
 #define ASDL_HPP
 
 #include <string>
+#include <ostream>
 #include <memory>
 #include <vector>
 #include <variant>
 
 #include "ast.hpp"
 #include "tacky.hpp"
+#include "symbol.hpp"
 
 /**
  * @brief Base class for all ASDL nodes.
@@ -22,9 +24,14 @@ public:
     virtual std::string toString() const = 0;
 
     /**
-     * @brief Convert node to assembly code string.
+     * @brief Write the assembly code of the node to a stream.
      */
-    virtual std::string toASM() const = 0;
+    virtual void emit(std::ostream& os) const = 0;
+
+    /**
+     * @brief Convert node to assembly code string (collects emit()).
+     */
+    std::string toASM() const;
 };
 
 /**
@@ -32,7 +39,12 @@ public:
  */
 enum class Reg {
     AX,
+    CX,
     DX,
+    SI,
+    DI,
+    R8,
+    R9,
     R10,
     R11
 };
@@ -51,7 +63,12 @@ enum class UnaryOperator {
 enum class BinaryOperator {
     ADD,
     SUB,
-    MULT
+    MULT,
+    XOR,
+    AND,
+    SHL,  ///< Shifts take an immediate count as source
+    SAR,
+    SHR
 };
 
 /**
@@ -72,13 +89,72 @@ enum class CondNode {
 inline std::string regToString(Reg r) {
     switch (r) {
         case Reg::AX: return "AX";
+        case Reg::CX: return "CX";
         case Reg::DX: return "DX";
+        case Reg::SI: return "SI";
+        case Reg::DI: return "DI";
+        case Reg::R8: return "R8";
+        case Reg::R9: return "R9";
         case Reg::R10: return "R10";
         case Reg::R11: return "R11";
         default: return "UNKNOWN_REG";
     }
 }
 
+/**
+ * @brief Assembly name of the 32-bit register.
+ */
+inline const char* regToASM(Reg r) {
+    switch (r) {
+        case Reg::AX: return "%eax";
+        case Reg::CX: return "%ecx";
+        case Reg::DX: return "%edx";
+        case Reg::SI: return "%esi";
+        case Reg::DI: return "%edi";
+        case Reg::R8: return "%r8d";
+        case Reg::R9: return "%r9d";
+        case Reg::R10: return "%r10d";
+        case Reg::R11: return "%r11d";
+    }
+    return "%UNKNOWN_REG";
+}
+
+/**
+ * @brief Assembly name of the low byte of the register, as written by SetCC.
+ */
+inline const char* regToByteASM(Reg r) {
+    switch (r) {
+        case Reg::AX: return "%al";
+        case Reg::CX: return "%cl";
+        case Reg::DX: return "%dl";
+        case Reg::SI: return "%sil";
+        case Reg::DI: return "%dil";
+        case Reg::R8: return "%r8b";
+        case Reg::R9: return "%r9b";
+        case Reg::R10: return "%r10b";
+        case Reg::R11: return "%r11b";
+    }
+    return "%UNKNOWN_REG";
+}
+
+/**
+ * @brief Assembly name of the 64-bit register, as used in addresses.
+ */
+inline const char* regToQuadASM(Reg r) {
+    switch (r) {
+        case Reg::AX: return "%rax";
+        case Reg::CX: return "%rcx";
+        case Reg::DX: return "%rdx";
+        case Reg::SI: return "%rsi";
+        case Reg::DI: return "%rdi";
+        case Reg::R8: return "%r8";
+        case Reg::R9: return "%r9";
+        case Reg::R10: return "%r10";
+        case Reg::R11: return "%r11";
+    }
+    return "%UNKNOWN_REG";
+}
+
 /**
  * @brief Convert CondNode to string.
  */
@@ -96,7 +172,7 @@ inline std::string condNodeToString(CondNode c) {
 /**
  * @brief Convert CondNode to asm.
  */
-inline std::string condNodeToASM(CondNode c) {
+inline const char* condNodeToASM(CondNode c) {
     switch (c) {
         case CondNode::E: return "e";
         case CondNode::NE: return "ne";
@@ -107,13 +183,37 @@ inline std::string condNodeToASM(CondNode c) {
     }
 }
 
+/**
+ * @brief Kind tag of an Operand, one per subclass.
+ */
+enum class OperandKind {
+    Imm,
+    Register,
+    Pseudo,
+    Stack
+};
+
+/**
+ * @brief How an instruction accesses one of its operands.
+ */
+enum class OperandRole {
+    Read,
+    Write,
+    ReadWrite
+};
+
 /**
  * @brief Operand type: immediate value or register.
  */
 class Operand : public ASDLNode {
+    OperandKind operandKind;
+protected:
+    explicit Operand(OperandKind k) : operandKind(k) {}
 public:
     virtual ~Operand() {}
 
+    OperandKind kind() const { return operandKind; }
+
     /**
      * @brief Clone the operand object.
      * @return A dynamically allocated copy of the operand.
@@ -124,59 +224,103 @@ public:
 class Imm : public Operand {
     int value;
 public:
-    explicit Imm(int v) : value(v) {}
+    static constexpr OperandKind Kind = OperandKind::Imm;
+
+    explicit Imm(int v) : Operand(Kind), value(v) {}
     int getValue() const { return value; }
     Operand* clone() const override { return new Imm(value); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Register : public Operand {
     Reg reg;
 public:
-    explicit Register(Reg r) : reg(r) {}
+    static constexpr OperandKind Kind = OperandKind::Register;
+
+    explicit Register(Reg r) : Operand(Kind), reg(r) {}
     Reg getReg() const { return reg; }
     Operand* clone() const override { return new Register(reg); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Pseudo : public Operand {
-    std::string identifier;
+    Symbol identifier;
 public:
-    explicit Pseudo(std::string id) : identifier(std::move(id)) {}
-    const std::string& getIdentifier() const { return identifier; }
+    static constexpr OperandKind Kind = OperandKind::Pseudo;
+
+    explicit Pseudo(Symbol id) : Operand(Kind), identifier(id) {}
+    Symbol getIdentifier() const { return identifier; }
     Operand* clone() const override { return new Pseudo(identifier); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Stack : public Operand {
     int value;
 public:
-    explicit Stack(int n) : value(n) {}
+    static constexpr OperandKind Kind = OperandKind::Stack;
+
+    explicit Stack(int n) : Operand(Kind), value(n) {}
     int getValue() const { return value; }
     Operand* clone() const override { return new Stack(value); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
+};
+
+/**
+ * @brief Returns true if two operands are the same immediate, register or stack slot.
+ */
+bool sameOperand(const Operand& a, const Operand& b);
+
+/**
+ * @brief Kind tag of an Instruction, one per subclass.
+ */
+enum class InstructionKind {
+    Mov,
+    Unary,
+    Binary,
+    Cmp,
+    Idiv,
+    Imul,
+    Lea,
+    Cdq,
+    Jmp,
+    JmpCC,
+    SetCC,
+    Cmov,
+    Label,
+    AllocateStack,
+    Ret
 };
 
 /**
  * @brief Instruction type: Mov or Ret.
+ *
+ * Passes switch on kind() and use as<T>() rather than dynamic_cast, and visit operands
+ * with forEachOperand().
  */
 class Instruction : public ASDLNode {
+    InstructionKind instructionKind;
+protected:
+    explicit Instruction(InstructionKind k) : instructionKind(k) {}
 public:
     virtual ~Instruction() = default;
+
+    InstructionKind kind() const { return instructionKind; }
 };
 
 class Mov : public Instruction {
     std::unique_ptr<Operand> src;
     std::unique_ptr<Operand> dst;
 public:
+    static constexpr InstructionKind Kind = InstructionKind::Mov;
+
     Mov(std::unique_ptr<Operand> s, std::unique_ptr<Operand> d);
     Operand* getDst() {return dst.get();}
     Operand* getSrc() {return src.get();}
@@ -190,18 +334,27 @@ public:
     Operand* cloneSrc() const { return src->clone(); }
     Operand* cloneDst() const { return dst->clone(); }
 
+    template <typename F>
+    void forEachOperand(F&& f) { f(src, OperandRole::Read); f(dst, OperandRole::Write); }
+
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Unary : public Instruction {
     UnaryOperator unary_operator;
     std::unique_ptr<Operand> dst;
 public:
+    static constexpr InstructionKind Kind = InstructionKind::Unary;
+
     Unary(UnaryOperator u, std::unique_ptr<Operand> d);
+    UnaryOperator getOperator() const { return unary_operator; }
+
+    template <typename F>
+    void forEachOperand(F&& f) { f(dst, OperandRole::ReadWrite); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 
     std::unique_ptr<Operand> releaseDst() { return std::move(dst); }
 
@@ -215,8 +368,10 @@ class Binary : public Instruction {
     std::unique_ptr<Operand> dst;
 
 public:
+    static constexpr InstructionKind Kind = InstructionKind::Binary;
+
     Binary(std::variant<BinaryOperator, CondNode> op, std::unique_ptr<Operand> s, std::unique_ptr<Operand> d)
-        : op_type(std::move(op)), src(std::move(s)), dst(std::move(d)) {}
+        : Instruction(Kind), op_type(std::move(op)), src(std::move(s)), dst(std::move(d)) {}
 
     const std::variant<BinaryOperator, CondNode>& getOperator() const { return op_type; }
     bool isBinaryOperator() const { return std::holds_alternative<BinaryOperator>(op_type); }
@@ -232,8 +387,11 @@ public:
     BinaryOperator getBinaryOperator() const { return std::get<BinaryOperator>(op_type); }
     CondNode getCondNode() const { return std::get<CondNode>(op_type); }
 
+    template <typename F>
+    void forEachOperand(F&& f) { f(src, OperandRole::Read); f(dst, OperandRole::ReadWrite); }
+
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Cmp : public Instruction {
@@ -241,8 +399,10 @@ class Cmp : public Instruction {
     std::unique_ptr<Operand> rhs;
 
 public:
+    static constexpr InstructionKind Kind = InstructionKind::Cmp;
+
     Cmp(std::unique_ptr<Operand> lhs, std::unique_ptr<Operand> rhs)
-        : lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+        : Instruction(Kind), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
 
     Operand* getLHS() const { return lhs.get(); }
     Operand* getRHS() const { return rhs.get(); }
@@ -251,57 +411,131 @@ public:
     void setLHS(std::unique_ptr<Operand> newLHS) { lhs = std::move(newLHS); }
     void setRHS(std::unique_ptr<Operand> newRHS) { rhs = std::move(newRHS); }
 
+    template <typename F>
+    void forEachOperand(F&& f) { f(lhs, OperandRole::Read); f(rhs, OperandRole::Read); }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Idiv : public Instruction {
     std::unique_ptr<Operand> dst;
 public:
+    static constexpr InstructionKind Kind = InstructionKind::Idiv;
+
     Idiv(std::unique_ptr<Operand> d);
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 
     std::unique_ptr<Operand> releaseDst() { return std::move(dst); }
 
     Operand* getDst() { return dst.get(); }
     void setDst(std::unique_ptr<Operand> newDst) { dst = std::move(newDst); }
 
+    template <typename F>
+    void forEachOperand(F&& f) { f(dst, OperandRole::Read); }
+};
+
+/**
+ * @brief One-operand `imull src`: EDX:EAX = EAX * src, signed.
+ *
+ * Gives the high half of a product in DX, for division by a constant.
+ */
+class Imul : public Instruction {
+    std::unique_ptr<Operand> src;
+public:
+    static constexpr InstructionKind Kind = InstructionKind::Imul;
+
+    Imul(std::unique_ptr<Operand> s);
+
+    std::string toString() const override;
+    void emit(std::ostream& os) const override;
+
+    std::unique_ptr<Operand> releaseSrc() { return std::move(src); }
+
+    Operand* getSrc() { return src.get(); }
+    void setSrc(std::unique_ptr<Operand> newSrc) { src = std::move(newSrc); }
+
+    template <typename F>
+    void forEachOperand(F&& f) { f(src, OperandRole::Read); }
+};
+
+/**
+ * @brief `leal (base,index,scale), dst`: dst = base + index * scale, without touching the flags.
+ *
+ * The scale is 1, 2, 4 or 8; base, index and dst must be registers once legalized.
+ */
+class Lea : public Instruction {
+    std::unique_ptr<Operand> base;
+    std::unique_ptr<Operand> index;
+    int scale;
+    std::unique_ptr<Operand> dst;
+public:
+    static constexpr InstructionKind Kind = InstructionKind::Lea;
+
+    Lea(std::unique_ptr<Operand> b, std::unique_ptr<Operand> i, int scale, std::unique_ptr<Operand> d);
+
+    Operand* getBase() const { return base.get(); }
+    Operand* getIndex() const { return index.get(); }
+    int getScale() const { return scale; }
+    Operand* getDst() const { return dst.get(); }
+    std::unique_ptr<Operand> releaseBase() { return std::move(base); }
+    std::unique_ptr<Operand> releaseIndex() { return std::move(index); }
+    std::unique_ptr<Operand> releaseDst() { return std::move(dst); }
+    void setBase(std::unique_ptr<Operand> newBase) { base = std::move(newBase); }
+    void setIndex(std::unique_ptr<Operand> newIndex) { index = std::move(newIndex); }
+    void setDst(std::unique_ptr<Operand> newDst) { dst = std::move(newDst); }
+
+    template <typename F>
+    void forEachOperand(F&& f) { f(base, OperandRole::Read); f(index, OperandRole::Read); f(dst, OperandRole::Write); }
+
+    std::string toString() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Cdq : public Instruction {
 public:
-    Cdq() = default;
+    static constexpr InstructionKind Kind = InstructionKind::Cdq;
+
+    Cdq() : Instruction(Kind) {}
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Jmp : public Instruction {
-    std::string name;
+    Symbol name;
 public:
-    Jmp(std::string str);
+    static constexpr InstructionKind Kind = InstructionKind::Jmp;
+
+    Jmp(Symbol target);
+    Symbol getTarget() const { return name; }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class JmpCC : public Instruction {
     CondNode cond_node;
-    std::string name;
+    Symbol name;
 public:
-    JmpCC(CondNode cn, std::string str);
+    static constexpr InstructionKind Kind = InstructionKind::JmpCC;
+
+    JmpCC(CondNode cn, Symbol target);
+    Symbol getTarget() const { return name; }
+    CondNode getCond() const { return cond_node; }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class SetCC : public Instruction {
     CondNode cond_node;
     std::unique_ptr<Operand> op;
 public:
+    static constexpr InstructionKind Kind = InstructionKind::SetCC;
+
     SetCC(CondNode cn, std::unique_ptr<Operand> o);
 
     Operand* getDst() const { return op.get(); }
@@ -311,36 +545,118 @@ public:
 
     CondNode getCond() const { return cond_node; }
 
+    /**
+     * @brief Only the low byte is written, so the rest of the operand is also read.
+     */
+    template <typename F>
+    void forEachOperand(F&& f) { f(op, OperandRole::ReadWrite); }
+
+    std::string toString() const override;
+    void emit(std::ostream& os) const override;
+};
+
+/**
+ * @brief `cmovCCl src, dst`: dst = src if the condition holds; reads the flags.
+ *
+ * dst must be a register once legalized, and src a register or a stack slot.
+ */
+class Cmov : public Instruction {
+    CondNode cond_node;
+    std::unique_ptr<Operand> src;
+    std::unique_ptr<Operand> dst;
+public:
+    static constexpr InstructionKind Kind = InstructionKind::Cmov;
+
+    Cmov(CondNode cn, std::unique_ptr<Operand> s, std::unique_ptr<Operand> d);
+
+    CondNode getCond() const { return cond_node; }
+    Operand* getSrc() const { return src.get(); }
+    Operand* getDst() const { return dst.get(); }
+    std::unique_ptr<Operand> releaseSrc() { return std::move(src); }
+    std::unique_ptr<Operand> releaseDst() { return std::move(dst); }
+    void setSrc(std::unique_ptr<Operand> newSrc) { src = std::move(newSrc); }
+    void setDst(std::unique_ptr<Operand> newDst) { dst = std::move(newDst); }
+
+    /**
+     * @brief dst keeps its value when the condition fails, so it is also read.
+     */
+    template <typename F>
+    void forEachOperand(F&& f) { f(src, OperandRole::Read); f(dst, OperandRole::ReadWrite); }
+
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Label : public Instruction {
-    std::string name;
+    Symbol name;
 public:
-    Label(std::string id);
+    static constexpr InstructionKind Kind = InstructionKind::Label;
+
+    Label(Symbol id);
+    Symbol getName() const { return name; }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class AllocateStack : public Instruction {
     int value;
 public:
+    static constexpr InstructionKind Kind = InstructionKind::AllocateStack;
+
     explicit AllocateStack(int n);
+    int getValue() const { return value; }
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
 class Ret : public Instruction {
 public:
-    Ret() = default;
+    static constexpr InstructionKind Kind = InstructionKind::Ret;
+
+    Ret() : Instruction(Kind) {}
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
 };
 
+/**
+ * @brief Returns an operand or instruction as a T if its kind tag says it is one, else nullptr.
+ */
+template <typename T, typename Node>
+T* as(Node* node) {
+    return node && node->kind() == T::Kind ? static_cast<T*>(node) : nullptr;
+}
+
+template <typename T, typename Node>
+const T* as(const Node* node) {
+    return node && node->kind() == T::Kind ? static_cast<const T*>(node) : nullptr;
+}
+
+/**
+ * @brief Calls `f(slot, role)` for every explicit operand of an instruction.
+ *
+ * `slot` is the `std::unique_ptr<Operand>&` holding the operand, so a pass can replace
+ * the operand in place. Registers an instruction uses implicitly (AX and DX for Cdq,
+ * Idiv, Imul and Ret) are not visited.
+ */
+template <typename F>
+void forEachOperand(Instruction& instr, F&& f) {
+    switch (instr.kind()) {
+        case InstructionKind::Mov:    static_cast<Mov&>(instr).forEachOperand(f); break;
+        case InstructionKind::Unary:  static_cast<Unary&>(instr).forEachOperand(f); break;
+        case InstructionKind::Binary: static_cast<Binary&>(instr).forEachOperand(f); break;
+        case InstructionKind::Cmp:    static_cast<Cmp&>(instr).forEachOperand(f); break;
+        case InstructionKind::Idiv:   static_cast<Idiv&>(instr).forEachOperand(f); break;
+        case InstructionKind::Imul:   static_cast<Imul&>(instr).forEachOperand(f); break;
+        case InstructionKind::Lea:    static_cast<Lea&>(instr).forEachOperand(f); break;
+        case InstructionKind::SetCC:  static_cast<SetCC&>(instr).forEachOperand(f); break;
+        case InstructionKind::Cmov:   static_cast<Cmov&>(instr).forEachOperand(f); break;
+        default: break;
+    }
+}
+
 /**
  * @brief FunctionDefinition contains a function name and a list of instructions.
  */
@@ -355,7 +671,17 @@ public:
     const std::vector<std::unique_ptr<Instruction>>& getInstructions() const;
 
     std::string toString() const override;
-    std::string toASM() const override;
+
+    /**
+     * @brief Writes the function with the symbol conventions of the host (see hostObjectFormat).
+     */
+    void emit(std::ostream& os) const override;
+
+    /**
+     * @brief Writes the function as assembly.
+     * @param machO Use the Mach-O `_` prefix on the function symbol; ELF uses the plain name
+     */
+    void emit(std::ostream& os, bool machO) const;
 };
 
 /**
@@ -367,18 +693,29 @@ public:
     explicit ASDLProgram(std::unique_ptr<FunctionDefinition> funcDef);
 
     std::string toString() const override;
-    std::string toASM() const override;
+    void emit(std::ostream& os) const override;
+
+    /**
+     * @brief Writes the program as assembly, with Mach-O or ELF symbol names.
+     */
+    void emit(std::ostream& os, bool machO) const;
     FunctionDefinition* getFunctionDefinition() const;
 
 };
 
 /** 
- * @brief convert a tacky program to an ASDL program.
+ * @brief convert a flat tacky program to an ASDL program.
+ *
+ * Virtual registers become Pseudo operands named after the register. Division and
+ * remainder by a constant are strength-reduced to shifts or a multiply-high by a magic
+ * number, and multiplication by a constant to a shift or lea where that is cheaper; the
+ * other divisions use idiv. A CopyIfNotZero becomes a Cmov, testing the flags of the
+ * comparison that computed its condition when nothing else reads that condition.
  *
- * @param program The tacky program.
+ * @param program The flat tacky program.
  * @return The ASDL program.
  */
-ASDLProgram convertTackyToASDL(const tacky::Program& tackyProgram);
+ASDLProgram convertTackyToASDL(const tacky::FlatProgram& tackyProgram);
 
 /**
  * @brief Replaces all Pseudo operands in the ASDL IR with stack-based operands.
@@ -387,6 +724,7 @@ ASDLProgram convertTackyToASDL(const tacky::Program& tackyProgram);
  * with a `Stack` operand representing a memory location on the stack. 
  * Each unique `Pseudo` variable is assigned a unique negative offset from `rbp`, 
  * starting from -4 and decrementing by 4 for each additional temporary variable.
+ * Offsets are kept in a table indexed by the symbol of the pseudo.
  *
  * This transformation is necessary to allocate space for temporaries in the 
  * function's stack frame during code generation.
@@ -427,8 +765,9 @@ void legalizeMovMemoryToMemory(ASDLProgram& program);
  * @brief Write the assembly code generated from the ASDL Program to a file.
  *
  * @param program The ASDL Program node.
+ * @param machO Use Mach-O symbol names (`_main`) rather than ELF ones (`main`).
  * @param filename Output filename.
  */
-void writeASMToFile(const ASDLProgram& program, const std::string& filename);
+void writeASMToFile(const ASDLProgram& program, bool machO, const std::string& filename);
 
 #endif // ASDL_HPP
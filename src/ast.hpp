@@ -1,10 +1,27 @@
+/**
+ * @file ast.hpp
+ * @brief Compact, arena-allocated Abstract Syntax Tree.
+ *
+ * Every node kind is its own class holding only the fields that kind needs, tagged with
+ * its kind enum so that passes can switch on `type` and downcast with `as<T>()`. Nodes
+ * are allocated from the Arena owned by Program and refer to their children through raw
+ * pointers. Names keep their source spelling as a view into the SourceBuffer (for
+ * diagnostics), so the source buffer must outlive the tree, and are identified by their
+ * Symbol: the interned source name after parsing, the unique variable or loop label after
+ * validation. Nodes are never freed one by one: destroying the Program releases the whole
+ * tree at once.
+ */
+
 #ifndef AST_HPP
 #define AST_HPP
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <vector>
 #include "lexer.hpp"
+#include "arena.hpp"
+#include "symbol.hpp"
 
 /**
  * @brief Enum class for expression types.
@@ -79,234 +96,298 @@ enum class ForInitType {
 };
 
 /**
- * @brief Base class for all Abstract Syntax Tree (AST) nodes.
+ * @brief Represents an expression node.
+ *
+ * Base of the expression kinds below; `type` tells which one a node is.
  */
-class ASTNode {
+class Expression {
 public:
-    virtual ~ASTNode() = default;
+    ExpressionType type;
+
+    /**
+     * @brief Downcasts to a concrete expression kind (the kind must match `type`).
+     */
+    template <typename T>
+    T* as() { return static_cast<T*>(this); }
+
+    template <typename T>
+    const T* as() const { return static_cast<const T*>(this); }
+
+protected:
+    explicit Expression(ExpressionType t) : type(t) {}
 };
 
 /**
- * @brief Represents an expression node.
+ * @brief Integer literal.
  */
-class Expression : public ASTNode {
+class ConstantExpression : public Expression {
 public:
-    ExpressionType type;
+    int value;
 
-    // Constant
-    int value = 0;
+    explicit ConstantExpression(int v)
+        : Expression(ExpressionType::CONSTANT), value(v) {}
+};
 
-    // Unary expression
+/**
+ * @brief Unary operator applied to one operand.
+ */
+class UnaryExpression : public Expression {
+public:
     UnaryOpast un_op;
-    std::unique_ptr<Expression> operand;
+    Expression* operand;
 
-    // Binary expression
-    BinaryOpast bin_op;
-    std::unique_ptr<Expression> operand1;
-    std::unique_ptr<Expression> operand2;
-
-    // Variable expression
-    std::string identifier;
-
-    // Assignment expression
-    std::unique_ptr<Expression> exp1;
-    std::unique_ptr<Expression> exp2;
+    UnaryExpression(UnaryOpast unaryOp, Expression* expr)
+        : Expression(ExpressionType::UNARY), un_op(unaryOp), operand(expr) {}
+};
 
-    // Conditional (ternary) expression
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<Expression> trueExpr;
-    std::unique_ptr<Expression> falseExpr;
+/**
+ * @brief Binary operator applied to two operands.
+ */
+class BinaryExpression : public Expression {
+public:
+    BinaryOpast bin_op;
+    Expression* operand1;
+    Expression* operand2;
 
-    // Constructors
-    Expression(int v)
-        : type(ExpressionType::CONSTANT), value(v) {}
+    BinaryExpression(BinaryOpast binaryOp, Expression* lhs, Expression* rhs)
+        : Expression(ExpressionType::BINARY), bin_op(binaryOp), operand1(lhs), operand2(rhs) {}
+};
 
-    Expression(UnaryOpast unaryOp, std::unique_ptr<Expression> expr)
-        : type(ExpressionType::UNARY), un_op(unaryOp), operand(std::move(expr)) {}
+/**
+ * @brief Reference to a variable.
+ */
+class VarExpression : public Expression {
+public:
+    std::string_view identifier;
+    Symbol symbol;   // source name; the unique variable name once validated
 
-    Expression(BinaryOpast binaryOp, std::unique_ptr<Expression> lhs, std::unique_ptr<Expression> rhs)
-        : type(ExpressionType::BINARY), bin_op(binaryOp), operand1(std::move(lhs)), operand2(std::move(rhs)) {}
+    VarExpression(std::string_view id, Symbol sym)
+        : Expression(ExpressionType::VAR), identifier(id), symbol(sym) {}
+};
 
-    Expression(std::string id)
-        : type(ExpressionType::VAR), identifier(std::move(id)) {}
+/**
+ * @brief Assignment `exp1 = exp2`.
+ */
+class AssignmentExpression : public Expression {
+public:
+    Expression* exp1;
+    Expression* exp2;
 
-    Expression(std::unique_ptr<Expression> lhs, std::unique_ptr<Expression> rhs)
-        : type(ExpressionType::ASSIGNMENT), exp1(std::move(lhs)), exp2(std::move(rhs)) {}
+    AssignmentExpression(Expression* lhs, Expression* rhs)
+        : Expression(ExpressionType::ASSIGNMENT), exp1(lhs), exp2(rhs) {}
+};
 
-    Expression(std::unique_ptr<Expression> cond,
-               std::unique_ptr<Expression> tExpr,
-               std::unique_ptr<Expression> fExpr)
-        : type(ExpressionType::CONDITIONAL),
-          condition(std::move(cond)),
-          trueExpr(std::move(tExpr)),
-          falseExpr(std::move(fExpr)) {}
+/**
+ * @brief Conditional (ternary) expression `condition ? trueExpr : falseExpr`.
+ */
+class ConditionalExpression : public Expression {
+public:
+    Expression* condition;
+    Expression* trueExpr;
+    Expression* falseExpr;
+
+    ConditionalExpression(Expression* cond, Expression* tExpr, Expression* fExpr)
+        : Expression(ExpressionType::CONDITIONAL),
+          condition(cond),
+          trueExpr(tExpr),
+          falseExpr(fExpr) {}
 };
 
 /**
  * @brief Represents a variable declaration (optionally with initializer).
  */
-class Declaration : public ASTNode {
+class Declaration {
 public:
-    std::string name;
-    std::unique_ptr<Expression> initializer;
+    std::string_view name;
+    Expression* initializer;
+    Symbol symbol;   // source name; the unique variable name once validated
 
-    Declaration(const std::string& id, std::unique_ptr<Expression> init = nullptr)
-        : name(id), initializer(std::move(init)) {}
+    Declaration(std::string_view id, Symbol sym, Expression* init = nullptr)
+        : name(id), initializer(init), symbol(sym) {}
 };
 
 /** 
  * @brief Represents a For Init node. 
  */
-class ForInit : public ASTNode {
+class ForInit {
 public:
     ForInitType type;
-    std::unique_ptr<Declaration> decl;
-    std::unique_ptr<Expression> expr;
+    Declaration* decl = nullptr;
+    Expression* expr = nullptr;   // may be null for an empty init clause
 
-    void setExpression(std::unique_ptr<Expression> e) { expr = std::move(e); }
+    explicit ForInit(Declaration* d) 
+        : type(ForInitType::INIT_DECL), decl(d) {}
     
-    ForInit(std::unique_ptr<Declaration> d) 
-        : type(ForInitType::INIT_DECL), decl(std::move(d)) {}
-    
-    ForInit(std::unique_ptr<Expression> e)
-        : type(ForInitType::INIT_EXP), expr(std::move(e)) {}
+    explicit ForInit(Expression* e)
+        : type(ForInitType::INIT_EXP), expr(e) {}
 };
 
 class Block;
 
 /**
- * @brief Represents a statement node (return, expression, null, if, or compound).
+ * @brief Represents a statement node.
+ *
+ * Base of the statement kinds below; `type` tells which one a node is.
  */
-class Statement : public ASTNode {
+class Statement {
 public:
     StatementType type;
 
-    // Optional label
-    std::string label;
-
-    // For return or expression statements
-    std::unique_ptr<Expression> expression;
-
-    // For if / while / etc.
-    std::unique_ptr<Expression> condition;
-
-    // For loop bodies and condition branches
-    std::unique_ptr<Statement> thenBranch;
-    std::unique_ptr<Statement> elseBranch;  // used for IF
-    std::unique_ptr<Statement> body;        // used for loops
-
-    // For compound statements
-    std::unique_ptr<Block> block;
-
-    // For 'for' loops
-    std::unique_ptr<ForInit> forInit;
-    std::unique_ptr<Expression> postExpr;
-
-    // Constructors
-    Statement(std::unique_ptr<Expression> expr, StatementType type)
-        : type(type), expression(std::move(expr)) {}
-
-    Statement(StatementType type)
-        : type(type) {}
-
-    Statement(std::unique_ptr<Block> b)
-        : type(StatementType::COMPOUND), block(std::move(b)) {}
-
-    Statement(std::unique_ptr<Expression> cond,
-              std::unique_ptr<Statement> thenStmt,
-              std::unique_ptr<Statement> elseStmt = nullptr)
-        : type(StatementType::IF),
-          condition(std::move(cond)),
-          thenBranch(std::move(thenStmt)),
-          elseBranch(std::move(elseStmt)) {}
-
-    // WHILE and DO_WHILE: while (cond) body;
-    Statement(std::unique_ptr<Expression> cond,
-              std::unique_ptr<Statement> bodyStmt,
-              StatementType t,
-              const std::string& lbl = "")
-        : type(t),
-          label(lbl),
-          condition(std::move(cond)),
-          body(std::move(bodyStmt)) {}
-
-    // FOR: for (init; cond; post) body;
-    Statement(std::unique_ptr<ForInit> init,
-              std::unique_ptr<Expression> cond,
-              std::unique_ptr<Expression> post,
-              std::unique_ptr<Statement> bodyStmt,
-              const std::string& lbl = "")
-        : type(StatementType::FOR),
-          label(lbl),
-          forInit(std::move(init)),
-          condition(std::move(cond)),
-          postExpr(std::move(post)),
-          body(std::move(bodyStmt)) {}
-
-    // BREAK and CONTINUE
-    static std::unique_ptr<Statement> makeBreak(const std::string& lbl = "") {
-        auto stmt = std::make_unique<Statement>(StatementType::BREAK);
-        stmt->label = lbl;
-        return stmt;
-    }
-
-    static std::unique_ptr<Statement> makeContinue(const std::string& lbl = "") {
-        auto stmt = std::make_unique<Statement>(StatementType::CONTINUE);
-        stmt->label = lbl;
-        return stmt;
-    }
+    /**
+     * @brief Downcasts to a concrete statement kind (the kind must match `type`).
+     */
+    template <typename T>
+    T* as() { return static_cast<T*>(this); }
+
+    template <typename T>
+    const T* as() const { return static_cast<const T*>(this); }
+
+protected:
+    explicit Statement(StatementType t) : type(t) {}
+};
+
+/**
+ * @brief RETURN and EXPRESSION statements.
+ */
+class ExpressionStatement : public Statement {
+public:
+    Expression* expression;
+
+    ExpressionStatement(Expression* expr, StatementType type)
+        : Statement(type), expression(expr) {}
+};
+
+/**
+ * @brief The empty statement `;`.
+ */
+class NullStatement : public Statement {
+public:
+    NullStatement() : Statement(StatementType::NULL_STMT) {}
+};
+
+/**
+ * @brief IF statement with optional else branch.
+ */
+class IfStatement : public Statement {
+public:
+    Expression* condition;
+    Statement* thenBranch;
+    Statement* elseBranch;  // null when there is no else
+
+    IfStatement(Expression* cond, Statement* thenStmt, Statement* elseStmt = nullptr)
+        : Statement(StatementType::IF),
+          condition(cond),
+          thenBranch(thenStmt),
+          elseBranch(elseStmt) {}
+};
+
+/**
+ * @brief Compound statement (nested block).
+ */
+class CompoundStatement : public Statement {
+public:
+    Block* block;
+
+    explicit CompoundStatement(Block* b)
+        : Statement(StatementType::COMPOUND), block(b) {}
 };
 
+/**
+ * @brief BREAK and CONTINUE; label names the enclosing loop once resolved.
+ */
+class LoopControlStatement : public Statement {
+public:
+    Symbol label;
+
+    explicit LoopControlStatement(StatementType type, Symbol lbl = NoSymbol)
+        : Statement(type), label(lbl) {}
+};
+
+/**
+ * @brief WHILE and DO_WHILE: while (cond) body;
+ */
+class WhileStatement : public Statement {
+public:
+    Expression* condition;
+    Statement* body;
+    Symbol label;
+
+    WhileStatement(Expression* cond, Statement* bodyStmt, StatementType t, Symbol lbl = NoSymbol)
+        : Statement(t), condition(cond), body(bodyStmt), label(lbl) {}
+};
+
+/**
+ * @brief FOR: for (init; cond; post) body;
+ */
+class ForStatement : public Statement {
+public:
+    ForInit* forInit;
+    Expression* condition;  // null when omitted
+    Expression* postExpr;   // null when omitted
+    Statement* body;
+    Symbol label;
+
+    ForStatement(ForInit* init, Expression* cond, Expression* post, Statement* bodyStmt,
+                 Symbol lbl = NoSymbol)
+        : Statement(StatementType::FOR),
+          forInit(init),
+          condition(cond),
+          postExpr(post),
+          body(bodyStmt),
+          label(lbl) {}
+};
 
 /**
  * @brief Represents a block item: either a statement or a declaration.
  */
-class BlockItem : public ASTNode {
+class BlockItem {
 public:
     BlockItemType type;
 
-    std::unique_ptr<Statement> statement;
-    std::unique_ptr<Declaration> declaration;
+    union {
+        Statement* statement;
+        Declaration* declaration;
+    };
 
-    BlockItem(std::unique_ptr<Statement> stmt)
-        : type(BlockItemType::STATEMENT), statement(std::move(stmt)) {}
+    explicit BlockItem(Statement* stmt)
+        : type(BlockItemType::STATEMENT), statement(stmt) {}
 
-    BlockItem(std::unique_ptr<Declaration> decl)
-        : type(BlockItemType::DECLARATION), declaration(std::move(decl)) {}
+    explicit BlockItem(Declaration* decl)
+        : type(BlockItemType::DECLARATION), declaration(decl) {}
 };
 
 /**
  * @brief Represents a compound block of code containing multiple block items.
  */
-class Block : public ASTNode {
+class Block {
 public:
-    std::vector<std::unique_ptr<BlockItem>> items;
+    ArenaArray<BlockItem> items;
 
-    Block(std::vector<std::unique_ptr<BlockItem>>&& items)
-        : items(std::move(items)) {}
+    explicit Block(ArenaArray<BlockItem> items)
+        : items(items) {}
 };
 
 /**
  * @brief Represents a function definition.
  */
-class Function : public ASTNode {
+class Function {
 public:
-    std::string name;
-    std::unique_ptr<Block> body;
+    std::string_view name;
+    Block* body;
 
-    Function(const std::string& id, std::unique_ptr<Block> b)
-        : name(id), body(std::move(b)) {}
+    Function(std::string_view id, Block* b)
+        : name(id), body(b) {}
 };
 
 /**
  * @brief Represents the root program node (entry point).
+ *
+ * Owns the arena every other node of the tree is allocated from.
  */
-class Program : public ASTNode {
+class Program {
 public:
-    std::unique_ptr<Function> function;
-
-    Program(std::unique_ptr<Function> func)
-        : function(std::move(func)) {}
+    Arena arena;
+    Function* function = nullptr;
 };
 
 #endif // AST_HPP
@@ -0,0 +1,116 @@
+/**
+ * @file cache.cpp
+ * @brief Implementation of the compilation cache.
+ */
+
+#include "cache.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+const char* const CompilerVersion = "athos-cc 1 (" __DATE__ " " __TIME__ ")";
+
+uint64_t fnv1a(std::string_view data, uint64_t hash) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// --- Files ---
+
+void writeFileAtomically(const std::string& path, std::string_view contents, bool executable) {
+    // A random suffix keeps writers in other threads and processes off this temporary
+    static thread_local std::mt19937_64 random(std::random_device{}());
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".tmp%016llx", static_cast<unsigned long long>(random()));
+    const std::string temporary = path + suffix;
+
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + temporary);
+    }
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    file.close();
+
+    std::error_code error;
+    if (file && executable) {
+        fs::permissions(temporary, fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec,
+                        fs::perm_options::add, error);
+    }
+    if (file && !error) {
+        fs::rename(temporary, path, error);
+    }
+    if (!file || error) {
+        fs::remove(temporary, error);
+        throw std::runtime_error("Failed to write output file: " + path);
+    }
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    if (file.bad()) return false;
+    contents = buffer.str();
+    return true;
+}
+
+// --- CompileCache ---
+
+CompileCache::CompileCache(std::string dir) : directory(std::move(dir)) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error || !fs::is_directory(directory)) {
+        throw std::runtime_error("Failed to create cache directory: " + directory);
+    }
+}
+
+std::string CompileCache::entryPath(uint64_t key) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory + "/" + name;
+}
+
+bool CompileCache::lookup(uint64_t key, std::string& diagnostics, std::string& result) {
+    // An entry is "<size of diagnostics>\n", the diagnostics, then the result
+    std::string entry;
+    size_t newline = std::string::npos;
+    size_t diagnosticsSize = 0;
+    if (readFile(entryPath(key), entry) && (newline = entry.find('\n')) != std::string::npos) {
+        diagnosticsSize = std::strtoull(entry.c_str(), nullptr, 10);
+    }
+    if (newline == std::string::npos || diagnosticsSize > entry.size() - newline - 1) {
+        ++missCount;
+        return false;
+    }
+
+    diagnostics = entry.substr(newline + 1, diagnosticsSize);
+    result = entry.substr(newline + 1 + diagnosticsSize);
+    ++hitCount;
+    return true;
+}
+
+void CompileCache::store(uint64_t key, std::string_view diagnostics, std::string_view result) {
+    std::string entry = std::to_string(diagnostics.size()) + "\n";
+    entry.append(diagnostics);
+    entry.append(result);
+    try {
+        writeFileAtomically(entryPath(key), entry);
+    } catch (const std::runtime_error&) {
+        // The next compilation of this source will simply miss again
+    }
+}
+
+void CompileCache::printStats(std::ostream& os) const {
+    os << "cache " << directory << ": " << hits() << " hits, " << misses() << " misses\n";
+}
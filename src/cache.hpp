@@ -0,0 +1,94 @@
+/**
+ * @file cache.hpp
+ * @brief Content-addressed cache of compilation results (--cache-dir).
+ *
+ * An entry is named after a hash of everything its result depends on: the compiler
+ * version, the options that change the output and the bytes of the source. An unchanged
+ * file compiled again with the same settings then hits the cache whatever its path.
+ *
+ * Entries are written to a temporary file and renamed into place, so several threads or
+ * processes can share one directory: a reader sees a complete entry or none, and two
+ * writers of the same entry write the same bytes.
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Offset basis of the 64-bit FNV-1a hash.
+ */
+constexpr uint64_t FnvOffsetBasis = 14695981039346656037ull;
+
+/**
+ * @brief Continues a 64-bit FNV-1a hash over `data`.
+ */
+uint64_t fnv1a(std::string_view data, uint64_t hash = FnvOffsetBasis);
+
+/**
+ * @brief Version of the compiler, hashed into every cache key.
+ *
+ * Includes the build time, so a rebuilt compiler does not reuse the results of an old one.
+ */
+extern const char* const CompilerVersion;
+
+/**
+ * @brief Writes a file by renaming a complete temporary copy over it.
+ * @param executable Make the file executable (for linked programs).
+ * @throws std::runtime_error If the file cannot be written.
+ */
+void writeFileAtomically(const std::string& path, std::string_view contents, bool executable = false);
+
+/**
+ * @brief Reads a whole file.
+ * @return False if the file cannot be read.
+ */
+bool readFile(const std::string& path, std::string& contents);
+
+/**
+ * @brief A directory of cached results, shared by every compilation of an invocation.
+ *
+ * An entry holds what a compilation wrote to its error stream (e.g. peephole statistics)
+ * and its result: the printed assembly for --codegen, the executable or object file for
+ * --compile. Methods are safe to call from several threads.
+ */
+class CompileCache {
+    std::string directory;
+    std::atomic<unsigned> hitCount{0};
+    std::atomic<unsigned> missCount{0};
+
+    std::string entryPath(uint64_t key) const;
+
+public:
+    /**
+     * @brief Opens a cache directory, creating it if needed.
+     * @throws std::runtime_error If the directory cannot be created.
+     */
+    explicit CompileCache(std::string directory);
+
+    /**
+     * @brief Reads the entry of `key`, and counts a hit or a miss.
+     * @return False if there is no such entry.
+     */
+    bool lookup(uint64_t key, std::string& diagnostics, std::string& result);
+
+    /**
+     * @brief Adds the entry of `key`. Failing to write it only loses the entry.
+     */
+    void store(uint64_t key, std::string_view diagnostics, std::string_view result);
+
+    unsigned hits() const { return hitCount; }
+    unsigned misses() const { return missCount; }
+
+    /**
+     * @brief Prints the hit and miss counters.
+     */
+    void printStats(std::ostream& os) const;
+};
+
+#endif // CACHE_HPP
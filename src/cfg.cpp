@@ -0,0 +1,207 @@
+/**
+ * @file cfg.cpp
+ * @brief Construction and linearization of control-flow graphs.
+ */
+
+#include "cfg.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tacky {
+
+static bool isJump(Opcode op) {
+    return op == Opcode::Jump || isConditionalJump(op);
+}
+
+const Instr* BasicBlock::terminator() const {
+    if (code.empty()) return nullptr;
+    const Instr& last = code.back();
+    return isJump(last.op) || last.op == Opcode::Return ? &last : nullptr;
+}
+
+ControlFlowGraph ControlFlowGraph::build(const FlatFunction& fn) {
+    ControlFlowGraph cfg;
+    cfg.labelBlocks.assign(symbols().size(), -1);
+    cfg.blocks.emplace_back();
+    bool closed = false;  // the current block ended with a jump or return
+
+    for (const Instr& instr : fn.code) {
+        BasicBlock* current = &cfg.blocks.back();
+        if (instr.op == Opcode::Label) {
+            if (closed || !current->code.empty() || current->label != NoSymbol) {
+                cfg.blocks.emplace_back();
+                current = &cfg.blocks.back();
+            }
+            current->label = instr.label;
+            cfg.labelBlocks[instr.label] = static_cast<int>(cfg.blocks.size() - 1);
+            closed = false;
+            continue;
+        }
+        if (closed) {
+            cfg.blocks.emplace_back();
+            current = &cfg.blocks.back();
+            closed = false;
+        }
+        current->code.push_back(instr);
+        closed = isJump(instr.op) || instr.op == Opcode::Return;
+    }
+
+    for (size_t i = 0; i + 1 < cfg.blocks.size(); ++i) {
+        const Instr* last = cfg.blocks[i].terminator();
+        if (!last || isConditionalJump(last->op)) {
+            cfg.blocks[i].fallthrough = static_cast<int>(i + 1);
+        }
+    }
+
+    cfg.computeEdges();
+    return cfg;
+}
+
+std::vector<int> ControlFlowGraph::insertBlocks(const std::vector<Insertion>& insertions) {
+    std::vector<BasicBlock> moved;
+    moved.reserve(blocks.size() + insertions.size());
+    std::vector<int> renumbered(blocks.size());
+    std::vector<int> inserted(insertions.size());
+    std::vector<int> enteredThrough(blocks.size() + insertions.size(), -1);  // new block taking the fallthrough
+
+    size_t next = 0;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (next < insertions.size() && insertions[next].position == static_cast<int>(i)) {
+            inserted[next] = static_cast<int>(moved.size());
+            moved.emplace_back();
+            moved.back().label = insertions[next].label;
+            if (insertions[next].takeFallthrough) enteredThrough[moved.size()] = inserted[next];
+            ++next;
+        }
+        renumbered[i] = static_cast<int>(moved.size());
+        moved.push_back(std::move(blocks[i]));
+    }
+    blocks = std::move(moved);
+
+    for (size_t i = 0; i < renumbered.size(); ++i) {
+        BasicBlock& block = blocks[renumbered[i]];
+        if (block.fallthrough < 0) continue;
+        block.fallthrough = renumbered[block.fallthrough];
+        if (enteredThrough[block.fallthrough] >= 0) block.fallthrough = enteredThrough[block.fallthrough];
+    }
+    for (int block : inserted) blocks[block].fallthrough = block + 1;
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        Symbol label = blocks[i].label;
+        if (label == NoSymbol) continue;
+        if (label >= labelBlocks.size()) labelBlocks.resize(label + 1, -1);
+        labelBlocks[label] = static_cast<int>(i);
+    }
+    return inserted;
+}
+
+void ControlFlowGraph::computeEdges() {
+    for (BasicBlock& block : blocks) {
+        block.succs.clear();
+        block.preds.clear();
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        BasicBlock& block = blocks[i];
+        if (block.removed) continue;
+
+        auto addEdge = [&](int target) {
+            if (target < 0) {
+                throw std::runtime_error("Jump to a label outside the function");
+            }
+            if (std::find(block.succs.begin(), block.succs.end(), target) == block.succs.end()) {
+                block.succs.push_back(target);
+                blocks[target].preds.push_back(static_cast<int>(i));
+            }
+        };
+
+        const Instr* last = block.terminator();
+        if (last && isJump(last->op)) {
+            addEdge(blockOf(last->label));
+        }
+        if (!last || (last->op != Opcode::Jump && last->op != Opcode::Return)) {
+            if (block.fallthrough >= 0) addEdge(block.fallthrough);
+        }
+    }
+}
+
+std::vector<int> ControlFlowGraph::reversePostorder() const {
+    std::vector<int> order;
+    if (blocks.empty()) return order;
+
+    std::vector<char> visited(blocks.size(), 0);
+    std::vector<std::pair<int, size_t>> stack;  // block, next successor to visit
+    stack.push_back({0, 0});
+    visited[0] = 1;
+
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < blocks[block].succs.size()) {
+            int succ = blocks[block].succs[next++];
+            if (!visited[succ]) {
+                visited[succ] = 1;
+                stack.push_back({succ, 0});
+            }
+        } else {
+            order.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+void ControlFlowGraph::linearize(FlatFunction& fn) const {
+    std::vector<std::vector<Instr>> finalCode(blocks.size());
+    std::vector<char> referenced(labelBlocks.size(), 0);
+
+    auto nextLive = [&](size_t i) {
+        for (size_t j = i + 1; j < blocks.size(); ++j) {
+            if (!blocks[j].removed) return static_cast<int>(j);
+        }
+        return -1;
+    };
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const BasicBlock& block = blocks[i];
+        if (block.removed) continue;
+        int next = nextLive(i);
+        std::vector<Instr>& code = finalCode[i];
+        code = block.code;
+
+        // A jump to the block that follows anyway is not needed
+        const Instr* last = block.terminator();
+        if (last && isJump(last->op) && blockOf(last->label) == next &&
+            (last->op == Opcode::Jump || block.fallthrough == next)) {
+            code.pop_back();
+            last = nullptr;
+        }
+
+        bool fallsOff = !last || isConditionalJump(last->op);
+        if (fallsOff && block.fallthrough >= 0 && block.fallthrough != next) {
+            Symbol target = blocks[block.fallthrough].label;
+            if (target == NoSymbol) {
+                throw std::runtime_error("Cannot jump to a block without a label");
+            }
+            code.push_back(Instr::jump(target));
+        }
+
+        for (const Instr& instr : code) {
+            if (isJump(instr.op)) referenced[instr.label] = 1;
+        }
+    }
+
+    fn.code.clear();
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const BasicBlock& block = blocks[i];
+        if (block.removed) continue;
+        if (block.label != NoSymbol && referenced[block.label]) {
+            fn.code.push_back(Instr::labelAt(block.label));
+        }
+        fn.code.insert(fn.code.end(), finalCode[i].begin(), finalCode[i].end());
+    }
+}
+
+} // namespace tacky
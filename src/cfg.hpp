@@ -0,0 +1,100 @@
+/**
+ * @file cfg.hpp
+ * @brief Control-flow graph over flat TACKY functions.
+ *
+ * A function is split into basic blocks: straight-line runs of instructions that are
+ * only entered at the top (through their label or by falling into them) and only left
+ * at the bottom. Passes edit the blocks and then write them back to the function with
+ * linearize(), which also drops jumps to the next block and labels nothing jumps to.
+ */
+
+#ifndef CFG_HPP
+#define CFG_HPP
+
+#include <vector>
+
+#include "tacky.hpp"
+
+namespace tacky {
+
+/**
+ * @brief A basic block of a FlatFunction.
+ */
+struct BasicBlock {
+    Symbol label = NoSymbol;   ///< Label starting the block, if any
+    std::vector<Instr> code;   ///< Instructions after the label; jumps only come last
+    int fallthrough = -1;      ///< Block reached by falling off the end, or -1
+    std::vector<int> succs;    ///< Successor blocks
+    std::vector<int> preds;    ///< Predecessor blocks
+    bool removed = false;      ///< Set by passes; removed blocks are skipped by linearize()
+
+    /**
+     * @brief Returns the last instruction if it is a jump or a return, else nullptr.
+     */
+    const Instr* terminator() const;
+};
+
+/**
+ * @brief The basic blocks of a function, in program order; block 0 is the entry.
+ */
+class ControlFlowGraph {
+    std::vector<int> labelBlocks;  ///< Block of each label, indexed by symbol
+
+public:
+    std::vector<BasicBlock> blocks;
+
+    /**
+     * @brief Splits a function into basic blocks and computes the edges.
+     */
+    static ControlFlowGraph build(const FlatFunction& fn);
+
+    /**
+     * @brief Returns the block starting with a label, or -1.
+     */
+    int blockOf(Symbol label) const {
+        return label < labelBlocks.size() ? labelBlocks[label] : -1;
+    }
+
+    /**
+     * @brief An empty block to insert with insertBlocks().
+     */
+    struct Insertion {
+        int position;          ///< Block it goes before, numbered as before any insertion
+        Symbol label;          ///< Label the new block starts with
+        bool takeFallthrough;  ///< The block falling into `position` falls into the new one instead
+    };
+
+    /**
+     * @brief Inserts empty blocks, each before its block `position`.
+     *
+     * The blocks are renumbered once for all the insertions; each new block falls through
+     * into the one it was inserted before. Jumps keep their targets. Edges are not
+     * updated: call computeEdges() afterwards.
+     *
+     * @param insertions Sorted by position, with one insertion at most per position.
+     * @return The index of each new block.
+     */
+    std::vector<int> insertBlocks(const std::vector<Insertion>& insertions);
+
+    /**
+     * @brief Recomputes successors and predecessors of the blocks that are not removed.
+     */
+    void computeEdges();
+
+    /**
+     * @brief Returns the blocks reachable from the entry in reverse postorder.
+     */
+    std::vector<int> reversePostorder() const;
+
+    /**
+     * @brief Writes the remaining blocks back to the function, in order.
+     *
+     * A block must fall through only into the next remaining block, unless that block
+     * has a label, in which case a Jump is inserted.
+     */
+    void linearize(FlatFunction& fn) const;
+};
+
+} // namespace tacky
+
+#endif // CFG_HPP
@@ -1,17 +1,19 @@
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <cstdlib>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
 
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "ast.hpp"
-#include "asdl.hpp"
-#include "tacky.hpp"
-#include "lowerer.hpp"
-#include "validate.hpp"
+#include "driver.hpp"
+#include "cache.hpp"
+#include "peephole.hpp"
 
 
 void print_help() {
@@ -22,140 +24,359 @@ void print_help() {
     std::cout << "  ./compiler --tacky <source_file>    # Lower to TACKY intermediate code and print\n";
     std::cout << "  ./compiler --codegen <source_file>  # Generate assembly from parsed AST\n";
     std::cout << "  ./compiler <source_file>            # Compile and link (default behavior)\n";
+    std::cout << "  ./compiler -c <source_file>         # Compile to an object file without linking\n";
+    std::cout << "  ./compiler --run <source_file>      # Compile in memory, run main and exit with its status\n";
+    std::cout << "  ./compiler --server [options]       # Answer compile requests read from stdin\n";
     std::cout << "  ./compiler --help                   # Show this help message\n";
+    std::cout << "\nSeveral source files can be given to --tacky, --codegen and compilation;\n";
+    std::cout << "each one gets its own outputs, named after it (example.c gives example.o, example).\n";
+    std::cout << "\nOptions:\n";
+    std::cout << "  -o <path>                           # Name of the executable, object file or printed output\n";
+    std::cout << "  --jobs <n>                          # Compile up to n files at the same time\n";
+    std::cout << "  --time-passes[=json]                # Print the wall and CPU time of each phase and peak RSS\n";
+    std::cout << "  --stats[=json]                      # Print token, node, instruction and byte counts\n";
+    std::cout << "  --cache-dir <dir>                   # Reuse the results of earlier --codegen and compile runs\n";
+    std::cout << "  --target=<arch>                     # Generate code for x86_64 or aarch64 (default: host)\n";
+    std::cout << "  -O0                                 # No optimization (default)\n";
+    std::cout << "  -O1                                 # Optimize the TACKY IR and allocate registers\n";
+    std::cout << "  -fshare-stack-slots                 # At -O0, let pseudos with disjoint lifetimes share a slot\n";
+    std::cout << "  -fno-peephole=<rule>                # Turn off one peephole rule (used at -O1)\n";
+    std::cout << "  -fpeephole-stats                    # Print how often each peephole rule fired\n";
+    std::cout << "  -fno-integrated-as                  # Write <name>.s and let clang assemble it\n";
+    std::cout << "\nA --server request is one line of the arguments above naming one source file;\n";
+    std::cout << "with --source-length=<n>, the n bytes after the line are the source itself.\n";
+    std::cout << "Each response is 'status=<s> stdout=<n> stderr=<m>' followed by both outputs.\n";
+    std::cout << "\nRegister allocation, the peephole optimizer, the integrated assembler and --run are\n";
+    std::cout << "x86_64 only; aarch64 code keeps every value in a stack slot and goes through <name>.s.\n";
 }
 
-int main(int argc, char* argv[]) {
-    std::string filepath;
-    std::string mode;
-
-    if (argc == 2) {
-        if (std::string(argv[1]) == "--help") {
-            print_help();
-            return 0;
-        }
-        mode = "--compile";
-        filepath = argv[1];
-    } else if (argc == 3) {
-        mode = argv[1];
-        filepath = argv[2];
-    } else {
-        print_help();
-        return 1;
+/**
+ * @brief Reads the value of an option given as `--name=value` or `--name value`.
+ * @return False if the option has no value.
+ */
+bool optionValue(const std::string& arg, const std::string& name, size_t& i, const std::vector<std::string>& args,
+                 std::string& value) {
+    if (arg.size() > name.size() && arg[name.size()] == '=') {
+        value = arg.substr(name.size() + 1);
+        return true;
     }
+    if (arg == name && i + 1 < args.size()) {
+        value = args[++i];
+        return true;
+    }
+    return false;
+}
 
-    try {
-        if (mode == "--lex") {
-            std::cout << "Running lexer on: " << filepath << "\n";
-            auto lex = lexer(filepath, /*verbose=*/true);
-            if (lex.empty()) {
-                std::cerr << "Lexer returned no tokens.\n";
-                return 1;
-            }
+/**
+ * @brief Reads a positive integer option value.
+ * @return False if `value` is not a positive integer.
+ */
+bool parseCount(const std::string& value, long& n) {
+    char* end = nullptr;
+    n = std::strtol(value.c_str(), &end, 10);
+    return !value.empty() && *end == '\0' && n >= 1;
+}
 
-        } else if (mode == "--parse") {
-            std::cout << "Running lexer and parser on: " << filepath << "\n";
-            auto lex = lexer(filepath, /*verbose=*/false);
-            Parser parser(lex, /*verbose=*/true);
-            parser.parseProgram();
-            std::cout << "Parsing completed successfully.\n";
+/**
+ * @brief What one command line (or one --server request) asks for.
+ */
+struct Invocation {
+    CompileOptions options;
+    std::vector<std::string> files;
+    unsigned jobs = 1;
+    bool help = false;
+    bool server = false;
+    size_t sourceLength = 0;  ///< --source-length: size of the inline source of a request
+};
 
-        } else if (mode == "--validate") {
-            std::cout << "Running semantic validation on: " << filepath << "\n";
+/**
+ * @brief Parses command-line arguments into `invocation`, on top of what it already holds.
+ * @return False after printing the error to `err` if an argument is invalid.
+ */
+bool parseArguments(const std::vector<std::string>& args, Invocation& invocation, std::ostream& err) {
+    CompileOptions& options = invocation.options;
+    bool modeSet = false;
 
-            auto lex = lexer(filepath, /*verbose=*/false);
-            Parser parser(lex, /*verbose=*/false);
-            auto program = parser.parseProgram();
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        std::string value;
+        long n = 0;
+        if (arg == "--help") {
+            invocation.help = true;
+        } else if (arg == "--server") {
+            invocation.server = true;
+        } else if (arg == "-O0" || arg == "-O1") {
+            options.optLevel = arg[2] - '0';
+        } else if (arg == "-fshare-stack-slots") {
+            options.shareStackSlots = true;
+        } else if (arg == "-fpeephole-stats") {
+            options.peepholeStats = true;
+        } else if (arg == "-c") {
+            options.objectOnly = true;
+        } else if (arg == "-fno-integrated-as") {
+            options.integratedAs = false;
+        } else if (arg == "-o") {
+            if (i + 1 >= args.size()) {
+                err << "Missing path after -o\n";
+                return false;
+            }
+            options.output = args[++i];
+        } else if (arg.rfind("-fno-peephole=", 0) == 0) {
+            if (!PeepholeOptimizer().disableRule(arg.substr(14))) {
+                err << "Unknown peephole rule: " << arg.substr(14) << "\n";
+                return false;
+            }
+            options.disabledPeepholeRules.push_back(arg.substr(14));
+        } else if (arg.rfind("--target", 0) == 0) {
+            optionValue(arg, "--target", i, args, value);
+            if (!parseTarget(value, options.target)) {
+                err << "Unknown target: " << value << "\n";
+                return false;
+            }
+        } else if (arg.rfind("--jobs", 0) == 0) {
+            optionValue(arg, "--jobs", i, args, value);
+            if (!parseCount(value, n)) {
+                err << "Invalid number of jobs: " << value << "\n";
+                return false;
+            }
+            invocation.jobs = static_cast<unsigned>(n);
+        } else if (arg == "--time-passes" || arg == "--time-passes=json") {
+            options.timePasses = true;
+            options.reportJson = options.reportJson || arg.size() > 13;
+        } else if (arg == "--stats" || arg == "--stats=json") {
+            options.stats = true;
+            options.reportJson = options.reportJson || arg.size() > 7;
+        } else if (arg.rfind("--cache-dir", 0) == 0) {
+            if (!optionValue(arg, "--cache-dir", i, args, value) || value.empty()) {
+                err << "Missing directory after --cache-dir\n";
+                return false;
+            }
+            options.cacheDir = value;
+        } else if (arg.rfind("--source-length", 0) == 0) {
+            optionValue(arg, "--source-length", i, args, value);
+            if (value != "0" && !parseCount(value, n)) {
+                err << "Invalid source length: " << value << "\n";
+                return false;
+            }
+            invocation.sourceLength = static_cast<size_t>(n);
+        } else if (arg.rfind("--", 0) == 0 && !modeSet) {
+            options.mode = arg;
+            modeSet = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            invocation.files.push_back(arg);
+        } else {
+            err << "Unexpected argument: " << arg << "\n";
+            return false;
+        }
+    }
 
-            validate_verbose = true;
+    if (options.mode != "--lex" && options.mode != "--parse" && options.mode != "--validate" &&
+        options.mode != "--tacky" && options.mode != "--codegen" && options.mode != "--compile" &&
+        options.mode != "--run") {
+        err << "Unknown option: " << options.mode << "\n";
+        return false;
+    }
+    return true;
+}
 
-            resolve_program(program.get());
+/**
+ * @brief Compiles several files on `jobs` worker threads.
+ *
+ * The output of each file is buffered and printed in the order of the files, as soon as
+ * the files before it are done.
+ *
+ * @return 0 if every file compiled, 1 otherwise.
+ */
+int compileFiles(const CompileOptions& options, const std::vector<std::string>& files, unsigned jobs) {
+    struct Result {
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 0;
+        bool done = false;
+    };
+    std::vector<Result> results(files.size());
+    std::atomic<size_t> next{0};
+    std::mutex printMutex;
+    size_t nextToPrint = 0;
+    int status = 0;
 
-            std::cout << "Semantic validation completed successfully.\n";
-        } else if (mode == "--tacky") {
-            std::cout << "Lowering AST to TACKY for: " << filepath << "\n";
-            auto lex = lexer(filepath, false);
-            Parser parser(lex, false);
-            auto ast = parser.parseProgram();
-            resolve_program(ast.get());
-            Lowerer lowerer;
-            auto tackyProgram = lowerer.lower(ast.get());
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            Result& result = results[i];
+            result.status = compileFile(options, files[i], result.out, result.err);
 
-            std::cout << "\nGenerated TACKY IR:\n";
-            std::cout << tackyProgram->toString() << "\n";
+            std::lock_guard<std::mutex> lock(printMutex);
+            result.done = true;
+            while (nextToPrint < results.size() && results[nextToPrint].done) {
+                Result& ready = results[nextToPrint++];
+                std::cout << ready.out.str() << std::flush;
+                std::cerr << ready.err.str() << std::flush;
+                if (ready.status != 0) status = 1;
+                ready.out.str({});
+                ready.err.str({});
+            }
+        }
+    };
 
-        } else if (mode == "--codegen") {
-            std::cout << "Generating assembly from: " << filepath << "\n";
-            auto lex = lexer(filepath, false);
-            Parser parser(lex, false);
-            auto ast = parser.parseProgram();
-            resolve_program(ast.get());
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < jobs; ++t) threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads) thread.join();
+    return status;
+}
 
-            Lowerer lowerer;
-            auto tackyProgram = lowerer.lower(ast.get());
+/**
+ * @brief --server: answers compile requests read from stdin until end of input.
+ *
+ * A request is one line of arguments, with the syntax of the command line, naming one
+ * source file; the options of the server command line apply unless the request overrides
+ * them. With `--source-length=N`, the N bytes after the line are the source and the file
+ * name only names the outputs. Each response is a line
+ * `status=<exit status> stdout=<bytes> stderr=<bytes>` followed by the two outputs.
+ *
+ * Requests run one after the other in this process and share one CompileWorkspace, so
+ * they neither pay for startup nor allocate their tables again.
+ */
+int runServer(const Invocation& defaults) {
+    CompileWorkspace workspace;
+    std::map<std::string, std::unique_ptr<CompileCache>> caches;
+    std::string line;
 
-            ASDLProgram asdlProgram = convertTackyToASDL(*tackyProgram);
-            int stackOffset = replacePseudosWithStack(asdlProgram);  
-            insertAllocateStack(asdlProgram,-stackOffset);
-            legalizeMovMemoryToMemory(asdlProgram);
+    while (std::getline(std::cin, line)) {
+        std::istringstream words(line);
+        std::vector<std::string> args;
+        for (std::string word; words >> word;) args.push_back(word);
+        if (args.empty()) continue;
 
-            std::cout << "\nGenerated ASDL:\n";
-            std::cout << asdlProgram.toString() << "\n";
+        Invocation request = defaults;
+        request.files.clear();
+        request.sourceLength = 0;
+        request.options.output.clear();
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 1;
 
-            std::cout << "\nGenerated Assembly:\n";
-            std::cout << asdlProgram.toASM() << "\n";
+        bool valid = parseArguments(args, request, err);
+        std::string text;
+        if (request.sourceLength > 0) {
+            // Read the source even if the request is invalid, so the next one starts after it
+            text.resize(request.sourceLength);
+            std::cin.read(&text[0], static_cast<std::streamsize>(text.size()));
+            if (!std::cin) {
+                std::cerr << "Server input ended inside the source of a request\n";
+                return 1;
+            }
+        }
+        if (valid && request.files.size() != 1) {
+            err << "A request names exactly one source file\n";
+            valid = false;
+        }
+        // The verbose phases log straight to stdout, which carries the responses, and a
+        // program run by --run would take the server down if it traps or never returns
+        if (valid && (request.options.mode == "--lex" || request.options.mode == "--parse" ||
+                      request.options.mode == "--validate" || request.options.mode == "--run")) {
+            err << request.options.mode << " is not available in --server mode\n";
+            valid = false;
+        }
 
-            std::cout << "stackoffset value = " << stackOffset << std::endl;
+        if (valid && !request.options.cacheDir.empty()) {
+            std::unique_ptr<CompileCache>& cache = caches[request.options.cacheDir];
+            try {
+                if (!cache) cache = std::make_unique<CompileCache>(request.options.cacheDir);
+                request.options.cache = cache.get();
+            } catch (const std::runtime_error& e) {
+                err << "Error: " << e.what() << "\n";
+                valid = false;
+            }
+        }
 
-        } else if (mode == "--compile") {
-            std::cout << "Full compilation of: " << filepath << "\n";
-            auto lex = lexer(filepath, false);
-            Parser parser(lex, false);
-            auto ast = parser.parseProgram();
-            resolve_program(ast.get());
+        if (valid && request.sourceLength > 0) {
+            status = compileSource(request.options, request.files[0], text, out, err, &workspace);
+        } else if (valid) {
+            status = compileFile(request.options, request.files[0], out, err, &workspace);
+        }
 
-            Lowerer lowerer;
-            auto tackyProgram = lowerer.lower(ast.get());
+        const std::string outText = out.str();
+        const std::string errText = err.str();
+        std::cout << "status=" << status << " stdout=" << outText.size() << " stderr=" << errText.size() << "\n"
+                  << outText << errText << std::flush;
+    }
 
-            ASDLProgram asdlProgram = convertTackyToASDL(*tackyProgram);
-            int stackOffset = replacePseudosWithStack(asdlProgram);
-            insertAllocateStack(asdlProgram, -stackOffset); 
-            legalizeMovMemoryToMemory(asdlProgram);
+    for (const auto& entry : caches) {
+        if (entry.second) entry.second->printStats(std::cerr);
+    }
+    return 0;
+}
 
-            const std::string asm_filename = "out.s";
-            try {
-                writeASMToFile(asdlProgram, asm_filename);
-            } catch (const std::exception& e) {
-                std::cerr << "Error while writing assembly: " << e.what() << "\n";
-                return 1;
-            }
+int main(int argc, char* argv[]) {
+    Invocation invocation;
+    if (!parseArguments(std::vector<std::string>(argv + 1, argv + argc), invocation, std::cerr)) {
+        print_help();
+        return 1;
+    }
+    if (invocation.help) {
+        print_help();
+        return 0;
+    }
+    if (invocation.server) {
+        if (!invocation.files.empty()) {
+            std::cerr << "--server reads its source files from the requests\n";
+            return 1;
+        }
+        return runServer(invocation);
+    }
 
-            std::string exec_name = filepath;
-            size_t last_slash = exec_name.find_last_of("/\\");
-            if (last_slash != std::string::npos)
-                exec_name = exec_name.substr(last_slash + 1);
-            size_t dot_pos = exec_name.rfind('.');
-            if (dot_pos != std::string::npos)
-                exec_name = exec_name.substr(0, dot_pos);
-
-            std::string command = "clang -arch x86_64 -o " + exec_name + " out.s";
-            int result = system(command.c_str());
-            if (result != 0) {
-                std::cerr << "Linking failed.\n";
-                return 1;
-            }
+    CompileOptions& options = invocation.options;
+    const std::vector<std::string>& files = invocation.files;
+    if (files.empty()) {
+        print_help();
+        return 1;
+    }
+    if (invocation.sourceLength > 0) {
+        std::cerr << "--source-length is only used by --server requests\n";
+        return 1;
+    }
 
-            std::cout << "Compilation succeeded. Executable is '" << exec_name << "'\n";
-        } else {
-            std::cerr << "Unknown option: " << mode << "\n";
-            print_help();
+    std::unique_ptr<CompileCache> cache;
+    if (!options.cacheDir.empty()) {
+        try {
+            cache = std::make_unique<CompileCache>(options.cacheDir);
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Error: " << e.what() << "\n";
             return 1;
         }
+        options.cache = cache.get();
+    }
+
+    if (files.size() == 1) {
+        int status = compileFile(options, files[0], std::cout, std::cerr);
+        if (cache) cache->printStats(std::cerr);
+        return status;
+    }
 
-    } catch (const std::runtime_error& e) {
-        std::cerr << "Error: " << e.what() << "\n";
+    if (!options.output.empty()) {
+        std::cerr << "-o takes a single source file\n";
+        return 1;
+    }
+    // The verbose phases log straight to stdout, and --run exits with the status of one main
+    if (options.mode == "--lex" || options.mode == "--parse" || options.mode == "--validate" ||
+        options.mode == "--run") {
+        std::cerr << options.mode << " takes a single source file\n";
         return 1;
     }
+    if (options.mode == "--compile") {
+        std::unordered_set<std::string> stems;
+        for (const std::string& file : files) {
+            if (!stems.insert(outputStem(file)).second) {
+                std::cerr << "Several source files would write '" << outputStem(file) << "'\n";
+                return 1;
+            }
+        }
+    }
 
-    return 0;
+    unsigned jobs = invocation.jobs;
+    if (jobs > files.size()) jobs = static_cast<unsigned>(files.size());
+    int status = compileFiles(options, files, jobs);
+    if (cache) cache->printStats(std::cerr);
+    return status;
 }
@@ -0,0 +1,180 @@
+/**
+ * @file dataflow.cpp
+ * @brief Implementation of the liveness and reaching copies analyses.
+ */
+
+#include "dataflow.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace tacky {
+
+// --- Liveness ---
+
+BlockLiveness solveLiveness(const std::vector<std::vector<int>>& succs, const std::vector<RegisterList>& uses,
+                            const std::vector<RegisterList>& defs, const std::vector<int>& blocks) {
+    size_t count = succs.size();
+    BlockLiveness result;
+    result.liveIn.resize(count);
+    result.liveOut.resize(count);
+
+    std::vector<std::vector<int>> preds(count);
+    for (int b : blocks) {
+        for (int succ : succs[b]) preds[succ].push_back(b);
+    }
+
+    // Taken from the back, so that later blocks are solved first
+    std::vector<int> pending(blocks.begin(), blocks.end());
+    std::vector<char> queued(count, 0);
+    for (int b : blocks) queued[b] = 1;
+
+    RegisterList merged;
+    RegisterList in;
+    while (!pending.empty()) {
+        int b = pending.back();
+        pending.pop_back();
+        queued[b] = 0;
+
+        RegisterList& out = result.liveOut[b];
+        out.clear();
+        for (int succ : succs[b]) {
+            const RegisterList& next = result.liveIn[succ];
+            merged.clear();
+            std::set_union(out.begin(), out.end(), next.begin(), next.end(), std::back_inserter(merged));
+            out.swap(merged);
+        }
+
+        merged.clear();
+        std::set_difference(out.begin(), out.end(), defs[b].begin(), defs[b].end(), std::back_inserter(merged));
+        in.clear();
+        std::set_union(uses[b].begin(), uses[b].end(), merged.begin(), merged.end(), std::back_inserter(in));
+        if (in == result.liveIn[b]) continue;
+
+        result.liveIn[b].swap(in);
+        for (int pred : preds[b]) {
+            if (!queued[pred]) {
+                queued[pred] = 1;
+                pending.push_back(pred);
+            }
+        }
+    }
+
+    return result;
+}
+
+std::vector<RegisterList> computeLiveOut(const ControlFlowGraph& cfg, size_t regCount) {
+    size_t blockCount = cfg.blocks.size();
+    std::vector<std::vector<int>> succs(blockCount);
+    std::vector<RegisterList> uses(blockCount);
+    std::vector<RegisterList> defs(blockCount);
+    std::vector<char> used(regCount, 0);
+    std::vector<char> defined(regCount, 0);
+
+    // Registers read before being written in the block, and registers written in it
+    for (size_t b = 0; b < blockCount; ++b) {
+        if (cfg.blocks[b].removed) continue;
+        succs[b] = cfg.blocks[b].succs;
+        for (const Instr& instr : cfg.blocks[b].code) {
+            forEachUse(instr, [&](uint32_t reg) {
+                if (defined[reg] || used[reg]) return;
+                used[reg] = 1;
+                uses[b].push_back(reg);
+            });
+            if (hasDef(instr) && !defined[instr.dst.regIndex()]) {
+                defined[instr.dst.regIndex()] = 1;
+                defs[b].push_back(instr.dst.regIndex());
+            }
+        }
+        for (uint32_t reg : uses[b]) used[reg] = 0;
+        for (uint32_t reg : defs[b]) defined[reg] = 0;
+        std::sort(uses[b].begin(), uses[b].end());
+        std::sort(defs[b].begin(), defs[b].end());
+    }
+
+    return solveLiveness(succs, uses, defs, cfg.reversePostorder()).liveOut;
+}
+
+// --- Reaching copies ---
+
+ReachingCopies computeReachingCopies(const ControlFlowGraph& cfg, size_t regCount) {
+    ReachingCopies result;
+    size_t blockCount = cfg.blocks.size();
+    result.firstCopy.resize(blockCount);
+
+    for (size_t b = 0; b < blockCount; ++b) {
+        result.firstCopy[b] = static_cast<int>(result.copies.size());
+        if (cfg.blocks[b].removed) continue;
+        for (const Instr& instr : cfg.blocks[b].code) {
+            if (instr.op == Opcode::Copy) result.copies.push_back({instr.dst.regIndex(), instr.src1});
+        }
+    }
+
+    // A copy that holds at the end of a block but whose dst is dead there can never be
+    // used, so the result keeps one copy at most per register live out of the block
+    std::vector<RegisterList> liveOut = computeLiveOut(cfg, regCount);
+    CopyTracker tracker(result.copies, regCount);
+    auto transfer = [&](int b, const std::vector<int>& in) {
+        tracker.enterBlock(in);
+        int id = result.firstCopy[b];
+        for (const Instr& instr : cfg.blocks[b].code) {
+            if (!hasDef(instr)) continue;
+            tracker.write(instr.dst.regIndex());
+            if (instr.op == Opcode::Copy) {
+                if (instr.src1 != instr.dst) tracker.copy(id);
+                ++id;
+            }
+        }
+
+        std::vector<int> out;
+        for (uint32_t reg : liveOut[b]) {
+            int holding = tracker.copyTo(reg);
+            if (holding >= 0) out.push_back(holding);
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+
+    // Copies must hold on every path, so a block whose out set is not known yet holds
+    // every copy as far as its successors are concerned, and sets only shrink
+    result.in.assign(blockCount, {});
+    std::vector<std::vector<int>> out(blockCount);
+    std::vector<char> known(blockCount, 0);
+
+    std::vector<int> order = cfg.reversePostorder();
+    std::vector<int> merged;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b : order) {
+            std::vector<int>& in = result.in[b];
+            in.clear();
+            if (b != 0) {
+                bool first = true;
+                for (int pred : cfg.blocks[b].preds) {
+                    if (!known[pred]) continue;
+                    if (first) {
+                        in = out[pred];
+                        first = false;
+                        continue;
+                    }
+                    merged.clear();
+                    std::set_intersection(in.begin(), in.end(), out[pred].begin(), out[pred].end(),
+                                          std::back_inserter(merged));
+                    in.swap(merged);
+                }
+            }
+
+            std::vector<int> newOut = transfer(b, in);
+            if (!known[b] || newOut != out[b]) {
+                out[b] = std::move(newOut);
+                known[b] = 1;
+                changed = true;
+            }
+        }
+    }
+
+    return result;
+}
+
+} // namespace tacky
@@ -0,0 +1,220 @@
+/**
+ * @file dataflow.hpp
+ * @brief Dataflow analyses over the control-flow graph of a flat TACKY function.
+ *
+ * Few registers are live across block boundaries, so the per-block sets are sorted
+ * vectors rather than bit sets over every register of the function; each analysis
+ * revisits blocks until its per-block sets reach a fixed point.
+ */
+
+#ifndef DATAFLOW_HPP
+#define DATAFLOW_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "cfg.hpp"
+
+namespace tacky {
+
+/**
+ * @brief Fixed-size set of small integers, one bit each.
+ */
+class BitSet {
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+
+public:
+    explicit BitSet(size_t size = 0) : words((size + 63) / 64, 0), bits(size) {}
+
+    size_t size() const { return bits; }
+    bool test(size_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+    void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+    void reset(size_t i) { words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+
+    void setAll() {
+        for (auto& w : words) w = ~uint64_t(0);
+        if (bits % 64) words.back() = (uint64_t(1) << (bits % 64)) - 1;
+    }
+
+    /**
+     * @brief Adds every element of `other`; returns true if the set grew.
+     */
+    bool unionWith(const BitSet& other) {
+        bool changed = false;
+        for (size_t i = 0; i < words.size(); ++i) {
+            uint64_t merged = words[i] | other.words[i];
+            changed |= merged != words[i];
+            words[i] = merged;
+        }
+        return changed;
+    }
+
+    /**
+     * @brief Keeps only elements also in `other`.
+     */
+    void intersectWith(const BitSet& other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= other.words[i];
+    }
+
+    /**
+     * @brief Calls `f(i)` for every element, in increasing order.
+     */
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t w = 0; w < words.size(); ++w) {
+            for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+                f(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+            }
+        }
+    }
+
+    bool operator==(const BitSet& other) const { return words == other.words; }
+    bool operator!=(const BitSet& other) const { return words != other.words; }
+};
+
+/**
+ * @brief Calls `f(reg)` for every virtual register an instruction reads.
+ *
+ * A CopyIfNotZero also reads its dst, which it leaves unchanged when it does not copy.
+ */
+template <typename F>
+void forEachUse(const Instr& instr, F f) {
+    if (instr.src1.isReg()) f(instr.src1.regIndex());
+    if (instr.src2.isReg()) f(instr.src2.regIndex());
+    if (instr.op == Opcode::CopyIfNotZero) f(instr.dst.regIndex());
+}
+
+/**
+ * @brief Returns true if an instruction writes its dst register.
+ */
+inline bool hasDef(const Instr& instr) {
+    return instr.dst.isReg();
+}
+
+/**
+ * @brief Sorted set of registers, for sets that hold few of them.
+ */
+using RegisterList = std::vector<uint32_t>;
+
+/**
+ * @brief Registers live on entry to and at the end of every block.
+ */
+struct BlockLiveness {
+    std::vector<RegisterList> liveIn;
+    std::vector<RegisterList> liveOut;
+};
+
+/**
+ * @brief Solves liveness over any graph of blocks.
+ *
+ * A block is revisited only when the live-in set of one of its successors grew.
+ *
+ * @param succs Successors of every block.
+ * @param uses Registers each block reads before writing them.
+ * @param defs Registers each block writes.
+ * @param blocks Blocks to solve for, best in reverse postorder; the others keep empty
+ *        sets and are not looked at as predecessors.
+ */
+BlockLiveness solveLiveness(const std::vector<std::vector<int>>& succs, const std::vector<RegisterList>& uses,
+                            const std::vector<RegisterList>& defs, const std::vector<int>& blocks);
+
+/**
+ * @brief Computes the registers live at the end of every block.
+ *
+ * A register is live if some path from that point reads it before writing it.
+ *
+ * @param regCount Number of virtual registers of the function.
+ * @return Live-out set per block (empty for removed and unreachable blocks).
+ */
+std::vector<RegisterList> computeLiveOut(const ControlFlowGraph& cfg, size_t regCount);
+
+/**
+ * @brief Result of the reaching copies analysis.
+ *
+ * Copies are numbered in program order: block by block, and within a block in
+ * instruction order.
+ */
+struct ReachingCopies {
+    struct Copy {
+        uint32_t dst;  ///< Register written
+        Value src;     ///< Immediate or register copied
+    };
+
+    std::vector<Copy> copies;          ///< Every Copy instruction of the function
+    std::vector<int> firstCopy;        ///< Number of the first copy of each block
+    std::vector<std::vector<int>> in;  ///< Copies that hold on entry to each block, sorted
+};
+
+/**
+ * @brief Follows which copy holds for each register while walking through blocks.
+ *
+ * Writing a register ends the copy to it at once; the copies from it are only found
+ * to have ended when they are next looked up, so a write costs the same however many
+ * copies read the register.
+ */
+class CopyTracker {
+    const std::vector<ReachingCopies::Copy>& copies;
+    std::vector<int> holding;         // last copy to each register
+    std::vector<uint32_t> madeAt;     // time of that copy
+    std::vector<uint32_t> writtenAt;  // time of the last write of each register
+    uint32_t blockStart = 0;
+    uint32_t time = 0;
+
+public:
+    CopyTracker(const std::vector<ReachingCopies::Copy>& copies, size_t regCount)
+        : copies(copies), holding(regCount, -1), madeAt(regCount, 0), writtenAt(regCount, 0) {}
+
+    /**
+     * @brief Starts a block, where the copies `in` hold.
+     */
+    void enterBlock(const std::vector<int>& in) {
+        blockStart = ++time;
+        for (int id : in) {
+            holding[copies[id].dst] = id;
+            madeAt[copies[id].dst] = time;
+        }
+    }
+
+    /**
+     * @brief Records a write of `reg`.
+     */
+    void write(uint32_t reg) {
+        writtenAt[reg] = ++time;
+        holding[reg] = -1;
+    }
+
+    /**
+     * @brief Records copy `id`, right after the write of its dst.
+     */
+    void copy(int id) {
+        holding[copies[id].dst] = id;
+        madeAt[copies[id].dst] = time;
+    }
+
+    /**
+     * @brief Returns the copy that holds for `reg`, or -1.
+     */
+    int copyTo(uint32_t reg) const {
+        int id = holding[reg];
+        if (id < 0 || madeAt[reg] < blockStart) return -1;
+        Value src = copies[id].src;
+        if (src.isReg() && writtenAt[src.regIndex()] > madeAt[reg]) return -1;
+        return id;
+    }
+};
+
+/**
+ * @brief Finds, for every block, the copies `dst = src` that hold on every path into it.
+ *
+ * A copy stops holding when its dst or its src register is written again. Only copies
+ * whose dst is still live are kept, so that each set holds at most one copy per live
+ * register.
+ *
+ * @param regCount Number of virtual registers of the function.
+ */
+ReachingCopies computeReachingCopies(const ControlFlowGraph& cfg, size_t regCount);
+
+} // namespace tacky
+
+#endif // DATAFLOW_HPP
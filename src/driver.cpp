@@ -0,0 +1,521 @@
+/**
+ * @file driver.cpp
+ * @brief Implementation of a single compilation.
+ */
+
+#include "driver.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "ast.hpp"
+#include "asdl.hpp"
+#include "tacky.hpp"
+#include "lowerer.hpp"
+#include "validate.hpp"
+#include "optimize.hpp"
+#include "regalloc.hpp"
+#include "peephole.hpp"
+#include "x86encoder.hpp"
+#include "objectfile.hpp"
+#include "jit.hpp"
+#include "aarch64.hpp"
+#include "cache.hpp"
+#include "stats.hpp"
+
+namespace {
+
+/**
+ * @brief Parses, validates and lowers a source file, then optimizes its TACKY.
+ */
+tacky::FlatProgram lowerFile(const CompileOptions& options, const SourceBuffer& source, CompileReport& report) {
+    Parser parser(source, false);
+    // The parser pulls tokens from the lexer as it goes, so "parse" includes lexing
+    PhaseTimer timer(report, "parse");
+    auto ast = parser.parseProgram();
+    report.count("tokens", parser.tokenCount());
+    report.count("ast_nodes", ast->arena.objectCount());
+
+    timer.next("validate");
+    ValidationContext validation;
+    resolve_program(ast.get(), validation);
+
+    timer.next("lower");
+    Lowerer lowerer(options.optLevel >= 1);
+    auto tackyProgram = lowerer.lower(ast.get());
+    report.count("tacky_instructions", tackyProgram.function.code.size());
+
+    timer.next("optimize");
+    optimizeProgram(tackyProgram, options.optLevel);
+    report.count("tacky_instructions_optimized", tackyProgram.function.code.size());
+    report.count("pseudos", tackyProgram.function.registers.size());
+    return tackyProgram;
+}
+
+/**
+ * @brief Replaces the pseudos of a program with registers or stack slots.
+ * @return Stack size in bytes, as returned by replacePseudosWithStack.
+ */
+int assignPseudos(ASDLProgram& program, int optLevel, bool shareStackSlots) {
+    if (optLevel >= 1) return allocateRegisters(program);
+    if (shareStackSlots) return colorStackSlots(program);
+    return replacePseudosWithStack(program);
+}
+
+/**
+ * @brief Returns the number of instructions of an ASDL program.
+ */
+size_t instructionCount(const ASDLProgram& program) {
+    return program.getFunctionDefinition()->getInstructions().size();
+}
+
+/**
+ * @brief Runs the x86-64 backend up to legalized (and at -O1, peephole-optimized) code.
+ */
+ASDLProgram generateX86(const CompileOptions& options, const tacky::FlatProgram& tackyProgram,
+                        std::ostream& err, int& stackOffset, CompileReport& report) {
+    PhaseTimer timer(report, "select");
+    ASDLProgram asdlProgram = convertTackyToASDL(tackyProgram);
+    report.count("instructions_selected", instructionCount(asdlProgram));
+
+    timer.next("assign-pseudos");
+    stackOffset = assignPseudos(asdlProgram, options.optLevel, options.shareStackSlots);
+    report.count("stack_bytes", stackOffset);
+
+    timer.next("legalize");
+    insertAllocateStack(asdlProgram, -stackOffset);
+    legalizeMovMemoryToMemory(asdlProgram);
+    report.count("instructions_legalized", instructionCount(asdlProgram));
+
+    if (options.optLevel >= 1) {
+        timer.next("peephole");
+        PeepholeOptimizer peephole;
+        for (const std::string& rule : options.disabledPeepholeRules) peephole.disableRule(rule);
+        peephole.run(asdlProgram);
+        if (options.peepholeStats) peephole.printStats(err);
+        report.count("instructions_final", instructionCount(asdlProgram));
+    }
+    return asdlProgram;
+}
+
+/**
+ * @brief Runs the AArch64 backend up to legalized code.
+ */
+aarch64::Program generateAArch64(const tacky::FlatProgram& tackyProgram, int& stackOffset, CompileReport& report) {
+    PhaseTimer timer(report, "select");
+    aarch64::Program armProgram = aarch64::convertTackyToAArch64(tackyProgram);
+    report.count("instructions_selected", armProgram.function.code.size());
+
+    timer.next("assign-pseudos");
+    stackOffset = aarch64::replacePseudosWithStack(armProgram);
+    report.count("stack_bytes", stackOffset);
+
+    timer.next("legalize");
+    aarch64::legalize(armProgram, stackOffset);
+    report.count("instructions_legalized", armProgram.function.code.size());
+    return armProgram;
+}
+
+/**
+ * @brief Returns the size of a file written by the compiler (0 if it cannot be read).
+ */
+uint64_t writtenBytes(const std::string& path) {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(path, error);
+    return error ? 0 : size;
+}
+
+/**
+ * @brief Returns the clang options that select `target`, followed by a space.
+ *
+ * On macOS this is the -arch of the slice to build; elsewhere the native target is the
+ * default and other ones need a target triple.
+ */
+std::string clangTargetFlags(Target target, ObjectFormat format) {
+    if (format == ObjectFormat::MachO) {
+        return target == Target::AArch64 ? "-arch arm64 " : "-arch x86_64 ";
+    }
+    if (target == hostTarget()) return "";
+    return target == Target::AArch64 ? "--target=aarch64-linux-gnu " : "--target=x86_64-linux-gnu ";
+}
+
+/**
+ * @brief Returns the cache key of a compilation: everything its result depends on.
+ *
+ * The path of the source is left out, so that copies of a file share an entry.
+ */
+uint64_t cacheKey(const CompileOptions& options, std::string_view source) {
+    std::string settings = std::string(CompilerVersion) + '\0' + options.mode + '\0';
+    settings += std::to_string(options.optLevel);
+    settings += options.shareStackSlots ? 's' : '-';
+    settings += options.peepholeStats ? 'p' : '-';
+    settings += options.objectOnly ? 'c' : '-';
+    settings += options.integratedAs ? 'i' : '-';
+    settings += options.target == Target::AArch64 ? 'a' : 'x';
+    // --codegen prints plain assembly to an -o file, and more to standard output
+    settings += options.mode == "--codegen" && !options.output.empty() ? 'f' : '-';
+    settings += hostObjectFormat() == ObjectFormat::MachO ? 'm' : 'e';
+    for (const std::string& rule : options.disabledPeepholeRules) settings += '\0' + rule;
+    settings += '\0';
+    return fnv1a(source, fnv1a(settings));
+}
+
+/**
+ * @brief Removes the extension of the last component of a path.
+ */
+std::string withoutExtension(const std::string& path) {
+    size_t dot_pos = path.rfind('.');
+    size_t last_slash = path.find_last_of("/\\");
+    if (dot_pos == std::string::npos || (last_slash != std::string::npos && dot_pos < last_slash)) return path;
+    return path.substr(0, dot_pos);
+}
+
+/**
+ * @brief Returns the path of the executable or object file --compile makes.
+ */
+std::string resultPath(const CompileOptions& options, const std::string& filepath) {
+    if (!options.output.empty()) return options.output;
+    return options.objectOnly ? outputStem(filepath) + ".o" : outputStem(filepath);
+}
+
+/**
+ * @brief --compile: writes the object or assembly of a file and links it.
+ */
+int compileToExecutable(const CompileOptions& options, const std::string& filepath, const SourceBuffer& source,
+                        std::ostream& out, std::ostream& err, CompileReport& report) {
+    out << "Full compilation of: " << filepath << "\n";
+    tacky::FlatProgram tackyProgram = lowerFile(options, source, report);
+
+    const std::string stem = options.output.empty() ? outputStem(filepath) : withoutExtension(options.output);
+    const std::string output_filename = resultPath(options, filepath);
+    ObjectFormat format = hostObjectFormat();
+    std::string input_filename;
+    int stackOffset = 0;
+    if (options.target == Target::AArch64) {
+        aarch64::Program armProgram = generateAArch64(tackyProgram, stackOffset, report);
+        input_filename = stem + ".s";
+        PhaseTimer timer(report, "emit");
+        try {
+            aarch64::writeAssemblyToFile(armProgram, format == ObjectFormat::MachO, input_filename);
+        } catch (const std::exception& e) {
+            err << "Error while writing assembly: " << e.what() << "\n";
+            return 1;
+        }
+        report.count("asm_bytes", writtenBytes(input_filename));
+    } else {
+        ASDLProgram asdlProgram = generateX86(options, tackyProgram, err, stackOffset, report);
+        if (options.integratedAs || options.objectOnly) {
+            input_filename = options.objectOnly ? output_filename : stem + ".o";
+            PhaseTimer timer(report, "encode");
+            try {
+                MachineCode code = encodeProgram(asdlProgram);
+                report.count("code_bytes", code.text.size());
+                timer.next("emit");
+                writeObjectFile(code, format, input_filename);
+            } catch (const std::exception& e) {
+                err << "Error while writing object file: " << e.what() << "\n";
+                return 1;
+            }
+            report.count("object_bytes", writtenBytes(input_filename));
+            if (options.objectOnly) {
+                out << "Compilation succeeded. Object file is '" << input_filename << "'\n";
+                return 0;
+            }
+        } else {
+            input_filename = stem + ".s";
+            PhaseTimer timer(report, "emit");
+            try {
+                writeASMToFile(asdlProgram, format == ObjectFormat::MachO, input_filename);
+            } catch (const std::exception& e) {
+                err << "Error while writing assembly: " << e.what() << "\n";
+                return 1;
+            }
+            report.count("asm_bytes", writtenBytes(input_filename));
+        }
+    }
+
+    // With -c, only aarch64 code gets here: its assembly still goes through clang
+    std::string command = "clang " + clangTargetFlags(options.target, format) +
+                          (options.objectOnly ? "-c " : "") + "-o " + output_filename + " " + input_filename;
+    PhaseTimer timer(report, options.objectOnly ? "assemble" : "link");
+    int result = std::system(command.c_str());
+    timer.stop();
+    if (result != 0) {
+        err << (options.objectOnly ? "Assembling failed.\n" : "Linking failed.\n");
+        return 1;
+    }
+
+    if (options.objectOnly) {
+        out << "Compilation succeeded. Object file is '" << output_filename << "'\n";
+    } else {
+        out << "Compilation succeeded. Executable is '" << output_filename << "'\n";
+    }
+    return 0;
+}
+
+/**
+ * @brief --run: encodes a file and calls its main in this process.
+ * @return The low 8 bits of the value main returns, as the exit status of the executable.
+ */
+int runInMemory(const CompileOptions& options, const std::string& filepath, const SourceBuffer& source,
+                std::ostream& out, std::ostream& err, CompileReport& report) {
+    out << "Running in memory: " << filepath << "\n";
+    if (options.target != Target::X86_64 || !canRunMachineCode()) {
+        err << "--run needs x86_64 code on an x86_64 host\n";
+        return 1;
+    }
+    tacky::FlatProgram tackyProgram = lowerFile(options, source, report);
+
+    int stackOffset = 0;
+    ASDLProgram asdlProgram = generateX86(options, tackyProgram, err, stackOffset, report);
+    PhaseTimer timer(report, "encode");
+    MachineCode code = encodeProgram(asdlProgram);
+    report.count("code_bytes", code.text.size());
+
+    timer.next("run");
+    int result = runMachineCode(code);
+    return result & 0xFF;
+}
+
+/**
+ * @brief --compile through the cache: copies out the cached result, or compiles and
+ * caches it.
+ */
+int compileCached(const CompileOptions& options, const std::string& filepath, const SourceBuffer& source,
+                  std::ostream& out, std::ostream& err, CompileReport& report) {
+    const uint64_t key = cacheKey(options, source.text());
+    const std::string output_filename = resultPath(options, filepath);
+    std::string diagnostics;
+    std::string result;
+
+    if (options.cache->lookup(key, diagnostics, result)) {
+        out << "Full compilation of: " << filepath << "\n";
+        err << diagnostics;
+        writeFileAtomically(output_filename, result, !options.objectOnly);
+        out << "Compilation succeeded. " << (options.objectOnly ? "Object file" : "Executable") << " is '"
+            << output_filename << "' (cached)\n";
+        return 0;
+    }
+
+    std::ostringstream generatedErr;
+    int status = compileToExecutable(options, filepath, source, out, generatedErr, report);
+    diagnostics = generatedErr.str();
+    err << diagnostics;
+    if (status == 0 && readFile(output_filename, result)) {
+        options.cache->store(key, diagnostics, result);
+    }
+    return status;
+}
+
+/**
+ * @brief --codegen: prints the generated code of a source file.
+ *
+ * On standard output the assembly comes with the ASDL and the stack size; the -o file
+ * only gets the assembly, so that it can be assembled as it is.
+ */
+void printAssembly(const CompileOptions& options, const SourceBuffer& source, std::ostream& printed,
+                   std::ostream& err, CompileReport& report) {
+    const bool assemblyOnly = !options.output.empty();
+    tacky::FlatProgram tackyProgram = lowerFile(options, source, report);
+    int stackOffset = 0;
+    std::ostringstream assembly;
+
+    if (options.target == Target::AArch64) {
+        aarch64::Program armProgram = generateAArch64(tackyProgram, stackOffset, report);
+        PhaseTimer timer(report, "emit");
+        armProgram.emit(assembly, hostObjectFormat() == ObjectFormat::MachO);
+        timer.stop();
+        if (!assemblyOnly) printed << "\nGenerated Assembly:\n";
+        printed << assembly.str();
+    } else {
+        ASDLProgram asdlProgram = generateX86(options, tackyProgram, err, stackOffset, report);
+        PhaseTimer timer(report, "emit");
+        asdlProgram.emit(assembly, hostObjectFormat() == ObjectFormat::MachO);
+        timer.stop();
+
+        if (assemblyOnly) {
+            printed << assembly.str();
+        } else {
+            printed << "\nGenerated ASDL:\n";
+            printed << asdlProgram.toString() << "\n";
+
+            printed << "\nGenerated Assembly:\n";
+            printed << assembly.str();
+            printed << "\n";
+        }
+    }
+    report.count("asm_bytes", assembly.str().size());
+
+    if (!assemblyOnly) printed << "stackoffset value = " << stackOffset << std::endl;
+}
+
+} // namespace
+
+Target hostTarget() {
+#if defined(__aarch64__) || defined(__arm64__)
+    return Target::AArch64;
+#else
+    return Target::X86_64;
+#endif
+}
+
+bool parseTarget(const std::string& name, Target& target) {
+    if (name == "x86_64" || name == "x86-64") {
+        target = Target::X86_64;
+    } else if (name == "aarch64" || name == "arm64") {
+        target = Target::AArch64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string outputStem(const std::string& filepath) {
+    std::string stem = filepath;
+    size_t last_slash = stem.find_last_of("/\\");
+    if (last_slash != std::string::npos)
+        stem = stem.substr(last_slash + 1);
+    size_t dot_pos = stem.rfind('.');
+    if (dot_pos != std::string::npos)
+        stem = stem.substr(0, dot_pos);
+    return stem;
+}
+
+namespace {
+
+/**
+ * @brief Runs one compilation of `text`, or of the file `filepath` if `text` is null.
+ */
+int runCompilation(const CompileOptions& options, const std::string& filepath, const std::string* text,
+                   std::ostream& out, std::ostream& err, CompileWorkspace* workspace) {
+    // Every symbol of this compilation goes to its own table
+    std::optional<SymbolTableScope> symbolScope;
+    if (workspace) {
+        symbolScope.emplace(workspace->symbols);
+    } else {
+        symbolScope.emplace();
+    }
+    const std::string& mode = options.mode;
+    CompileReport report;
+    report.timePasses = options.timePasses;
+    report.stats = options.stats;
+    report.json = options.reportJson;
+    int status = 0;
+
+    try {
+        std::optional<SourceBuffer> source;
+        if (text) {
+            source.emplace(SourceBuffer::InMemory{}, *text);
+        } else {
+            source.emplace(filepath);
+        }
+
+        // --tacky and --codegen print to the -o file if there is one
+        std::ofstream outputFile;
+        std::ostream* printed = &out;
+        if (!options.output.empty() && (mode == "--tacky" || mode == "--codegen")) {
+            outputFile.open(options.output);
+            if (!outputFile.is_open()) {
+                throw std::runtime_error("Failed to open output file: " + options.output);
+            }
+            printed = &outputFile;
+        }
+
+        if (mode == "--lex") {
+            out << "Running lexer on: " << filepath << "\n";
+            auto lex = lexer(*source, /*verbose=*/true);
+            if (lex.empty()) {
+                err << "Lexer returned no tokens.\n";
+                status = 1;
+            }
+
+        } else if (mode == "--parse") {
+            out << "Running lexer and parser on: " << filepath << "\n";
+            Parser parser(*source, /*verbose=*/true);
+            parser.parseProgram();
+            out << "Parsing completed successfully.\n";
+
+        } else if (mode == "--validate") {
+            out << "Running semantic validation on: " << filepath << "\n";
+
+            Parser parser(*source, /*verbose=*/false);
+            auto program = parser.parseProgram();
+
+            ValidationContext validation;
+            validation.verbose = true;
+            resolve_program(program.get(), validation);
+
+            out << "Semantic validation completed successfully.\n";
+        } else if (mode == "--tacky") {
+            out << "Lowering AST to TACKY for: " << filepath << "\n";
+            tacky::FlatProgram tackyProgram = lowerFile(options, *source, report);
+
+            *printed << "\nGenerated TACKY IR:\n";
+            *printed << tacky::toProgram(tackyProgram)->toString() << "\n";
+
+        } else if (mode == "--codegen") {
+            out << "Generating assembly from: " << filepath << "\n";
+            if (!options.cache) {
+                printAssembly(options, *source, *printed, err, report);
+            } else {
+                const uint64_t key = cacheKey(options, source->text());
+                std::string diagnostics;
+                std::string assembly;
+                if (!options.cache->lookup(key, diagnostics, assembly)) {
+                    std::ostringstream generated;
+                    std::ostringstream generatedErr;
+                    printAssembly(options, *source, generated, generatedErr, report);
+                    diagnostics = generatedErr.str();
+                    assembly = generated.str();
+                    options.cache->store(key, diagnostics, assembly);
+                }
+                err << diagnostics;
+                *printed << assembly << std::flush;
+            }
+
+        } else if (mode == "--compile") {
+            if (options.cache) {
+                status = compileCached(options, filepath, *source, out, err, report);
+            } else {
+                status = compileToExecutable(options, filepath, *source, out, err, report);
+            }
+        } else if (mode == "--run") {
+            status = runInMemory(options, filepath, *source, out, err, report);
+        } else {
+            err << "Unknown option: " << mode << "\n";
+            status = 1;
+        }
+
+        if (outputFile.is_open()) {
+            outputFile.close();
+            if (!outputFile) {
+                throw std::runtime_error("Failed to write output file: " + options.output);
+            }
+        }
+
+    } catch (const std::runtime_error& e) {
+        err << "Error: " << e.what() << "\n";
+        status = 1;
+    }
+
+    report.print(err, filepath);
+    return status;
+}
+
+} // namespace
+
+int compileFile(const CompileOptions& options, const std::string& filepath, std::ostream& out, std::ostream& err,
+                CompileWorkspace* workspace) {
+    return runCompilation(options, filepath, nullptr, out, err, workspace);
+}
+
+int compileSource(const CompileOptions& options, const std::string& name, const std::string& text,
+                  std::ostream& out, std::ostream& err, CompileWorkspace* workspace) {
+    return runCompilation(options, name, &text, out, err, workspace);
+}
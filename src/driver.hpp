@@ -0,0 +1,115 @@
+/**
+ * @file driver.hpp
+ * @brief Runs the phases of the compiler on one source file.
+ *
+ * A compilation keeps all of its state (symbol table, validation context, lowerer,
+ * peephole statistics) in objects local to compileFile and names its output files after
+ * the source file, so compilations of different files can run on different threads at
+ * the same time.
+ */
+
+#ifndef DRIVER_HPP
+#define DRIVER_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "symbol.hpp"
+
+class CompileCache;
+
+/**
+ * @brief Architectures the compiler generates code for.
+ */
+enum class Target {
+    X86_64,
+    AArch64
+};
+
+/**
+ * @brief Returns the architecture the compiler runs on.
+ */
+Target hostTarget();
+
+/**
+ * @brief Parses the value of --target (`x86_64` or `aarch64`, also `x86-64` and `arm64`).
+ * @return False if the architecture is not supported.
+ */
+bool parseTarget(const std::string& name, Target& target);
+
+/**
+ * @brief Settings shared by every file of a compiler invocation.
+ */
+struct CompileOptions {
+    std::string mode = "--compile";   ///< Phase to stop at: --lex, --parse, ..., --compile, or --run
+    int optLevel = 0;                 ///< -O level
+    bool shareStackSlots = false;     ///< -fshare-stack-slots
+    bool peepholeStats = false;       ///< -fpeephole-stats
+    bool objectOnly = false;          ///< -c
+    bool integratedAs = true;         ///< Cleared by -fno-integrated-as
+    Target target = hostTarget();     ///< --target
+    std::string output;               ///< -o: path of the result, instead of one named after the source
+    std::string cacheDir;             ///< --cache-dir
+    bool timePasses = false;          ///< --time-passes: report the time spent in each phase
+    bool stats = false;               ///< --stats: report the size of the program after each phase
+    bool reportJson = false;          ///< Print those reports as JSON (--time-passes=json, --stats=json)
+    CompileCache* cache = nullptr;    ///< The opened --cache-dir, shared by every compilation
+    std::vector<std::string> disabledPeepholeRules;  ///< -fno-peephole= rules
+};
+
+/**
+ * @brief Returns the name of the outputs of a source file: its base name without the
+ * extension (`dir/example.c` gives `example`).
+ */
+std::string outputStem(const std::string& filepath);
+
+/**
+ * @brief Memory a caller keeps across compilations (see --server).
+ *
+ * Compilations given a workspace clear and reuse its tables instead of allocating new
+ * ones; nothing else carries over from one compilation to the next.
+ */
+struct CompileWorkspace {
+    SymbolTable symbols;  ///< Symbol table of the current compilation
+};
+
+/**
+ * @brief Compiles one source file.
+ *
+ * In --compile mode, writes `<stem>.o` (or `<stem>.s` when clang assembles it) in the
+ * current directory, then links the executable `<stem>` unless -c is given. With -o,
+ * the result goes to that path and intermediate files are named after it. --tacky
+ * writes what it prints to the -o file instead of `out`, and --codegen writes only the
+ * assembly there, without the ASDL and stack size it prints to `out`.
+ *
+ * With a cache, --codegen and --compile first look up the source and options there; a
+ * hit prints or copies out the cached result without running any phase, and a miss
+ * adds the result once it is made. Only the final result is cached, not the
+ * intermediate `.o` or `.s` files.
+ *
+ * --run encodes the x86-64 code of the file into executable memory and calls its main
+ * in this process, without writing any file or starting any process; the exit status is
+ * then the low 8 bits of what main returns, as it would be for the executable.
+ *
+ * The --time-passes and --stats reports are printed to `err` when the compilation ends.
+ *
+ * @param options Settings of the invocation.
+ * @param filepath Source file.
+ * @param out Stream for progress messages and printed IR.
+ * @param err Stream for errors and statistics.
+ * @param workspace Tables to reuse, or nullptr to allocate fresh ones.
+ * @return Exit status of the compilation: 0 on success (with --run, the status of main).
+ */
+int compileFile(const CompileOptions& options, const std::string& filepath, std::ostream& out, std::ostream& err,
+                CompileWorkspace* workspace = nullptr);
+
+/**
+ * @brief Compiles source text held in memory, like compileFile.
+ * @param name Stands for the file name: used in messages and to name the outputs.
+ * @param text The source text.
+ */
+int compileSource(const CompileOptions& options, const std::string& name, const std::string& text,
+                  std::ostream& out, std::ostream& err, CompileWorkspace* workspace = nullptr);
+
+#endif // DRIVER_HPP
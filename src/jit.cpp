@@ -0,0 +1,51 @@
+/**
+ * @file jit.cpp
+ * @brief Implementation of in-memory execution.
+ */
+
+#include "jit.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool canRunMachineCode() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#else
+    return false;
+#endif
+}
+
+int runMachineCode(const MachineCode& code) {
+    if (!canRunMachineCode()) {
+        throw std::runtime_error("Encoded x86-64 code can only run on an x86-64 host");
+    }
+
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t length = (code.text.size() + pageSize - 1) / pageSize * pageSize;
+    if (length == 0) throw std::runtime_error("No code to run");
+
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error(std::string("Failed to map memory for the code: ") + std::strerror(errno));
+    }
+    std::memcpy(memory, code.text.data(), code.text.size());
+
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0) {
+        int error = errno;
+        munmap(memory, length);
+        throw std::runtime_error(std::string("Failed to make the code executable: ") + std::strerror(error));
+    }
+
+    // The entry point is the first byte, and the function takes no arguments
+    auto function = reinterpret_cast<int (*)()>(memory);
+    int result = function();
+
+    munmap(memory, length);
+    return result;
+}
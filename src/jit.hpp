@@ -0,0 +1,32 @@
+/**
+ * @file jit.hpp
+ * @brief Running encoded x86-64 code in the compiler's own process (--run).
+ *
+ * The code of encodeProgram needs no relocations and only uses caller-saved registers,
+ * so once copied to executable memory it can be called like a C function returning int.
+ */
+
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "x86encoder.hpp"
+
+/**
+ * @brief Returns true if the compiler runs on x86-64, where encoded code can be run.
+ */
+bool canRunMachineCode();
+
+/**
+ * @brief Copies `code` to freshly mapped memory, makes it executable and calls it.
+ *
+ * The pages are mapped read-write, filled, switched to read-execute and unmapped after
+ * the call, so they are never writable and executable at the same time. The code runs
+ * on the calling thread: if it traps (e.g. on a division by zero), so does the compiler.
+ *
+ * @param code Output of encodeProgram.
+ * @return The value the function returns.
+ * @throws std::runtime_error If the host is not x86-64 or the memory cannot be mapped.
+ */
+int runMachineCode(const MachineCode& code);
+
+#endif // JIT_HPP
@@ -5,6 +5,9 @@
  * This lexer reads a source file, tokenizes it into a series of tokens such as
  * identifiers, constants, keywords, punctuation, and comments. It skips whitespace
  * and comments by default. The lexer throws exceptions on encountering invalid tokens.
+ *
+ * The scanner is hand-written: a single cursor walks the input once and dispatches on
+ * the first character of each token, so lexing is linear in the size of the source.
  * 
  * Supported tokens:
  * - Keywords: int, void, return
@@ -20,17 +23,80 @@
  * - Conditional statement
  */
 
+#include <cassert>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
-#include <regex>
 #include <stdexcept>
 #include <algorithm> 
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LEXER_HAVE_MMAP 1
+#endif
 
 #include "lexer.hpp"
 
+// --- SourceBuffer ---
+
+SourceBuffer::SourceBuffer(const std::string& filename, bool useMmap) {
+#ifdef LEXER_HAVE_MMAP
+    if (useMmap) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Error opening file: " + filename);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size = static_cast<size_t>(st.st_size);
+            if (size == 0) {
+                ::close(fd);
+                data = "";
+                return;
+            }
+            void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::close(fd);
+                data = static_cast<const char*>(addr);
+                mapped = true;
+                return;
+            }
+        }
+        // Not a regular file or mapping failed: fall back to reading it
+        ::close(fd);
+        size = 0;
+    }
+#endif
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error opening file: " + filename);
+    }
+    storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data = storage.data();
+    size = storage.size();
+}
+
+SourceBuffer::SourceBuffer(InMemory, std::string text) : storage(std::move(text)) {
+    data = storage.data();
+    size = storage.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+#ifdef LEXER_HAVE_MMAP
+    if (mapped) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
 /**
  * @brief Converts a Token enum value to a human-readable string.
  * 
@@ -82,210 +148,265 @@ std::string tokenToString(Token t) {
     }
 }
 
+
 /**
- * @brief Determines the token type for a given word string.
- * 
- * Matches keywords, punctuation, identifiers, constants, comments, and whitespace using regex.
- * Returns Token::MISMATCH if the input does not match any known token pattern.
- * 
- * @param word The input string to classify.
- * @return Token The corresponding token type.
+ * @brief Character classes used by the scanner (ASCII only, like the original regex patterns).
  */
-Token wordToToken(const std::string& word) {
-    if (word == "int")      return Token::INT;
-    if (word == "void")     return Token::VOID;
-    if (word == "return")   return Token::RETURN;
-    if (word == "(")        return Token::OPARENTHESIS;
-    if (word == ")")        return Token::CPARENTHESIS;
-    if (word == "{")        return Token::OBRACE;
-    if (word == "}")        return Token::CBRACE;
-    if (word == ";")        return Token::SEMICOLON;
-    if (word == "~")        return Token::COMPLEMENT;
-    if (word == "--")       return Token::DECREMENT;
-    if (word == "-")        return Token::NEGATION;
-    if (word == "+")        return Token::ADDITION;
-    if (word == "*")        return Token::MULTIPLICATION;
-    if (word == "/")        return Token::DIVISION;
-    if (word == "%")        return Token::REMAINDER;
-    if (word == "&&")       return Token::AND;
-    if (word == "||")       return Token::OR;
-    if (word == "==")       return Token::EQUAL;
-    if (word == "!=")       return Token::NOTEQUAL;
-    if (word == "!")        return Token::NOT;
-    if (word == "<")        return Token::LESS;
-    if (word == ">")        return Token::GREATER;
-    if (word == "<=")       return Token::LESSEQ;
-    if (word == ">=")       return Token::GREATEREQ;
-    if (word == "=")        return Token::ASSIGN;
-    if (word == "if")       return Token::IF;
-    if (word == "else")     return Token::ELSE;
-    if (word == ":")        return Token::COLON;
-    if (word == "?")        return Token::QUESTION_MARK;
-    if (word == "do")       return Token::DO;
-    if (word == "while")       return Token::WHILE;
-    if (word == "for")       return Token::FOR;
-    if (word == "continue")       return Token::CONTINUE;
-    if (word == "break")       return Token::BREAK;
-
-    if (std::regex_match(word, std::regex(R"(\d+)"))) 
-        return Token::CONSTANT;
-
-    if (std::regex_match(word, std::regex(R"([a-zA-Z_]\w*)"))) 
-        return Token::IDENTIFIER;
-
-    if (std::regex_match(word, std::regex(R"(^\s+$)"))) 
-        return Token::SKIP;
-
-    if (std::regex_match(word, std::regex(R"(//.*)"))) 
-        return Token::COMMENT;
-
-    if (std::regex_match(word, std::regex(R"(/\*.*\*/)"))) 
-        return Token::ML_COMMENT;
-
-    return Token::MISMATCH;
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+static inline bool isIdentStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+static inline bool isIdentChar(char c) { return isIdentStart(c) || isDigit(c); }
+// '\r' is plain whitespace, so CRLF sources need no normalization pass
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r'; }
+
+/**
+ * @brief Perfect-hash lookup of the language keywords.
+ *
+ * The hash `(length + 4 * first character) mod 16` is collision-free over the keyword set,
+ * so a single table probe followed by one string comparison classifies any identifier.
+ *
+ * @param word Pointer to the first character of the identifier.
+ * @param length Number of characters in the identifier.
+ * @return Token The keyword token, or Token::IDENTIFIER if the word is not a keyword.
+ */
+static Token keywordToken(const char* word, size_t length) {
+    struct Keyword {
+        const char* text;
+        Token token;
+    };
+    static const Keyword table[16] = {
+        {nullptr, Token::IDENTIFIER},      // 0
+        {"while", Token::WHILE},           // 1
+        {"do", Token::DO},                 // 2
+        {nullptr, Token::IDENTIFIER},      // 3
+        {"continue", Token::CONTINUE},     // 4
+        {nullptr, Token::IDENTIFIER},      // 5
+        {"if", Token::IF},                 // 6
+        {"int", Token::INT},               // 7
+        {"else", Token::ELSE},             // 8
+        {nullptr, Token::IDENTIFIER},      // 9
+        {nullptr, Token::IDENTIFIER},      // 10
+        {"for", Token::FOR},               // 11
+        {"void", Token::VOID},             // 12
+        {"break", Token::BREAK},           // 13
+        {"return", Token::RETURN},         // 14
+        {nullptr, Token::IDENTIFIER},      // 15
+    };
+
+    if (length < 2 || length > 8) return Token::IDENTIFIER;
+
+    const Keyword& kw = table[(length + 4 * static_cast<unsigned char>(word[0])) & 15];
+    if (kw.text && std::strlen(kw.text) == length && std::memcmp(kw.text, word, length) == 0) {
+        return kw.token;
+    }
+    return Token::IDENTIFIER;
+}
+
+// --- Scanner ---
+
+Scanner::Scanner(const SourceBuffer& source)
+    : cur(source.text().data()), end(source.text().data() + source.text().size()) {}
+
+[[noreturn]] void Scanner::invalidToken(const char* start, const char* stop) const {
+    std::ostringstream oss;
+    oss << "Lexical error: invalid token '" << std::string_view(start, stop - start)
+        << "' at line " << lineNumber
+        << ", position " << position;
+    throw std::runtime_error(oss.str());
 }
 
 /**
- * @brief Performs lexical analysis on the given source file.
- * 
- * Reads the entire file contents, then repeatedly matches and extracts tokens
- * according to predefined regular expression patterns. Skips whitespace and comments.
- * Throws an exception if an invalid token is encountered.
- * 
- * The recognized tokens include identifiers, constants, keywords (int, void, return),
- * punctuation (parentheses, braces, semicolon), comments (single-line and multi-line),
- * and whitespace.
+ * @brief Scans the next token from the source.
  * 
- * This function also tracks the line number for each token and stores it in the Lex struct,
- * so that errors or debug info can reference the exact line.
+ * Advances the cursor past whitespace, preprocessor lines and comments, then dispatches
+ * on the first character of the token. The recognized tokens include identifiers,
+ * constants, keywords (int, void, return, ...), punctuation (parentheses, braces,
+ * semicolon) and operators. Keywords are recognized through a perfect hash.
  * 
- * @param filename The path to the source file to lex.
- * @param verbose If true, prints all tokens with their types, positions, and lines.
- * @return std::vector<Lex> A vector of Lex objects representing the tokens found.
+ * The line number of each token is recorded in the Lex struct, so that errors or debug
+ * info can reference the exact line. The word is a view into the source buffer; no
+ * memory is allocated per token.
  * 
- * @throws std::runtime_error If the file cannot be opened or if a lexical error occurs.
+ * @param out Receives the scanned token.
+ * @return true if a token was produced, false at end of input.
+ * @throws std::runtime_error If a lexical error occurs.
  */
-std::vector<Lex> lexer(const std::string& filename, bool verbose) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Error opening file: " + filename);
-    }
+bool Scanner::next(Lex& out) {
+    while (cur < end) {
+        const char* start = cur;
+        char c = *cur;
+        Token token;
 
-    // Read entire file content into a string
-    std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        // Whitespace
+        if (isSpace(c)) {
+            while (cur < end && isSpace(*cur)) {
+                if (*cur == '\n') ++lineNumber;
+                ++cur;
+            }
+            continue;
+        }
 
-    // Normalize newlines (remove '\r' if present)
-    input.erase(std::remove(input.begin(), input.end(), '\r'), input.end());
+        // Preprocessor lines are skipped up to (not including) the newline
+        if (c == '#') {
+            while (cur < end && *cur != '\n') ++cur;
+            continue;
+        }
 
-    std::vector<Lex> lexemes;  // Vector to hold tokens
-    int position = 0;          // Position index of tokens
-    int lineNumber = 1;        // Current line number in source code
-
-    // Patterns for different token types in priority order
-    std::vector<std::pair<std::regex, Token>> patterns = {
-        {std::regex(R"(^#[^\n]*)"), Token::SKIP},
-        {std::regex(R"(^//[^\n]*)"), Token::COMMENT},
-        {std::regex(R"(^/\*([^*]|\*+[^*/])*\*+/)"), Token::ML_COMMENT},
-        {std::regex(R"(^\()"), Token::OPARENTHESIS},
-        {std::regex(R"(^\))"), Token::CPARENTHESIS},
-        {std::regex(R"(^\{)"), Token::OBRACE},
-        {std::regex(R"(^\})"), Token::CBRACE},
-        {std::regex(R"(^;)"), Token::SEMICOLON},
-        {std::regex(R"(^~)"), Token::COMPLEMENT},
-        {std::regex(R"(^--)"), Token::DECREMENT},
-        {std::regex(R"(^-)"), Token::NEGATION},
-        {std::regex(R"(^\+)"), Token::ADDITION},
-        {std::regex(R"(^\*)"), Token::MULTIPLICATION},
-        {std::regex(R"(^\/)"), Token::DIVISION},
-        {std::regex(R"(^\%)"), Token::REMAINDER},
-        {std::regex(R"(^&&)"), Token::AND},
-        {std::regex(R"(^\|\|)"), Token::OR},
-        {std::regex(R"(^==)"), Token::EQUAL},
-        {std::regex(R"(^!=)"), Token::NOTEQUAL},
-        {std::regex(R"(^!)"), Token::NOT},
-        {std::regex(R"(^<=)"), Token::LESSEQ},
-        {std::regex(R"(^>=)"), Token::GREATEREQ},
-        {std::regex(R"(^<)"), Token::LESS},
-        {std::regex(R"(^>)"), Token::GREATER},
-        {std::regex(R"(^\d+[a-zA-Z_]\w*)"), Token::MISMATCH}, // invalid token like 123abc
-        {std::regex(R"(^\bif\b)"), Token::IF},
-        {std::regex(R"(^\belse\b)"), Token::ELSE},
-        {std::regex(R"(^\bint\b)"), Token::INT},
-        {std::regex(R"(^\bvoid\b)"), Token::VOID},
-        {std::regex(R"(^\breturn\b)"), Token::RETURN},
-        {std::regex(R"(^\bdo\b)"), Token::DO},
-        {std::regex(R"(^\bfor\b)"), Token::FOR},
-        {std::regex(R"(^\bwhile\b)"), Token::WHILE},
-        {std::regex(R"(^\bcontinue\b)"), Token::CONTINUE},
-        {std::regex(R"(^\bbreak\b)"), Token::BREAK},
-        {std::regex(R"(^[a-zA-Z_]\w*)"), Token::IDENTIFIER},
-        {std::regex(R"(^\d+)"), Token::CONSTANT},
-        {std::regex(R"(^\s+)"), Token::SKIP},
-        {std::regex(R"(^=)"), Token::ASSIGN},
-        {std::regex(R"(^:)"), Token::COLON},
-        {std::regex(R"(^\?)"), Token::QUESTION_MARK},
-        {std::regex(R"(^\S)"), Token::MISMATCH},
-    };
+        // Identifiers and keywords
+        if (isIdentStart(c)) {
+            while (cur < end && isIdentChar(*cur)) ++cur;
+            token = keywordToken(start, cur - start);
+            std::string_view word(start, cur - start);
+            out = {word, token, position++, lineNumber,
+                   token == Token::IDENTIFIER ? symbols().intern(word) : NoSymbol};
+            return true;
+        }
+
+        // Constants; a digit run glued to identifier characters (e.g. 123abc) is invalid
+        if (isDigit(c)) {
+            while (cur < end && isDigit(*cur)) ++cur;
+            if (cur < end && isIdentStart(*cur)) {
+                while (cur < end && isIdentChar(*cur)) ++cur;
+                invalidToken(start, cur);
+            }
+            out = {std::string_view(start, cur - start), Token::CONSTANT, position++, lineNumber};
+            return true;
+        }
 
-    // Process input until fully consumed
-    while (!input.empty()) {
-        std::smatch match;
-        bool matched = false;
-
-        // Try each pattern in order to find a match at start of input
-        for (const auto& [regex, tokenType] : patterns) {
-            if (std::regex_search(input, match, regex)) {
-                std::string token = match.str(0);
-
-                // Skip whitespace and comments without adding tokens, but update line count
-                if (tokenType == Token::SKIP || tokenType == Token::COMMENT || tokenType == Token::ML_COMMENT) {
-                    // Count newlines in skipped text to keep line count accurate
-                    lineNumber += std::count(token.begin(), token.end(), '\n');
-                    input.erase(0, token.length());
-                    matched = true;
+        // Comments
+        if (c == '/' && cur + 1 < end && cur[1] == '/') {
+            while (cur < end && *cur != '\n') ++cur;
+            continue;
+        }
+        if (c == '/' && cur + 1 < end && cur[1] == '*') {
+            const char* close = nullptr;
+            for (const char* p = cur + 2; p + 1 < end; ++p) {
+                if (p[0] == '*' && p[1] == '/') {
+                    close = p + 2;
                     break;
                 }
+            }
+            // An unterminated comment is not a comment: it lexes as '/' followed by '*'
+            if (close) {
+                lineNumber += std::count(cur, close, '\n');
+                cur = close;
+                continue;
+            }
+        }
 
-                // Determine actual token for identifiers, constants, or mismatches
-                Token actualToken = tokenType;
-                if (tokenType == Token::IDENTIFIER || tokenType == Token::CONSTANT || tokenType == Token::MISMATCH) {
-                    actualToken = wordToToken(token);
-                }
+        // Punctuation and operators
+        char next = (cur + 1 < end) ? cur[1] : '\0';
+        size_t length = 1;
+        switch (c) {
+            case '(': token = Token::OPARENTHESIS; break;
+            case ')': token = Token::CPARENTHESIS; break;
+            case '{': token = Token::OBRACE; break;
+            case '}': token = Token::CBRACE; break;
+            case ';': token = Token::SEMICOLON; break;
+            case '~': token = Token::COMPLEMENT; break;
+            case '+': token = Token::ADDITION; break;
+            case '*': token = Token::MULTIPLICATION; break;
+            case '/': token = Token::DIVISION; break;
+            case '%': token = Token::REMAINDER; break;
+            case ':': token = Token::COLON; break;
+            case '?': token = Token::QUESTION_MARK; break;
+            case '-':
+                if (next == '-') { token = Token::DECREMENT; length = 2; }
+                else token = Token::NEGATION;
+                break;
+            case '&':
+                if (next != '&') invalidToken(start, start + 1);
+                token = Token::AND; length = 2;
+                break;
+            case '|':
+                if (next != '|') invalidToken(start, start + 1);
+                token = Token::OR; length = 2;
+                break;
+            case '=':
+                if (next == '=') { token = Token::EQUAL; length = 2; }
+                else token = Token::ASSIGN;
+                break;
+            case '!':
+                if (next == '=') { token = Token::NOTEQUAL; length = 2; }
+                else token = Token::NOT;
+                break;
+            case '<':
+                if (next == '=') { token = Token::LESSEQ; length = 2; }
+                else token = Token::LESS;
+                break;
+            case '>':
+                if (next == '=') { token = Token::GREATEREQ; length = 2; }
+                else token = Token::GREATER;
+                break;
+            default:
+                invalidToken(start, start + 1);
+        }
 
-                if (actualToken == Token::MISMATCH) {
-                    std::ostringstream oss;
-                    oss << "Lexical error: invalid token '" << token
-                        << "' at line " << lineNumber
-                        << ", position " << position;
-                    throw std::runtime_error(oss.str());
-                }
+        cur += length;
+        out = {std::string_view(start, length), token, position++, lineNumber};
+        return true;
+    }
 
-                // Count newlines in the matched token to update line number
-                int newlines = std::count(token.begin(), token.end(), '\n');
+    return false;
+}
 
-                // Store the current line number for this token
-                int tokenLine = lineNumber;
+// --- TokenStream ---
 
-                // Update lineNumber for the next token
-                lineNumber += newlines;
+TokenStream::TokenStream(const SourceBuffer& source) : scanner(source) {}
 
-                // Add the token with line and position info
-                lexemes.push_back({token, actualToken, position++, tokenLine});
+TokenStream::TokenStream(const std::vector<Lex>& lexemes)
+    : scanner(), replay(&lexemes) {}
 
-                // Remove matched token from input
-                input.erase(0, token.length());
-                matched = true;
-                break;
-            }
-        }
+bool TokenStream::fill() {
+    Lex& slot = ring[(head + count) % Capacity];
+    if (replay) {
+        if (replayIndex >= replay->size()) return false;
+        slot = (*replay)[replayIndex++];
+    } else if (!scanner.next(slot)) {
+        return false;
+    }
+    ++count;
+    ++pulled;
+    return true;
+}
 
-        // If no pattern matched, this is a lexical error
-        if (!matched) {
-            std::ostringstream oss;
-            oss << "Lexical error: could not match input at line "
-                << lineNumber << ", position " << position;
-            throw std::runtime_error(oss.str());
-        }
+const Lex& TokenStream::peek(size_t ahead) {
+    assert(ahead < Capacity && "lookahead wraps around the token ring");
+    while (count <= ahead) {
+        if (!fill()) return endToken;
+    }
+    return ring[(head + ahead) % Capacity];
+}
+
+Lex TokenStream::advance() {
+    if (count == 0 && !fill()) {
+        return endToken;
+    }
+    Lex lex = ring[head];
+    head = (head + 1) % Capacity;
+    --count;
+    return lex;
+}
+
+/**
+ * @brief Performs lexical analysis on the whole source buffer.
+ * 
+ * Drains a Scanner into a vector. The parser normally pulls tokens through a
+ * TokenStream instead; this entry point serves `--lex` and callers that need the
+ * complete token list.
+ * 
+ * @param source The source buffer to lex. Must outlive the returned tokens.
+ * @param verbose If true, prints all tokens with their types, positions, and lines.
+ * @return std::vector<Lex> A vector of Lex objects representing the tokens found.
+ * 
+ * @throws std::runtime_error If a lexical error occurs.
+ */
+std::vector<Lex> lexer(const SourceBuffer& source, bool verbose) {
+    std::vector<Lex> lexemes;  // Vector to hold tokens
+    Scanner scanner(source);
+    Lex lex;
+
+    while (scanner.next(lex)) {
+        lexemes.push_back(lex);
     }
 
     // If verbose, print all tokens with their word, type, position, and line number
@@ -1,7 +1,10 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "symbol.hpp"
+
 enum class Token {
     IDENTIFIER, CONSTANT, INT, VOID, RETURN,
     OPARENTHESIS, CPARENTHESIS, OBRACE, CBRACE, SEMICOLON, SKIP, COMMENT, ML_COMMENT, MISMATCH, COMPLEMENT,
@@ -13,16 +16,157 @@ enum class Token {
  * @struct Lex
  * @brief Represents a lexical token.
  * 
- * Contains the raw token string, the token type, its position (order) in the input stream,
- * and the line number where the token appears in the source file.
+ * Contains a view of the raw token text, the token type, its position (order) in the input
+ * stream, and the line number where the token appears in the source file.
+ *
+ * The word is a view into the SourceBuffer the token was scanned from, so tokenizing does
+ * not allocate per token; the buffer must outlive every Lex taken from it. Identifiers
+ * also carry their interned symbol.
  */
 struct Lex {
-    std::string word;
+    std::string_view word;
     Token token;
     int position;
     int line;           
+    Symbol symbol = NoSymbol;
+};
+
+/**
+ * @class SourceBuffer
+ * @brief Owns the bytes of a source file for the whole compilation.
+ *
+ * The file is memory-mapped read-only when the platform supports it (and mapping is
+ * requested); otherwise it is read into memory. Tokens and later phases borrow views
+ * into this buffer, so it must stay alive until lowering is finished.
+ */
+class SourceBuffer {
+    const char* data = nullptr;  /**< First byte of the source text */
+    size_t size = 0;             /**< Length of the source text in bytes */
+    bool mapped = false;         /**< True if data points into a memory mapping */
+    std::string storage;         /**< Backing storage when the file is not mapped */
+
+public:
+    /**
+     * @brief Loads a source file.
+     * @param filename Path to the source file.
+     * @param useMmap Memory-map the file instead of reading it (default true).
+     * @throws std::runtime_error If the file cannot be opened or read.
+     */
+    explicit SourceBuffer(const std::string& filename, bool useMmap = true);
+
+    /**
+     * @brief Tag selecting the constructor that takes the source text itself.
+     */
+    struct InMemory {};
+
+    /**
+     * @brief Wraps source text that is already in memory (e.g. sent to --server).
+     * @param text The source text; the buffer keeps its own copy.
+     */
+    SourceBuffer(InMemory, std::string text);
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    /**
+     * @brief Returns the whole source text.
+     */
+    std::string_view text() const { return std::string_view(data, size); }
+
+    /**
+     * @brief Returns true if the source is memory-mapped rather than copied.
+     */
+    bool isMapped() const { return mapped; }
+};
+
+/**
+ * @class Scanner
+ * @brief Incremental lexer that produces one token per call from a SourceBuffer.
+ *
+ * A single cursor walks the source from left to right, so scanning the whole input is
+ * linear in its size. Tokens are views into the buffer.
+ */
+class Scanner {
+    const char* cur = nullptr;  /**< Next unread character */
+    const char* end = nullptr;  /**< One past the last character */
+    int position = 0;           /**< Position index of the next token */
+    int lineNumber = 1;         /**< Current line number in source code */
+
+    /**
+     * @brief Throws a lexical error for the text [start, stop).
+     */
+    [[noreturn]] void invalidToken(const char* start, const char* stop) const;
+
+public:
+    Scanner() = default;
+    explicit Scanner(const SourceBuffer& source);
+
+    /**
+     * @brief Scans the next token.
+     * @param out Receives the token.
+     * @return true if a token was produced, false at end of input.
+     * @throws std::runtime_error On an invalid token.
+     */
+    bool next(Lex& out);
+};
+
+/**
+ * @class TokenStream
+ * @brief Pull-based token source with a small fixed-size lookahead ring buffer.
+ *
+ * Tokens are scanned on demand as the parser peeks at them, so memory use stays
+ * constant regardless of the number of tokens. A stream can also replay a token
+ * vector that was lexed up front.
+ */
+class TokenStream {
+    static constexpr size_t Capacity = 4;   /**< Ring size; maximum lookahead is Capacity - 1 */
+
+    Scanner scanner;                            /**< Token producer (unused when replaying) */
+    const std::vector<Lex>* replay = nullptr;   /**< Pre-lexed tokens, if any */
+    size_t replayIndex = 0;                     /**< Next token to replay */
+
+    Lex ring[Capacity];          /**< Lookahead buffer */
+    size_t head = 0;             /**< Index of the current token in the ring */
+    size_t count = 0;            /**< Number of buffered tokens */
+    size_t pulled = 0;           /**< Number of tokens pulled so far */
+    Lex endToken{"", Token::MISMATCH, -1, 0};   /**< Returned once input is exhausted */
+
+    /**
+     * @brief Pulls one more token into the ring.
+     * @return false if the input is exhausted.
+     */
+    bool fill();
+
+public:
+    explicit TokenStream(const SourceBuffer& source);
+    explicit TokenStream(const std::vector<Lex>& lexemes);
+
+    /**
+     * @brief Returns a token ahead of the current position without consuming it.
+     * @param ahead Distance from the current token; must be less than Capacity, which
+     *        is asserted, since the ring would otherwise wrap onto an earlier token.
+     * @return The token, or a MISMATCH token past the end of input.
+     */
+    const Lex& peek(size_t ahead = 0);
+
+    /**
+     * @brief Consumes and returns the current token.
+     * @return The token, or a MISMATCH token at end of input.
+     */
+    Lex advance();
+
+    /**
+     * @brief Checks if the stream is exhausted.
+     */
+    bool atEnd() { return &peek() == &endToken; }
+
+    /**
+     * @brief Returns the number of tokens scanned (or replayed) so far.
+     */
+    size_t tokenCount() const { return pulled; }
 };
 
-std::vector<Lex> lexer(const std::string& filename, bool verbose = true);
+std::vector<Lex> lexer(const SourceBuffer& source, bool verbose = true);
 std::string tokenToString(Token t);
 
@@ -0,0 +1,65 @@
+/**
+ * @file log.hpp
+ * @brief Debug logging for the front-end phases.
+ *
+ * Log messages are written through the COMPILER_LOG macro, which checks whether its
+ * category is enabled *before* evaluating the message arguments. Disabled logging
+ * therefore builds no strings and performs no allocations.
+ *
+ * Defining COMPILER_DISABLE_LOGGING at build time (e.g. -DCOMPILER_DISABLE_LOGGING for
+ * release builds) compiles every COMPILER_LOG call away entirely.
+ */
+
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <iostream>
+
+/**
+ * @brief Phases that can emit debug logs.
+ */
+enum class LogCategory {
+    Parser,
+    Validate
+};
+
+/**
+ * @brief Returns the prefix printed in front of messages of a category.
+ */
+inline const char* logCategoryName(LogCategory category) {
+    switch (category) {
+        case LogCategory::Parser: return "Parser";
+        case LogCategory::Validate: return "Validate";
+    }
+    return "Log";
+}
+
+/**
+ * @brief Writes one log line, streaming each argument to stdout in order.
+ *
+ * Only called once the category is known to be enabled; use COMPILER_LOG instead.
+ *
+ * @param category The category of the message.
+ * @param args Message parts; anything that can be written to an std::ostream.
+ */
+template <typename... Args>
+void writeLog(LogCategory category, const Args&... args) {
+    std::cout << "[" << logCategoryName(category) << "] ";
+    (std::cout << ... << args);
+    std::cout << std::endl;
+}
+
+/**
+ * @def COMPILER_LOG(enabled, category, ...)
+ * @brief Logs the message parts `...` under `category` if `enabled` is true.
+ *
+ * The message parts are not evaluated when `enabled` is false.
+ */
+#ifdef COMPILER_DISABLE_LOGGING
+#define COMPILER_LOG(enabled, category, ...) do { } while (0)
+#else
+#define COMPILER_LOG(enabled, category, ...) \
+    do { if (enabled) writeLog(category, __VA_ARGS__); } while (0)
+#endif
+
+#endif // LOG_HPP
@@ -0,0 +1,170 @@
+/**
+ * @file loops.cpp
+ * @brief Implementation of the dominator tree and of natural loop detection.
+ */
+
+#include "loops.hpp"
+
+#include <algorithm>
+
+namespace tacky {
+
+// --- Dominators ---
+
+DominatorTree::DominatorTree(const ControlFlowGraph& cfg)
+    : idom(cfg.blocks.size(), -1), first(cfg.blocks.size(), -1), last(cfg.blocks.size(), -1) {
+    size_t blockCount = cfg.blocks.size();
+    if (blockCount == 0) return;
+
+    // Algorithm of Lengauer and Tarjan, on the blocks numbered in depth-first preorder
+    std::vector<int> number(blockCount, -1);
+    std::vector<int> vertex;  // block of each number
+    std::vector<int> parent;  // number of the parent in the depth-first tree
+    std::vector<std::pair<int, size_t>> stack;  // block, next successor to visit
+    number[0] = 0;
+    vertex.push_back(0);
+    parent.push_back(0);
+    stack.push_back({0, 0});
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next == cfg.blocks[block].succs.size()) {
+            stack.pop_back();
+            continue;
+        }
+        int succ = cfg.blocks[block].succs[next++];
+        if (number[succ] >= 0) continue;
+        number[succ] = static_cast<int>(vertex.size());
+        vertex.push_back(succ);
+        parent.push_back(number[block]);
+        stack.push_back({succ, 0});
+    }
+
+    size_t count = vertex.size();
+    std::vector<int> semi(count);
+    std::vector<int> dom(count, 0);
+    std::vector<int> ancestor(count, -1);
+    std::vector<int> label(count);
+    std::vector<std::vector<int>> bucket(count);
+    for (size_t v = 0; v < count; ++v) {
+        semi[v] = static_cast<int>(v);
+        label[v] = static_cast<int>(v);
+    }
+
+    // Vertex of smallest semidominator on the path to v in the forest of linked vertices,
+    // compressing the path on the way
+    std::vector<int> path;
+    auto eval = [&](int v) {
+        if (ancestor[v] < 0) return v;
+        for (int x = v; ancestor[ancestor[x]] >= 0; x = ancestor[x]) path.push_back(x);
+        while (!path.empty()) {
+            int x = path.back();
+            path.pop_back();
+            if (semi[label[ancestor[x]]] < semi[label[x]]) label[x] = label[ancestor[x]];
+            ancestor[x] = ancestor[ancestor[x]];
+        }
+        return label[v];
+    };
+
+    for (size_t i = count; i-- > 1;) {
+        int w = static_cast<int>(i);
+        for (int pred : cfg.blocks[vertex[w]].preds) {
+            if (number[pred] < 0) continue;  // unreachable
+            int u = eval(number[pred]);
+            semi[w] = std::min(semi[w], semi[u]);
+        }
+        bucket[semi[w]].push_back(w);
+        ancestor[w] = parent[w];
+        for (int v : bucket[parent[w]]) {
+            int u = eval(v);
+            dom[v] = semi[u] < semi[v] ? u : parent[w];
+        }
+        bucket[parent[w]].clear();
+    }
+    std::vector<std::vector<int>> children(count);
+    for (size_t w = 1; w < count; ++w) {
+        if (dom[w] != semi[w]) dom[w] = dom[dom[w]];
+        children[dom[w]].push_back(static_cast<int>(w));
+    }
+
+    for (size_t w = 0; w < count; ++w) idom[vertex[w]] = vertex[dom[w]];
+
+    // Numbers the tree in preorder: a dominates b when b's number lies in a's subtree
+    int counter = 0;
+    std::vector<std::pair<int, size_t>> walk;  // number, next child to visit
+    walk.push_back({0, 0});
+    first[vertex[0]] = counter++;
+    while (!walk.empty()) {
+        auto& [v, next] = walk.back();
+        if (next == children[v].size()) {
+            last[vertex[v]] = counter - 1;
+            walk.pop_back();
+            continue;
+        }
+        int child = children[v][next++];
+        first[vertex[child]] = counter++;
+        walk.push_back({child, 0});
+    }
+}
+
+bool DominatorTree::dominates(int a, int b) const {
+    if (!reachable(a) || !reachable(b)) return false;
+    return first[a] <= first[b] && first[b] <= last[a];
+}
+
+// --- Natural loops ---
+
+std::vector<Loop> findLoops(const ControlFlowGraph& cfg, const DominatorTree& dominators) {
+    std::vector<Loop> loops;
+    size_t blockCount = cfg.blocks.size();
+    std::vector<int> inLoop(blockCount, -1);  // header of the last loop found to hold each block
+    std::vector<int> exitOf(blockCount, -1);  // header of the last loop found to exit to each block
+
+    for (size_t h = 0; h < blockCount; ++h) {
+        int header = static_cast<int>(h);
+        if (cfg.blocks[h].removed || !dominators.reachable(header)) continue;
+
+        // Walks back from the sources of the back edges, stopping at the header
+        Loop loop{header, {}, {}};
+        auto add = [&](int b) {
+            inLoop[b] = header;
+            loop.blocks.push_back(b);
+        };
+        std::vector<int> work;
+        for (int pred : cfg.blocks[h].preds) {
+            if (dominators.dominates(header, pred) && inLoop[pred] != header) {
+                add(pred);
+                work.push_back(pred);
+            }
+        }
+        if (work.empty()) continue;
+        if (inLoop[h] != header) add(header);
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            if (b == header) continue;
+            for (int pred : cfg.blocks[b].preds) {
+                if (inLoop[pred] != header && dominators.reachable(pred)) {
+                    add(pred);
+                    work.push_back(pred);
+                }
+            }
+        }
+
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+        for (int b : loop.blocks) {
+            for (int succ : cfg.blocks[b].succs) {
+                if (inLoop[succ] == header || exitOf[succ] == header) continue;
+                exitOf[succ] = header;
+                loop.exits.push_back(succ);
+            }
+        }
+        std::sort(loop.exits.begin(), loop.exits.end());
+        loops.push_back(std::move(loop));
+    }
+
+    std::stable_sort(loops.begin(), loops.end(),
+                     [](const Loop& a, const Loop& b) { return a.blocks.size() > b.blocks.size(); });
+    return loops;
+}
+
+} // namespace tacky
@@ -0,0 +1,70 @@
+/**
+ * @file loops.hpp
+ * @brief Dominators and natural loops of the control-flow graph of a flat TACKY function.
+ *
+ * A block `a` dominates `b` if every path from the entry to `b` goes through `a`. An
+ * edge whose target dominates its source is a back edge; the natural loop of a header
+ * is the header plus every block that reaches one of its back edges without passing
+ * through it. Loops built by the lowerer are always natural loops.
+ */
+
+#ifndef LOOPS_HPP
+#define LOOPS_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "cfg.hpp"
+
+namespace tacky {
+
+/**
+ * @brief Immediate dominators of the blocks reachable from the entry.
+ */
+class DominatorTree {
+    std::vector<int> idom;   ///< Immediate dominator of each block; the entry's is itself
+    std::vector<int> first;  ///< Number of each block in a preorder walk of the tree, or -1
+    std::vector<int> last;   ///< Largest number in the subtree of each block
+
+public:
+    /**
+     * @brief Computes the dominators of a graph whose edges are up to date.
+     */
+    explicit DominatorTree(const ControlFlowGraph& cfg);
+
+    /**
+     * @brief Returns true if a block is reachable from the entry.
+     */
+    bool reachable(int block) const { return first[block] >= 0; }
+
+    /**
+     * @brief Returns true if `a` dominates `b`; every block dominates itself.
+     *
+     * Takes constant time, however deep the tree.
+     */
+    bool dominates(int a, int b) const;
+};
+
+/**
+ * @brief A natural loop.
+ */
+struct Loop {
+    int header;               ///< The only block entered from outside the loop
+    std::vector<int> blocks;  ///< Blocks of the loop in increasing order, header included
+    std::vector<int> exits;   ///< Blocks outside the loop with a predecessor inside it
+
+    /**
+     * @brief Returns true if a block is part of the loop.
+     */
+    bool contains(int block) const { return std::binary_search(blocks.begin(), blocks.end(), block); }
+};
+
+/**
+ * @brief Finds the natural loops of a graph; back edges to the same header form one loop.
+ * @return The loops, larger first, so that a loop comes before the loops nested in it.
+ */
+std::vector<Loop> findLoops(const ControlFlowGraph& cfg, const DominatorTree& dominators);
+
+} // namespace tacky
+
+#endif // LOOPS_HPP
@@ -5,12 +5,27 @@
 #include <string>
 #include <stdexcept>
 
-std::string Lowerer::newTemp() {
-    return "%tmp" + std::to_string(tempCounter++);
+tacky::Value Lowerer::newTemp() {
+    return tacky::Value::reg(function.newRegister(symbols().numbered(tempBase, tempCounter++, '\0')));
 }
 
-std::string Lowerer::newLabel(const std::string& base) {
-    return base + "_" + std::to_string(labelCounter++);
+tacky::Value Lowerer::variable(Symbol name) {
+    if (name >= variableRegisters.size()) {
+        variableRegisters.resize(symbols().size(), UINT32_MAX);
+    }
+    uint32_t& reg = variableRegisters[name];
+    if (reg == UINT32_MAX) {
+        reg = function.newRegister(name);
+    }
+    return tacky::Value::reg(reg);
+}
+
+bool Lowerer::isCheapOperand(const Expression* expr) {
+    return expr->type == ExpressionType::CONSTANT || expr->type == ExpressionType::VAR;
+}
+
+Symbol Lowerer::newLabel(std::string_view base) {
+    return symbols().numbered(symbols().intern(base), labelCounter++);
 }
 
 tacky::BinaryOp Lowerer::toTackyBinaryOp(BinaryOpast op) {
@@ -31,165 +46,280 @@ tacky::BinaryOp Lowerer::toTackyBinaryOp(BinaryOpast op) {
     }
 }
 
-std::unique_ptr<tacky::Val> Lowerer::lowerExpression(const Expression* expr) {
-    // Binary operation
-    if (expr->operand1 && expr->operand2) {
-        if (expr->bin_op == BinaryOpast::AND) {
-            auto v1 = lowerExpression(expr->operand1.get());
-            std::string result = newTemp();
-            std::string falseLabel = newLabel("false");
-            std::string endLabel = newLabel("end");
-
-            instructions.push_back(std::make_unique<tacky::JumpIfZero>(
-                std::move(v1), falseLabel
-            ));
-
-            auto v2 = lowerExpression(expr->operand2.get());
-            instructions.push_back(std::make_unique<tacky::JumpIfZero>(
-                std::move(v2), falseLabel
-            ));
-
-            instructions.push_back(std::make_unique<tacky::Copy>(
-                std::make_unique<tacky::Constant>(1),
-                std::make_unique<tacky::Var>(result)
-            ));
-            instructions.push_back(std::make_unique<tacky::Jump>(endLabel));
-
-            instructions.push_back(std::make_unique<tacky::Label>(falseLabel));
-            instructions.push_back(std::make_unique<tacky::Copy>(
-                std::make_unique<tacky::Constant>(0),
-                std::make_unique<tacky::Var>(result)
-            ));
-
-            instructions.push_back(std::make_unique<tacky::Label>(endLabel));
-
-            return std::make_unique<tacky::Var>(result);
-        }
-
-        if (expr->bin_op == BinaryOpast::OR) {
-            auto v1 = lowerExpression(expr->operand1.get());
-            std::string result = newTemp();
-            std::string trueLabel = newLabel("true");
-            std::string endLabel = newLabel("end");
-
-            instructions.push_back(std::make_unique<tacky::JumpIfNotZero>(
-                std::move(v1), trueLabel
-            ));
+tacky::Value Lowerer::lowerExpression(const Expression* expr) {
+    tasks.push_back({Task::Kind::Value, expr});
+    runTasks(tasks.size() - 1);
+    tacky::Value result = values.back();
+    values.pop_back();
+    return result;
+}
 
-            auto v2 = lowerExpression(expr->operand2.get());
-            instructions.push_back(std::make_unique<tacky::JumpIfNotZero>(
-                std::move(v2), trueLabel
-            ));
+void Lowerer::lowerCondition(const Expression* condition, Symbol target, bool jumpIfTrue) {
+    tasks.push_back({Task::Kind::Condition, condition, target});
+    tasks.back().jumpIfTrue = jumpIfTrue;
+    runTasks(tasks.size() - 1);
+}
 
-            instructions.push_back(std::make_unique<tacky::Copy>(
-                std::make_unique<tacky::Constant>(0),
-                std::make_unique<tacky::Var>(result)
-            ));
-            instructions.push_back(std::make_unique<tacky::Jump>(endLabel));
+// --- Expression tasks ---
+
+void Lowerer::runTasks(size_t base) {
+    using Kind = Task::Kind;
+
+    // Tasks run last pushed first: the steps of a node are pushed in reverse order, and an
+    // evaluated operand is left on `values` for the step that consumes it
+    auto popValue = [this]() {
+        tacky::Value value = values.back();
+        values.pop_back();
+        return value;
+    };
+    auto condition = [this](const Expression* expr, Symbol target, bool jumpIfTrue) {
+        Task task{Kind::Condition, expr, target};
+        task.jumpIfTrue = jumpIfTrue;
+        return task;
+    };
+
+    while (tasks.size() > base) {
+        Task task = tasks.back();
+        tasks.pop_back();
+
+        switch (task.kind) {
+            case Kind::Value:
+                pushValueTasks(task.expr);
+                break;
+
+            case Kind::Condition: {
+                const Expression* expr = task.expr;
+                if (expr->type == ExpressionType::BINARY) {
+                    auto binary = expr->as<BinaryExpression>();
+
+                    if (binary->bin_op == BinaryOpast::AND || binary->bin_op == BinaryOpast::OR) {
+                        // a && b is decided as soon as a is false, a || b as soon as a is true
+                        bool decidedBy = binary->bin_op == BinaryOpast::OR;
+                        if (task.jumpIfTrue == decidedBy) {
+                            tasks.push_back(condition(binary->operand2, task.target, task.jumpIfTrue));
+                            tasks.push_back(condition(binary->operand1, task.target, task.jumpIfTrue));
+                        } else {
+                            Symbol skipLabel = newLabel(decidedBy ? "true" : "false");
+                            tasks.push_back({Kind::Label, nullptr, skipLabel});
+                            tasks.push_back(condition(binary->operand2, task.target, task.jumpIfTrue));
+                            tasks.push_back(condition(binary->operand1, skipLabel, decidedBy));
+                        }
+                        break;
+                    }
+
+                    tacky::BinaryOp op = toTackyBinaryOp(binary->bin_op);
+                    if (tacky::isRelational(op)) {
+                        Task compare{Kind::Compare, nullptr, task.target};
+                        compare.op = task.jumpIfTrue ? op : tacky::negateRelation(op);
+                        tasks.push_back(compare);
+                        tasks.push_back({Kind::Value, binary->operand2});
+                        tasks.push_back({Kind::Value, binary->operand1});
+                        break;
+                    }
+                } else if (expr->type == ExpressionType::UNARY && expr->as<UnaryExpression>()->un_op == UnaryOpast::NOT) {
+                    tasks.push_back(condition(expr->as<UnaryExpression>()->operand, task.target, !task.jumpIfTrue));
+                    break;
+                } else if (expr->type == ExpressionType::CONSTANT) {
+                    if ((expr->as<ConstantExpression>()->value != 0) == task.jumpIfTrue) {
+                        emit(tacky::Instr::jump(task.target));
+                    }
+                    break;
+                }
 
-            instructions.push_back(std::make_unique<tacky::Label>(trueLabel));
-            instructions.push_back(std::make_unique<tacky::Copy>(
-                std::make_unique<tacky::Constant>(1),
-                std::make_unique<tacky::Var>(result)
-            ));
+                // Any other condition is computed as a value and tested against zero
+                Task test{Kind::JumpIf, nullptr, task.target};
+                test.jumpIfTrue = task.jumpIfTrue;
+                tasks.push_back(test);
+                tasks.push_back({Kind::Value, expr});
+                break;
+            }
 
-            instructions.push_back(std::make_unique<tacky::Label>(endLabel));
+            case Kind::Unary: {
+                auto src = popValue();
+                tacky::Value tmp = newTemp();
+
+                tacky::UnaryOp op;
+                switch (task.expr->as<UnaryExpression>()->un_op) {
+                    case UnaryOpast::COMPLEMENT: op = tacky::UnaryOp::Complement; break;
+                    case UnaryOpast::NEGATE:     op = tacky::UnaryOp::Negate;     break;
+                    case UnaryOpast::NOT:        op = tacky::UnaryOp::Not;        break;
+                    default:
+                        throw std::runtime_error("Unknown UnaryOpast in lowerExpression");
+                }
 
-            return std::make_unique<tacky::Var>(result);
-        }
+                emit(tacky::Instr::unary(op, src, tmp));
+                values.push_back(tmp);
+                break;
+            }
 
-        // Standard binary op
-        auto lhs = lowerExpression(expr->operand1.get());
-        auto rhs = lowerExpression(expr->operand2.get());
-        auto tmpName = newTemp();
+            case Kind::Binary: {
+                auto rhs = popValue();
+                auto lhs = popValue();
+                tacky::Value tmp = newTemp();
 
-        tacky::BinaryOp op = toTackyBinaryOp(expr->bin_op);
-        instructions.push_back(std::make_unique<tacky::Binary>(
-            op,
-            std::move(lhs),
-            std::move(rhs),
-            std::make_unique<tacky::Var>(tmpName)
-        ));
+                tacky::BinaryOp op = toTackyBinaryOp(task.expr->as<BinaryExpression>()->bin_op);
+                emit(tacky::Instr::binary(op, lhs, rhs, tmp));
+                values.push_back(tmp);
+                break;
+            }
 
-        return std::make_unique<tacky::Var>(tmpName);
-    }
+            case Kind::Assign: {
+                auto rhs = popValue();
+                tacky::Value lhs = variable(task.expr->as<AssignmentExpression>()->exp1->as<VarExpression>()->symbol);
 
-    // Constant
-    if (!expr->operand && expr->type == ExpressionType::CONSTANT) {
-        return std::make_unique<tacky::Constant>(expr->value);
-    }
+                emit(tacky::Instr::copy(rhs, lhs));
+                values.push_back(lhs);
+                break;
+            }
 
-    // Variable
-    if (expr->type == ExpressionType::VAR) {
-        return std::make_unique<tacky::Var>(expr->identifier);
-    }
+            case Kind::Logical:
+                // The operands fell through: a && b is 1 and a || b is 0, else the label gives the other value
+                emit(tacky::Instr::copy(tacky::Value::imm(task.jumpIfTrue ? 0 : 1), task.result));
+                emit(tacky::Instr::jump(task.end));
+
+                emit(tacky::Instr::labelAt(task.target));
+                emit(tacky::Instr::copy(tacky::Value::imm(task.jumpIfTrue ? 1 : 0), task.result));
+
+                emit(tacky::Instr::labelAt(task.end));
+                values.push_back(task.result);
+                break;
+
+            case Kind::Select: {
+                // dst = falseVal, then dst = trueVal if the condition holds
+                auto falseVal = popValue();
+                auto trueVal = popValue();
+                auto value = popValue();
+                emit(tacky::Instr::copy(falseVal, task.result));
+                emit(tacky::Instr::copyIfNotZero(value, trueVal, task.result));
+                values.push_back(task.result);
+                break;
+            }
 
-    // Assignment (only var = expr form supported)
-    if (expr->type == ExpressionType::ASSIGNMENT && expr->exp1->type == ExpressionType::VAR) {
-        auto rhs = lowerExpression(expr->exp2.get());
-        std::string lhsName = expr->exp1->identifier;
+            case Kind::CopyThenJump:
+                // End of the true branch, start of the else branch
+                emit(tacky::Instr::copy(popValue(), task.result));
+                emit(tacky::Instr::jump(task.end));
+                emit(tacky::Instr::labelAt(task.target));
+                break;
+
+            case Kind::CopyThenLabel:
+                // End of the else branch
+                emit(tacky::Instr::copy(popValue(), task.result));
+                emit(tacky::Instr::labelAt(task.end));
+                values.push_back(task.result);
+                break;
+
+            case Kind::Compare: {
+                auto rhs = popValue();
+                auto lhs = popValue();
+                emit(tacky::Instr::jumpIfCompare(task.op, lhs, rhs, task.target));
+                break;
+            }
 
-        instructions.push_back(std::make_unique<tacky::Copy>(
-            std::move(rhs),
-            std::make_unique<tacky::Var>(lhsName)
-        ));
+            case Kind::JumpIf: {
+                auto value = popValue();
+                emit(task.jumpIfTrue ? tacky::Instr::jumpIfNotZero(value, task.target)
+                                     : tacky::Instr::jumpIfZero(value, task.target));
+                break;
+            }
 
-        return std::make_unique<tacky::Var>(lhsName);
+            case Kind::Label:
+                emit(tacky::Instr::labelAt(task.target));
+                break;
+        }
     }
+}
 
-    if (expr->type == ExpressionType::CONDITIONAL) {
-        auto dst = newTemp();  // temporary variable to hold the result
-
-        std::string elseLabel = newLabel("cond_else");
-        std::string endLabel = newLabel("cond_end");
-
-        // Lower the condition expression
-        auto condVal = lowerExpression(expr->condition.get());
-
-        // If condition is false, jump to else
-        instructions.push_back(std::make_unique<tacky::JumpIfZero>(std::move(condVal), elseLabel));
-
-        // True branch: evaluate and copy to dst
-        auto trueVal = lowerExpression(expr->trueExpr.get());
-        instructions.push_back(std::make_unique<tacky::Copy>(std::move(trueVal), std::make_unique<tacky::Var>(dst)));
-
-        instructions.push_back(std::make_unique<tacky::Jump>(endLabel));
+void Lowerer::pushValueTasks(const Expression* expr) {
+    using Kind = Task::Kind;
+
+    switch (expr->type) {
+        case ExpressionType::BINARY: {
+            auto binary = expr->as<BinaryExpression>();
+
+            if (binary->bin_op == BinaryOpast::AND || binary->bin_op == BinaryOpast::OR) {
+                // Both operands jump to the label that decides the result, and fall through otherwise
+                bool isOr = binary->bin_op == BinaryOpast::OR;
+                Task logical{Kind::Logical};
+                logical.result = newTemp();
+                logical.target = newLabel(isOr ? "true" : "false");
+                logical.end = newLabel("end");
+                logical.jumpIfTrue = isOr;
+                tasks.push_back(logical);
+
+                for (const Expression* operand : {binary->operand2, binary->operand1}) {
+                    Task task{Kind::Condition, operand, logical.target};
+                    task.jumpIfTrue = isOr;
+                    tasks.push_back(task);
+                }
+                return;
+            }
 
-        // Else label
-        instructions.push_back(std::make_unique<tacky::Label>(elseLabel));
+            // Standard binary op
+            tasks.push_back({Kind::Binary, expr});
+            tasks.push_back({Kind::Value, binary->operand2});
+            tasks.push_back({Kind::Value, binary->operand1});
+            return;
+        }
 
-        // False branch: evaluate and copy to dst
-        auto falseVal = lowerExpression(expr->falseExpr.get());
-        instructions.push_back(std::make_unique<tacky::Copy>(std::move(falseVal), std::make_unique<tacky::Var>(dst)));
+        case ExpressionType::CONSTANT:
+            values.push_back(tacky::Value::imm(expr->as<ConstantExpression>()->value));
+            return;
 
-        // End label
-        instructions.push_back(std::make_unique<tacky::Label>(endLabel));
+        case ExpressionType::VAR:
+            values.push_back(variable(expr->as<VarExpression>()->symbol));
+            return;
 
-        return std::make_unique<tacky::Var>(dst);
-    }
+        // Assignment (only var = expr form supported)
+        case ExpressionType::ASSIGNMENT: {
+            auto assign = expr->as<AssignmentExpression>();
+            if (assign->exp1->type != ExpressionType::VAR) break;
 
+            tasks.push_back({Kind::Assign, expr});
+            tasks.push_back({Kind::Value, assign->exp2});
+            return;
+        }
 
-    // Unary
-    if (expr->operand) {
-        auto src = lowerExpression(expr->operand.get());
-        auto tmpName = newTemp();
+        case ExpressionType::CONDITIONAL: {
+            auto cond = expr->as<ConditionalExpression>();
+            tacky::Value dst = newTemp();  // temporary variable to hold the result
+
+            if (branchlessConditionals && isCheapOperand(cond->trueExpr) && isCheapOperand(cond->falseExpr)) {
+                Task select{Kind::Select};
+                select.result = dst;
+                tasks.push_back(select);
+                tasks.push_back({Kind::Value, cond->falseExpr});
+                tasks.push_back({Kind::Value, cond->trueExpr});
+                tasks.push_back({Kind::Value, cond->condition});
+                return;
+            }
 
-        tacky::UnaryOp op;
-        switch (expr->un_op) {
-            case UnaryOpast::COMPLEMENT: op = tacky::UnaryOp::Complement; break;
-            case UnaryOpast::NEGATE:     op = tacky::UnaryOp::Negate;     break;
-            case UnaryOpast::NOT:        op = tacky::UnaryOp::Not;        break;
-            default:
-                throw std::runtime_error("Unknown UnaryOpast in lowerExpression");
+            Symbol elseLabel = newLabel("cond_else");
+            Symbol endLabel = newLabel("cond_end");
+
+            // condition, jumping to else if false; true branch; else label; false branch; end label
+            Task last{Kind::CopyThenLabel};
+            last.result = dst;
+            last.end = endLabel;
+            tasks.push_back(last);
+            tasks.push_back({Kind::Value, cond->falseExpr});
+
+            Task middle{Kind::CopyThenJump, nullptr, elseLabel};
+            middle.result = dst;
+            middle.end = endLabel;
+            tasks.push_back(middle);
+            tasks.push_back({Kind::Value, cond->trueExpr});
+
+            Task test{Kind::Condition, cond->condition, elseLabel};
+            test.jumpIfTrue = false;
+            tasks.push_back(test);
+            return;
         }
 
-        instructions.push_back(std::make_unique<tacky::Unary>(
-            op,
-            std::move(src),
-            std::make_unique<tacky::Var>(tmpName)
-        ));
-
-        return std::make_unique<tacky::Var>(tmpName);
+        case ExpressionType::UNARY:
+            tasks.push_back({Kind::Unary, expr});
+            tasks.push_back({Kind::Value, expr->as<UnaryExpression>()->operand});
+            return;
     }
 
     throw std::runtime_error("Unhandled expression type");
@@ -198,126 +328,126 @@ std::unique_ptr<tacky::Val> Lowerer::lowerExpression(const Expression* expr) {
 void Lowerer::lowerStatement(const Statement* stmt) {
     switch (stmt->type) {
         case StatementType::RETURN: {
-            auto val = lowerExpression(stmt->expression.get());
-            instructions.push_back(std::make_unique<tacky::Return>(std::move(val)));
+            auto val = lowerExpression(stmt->as<ExpressionStatement>()->expression);
+            emit(tacky::Instr::ret(val));
             break;
         }
         case StatementType::EXPRESSION: {
-            lowerExpression(stmt->expression.get());
+            lowerExpression(stmt->as<ExpressionStatement>()->expression);
             break;
         }
         case StatementType::IF: {
-            auto condVal = lowerExpression(stmt->condition.get());
+            auto ifStmt = stmt->as<IfStatement>();
 
-            std::string elseLabel = newLabel("else");
-            std::string endLabel = newLabel("endif");
+            Symbol elseLabel = newLabel("else");
+            Symbol endLabel = newLabel("endif");
 
-            if (stmt->elseBranch) {
-                instructions.push_back(std::make_unique<tacky::JumpIfZero>(std::move(condVal), elseLabel));
+            if (ifStmt->elseBranch) {
+                lowerCondition(ifStmt->condition, elseLabel, false);
 
-                lowerStatement(stmt->thenBranch.get());
+                lowerStatement(ifStmt->thenBranch);
 
-                instructions.push_back(std::make_unique<tacky::Jump>(endLabel));
+                emit(tacky::Instr::jump(endLabel));
 
-                instructions.push_back(std::make_unique<tacky::Label>(elseLabel));
+                emit(tacky::Instr::labelAt(elseLabel));
 
-                lowerStatement(stmt->elseBranch.get());
-                instructions.push_back(std::make_unique<tacky::Label>(endLabel));
+                lowerStatement(ifStmt->elseBranch);
+                emit(tacky::Instr::labelAt(endLabel));
             } else {
-                instructions.push_back(std::make_unique<tacky::JumpIfZero>(std::move(condVal), endLabel));
+                lowerCondition(ifStmt->condition, endLabel, false);
 
-                lowerStatement(stmt->thenBranch.get());
+                lowerStatement(ifStmt->thenBranch);
 
-                instructions.push_back(std::make_unique<tacky::Jump>(endLabel));
+                emit(tacky::Instr::jump(endLabel));
 
-                instructions.push_back(std::make_unique<tacky::Label>(endLabel));
+                emit(tacky::Instr::labelAt(endLabel));
             }
 
             break;
         }
         case StatementType::COMPOUND: {
-            lowerBlock(stmt->block.get());
+            lowerBlock(stmt->as<CompoundStatement>()->block);
             break;
         }
         case StatementType::BREAK: {
-            std::string breakLabel = "break_" + stmt->label;
-            instructions.push_back(std::make_unique<tacky::Jump>(breakLabel));
+            Symbol breakLabel = symbols().derive(breakPrefix, stmt->as<LoopControlStatement>()->label);
+            emit(tacky::Instr::jump(breakLabel));
             break;
         }
         case StatementType::CONTINUE: {
-            std::string continueLabel = "continue_" + stmt->label;
-            instructions.push_back(std::make_unique<tacky::Jump>(continueLabel));
+            Symbol continueLabel = symbols().derive(continuePrefix, stmt->as<LoopControlStatement>()->label);
+            emit(tacky::Instr::jump(continueLabel));
             break;
         }
         case StatementType::DO_WHILE: {
-            std::string startLabel = "start_" + stmt->label;
-            std::string breakLabel = "break_" + stmt->label;
-            std::string continueLabel = "continue_" + stmt->label;
-
-            instructions.push_back(std::make_unique<tacky::Label>(startLabel));
+            auto loop = stmt->as<WhileStatement>();
+            Symbol label = loop->label;
+            Symbol startLabel = symbols().derive(startPrefix, label);
+            Symbol breakLabel = symbols().derive(breakPrefix, label);
+            Symbol continueLabel = symbols().derive(continuePrefix, label);
 
-            lowerStatement(stmt->body.get());
+            emit(tacky::Instr::labelAt(startLabel));
 
-            instructions.push_back(std::make_unique<tacky::Label>(continueLabel));
+            lowerStatement(loop->body);
 
-            auto condVal = lowerExpression(stmt->condition.get());
+            emit(tacky::Instr::labelAt(continueLabel));
 
-            instructions.push_back(std::make_unique<tacky::JumpIfNotZero>(std::move(condVal),startLabel));
+            lowerCondition(loop->condition, startLabel, true);
 
-            instructions.push_back(std::make_unique<tacky::Label>(breakLabel));
+            emit(tacky::Instr::labelAt(breakLabel));
 
             break;
         }
         case StatementType::WHILE: {
-            std::string breakLabel = "break_" + stmt->label;
-            std::string continueLabel = "continue_" + stmt->label;
-
-            instructions.push_back(std::make_unique<tacky::Label>(continueLabel));
+            auto loop = stmt->as<WhileStatement>();
+            Symbol label = loop->label;
+            Symbol breakLabel = symbols().derive(breakPrefix, label);
+            Symbol continueLabel = symbols().derive(continuePrefix, label);
 
-            auto condVal = lowerExpression(stmt->condition.get());
+            emit(tacky::Instr::labelAt(continueLabel));
 
-            instructions.push_back(std::make_unique<tacky::JumpIfZero>(std::move(condVal),breakLabel));
+            lowerCondition(loop->condition, breakLabel, false);
 
-            lowerStatement(stmt->body.get());
+            lowerStatement(loop->body);
 
-            instructions.push_back(std::make_unique<tacky::Jump>(continueLabel));
+            emit(tacky::Instr::jump(continueLabel));
 
-            instructions.push_back(std::make_unique<tacky::Label>(breakLabel));
+            emit(tacky::Instr::labelAt(breakLabel));
 
             break;
         }
         case StatementType::FOR: {
-            std::string startLabel = "start_" + stmt->label;
-            std::string continueLabel = "continue_" + stmt->label;
-            std::string breakLabel = "break_" + stmt->label;
-
-            if (stmt->forInit) {
-                if (stmt->forInit->type == ForInitType::INIT_DECL) {
-                    BlockItem item(std::move(stmt->forInit->decl));
-                    lowerBlockItem(&item);
-                } else if (stmt->forInit->type == ForInitType::INIT_EXP) {
-                    lowerExpression(stmt->forInit->expr.get());
+            auto loop = stmt->as<ForStatement>();
+            Symbol label = loop->label;
+            Symbol startLabel = symbols().derive(startPrefix, label);
+            Symbol continueLabel = symbols().derive(continuePrefix, label);
+            Symbol breakLabel = symbols().derive(breakPrefix, label);
+
+            if (loop->forInit) {
+                if (loop->forInit->type == ForInitType::INIT_DECL) {
+                    lowerDeclaration(loop->forInit->decl);
+                } else if (loop->forInit->type == ForInitType::INIT_EXP && loop->forInit->expr) {
+                    lowerExpression(loop->forInit->expr);
                 }
             }
 
-            instructions.push_back(std::make_unique<tacky::Label>(startLabel));
+            emit(tacky::Instr::labelAt(startLabel));
 
-            if (stmt->condition) {
-                auto condVal = lowerExpression(stmt->condition.get());
-                instructions.push_back(std::make_unique<tacky::JumpIfZero>(std::move(condVal), breakLabel));
+            if (loop->condition) {
+                lowerCondition(loop->condition, breakLabel, false);
             }
             
-            lowerStatement(stmt->body.get());
+            lowerStatement(loop->body);
 
-            instructions.push_back(std::make_unique<tacky::Label>(continueLabel));
+            emit(tacky::Instr::labelAt(continueLabel));
 
-            if (stmt->postExpr) {
-                lowerExpression(stmt->postExpr.get());
+            if (loop->postExpr) {
+                lowerExpression(loop->postExpr);
             }
 
-            instructions.push_back(std::make_unique<tacky::Jump>(startLabel));
+            emit(tacky::Instr::jump(startLabel));
 
-            instructions.push_back(std::make_unique<tacky::Label>(breakLabel));
+            emit(tacky::Instr::labelAt(breakLabel));
 
             break;
         }
@@ -331,36 +461,38 @@ void Lowerer::lowerBlock(const Block* block) {
 
     // Iterate over each item in the block and lower it
     for (const auto& item : block->items) {
-        lowerBlockItem(item.get());
+        lowerBlockItem(&item);
+    }
+}
+
+void Lowerer::lowerDeclaration(const Declaration* decl) {
+    if (decl->initializer) {
+        auto val = lowerExpression(decl->initializer);
+        emit(tacky::Instr::copy(val, variable(decl->symbol)));
     }
 }
 
 void Lowerer::lowerBlockItem(const BlockItem* item) {
     if (item->type == BlockItemType::STATEMENT) {
-        lowerStatement(item->statement.get());
+        lowerStatement(item->statement);
     } else if (item->type == BlockItemType::DECLARATION) {
-        std::string varName = item->declaration->name;
-
-        if (item->declaration->initializer) {
-            auto val = lowerExpression(item->declaration->initializer.get());
-            instructions.push_back(std::make_unique<tacky::Copy>(
-                std::move(val),
-                std::make_unique<tacky::Var>(varName)
-            ));
-        }
+        lowerDeclaration(item->declaration);
     }
 }
 
 void Lowerer::lowerFunction(const Function* fn) {
-    lowerBlock(fn->body.get());
+    lowerBlock(fn->body);
 }
 
-std::unique_ptr<tacky::Program> Lowerer::lower(const Program* astProgram) {
-    auto func = std::make_unique<tacky::Function>(astProgram->function->name);
+tacky::FlatProgram Lowerer::lower(const Program* astProgram) {
+    function.name = std::string(astProgram->function->name);
 
-    lowerFunction(astProgram->function.get());
+    lowerFunction(astProgram->function);
 
-    func->body = std::move(instructions);
+    // Falling off the end of main returns 0
+    if (function.code.empty() || function.code.back().op != tacky::Opcode::Return) {
+        emit(tacky::Instr::ret(tacky::Value::imm(0)));
+    }
 
-    return std::make_unique<tacky::Program>(std::move(func));
+    return tacky::FlatProgram{std::move(function)};
 }
@@ -14,28 +14,90 @@
  * 
  * It performs a post-order traversal of the AST expressions and
  * generates a flat list of TACKY instructions using temporary variables
- * and labels for control flow constructs.
+ * and labels for control flow constructs. Instructions are emitted
+ * directly into the flat IR (tacky::FlatFunction); variables and
+ * temporaries become virtual registers.
  */
 class Lowerer {
 private:
-    int tempCounter = 0; ///< Counter to generate fresh temporary variable names
-    int labelCounter = 0; ///< Counter to generate fresh labels
-    std::vector<std::unique_ptr<tacky::Instruction>> instructions; ///< Buffer of TACKY instructions
+    uint32_t tempCounter = 0; ///< Counter to generate fresh temporary variable names
+    uint32_t labelCounter = 0; ///< Counter to generate fresh labels
+    Symbol tempBase = symbols().intern("%tmp"); ///< Base name of temporaries
+    Symbol startPrefix = symbols().intern("start"); ///< Prefix of loop start labels
+    Symbol continuePrefix = symbols().intern("continue"); ///< Prefix of loop continue labels
+    Symbol breakPrefix = symbols().intern("break"); ///< Prefix of loop break labels
+    bool branchlessConditionals; ///< Lower cheap `?:` to CopyIfNotZero instead of jumps
+    tacky::FlatFunction function; ///< Function being lowered
+    std::vector<uint32_t> variableRegisters; ///< Virtual register of each variable, indexed by symbol
 
     /**
-     * @brief Generate a new unique temporary variable name.
+     * @brief A pending step of the lowering of an expression.
+     *
+     * Expressions are lowered with an explicit stack of tasks instead of recursion, so
+     * that nesting depth is bounded by memory rather than by the call stack. Which
+     * fields are meaningful depends on the kind.
+     */
+    struct Task {
+        enum class Kind : uint8_t {
+            Value,          ///< Lower `expr`, leaving its value on `values`
+            Condition,      ///< Lower `expr` into a jump to `target` if it is `jumpIfTrue`
+            Unary,          ///< Apply the operator of `expr` to the top value
+            Binary,         ///< Apply the operator of `expr` to the two top values
+            Assign,         ///< Copy the top value into the variable assigned by `expr`
+            Logical,        ///< Set `result` of a && or || whose operands jump to `target`
+            Select,         ///< Select `result` from the condition and arm values of a cheap ?:
+            CopyThenJump,   ///< Copy the top value into `result`, jump to `end`, place `target`
+            CopyThenLabel,  ///< Copy the top value into `result`, place `end`
+            Compare,        ///< Jump to `target` if the two top values compare by `op`
+            JumpIf,         ///< Jump to `target` if the top value is non-zero (`jumpIfTrue`) or zero
+            Label           ///< Place `target`
+        };
+        Kind kind;
+        const Expression* expr;
+        Symbol target;
+        Symbol end = NoSymbol;
+        tacky::Value result;
+        tacky::BinaryOp op = tacky::BinaryOp::ADD;
+        bool jumpIfTrue = false;
+
+        Task(Kind k, const Expression* e = nullptr, Symbol t = NoSymbol) : kind(k), expr(e), target(t) {}
+    };
+    std::vector<Task> tasks; ///< Pending tasks, innermost last
+    std::vector<tacky::Value> values; ///< Values of the operands lowered and not consumed yet
+
+    /**
+     * @brief Returns true if an expression can be evaluated even when its value is not
+     * used: it is a constant or a variable, so it has no side effect and cannot trap.
+     */
+    static bool isCheapOperand(const Expression* expr);
+
+    /**
+     * @brief Generate a new temporary in a fresh virtual register.
+     * 
+     * @return The register, named by a unique symbol (e.g., "%tmp0").
+     */
+    tacky::Value newTemp();
+
+    /**
+     * @brief Return the virtual register holding a variable, creating it on first use.
      * 
-     * @return A string representing the temporary variable (e.g., "%tmp0").
+     * @param name The unique name of the variable.
+     * @return The register.
+     */
+    tacky::Value variable(Symbol name);
+
+    /**
+     * @brief Append an instruction to the function being lowered.
      */
-    std::string newTemp();
+    void emit(const tacky::Instr& instr) { function.code.push_back(instr); }
 
     /**
      * @brief Generate a new unique label name based on a base string.
      * 
      * @param base The base name for the label (e.g., "true", "false", "end").
-     * @return A unique label string (e.g., "false_1").
+     * @return A symbol naming the unique label (e.g., "false_1").
      */
-    std::string newLabel(const std::string& base);
+    Symbol newLabel(std::string_view base);
 
     /**
      * @brief Convert an AST binary operator to its TACKY equivalent.
@@ -48,15 +110,40 @@ private:
     tacky::BinaryOp toTackyBinaryOp(BinaryOpast op);
 
     /**
-     * @brief Recursively lower an AST Expression node to a TACKY Val.
+     * @brief Lower an AST Expression node to a TACKY value.
      * 
      * Handles constants, variables, unary/binary expressions,
      * logical AND/OR with short-circuiting, and assignments.
+     * Operands are lowered left to right, in post-order, with the task stack.
      * 
      * @param expr Pointer to the AST Expression node.
-     * @return A unique_ptr to the lowered TACKY Val.
+     * @return The immediate or register holding the result.
      */
-    std::unique_ptr<tacky::Val> lowerExpression(const Expression* expr);
+    tacky::Value lowerExpression(const Expression* expr);
+
+    /**
+     * @brief Lower an expression used as a condition into a jump to `target`.
+     *
+     * Jumps when the condition is true (`jumpIfTrue`) or false, and falls through
+     * otherwise. Comparisons become a single JumpIfCompare, `!`, `&&` and `||` become
+     * jumps around each other, and constants an unconditional jump or nothing, so the
+     * 0/1 value of a condition is only computed when it is used as a value.
+     *
+     * @param condition Pointer to the AST Expression node.
+     * @param target Label to jump to.
+     * @param jumpIfTrue Whether to jump when the condition holds or when it does not.
+     */
+    void lowerCondition(const Expression* condition, Symbol target, bool jumpIfTrue);
+
+    /**
+     * @brief Run the tasks above `base` on the task stack, until it is back to `base` entries.
+     */
+    void runTasks(size_t base);
+
+    /**
+     * @brief Push the tasks that lower an expression to a value, or push the value of a leaf.
+     */
+    void pushValueTasks(const Expression* expr);
 
     /**
      * @brief Lower a single AST Statement into TACKY instructions.
@@ -67,6 +154,15 @@ private:
      */
     void lowerStatement(const Statement* stmt);
 
+    /**
+     * @brief Lower a variable declaration.
+     * 
+     * Emits a copy of the initializer into the variable if one is provided.
+     * 
+     * @param decl Pointer to the Declaration node.
+     */
+    void lowerDeclaration(const Declaration* decl);
+
     /**
      * @brief Lower a single BlockItem (either a declaration or statement).
      * 
@@ -95,12 +191,21 @@ private:
 
 public:
     /**
-     * @brief Lower an entire AST Program node into a TACKY IR Program.
+     * @brief Creates a lowerer.
+     *
+     * @param branchless If set, a conditional expression whose arms are both constants or
+     *        variables evaluates both arms and selects the result with a CopyIfNotZero,
+     *        which the backends turn into a conditional move, instead of branching.
+     */
+    explicit Lowerer(bool branchless = false) : branchlessConditionals(branchless) {}
+
+    /**
+     * @brief Lower an entire AST Program node into a flat TACKY IR Program.
      * 
      * @param astProgram Pointer to the AST Program node.
-     * @return A unique_ptr to the resulting TACKY IR Program.
+     * @return The resulting flat TACKY IR Program.
      */
-    std::unique_ptr<tacky::Program> lower(const Program* astProgram);
+    tacky::FlatProgram lower(const Program* astProgram);
 };
 
 #endif // LOWERER_HPP
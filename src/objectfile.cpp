@@ -0,0 +1,264 @@
+/**
+ * @file objectfile.cpp
+ * @brief Implementation of the ELF and Mach-O object writers.
+ */
+
+#include "objectfile.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Little-endian byte buffer.
+ */
+class ByteWriter {
+    std::vector<uint8_t> bytes;
+
+public:
+    size_t size() const { return bytes.size(); }
+    const std::vector<uint8_t>& data() const { return bytes; }
+
+    void u8(uint8_t v) { bytes.push_back(v); }
+    void u16(uint16_t v) { for (int i = 0; i < 2; ++i) u8(static_cast<uint8_t>(v >> (8 * i))); }
+    void u32(uint32_t v) { for (int i = 0; i < 4; ++i) u8(static_cast<uint8_t>(v >> (8 * i))); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; ++i) u8(static_cast<uint8_t>(v >> (8 * i))); }
+    void append(const std::vector<uint8_t>& other) { bytes.insert(bytes.end(), other.begin(), other.end()); }
+
+    /** Writes `s` NUL-padded to exactly `width` bytes. */
+    void fixed(const std::string& s, size_t width) {
+        for (size_t i = 0; i < width; ++i) u8(i < s.size() ? static_cast<uint8_t>(s[i]) : 0);
+    }
+
+    void cstring(const std::string& s) {
+        for (char c : s) u8(static_cast<uint8_t>(c));
+        u8(0);
+    }
+
+    void alignTo(size_t alignment) {
+        while (bytes.size() % alignment != 0) u8(0);
+    }
+};
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// --- ELF ---
+
+/**
+ * Layout: header, .text, .symtab, .strtab, .shstrtab, section headers. The empty
+ * .note.GNU-stack section marks the stack as non-executable.
+ */
+std::vector<uint8_t> buildELF(const MachineCode& code) {
+    constexpr size_t HeaderSize = 64;
+    constexpr size_t SymbolSize = 24;
+    constexpr size_t SectionHeaderSize = 64;
+    constexpr uint16_t SectionCount = 6;
+
+    ByteWriter strtab;
+    strtab.u8(0);
+    uint32_t nameIndex = static_cast<uint32_t>(strtab.size());
+    strtab.cstring(code.name);
+
+    ByteWriter shstrtab;
+    shstrtab.u8(0);
+    auto sectionName = [&](const char* name) {
+        uint32_t index = static_cast<uint32_t>(shstrtab.size());
+        shstrtab.cstring(name);
+        return index;
+    };
+    uint32_t textName = sectionName(".text");
+    uint32_t symtabName = sectionName(".symtab");
+    uint32_t strtabName = sectionName(".strtab");
+    uint32_t shstrtabName = sectionName(".shstrtab");
+    uint32_t noteName = sectionName(".note.GNU-stack");
+
+    size_t textOffset = HeaderSize;
+    size_t symtabOffset = alignUp(textOffset + code.text.size(), 8);
+    size_t strtabOffset = symtabOffset + 2 * SymbolSize;
+    size_t shstrtabOffset = strtabOffset + strtab.size();
+    size_t sectionsOffset = alignUp(shstrtabOffset + shstrtab.size(), 8);
+
+    ByteWriter out;
+    // e_ident: magic, 64-bit, little-endian, version 1, System V ABI
+    out.u8(0x7f); out.u8('E'); out.u8('L'); out.u8('F');
+    out.u8(2); out.u8(1); out.u8(1); out.u8(0);
+    out.fixed("", 8);
+    out.u16(1);                // ET_REL
+    out.u16(62);               // EM_X86_64
+    out.u32(1);                // EV_CURRENT
+    out.u64(0);                // e_entry
+    out.u64(0);                // e_phoff
+    out.u64(sectionsOffset);   // e_shoff
+    out.u32(0);                // e_flags
+    out.u16(HeaderSize);
+    out.u16(0);                // e_phentsize
+    out.u16(0);                // e_phnum
+    out.u16(SectionHeaderSize);
+    out.u16(SectionCount);
+    out.u16(4);                // e_shstrndx
+
+    out.append(code.text);
+    out.alignTo(8);
+
+    // Symbols: the null symbol, then the function (global, STT_FUNC, in .text)
+    out.fixed("", SymbolSize);
+    out.u32(nameIndex);
+    out.u8(0x12);
+    out.u8(0);
+    out.u16(1);
+    out.u64(0);
+    out.u64(code.text.size());
+
+    out.append(strtab.data());
+    out.append(shstrtab.data());
+    out.alignTo(8);
+
+    auto sectionHeader = [&](uint32_t name, uint32_t type, uint64_t flags, size_t offset, size_t size,
+                             uint32_t link, uint32_t info, uint64_t align, uint64_t entsize) {
+        out.u32(name);
+        out.u32(type);
+        out.u64(flags);
+        out.u64(0);  // sh_addr
+        out.u64(offset);
+        out.u64(size);
+        out.u32(link);
+        out.u32(info);
+        out.u64(align);
+        out.u64(entsize);
+    };
+    out.fixed("", SectionHeaderSize);
+    sectionHeader(textName, 1, 0x6, textOffset, code.text.size(), 0, 0, 16, 0);  // PROGBITS, AX
+    sectionHeader(symtabName, 2, 0, symtabOffset, 2 * SymbolSize, 3, 1, 8, SymbolSize);
+    sectionHeader(strtabName, 3, 0, strtabOffset, strtab.size(), 0, 0, 1, 0);
+    sectionHeader(shstrtabName, 3, 0, shstrtabOffset, shstrtab.size(), 0, 0, 1, 0);
+    sectionHeader(noteName, 1, 0, shstrtabOffset, 0, 0, 0, 1, 0);
+
+    return out.data();
+}
+
+// --- Mach-O ---
+
+/**
+ * Layout: header, load commands (one segment with __TEXT,__text, build version,
+ * symbol tables), the code, the symbol and the string table.
+ */
+std::vector<uint8_t> buildMachO(const MachineCode& code) {
+    constexpr size_t HeaderSize = 32;
+    constexpr uint32_t SegmentSize = 72 + 80;
+    constexpr uint32_t BuildVersionSize = 24;
+    constexpr uint32_t SymtabSize = 24;
+    constexpr uint32_t DysymtabSize = 80;
+    constexpr uint32_t CommandsSize = SegmentSize + BuildVersionSize + SymtabSize + DysymtabSize;
+
+    ByteWriter strtab;
+    strtab.u8(0);
+    uint32_t nameIndex = static_cast<uint32_t>(strtab.size());
+    strtab.cstring("_" + code.name);
+    strtab.alignTo(8);
+
+    size_t textOffset = alignUp(HeaderSize + CommandsSize, 16);
+    size_t symtabOffset = alignUp(textOffset + code.text.size(), 8);
+    size_t strtabOffset = symtabOffset + 16;
+
+    ByteWriter out;
+    out.u32(0xfeedfacf);  // MH_MAGIC_64
+    out.u32(0x01000007);  // CPU_TYPE_X86_64
+    out.u32(3);           // CPU_SUBTYPE_X86_64_ALL
+    out.u32(1);           // MH_OBJECT
+    out.u32(4);           // ncmds
+    out.u32(CommandsSize);
+    out.u32(0x2000);      // MH_SUBSECTIONS_VIA_SYMBOLS
+    out.u32(0);
+
+    // LC_SEGMENT_64: unnamed segment with the only section
+    out.u32(0x19);
+    out.u32(SegmentSize);
+    out.fixed("", 16);
+    out.u64(0);                   // vmaddr
+    out.u64(code.text.size());    // vmsize
+    out.u64(textOffset);          // fileoff
+    out.u64(code.text.size());    // filesize
+    out.u32(7);                   // maxprot: rwx
+    out.u32(7);                   // initprot
+    out.u32(1);                   // nsects
+    out.u32(0);
+    out.fixed("__text", 16);
+    out.fixed("__TEXT", 16);
+    out.u64(0);                   // addr
+    out.u64(code.text.size());
+    out.u32(static_cast<uint32_t>(textOffset));
+    out.u32(4);                   // align: 2^4
+    out.u32(0);                   // reloff
+    out.u32(0);                   // nreloc
+    out.u32(0x80000400);          // S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS
+    out.u32(0);
+    out.u32(0);
+    out.u32(0);
+
+    // LC_BUILD_VERSION: macOS 10.14
+    out.u32(0x32);
+    out.u32(BuildVersionSize);
+    out.u32(1);
+    out.u32(0x000A0E00);
+    out.u32(0);
+    out.u32(0);
+
+    // LC_SYMTAB
+    out.u32(0x2);
+    out.u32(SymtabSize);
+    out.u32(static_cast<uint32_t>(symtabOffset));
+    out.u32(1);
+    out.u32(static_cast<uint32_t>(strtabOffset));
+    out.u32(static_cast<uint32_t>(strtab.size()));
+
+    // LC_DYSYMTAB: no local symbols, one external definition, nothing undefined
+    out.u32(0xB);
+    out.u32(DysymtabSize);
+    out.u32(0); out.u32(0);
+    out.u32(0); out.u32(1);
+    out.u32(1); out.u32(0);
+    for (int i = 0; i < 12; ++i) out.u32(0);
+
+    out.alignTo(16);
+    out.append(code.text);
+    out.alignTo(8);
+
+    // nlist_64: N_SECT | N_EXT in section 1
+    out.u32(nameIndex);
+    out.u8(0x0f);
+    out.u8(1);
+    out.u16(0);
+    out.u64(0);
+
+    out.append(strtab.data());
+    return out.data();
+}
+
+} // namespace
+
+ObjectFormat hostObjectFormat() {
+#ifdef __APPLE__
+    return ObjectFormat::MachO;
+#else
+    return ObjectFormat::ELF;
+#endif
+}
+
+void writeObjectFile(const MachineCode& code, ObjectFormat format, const std::string& filename) {
+    std::vector<uint8_t> bytes = format == ObjectFormat::MachO ? buildMachO(code) : buildELF(code);
+
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + filename);
+    }
+    ofs.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    ofs.close();
+    if (!ofs) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+}
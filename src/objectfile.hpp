@@ -0,0 +1,37 @@
+/**
+ * @file objectfile.hpp
+ * @brief Writing encoded functions to relocatable object files.
+ */
+
+#ifndef OBJECTFILE_HPP
+#define OBJECTFILE_HPP
+
+#include <string>
+
+#include "x86encoder.hpp"
+
+/**
+ * @brief Object file formats the writer supports.
+ */
+enum class ObjectFormat {
+    ELF,   ///< ELF64 for x86-64 (Linux)
+    MachO  ///< 64-bit Mach-O for x86-64 (macOS), symbols prefixed with `_`
+};
+
+/**
+ * @brief Returns the object format of the platform the compiler runs on.
+ */
+ObjectFormat hostObjectFormat();
+
+/**
+ * @brief Writes a relocatable object with one text section holding the code, and the
+ * function as its only (global) symbol.
+ *
+ * @param code Output of encodeProgram.
+ * @param format Object file format.
+ * @param filename Path of the object file.
+ * @throws std::runtime_error If the file cannot be written.
+ */
+void writeObjectFile(const MachineCode& code, ObjectFormat format, const std::string& filename);
+
+#endif // OBJECTFILE_HPP
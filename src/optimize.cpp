@@ -0,0 +1,909 @@
+/**
+ * @file optimize.cpp
+ * @brief Implementation of the TACKY optimization passes.
+ */
+
+#include "optimize.hpp"
+#include "loops.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using tacky::BinaryOp;
+using tacky::Instr;
+using tacky::Opcode;
+using tacky::UnaryOp;
+using tacky::Value;
+
+// --- Constant folding ---
+
+namespace {
+
+/**
+ * @brief Evaluates a unary operator on a constant.
+ */
+int32_t evalUnary(UnaryOp op, int32_t v) {
+    switch (op) {
+        case UnaryOp::Complement: return ~v;
+        case UnaryOp::Negate:     return static_cast<int32_t>(0u - static_cast<uint32_t>(v));
+        case UnaryOp::Not:        return v == 0;
+    }
+    return v;
+}
+
+/**
+ * @brief Evaluates a binary operator on constants.
+ * @return False if the operation must be left to run time (it would trap).
+ */
+bool evalBinary(BinaryOp op, int32_t a, int32_t b, int32_t& result) {
+    uint32_t ua = static_cast<uint32_t>(a);
+    uint32_t ub = static_cast<uint32_t>(b);
+    switch (op) {
+        case BinaryOp::ADD:         result = static_cast<int32_t>(ua + ub); return true;
+        case BinaryOp::SUBTRACT:    result = static_cast<int32_t>(ua - ub); return true;
+        case BinaryOp::MULTIPLY:    result = static_cast<int32_t>(ua * ub); return true;
+        case BinaryOp::DIVIDE:
+        case BinaryOp::REMAINDER:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            result = op == BinaryOp::DIVIDE ? a / b : a % b;
+            return true;
+        case BinaryOp::EQUAL:       result = a == b; return true;
+        case BinaryOp::NOTEQUAL:    result = a != b; return true;
+        case BinaryOp::LESSTHAN:    result = a < b; return true;
+        case BinaryOp::LESSEQ:      result = a <= b; return true;
+        case BinaryOp::GREATERTHAN: result = a > b; return true;
+        case BinaryOp::GREATEREQ:   result = a >= b; return true;
+        default:                    return false;
+    }
+}
+
+bool isImm(Value v, int32_t n) { return v.isImm() && v.immValue() == n; }
+
+/**
+ * @brief Applies algebraic identities to a Binary with at least one non-constant operand.
+ * @return True if the instruction reduces to `dst = result`.
+ */
+bool simplifyBinary(BinaryOp op, Value a, Value b, Value& result) {
+    switch (op) {
+        case BinaryOp::ADD:
+            if (isImm(b, 0)) { result = a; return true; }
+            if (isImm(a, 0)) { result = b; return true; }
+            return false;
+        case BinaryOp::SUBTRACT:
+            if (isImm(b, 0)) { result = a; return true; }
+            if (a.isReg() && a == b) { result = Value::imm(0); return true; }
+            return false;
+        case BinaryOp::MULTIPLY:
+            if (isImm(b, 1)) { result = a; return true; }
+            if (isImm(a, 1)) { result = b; return true; }
+            if (isImm(a, 0) || isImm(b, 0)) { result = Value::imm(0); return true; }
+            return false;
+        case BinaryOp::DIVIDE:
+            if (isImm(b, 1)) { result = a; return true; }
+            return false;
+        case BinaryOp::REMAINDER:
+            if (isImm(b, 1)) { result = Value::imm(0); return true; }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief What is known about the virtual registers in the current run of code.
+ *
+ * A fact recorded at output index `i` holds from `i` on, until the register is defined
+ * again or the next label (where other paths join) starts a new region.
+ */
+class LocalFacts {
+    std::vector<int> lastDef;       /**< Index of the latest definition of each register */
+    std::vector<int> constAt;       /**< Index at which the register was set to a constant */
+    std::vector<int32_t> constant;  /**< That constant */
+    std::vector<int> notAt;         /**< Index at which the register was set to !notOf */
+    std::vector<Value> notOf;       /**< That operand */
+    int regionStart = 0;
+
+public:
+    explicit LocalFacts(size_t regCount)
+        : lastDef(regCount, -1), constAt(regCount, -1), constant(regCount),
+          notAt(regCount, -1), notOf(regCount) {}
+
+    void startRegion(int index) { regionStart = index; }
+
+    /**
+     * @brief Records that the instruction at `index` writes `dst`.
+     */
+    void define(Value dst, int index) {
+        uint32_t r = dst.regIndex();
+        lastDef[r] = index;
+        constAt[r] = -1;
+        notAt[r] = -1;
+    }
+
+    void defineConstant(Value dst, int32_t value, int index) {
+        define(dst, index);
+        constAt[dst.regIndex()] = index;
+        constant[dst.regIndex()] = value;
+    }
+
+    void defineNot(Value dst, Value src, int index) {
+        define(dst, index);
+        if (src != dst) {
+            notAt[dst.regIndex()] = index;
+            notOf[dst.regIndex()] = src;
+        }
+    }
+
+    /**
+     * @brief Returns the constant a register holds, or the operand unchanged.
+     */
+    Value substitute(Value v) const {
+        if (v.isReg() && constAt[v.regIndex()] >= regionStart) {
+            return Value::imm(constant[v.regIndex()]);
+        }
+        return v;
+    }
+
+    /**
+     * @brief Finds `x` such that `v == !x` still holds here.
+     */
+    bool negationOf(Value v, Value& x) const {
+        if (!v.isReg()) return false;
+        int at = notAt[v.regIndex()];
+        if (at < regionStart) return false;
+        Value src = notOf[v.regIndex()];
+        if (src.isReg() && lastDef[src.regIndex()] > at) return false;
+        x = src;
+        return true;
+    }
+};
+
+} // namespace
+
+bool foldConstants(tacky::FlatFunction& fn) {
+    LocalFacts facts(fn.registers.size());
+    std::vector<Instr> out;
+    out.reserve(fn.code.size());
+    bool changed = false;
+
+    auto substitute = [&](Value& v) {
+        Value known = facts.substitute(v);
+        if (known != v) {
+            v = known;
+            changed = true;
+        }
+    };
+
+    for (Instr instr : fn.code) {
+        int index = static_cast<int>(out.size());
+
+        switch (instr.op) {
+            case Opcode::Label:
+                facts.startRegion(index);
+                out.push_back(instr);
+                break;
+
+            case Opcode::Jump:
+                out.push_back(instr);
+                break;
+
+            case Opcode::Return:
+                substitute(instr.src1);
+                out.push_back(instr);
+                break;
+
+            case Opcode::Copy:
+                substitute(instr.src1);
+                if (instr.src1.isImm()) {
+                    facts.defineConstant(instr.dst, instr.src1.immValue(), index);
+                } else {
+                    facts.define(instr.dst, index);
+                }
+                out.push_back(instr);
+                break;
+
+            case Opcode::CopyIfNotZero:
+                substitute(instr.src1);
+                substitute(instr.src2);
+                if (instr.src1.isImm()) {
+                    // A known condition copies always or never
+                    if (instr.src1.immValue() != 0) {
+                        out.push_back(Instr::copy(instr.src2, instr.dst));
+                        if (instr.src2.isImm()) {
+                            facts.defineConstant(instr.dst, instr.src2.immValue(), index);
+                        } else {
+                            facts.define(instr.dst, index);
+                        }
+                    }
+                    changed = true;
+                } else if (instr.src2 == instr.dst) {
+                    changed = true;
+                } else {
+                    out.push_back(instr);
+                    facts.define(instr.dst, index);
+                }
+                break;
+
+            case Opcode::Unary:
+                substitute(instr.src1);
+                if (instr.src1.isImm()) {
+                    int32_t result = evalUnary(instr.unaryOp(), instr.src1.immValue());
+                    out.push_back(Instr::copy(Value::imm(result), instr.dst));
+                    facts.defineConstant(instr.dst, result, index);
+                    changed = true;
+                } else if (instr.unaryOp() == UnaryOp::Not) {
+                    out.push_back(instr);
+                    facts.defineNot(instr.dst, instr.src1, index);
+                } else {
+                    out.push_back(instr);
+                    facts.define(instr.dst, index);
+                }
+                break;
+
+            case Opcode::Binary: {
+                substitute(instr.src1);
+                substitute(instr.src2);
+                int32_t folded;
+                Value simplified;
+                if (instr.src1.isImm() && instr.src2.isImm() &&
+                    evalBinary(instr.binaryOp(), instr.src1.immValue(), instr.src2.immValue(), folded)) {
+                    out.push_back(Instr::copy(Value::imm(folded), instr.dst));
+                    facts.defineConstant(instr.dst, folded, index);
+                    changed = true;
+                } else if (simplifyBinary(instr.binaryOp(), instr.src1, instr.src2, simplified)) {
+                    out.push_back(Instr::copy(simplified, instr.dst));
+                    if (simplified.isImm()) {
+                        facts.defineConstant(instr.dst, simplified.immValue(), index);
+                    } else {
+                        facts.define(instr.dst, index);
+                    }
+                    changed = true;
+                } else {
+                    out.push_back(instr);
+                    facts.define(instr.dst, index);
+                }
+                break;
+            }
+
+            case Opcode::JumpIfZero:
+            case Opcode::JumpIfNotZero: {
+                substitute(instr.src1);
+                Value operand;
+                while (facts.negationOf(instr.src1, operand)) {
+                    instr.op = instr.op == Opcode::JumpIfZero ? Opcode::JumpIfNotZero : Opcode::JumpIfZero;
+                    instr.src1 = facts.substitute(operand);
+                    changed = true;
+                }
+                if (instr.src1.isImm()) {
+                    bool isZero = instr.src1.immValue() == 0;
+                    if (isZero == (instr.op == Opcode::JumpIfZero)) {
+                        out.push_back(Instr::jump(instr.label));
+                    }
+                    changed = true;
+                } else {
+                    out.push_back(instr);
+                }
+                break;
+            }
+
+            case Opcode::JumpIfCompare: {
+                substitute(instr.src1);
+                substitute(instr.src2);
+                int32_t holds;
+                if (instr.src1.isImm() && instr.src2.isImm() &&
+                    evalBinary(instr.binaryOp(), instr.src1.immValue(), instr.src2.immValue(), holds)) {
+                    if (holds) out.push_back(Instr::jump(instr.label));
+                    changed = true;
+                } else {
+                    out.push_back(instr);
+                }
+                break;
+            }
+        }
+    }
+
+    fn.code = std::move(out);
+    return changed;
+}
+
+// --- Control-flow cleanup ---
+
+namespace {
+
+/**
+ * @brief Splits a function into blocks, lets `transform` edit them and writes them back.
+ * @return True if the code of the function changed.
+ */
+template <typename Transform>
+bool rewriteBlocks(tacky::FlatFunction& fn, Transform transform) {
+    tacky::ControlFlowGraph cfg = tacky::ControlFlowGraph::build(fn);
+    transform(cfg);
+    std::vector<Instr> before = std::move(fn.code);
+    cfg.linearize(fn);
+    return fn.code != before;
+}
+
+bool isConditionalJump(const Instr* instr) {
+    return instr && tacky::isConditionalJump(instr->op);
+}
+
+} // namespace
+
+bool removeUnreachableCode(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [](tacky::ControlFlowGraph& cfg) {
+        std::vector<char> reachable(cfg.blocks.size(), 0);
+        for (int block : cfg.reversePostorder()) {
+            reachable[block] = 1;
+        }
+        for (size_t i = 0; i < cfg.blocks.size(); ++i) {
+            if (!reachable[i]) cfg.blocks[i].removed = true;
+        }
+    });
+}
+
+bool threadJumps(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [](tacky::ControlFlowGraph& cfg) {
+        // Follows blocks that do nothing but pass control on to a labelled block
+        auto finalTarget = [&](int start) {
+            int block = start;
+            for (size_t steps = 0; steps < cfg.blocks.size(); ++steps) {
+                const tacky::BasicBlock& current = cfg.blocks[block];
+                int next;
+                if (current.code.empty() && current.fallthrough >= 0) {
+                    next = current.fallthrough;
+                } else if (current.code.size() == 1 && current.code[0].op == Opcode::Jump) {
+                    next = cfg.blockOf(current.code[0].label);
+                } else {
+                    return block;
+                }
+                if (cfg.blocks[next].label == NoSymbol) return block;
+                block = next;
+            }
+            return start;  // a cycle of empty blocks, i.e. an infinite loop
+        };
+
+        for (tacky::BasicBlock& block : cfg.blocks) {
+            if (block.code.empty()) continue;
+            Instr& last = block.code.back();
+            if (last.op != Opcode::Jump && !isConditionalJump(&last)) continue;
+            int target = finalTarget(cfg.blockOf(last.label));
+            last.label = cfg.blocks[target].label;
+        }
+
+        // "if (c) goto L; goto M; L:" becomes "if (!c) goto M; L:"
+        for (size_t i = 0; i + 2 < cfg.blocks.size(); ++i) {
+            tacky::BasicBlock& block = cfg.blocks[i];
+            if (block.removed || !isConditionalJump(block.terminator())) continue;
+            tacky::BasicBlock& over = cfg.blocks[i + 1];
+            if (block.fallthrough != static_cast<int>(i + 1) || over.removed || over.preds.size() != 1 ||
+                over.code.size() != 1 || over.code[0].op != Opcode::Jump) continue;
+            Instr& last = block.code.back();
+            if (cfg.blockOf(last.label) != static_cast<int>(i + 2)) continue;
+
+            tacky::invertJump(last);
+            last.label = over.code[0].label;
+            block.fallthrough = static_cast<int>(i + 2);
+            over.removed = true;
+        }
+    });
+}
+
+bool mergeBlocks(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [](tacky::ControlFlowGraph& cfg) {
+        auto nextLive = [&](size_t i) {
+            for (size_t j = i + 1; j < cfg.blocks.size(); ++j) {
+                if (!cfg.blocks[j].removed) return static_cast<int>(j);
+            }
+            return -1;
+        };
+
+        for (size_t i = 0; i < cfg.blocks.size(); ++i) {
+            tacky::BasicBlock& a = cfg.blocks[i];
+            if (a.removed) continue;
+
+            while (a.succs.size() == 1 && !isConditionalJump(a.terminator())) {
+                int b = a.succs[0];
+                tacky::BasicBlock& next = cfg.blocks[b];
+                if (b == static_cast<int>(i) || b == 0 || next.preds.size() != 1) break;
+
+                // Moving the block must not change where it falls through to
+                const Instr* last = next.terminator();
+                bool leavesByJump = last && (last->op == Opcode::Jump || last->op == Opcode::Return);
+                if (!leavesByJump && b != nextLive(i)) break;
+
+                if (!a.code.empty() && a.code.back().op == Opcode::Jump) a.code.pop_back();
+                a.code.insert(a.code.end(), next.code.begin(), next.code.end());
+                a.fallthrough = next.fallthrough;
+                a.succs = next.succs;
+                for (int succ : a.succs) {
+                    for (int& pred : cfg.blocks[succ].preds) {
+                        if (pred == b) pred = static_cast<int>(i);
+                    }
+                }
+                next.removed = true;
+                next.code.clear();
+            }
+        }
+    });
+}
+
+// --- Copy propagation and dead stores ---
+
+namespace {
+
+/**
+ * @brief Does the work of propagateCopies on the blocks of a function.
+ */
+void replaceCopiedValues(tacky::ControlFlowGraph& cfg, size_t regCount) {
+    tacky::ReachingCopies reaching = tacky::computeReachingCopies(cfg, regCount);
+    const auto& copies = reaching.copies;
+    tacky::CopyTracker tracker(copies, regCount);
+
+    for (int b : cfg.reversePostorder()) {
+        tracker.enterBlock(reaching.in[b]);
+
+        auto replace = [&](Value& v) {
+            if (!v.isReg()) return;
+            int holding = tracker.copyTo(v.regIndex());
+            if (holding >= 0) v = copies[holding].src;
+        };
+
+        int id = reaching.firstCopy[b];
+        std::vector<Instr> code;
+        code.reserve(cfg.blocks[b].code.size());
+        for (Instr instr : cfg.blocks[b].code) {
+            replace(instr.src1);
+            replace(instr.src2);
+
+            if (tacky::hasDef(instr)) {
+                tracker.write(instr.dst.regIndex());
+                if (instr.op == Opcode::Copy) {
+                    if (copies[id].src != instr.dst) tracker.copy(id);
+                    ++id;
+                }
+            }
+
+            if (instr.op == Opcode::Copy && instr.src1 == instr.dst) continue;
+            code.push_back(instr);
+        }
+        cfg.blocks[b].code = std::move(code);
+    }
+}
+
+/**
+ * @brief Returns true if an instruction can be dropped when its result is unused.
+ */
+bool isRemovable(const Instr& instr) {
+    switch (instr.op) {
+        case Opcode::Copy:
+        case Opcode::CopyIfNotZero:
+        case Opcode::Unary:
+            return true;
+        case Opcode::Binary:
+            if (instr.binaryOp() == BinaryOp::DIVIDE || instr.binaryOp() == BinaryOp::REMAINDER) {
+                return instr.src2.isImm() && instr.src2.immValue() != 0 && instr.src2.immValue() != -1;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Does the work of eliminateDeadStores on the blocks of a function.
+ */
+void removeDeadStores(tacky::ControlFlowGraph& cfg, size_t regCount) {
+    std::vector<tacky::RegisterList> liveOut = tacky::computeLiveOut(cfg, regCount);
+    tacky::BitSet live(regCount);
+
+    for (size_t b = 0; b < cfg.blocks.size(); ++b) {
+        tacky::BasicBlock& block = cfg.blocks[b];
+        if (block.removed) continue;
+
+        for (uint32_t reg : liveOut[b]) live.set(reg);
+        std::vector<Instr> kept;
+        kept.reserve(block.code.size());
+        for (auto it = block.code.rbegin(); it != block.code.rend(); ++it) {
+            const Instr& instr = *it;
+            if (tacky::hasDef(instr)) {
+                uint32_t reg = instr.dst.regIndex();
+                if (!live.test(reg) && isRemovable(instr)) continue;
+                live.reset(reg);
+            }
+            tacky::forEachUse(instr, [&](uint32_t reg) { live.set(reg); });
+            kept.push_back(instr);
+        }
+        // Only the live-out registers and the reads of the block can still be set
+        for (const Instr& instr : kept) tacky::forEachUse(instr, [&](uint32_t reg) { live.reset(reg); });
+        for (uint32_t reg : liveOut[b]) live.reset(reg);
+        block.code.assign(kept.rbegin(), kept.rend());
+    }
+}
+
+} // namespace
+
+bool propagateCopies(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [&](tacky::ControlFlowGraph& cfg) { replaceCopiedValues(cfg, fn.registers.size()); });
+}
+
+bool eliminateDeadStores(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [&](tacky::ControlFlowGraph& cfg) { removeDeadStores(cfg, fn.registers.size()); });
+}
+
+// --- Loop optimizations ---
+
+namespace {
+
+/**
+ * @brief Returns a new symbol spelled `base` followed by a number no other symbol has.
+ */
+Symbol freshSymbol(std::string_view base, char separator) {
+    Symbol prefix = symbols().intern(base);
+    return symbols().numbered(prefix, static_cast<uint32_t>(symbols().size()), separator);
+}
+
+/**
+ * @brief Returns true if code can be placed in front of a loop.
+ *
+ * The jumps entering the loop are retargeted to that code, so the header needs a label.
+ */
+bool canInsertPreheader(const tacky::ControlFlowGraph& cfg, const tacky::Loop& loop) {
+    return cfg.blocks[loop.header].label != NoSymbol;
+}
+
+/**
+ * @brief Inserts a preheader holding `code[l]` before the header of every loop `l`
+ * whose code is not empty, and updates the edges.
+ *
+ * The edges entering the header from outside the loop now enter the preheader, which
+ * falls into the header, so the code runs once each time the loop is entered.
+ */
+void insertPreheaders(tacky::ControlFlowGraph& cfg, const std::vector<tacky::Loop>& loops,
+                      std::vector<std::vector<Instr>>& code) {
+    struct Preheader {
+        Symbol header;
+        Symbol label;
+        bool takeFallthrough;
+        size_t loop;
+    };
+    std::vector<Preheader> preheaders;
+
+    // Retargets the entering jumps first, while blocks still have the numbers of the loops
+    for (size_t l = 0; l < loops.size(); ++l) {
+        if (code[l].empty()) continue;
+        const tacky::Loop& loop = loops[l];
+        Preheader preheader{cfg.blocks[loop.header].label, freshSymbol("preheader", '_'), false, l};
+        for (int pred : cfg.blocks[loop.header].preds) {
+            if (loop.contains(pred)) continue;
+            tacky::BasicBlock& block = cfg.blocks[pred];
+            if (block.terminator() && block.code.back().label == preheader.header) {
+                block.code.back().label = preheader.label;
+            }
+            if (block.fallthrough == loop.header) preheader.takeFallthrough = true;
+        }
+        preheaders.push_back(preheader);
+    }
+
+    std::sort(preheaders.begin(), preheaders.end(),
+              [&](const Preheader& a, const Preheader& b) { return loops[a.loop].header < loops[b.loop].header; });
+    std::vector<tacky::ControlFlowGraph::Insertion> insertions;
+    for (const Preheader& preheader : preheaders) {
+        insertions.push_back({loops[preheader.loop].header, preheader.label, preheader.takeFallthrough});
+    }
+    std::vector<int> blocks = cfg.insertBlocks(insertions);
+    for (size_t i = 0; i < preheaders.size(); ++i) cfg.blocks[blocks[i]].code = std::move(code[preheaders[i].loop]);
+    cfg.computeEdges();
+}
+
+} // namespace
+
+bool hoistLoopInvariants(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [&](tacky::ControlFlowGraph& cfg) {
+        tacky::DominatorTree dominators(cfg);
+        std::vector<tacky::Loop> loops = tacky::findLoops(cfg, dominators);
+        if (loops.empty()) return;
+
+        size_t regCount = fn.registers.size();
+        std::vector<int> uses(regCount, 0);
+        for (const tacky::BasicBlock& block : cfg.blocks) {
+            for (const Instr& instr : block.code) tacky::forEachUse(instr, [&](uint32_t reg) { ++uses[reg]; });
+        }
+
+        struct Location {
+            int block;
+            size_t index;
+        };
+        std::vector<std::vector<char>> hoisted(cfg.blocks.size());
+        for (size_t b = 0; b < cfg.blocks.size(); ++b) hoisted[b].assign(cfg.blocks[b].code.size(), 0);
+        std::vector<std::vector<Instr>> preheaderCode(loops.size());
+        std::vector<int> defs(regCount, 0);          // writes in the current loop
+        std::vector<Location> def(regCount);         // the write, when there is one
+        std::vector<int> usesInLoop(regCount, 0);
+        std::vector<char> readFirst(regCount, 0);    // a read in the loop may come before the write
+        std::vector<char> invariant(regCount, 0);    // written by an instruction being hoisted
+
+        // Outer loops come first, so an instruction leaves all the loops it is invariant in
+        // at once; what they hoist is no longer part of the inner loops
+        for (size_t l = 0; l < loops.size(); ++l) {
+            const tacky::Loop& loop = loops[l];
+            if (!canInsertPreheader(cfg, loop)) continue;
+
+            std::vector<uint32_t> touched;
+            auto touch = [&](uint32_t reg) {
+                if (defs[reg] == 0 && usesInLoop[reg] == 0) touched.push_back(reg);
+            };
+            std::vector<int> exiting;
+            for (int b : loop.blocks) {
+                const std::vector<Instr>& code = cfg.blocks[b].code;
+                for (size_t i = 0; i < code.size(); ++i) {
+                    if (hoisted[b][i] || !tacky::hasDef(code[i])) continue;
+                    uint32_t reg = code[i].dst.regIndex();
+                    touch(reg);
+                    ++defs[reg];
+                    def[reg] = {b, i};
+                }
+                for (int succ : cfg.blocks[b].succs) {
+                    if (!loop.contains(succ)) {
+                        exiting.push_back(b);
+                        break;
+                    }
+                }
+            }
+
+            // With a single write, a read that the write does not dominate may see the value
+            // from before the loop, or from the previous iteration
+            for (int b : loop.blocks) {
+                const std::vector<Instr>& code = cfg.blocks[b].code;
+                for (size_t i = 0; i < code.size(); ++i) {
+                    if (hoisted[b][i]) continue;
+                    tacky::forEachUse(code[i], [&](uint32_t reg) {
+                        touch(reg);
+                        ++usesInLoop[reg];
+                        if (defs[reg] != 1) return;
+                        const Location& at = def[reg];
+                        if (at.block == b ? at.index >= i : !dominators.dominates(at.block, b)) readFirst[reg] = 1;
+                    });
+                }
+            }
+
+            auto isInvariant = [&](Value v) {
+                return !v.isReg() || defs[v.regIndex()] == 0 || invariant[v.regIndex()];
+            };
+
+            // `d = a op b` moves out if a and b do not change in the loop, it is the only
+            // write of d, it comes before every read of d in the loop, and d is either only
+            // read in the loop or written before any exit. Divisions and remainders that
+            // could trap stay in place, as the preheader runs even when the body does not
+            bool found = true;
+            while (found) {
+                found = false;
+                for (int b : loop.blocks) {
+                    const std::vector<Instr>& code = cfg.blocks[b].code;
+                    int dominatesExits = -1;  // computed on first use
+                    for (size_t i = 0; i < code.size(); ++i) {
+                        const Instr& instr = code[i];
+                        if (hoisted[b][i] || (instr.op != Opcode::Unary && instr.op != Opcode::Binary) ||
+                            !isRemovable(instr)) continue;
+                        uint32_t reg = instr.dst.regIndex();
+                        if (defs[reg] != 1 || readFirst[reg]) continue;
+                        if (!isInvariant(instr.src1) || !isInvariant(instr.src2)) continue;
+                        if (usesInLoop[reg] != uses[reg]) {
+                            if (dominatesExits < 0) {
+                                dominatesExits = std::all_of(exiting.begin(), exiting.end(),
+                                                             [&](int e) { return dominators.dominates(b, e); });
+                            }
+                            if (!dominatesExits) continue;
+                        }
+                        invariant[reg] = 1;
+                        hoisted[b][i] = 1;
+                        preheaderCode[l].push_back(instr);
+                        found = true;
+                    }
+                }
+            }
+
+            for (uint32_t reg : touched) {
+                defs[reg] = 0;
+                usesInLoop[reg] = 0;
+                readFirst[reg] = 0;
+                invariant[reg] = 0;
+            }
+        }
+
+        for (size_t b = 0; b < cfg.blocks.size(); ++b) {
+            std::vector<Instr>& code = cfg.blocks[b].code;
+            size_t kept = 0;
+            for (size_t i = 0; i < code.size(); ++i) {
+                if (!hoisted[b][i]) code[kept++] = code[i];
+            }
+            code.resize(kept);
+        }
+        insertPreheaders(cfg, loops, preheaderCode);
+    });
+}
+
+bool simplifyInductionVariables(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [&](tacky::ControlFlowGraph& cfg) {
+        tacky::DominatorTree dominators(cfg);
+        std::vector<tacky::Loop> loops = tacky::findLoops(cfg, dominators);
+        if (loops.empty()) return;
+
+        struct Location {
+            int block;
+            size_t index;
+        };
+        std::vector<std::vector<Instr>> preheaderCode(loops.size());
+        std::vector<int> defs(fn.registers.size(), 0);
+        std::vector<Location> lastDef(fn.registers.size());
+
+        for (size_t l = 0; l < loops.size(); ++l) {
+            const tacky::Loop& loop = loops[l];
+            if (!canInsertPreheader(cfg, loop)) continue;
+
+            std::vector<uint32_t> written;
+            for (int b : loop.blocks) {
+                const std::vector<Instr>& code = cfg.blocks[b].code;
+                for (size_t i = 0; i < code.size(); ++i) {
+                    if (!tacky::hasDef(code[i])) continue;
+                    uint32_t reg = code[i].dst.regIndex();
+                    if (defs[reg]++ == 0) written.push_back(reg);
+                    lastDef[reg] = {b, i};
+                }
+            }
+
+            // A basic induction variable changes by a constant step at its only write in
+            // the loop: `i = i + c`, or `t = i + c; i = t` as lowered from assignments
+            auto stepOf = [&](uint32_t reg, int32_t& step) {
+                if (defs[reg] != 1) return false;
+                const Location& at = lastDef[reg];
+                const std::vector<Instr>& code = cfg.blocks[at.block].code;
+                const Instr* update = &code[at.index];
+                Value next = Value::reg(reg);
+                if (update->op == Opcode::Copy && update->src1.isReg() && at.index > 0) {
+                    next = update->src1;
+                    update = &code[at.index - 1];
+                }
+                if (update->op != Opcode::Binary || update->dst != next) return false;
+                Value i = Value::reg(reg);
+                if (update->binaryOp() == BinaryOp::ADD && update->src1 == i && update->src2.isImm()) {
+                    step = update->src2.immValue();
+                } else if (update->binaryOp() == BinaryOp::ADD && update->src2 == i && update->src1.isImm()) {
+                    step = update->src1.immValue();
+                } else if (update->binaryOp() == BinaryOp::SUBTRACT && update->src1 == i && update->src2.isImm()) {
+                    step = static_cast<int32_t>(0u - static_cast<uint32_t>(update->src2.immValue()));
+                } else {
+                    return false;
+                }
+                return true;
+            };
+
+            // `d = i * k`, with k constant in the loop, becomes a copy of a register that
+            // starts at i * k in the preheader and grows by step * k wherever i changes
+            std::map<std::pair<uint32_t, uint64_t>, uint32_t> products;  // (i, k) -> register
+            std::vector<std::pair<Location, Instr>> increments;
+            for (int b : loop.blocks) {
+                for (Instr& instr : cfg.blocks[b].code) {
+                    if (instr.op != Opcode::Binary || instr.binaryOp() != BinaryOp::MULTIPLY) continue;
+                    int32_t step = 0;
+                    Value i = instr.src1;
+                    Value k = instr.src2;
+                    if (!i.isReg() || !stepOf(i.regIndex(), step)) std::swap(i, k);
+                    if (!i.isReg() || !stepOf(i.regIndex(), step)) continue;
+                    if (k.isReg() && defs[k.regIndex()] != 0) continue;
+
+                    // Constants and registers get different keys
+                    uint64_t factor = k.isImm() ? static_cast<uint32_t>(k.immValue())
+                                                : (uint64_t(1) << 32) | k.regIndex();
+                    auto key = std::make_pair(i.regIndex(), factor);
+                    auto found = products.find(key);
+                    if (found == products.end()) {
+                        Value product = Value::reg(fn.newRegister(freshSymbol("%iv", '\0')));
+                        preheaderCode[l].push_back(Instr::binary(BinaryOp::MULTIPLY, i, k, product));
+                        Value increment;
+                        if (k.isImm()) {
+                            increment = Value::imm(static_cast<int32_t>(static_cast<uint32_t>(step) *
+                                                                        static_cast<uint32_t>(k.immValue())));
+                        } else if (step == 1) {
+                            increment = k;
+                        } else {
+                            increment = Value::reg(fn.newRegister(freshSymbol("%iv", '\0')));
+                            preheaderCode[l].push_back(
+                                Instr::binary(BinaryOp::MULTIPLY, k, Value::imm(step), increment));
+                        }
+                        increments.push_back(
+                            {lastDef[i.regIndex()], Instr::binary(BinaryOp::ADD, product, increment, product)});
+                        found = products.emplace(key, product.regIndex()).first;
+                    }
+                    instr = Instr::copy(Value::reg(found->second), instr.dst);
+                }
+            }
+
+            // Later positions first, so that the earlier ones stay valid
+            std::sort(increments.begin(), increments.end(), [](const auto& a, const auto& b) {
+                return a.first.block != b.first.block ? a.first.block < b.first.block
+                                                      : a.first.index > b.first.index;
+            });
+            for (const auto& [at, increment] : increments) {
+                std::vector<Instr>& code = cfg.blocks[at.block].code;
+                code.insert(code.begin() + static_cast<std::ptrdiff_t>(at.index + 1), increment);
+            }
+
+            for (uint32_t reg : written) defs[reg] = 0;
+        }
+
+        insertPreheaders(cfg, loops, preheaderCode);
+    });
+}
+
+// --- Pipeline ---
+
+namespace {
+
+/**
+ * @brief A pass of the pipeline, with what it looks at and what it may change.
+ */
+struct Pass {
+    bool (*run)(tacky::FlatFunction& fn);
+    bool readsFlowOnly;  ///< Looks only at the blocks and the jumps between them
+    bool changesFlow;    ///< May change the blocks or the jumps, not only what the blocks compute
+};
+
+/**
+ * @brief Runs propagateCopies and then eliminateDeadStores on the same blocks, as
+ * neither changes control flow.
+ */
+bool propagateCopiesAndEliminateDeadStores(tacky::FlatFunction& fn) {
+    return rewriteBlocks(fn, [&](tacky::ControlFlowGraph& cfg) {
+        replaceCopiedValues(cfg, fn.registers.size());
+        removeDeadStores(cfg, fn.registers.size());
+    });
+}
+
+const Pass pipeline[] = {
+    {foldConstants, false, true},
+    {removeUnreachableCode, true, true},
+    {threadJumps, false, true},
+    {mergeBlocks, true, true},
+    {propagateCopiesAndEliminateDeadStores, false, false},
+    {hoistLoopInvariants, false, true},
+    {simplifyInductionVariables, false, true},
+};
+
+/** Rounds of the pipeline after which it stops, even if the passes still find work. */
+constexpr int MaxRounds = 32;
+
+} // namespace
+
+void optimizeProgram(tacky::FlatProgram& program, int level) {
+    if (level <= 0) return;
+
+    tacky::FlatFunction& fn = program.function;
+    constexpr size_t passCount = sizeof(pipeline) / sizeof(pipeline[0]);
+
+    // Each run of a pass is one step. A pass runs again only if what it looks at changed
+    // after the step of its last run, which includes changes made by that run itself
+    int step = 0;
+    int codeChangedAt = 0;
+    int flowChangedAt = 0;
+    int ranAt[passCount];
+    std::fill(ranAt, ranAt + passCount, -1);
+
+    for (int round = 0; round < MaxRounds; ++round) {
+        bool ran = false;
+        for (size_t p = 0; p < passCount; ++p) {
+            const Pass& pass = pipeline[p];
+            if ((pass.readsFlowOnly ? flowChangedAt : codeChangedAt) <= ranAt[p]) continue;
+            ran = true;
+            ranAt[p] = step++;
+            if (!pass.run(fn)) continue;
+            codeChangedAt = step;
+            if (pass.changesFlow) flowChangedAt = step;
+        }
+        if (!ran) break;
+    }
+}
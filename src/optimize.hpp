@@ -0,0 +1,116 @@
+/**
+ * @file optimize.hpp
+ * @brief Optimization passes over the flat TACKY IR.
+ *
+ * Passes run between Lowerer::lower and convertTackyToASDL. Each pass rewrites a
+ * FlatFunction in place and reports whether it changed anything, so the pipeline can
+ * repeat them until the code stops changing.
+ */
+
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include "tacky.hpp"
+#include "cfg.hpp"
+#include "dataflow.hpp"
+
+/**
+ * @brief Folds constant expressions and simplifies algebraic identities.
+ *
+ * Within each run of instructions between labels, variables copied from a constant are
+ * replaced by the constant. Then:
+ * - Unary and Binary instructions on constants become a Copy of the result. Arithmetic
+ *   wraps around like the generated code does; division and remainder by zero, and
+ *   INT_MIN / -1, are left in place so that they still trap at run time.
+ * - `x + 0`, `x - 0`, `x * 1`, `x / 1` become `x`; `x * 0`, `x % 1`, `x - x` become 0.
+ * - A conditional jump on `!t` jumps on `t` with the opposite condition, so `!!x` in a
+ *   condition tests `x` directly.
+ * - A conditional jump on a constant, or a JumpIfCompare of two constants, becomes a
+ *   Jump or is removed, and a CopyIfNotZero on a constant a Copy or nothing.
+ *
+ * @param fn The function to rewrite.
+ * @return True if any instruction changed.
+ */
+bool foldConstants(tacky::FlatFunction& fn);
+
+/**
+ * @brief Removes the blocks that cannot be reached from the entry of the function.
+ * @return True if any instruction changed.
+ */
+bool removeUnreachableCode(tacky::FlatFunction& fn);
+
+/**
+ * @brief Retargets jumps whose target only jumps (or falls) to another label.
+ *
+ * A jump to `L1` where `L1: goto L2;` becomes a jump to `L2`, following whole chains.
+ * @return True if any instruction changed.
+ */
+bool threadJumps(tacky::FlatFunction& fn);
+
+/**
+ * @brief Merges each block into its predecessor when that is its only way in and out.
+ *
+ * The jump between the two blocks and the label of the second one disappear.
+ * @return True if any instruction changed.
+ */
+bool mergeBlocks(tacky::FlatFunction& fn);
+
+/**
+ * @brief Replaces uses of variables by the value they were copied from.
+ *
+ * Uses reaching copies: after `x = y`, a read of `x` reached only by that copy (with
+ * neither `x` nor `y` written since, on any path) reads `y` instead. Copies that become
+ * `x = x` are removed.
+ * @return True if any instruction changed.
+ */
+bool propagateCopies(tacky::FlatFunction& fn);
+
+/**
+ * @brief Removes Copy, Unary and Binary instructions whose result is never read.
+ *
+ * Uses liveness. Divisions and remainders are kept unless their divisor is a constant
+ * that cannot trap.
+ * @return True if any instruction changed.
+ */
+bool eliminateDeadStores(tacky::FlatFunction& fn);
+
+/**
+ * @brief Moves computations that give the same result on every iteration of a loop in
+ * front of it.
+ *
+ * Uses the natural loops of loops.hpp, outer loops first. A Unary or Binary instruction
+ * `d = a op b` is hoisted into a preheader (a block inserted before the loop header, run
+ * once per entry into the loop) when a and b are constants, are not written in the loop
+ * or are themselves hoisted, d is written nowhere else in the loop and not read in it
+ * before this write, and d is dead after the loop or the instruction runs before every
+ * exit. Divisions and remainders that could trap stay in place.
+ * @return True if any instruction changed.
+ */
+bool hoistLoopInvariants(tacky::FlatFunction& fn);
+
+/**
+ * @brief Replaces products of induction variables by registers updated with additions.
+ *
+ * A basic induction variable `i` of a loop is written once in it, by `i = i + c` or
+ * `i = i - c` for a constant c. Each `d = i * k` with k constant in the loop becomes
+ * `d = s`, where the preheader sets `s = i * k` and the loop adds `c * k` to s right
+ * after updating i.
+ * @return True if any instruction changed.
+ */
+bool simplifyInductionVariables(tacky::FlatFunction& fn);
+
+/**
+ * @brief Runs the optimization pipeline for an optimization level.
+ *
+ * Level 0 leaves the program untouched; level 1 runs the passes in turn until none of
+ * them changes the program, or for a fixed number of rounds at most. A pass is skipped
+ * when nothing it looks at changed since its last run: the control-flow cleanups only
+ * run again after a change to the blocks or jumps. propagateCopies and
+ * eliminateDeadStores, which change neither, share one CFG.
+ *
+ * @param program The program to optimize.
+ * @param level Optimization level (0 or 1).
+ */
+void optimizeProgram(tacky::FlatProgram& program, int level);
+
+#endif // OPTIMIZE_HPP
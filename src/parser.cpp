@@ -1,9 +1,13 @@
 #include "parser.hpp"
 #include "ast.hpp"
+#include "log.hpp"
 #include <sstream>
 #include <iostream>
+#include <charconv>
+
+// Constructors
+Parser::Parser(const SourceBuffer& source, bool verboseMode) : tokens(source), verbose(verboseMode) {}
 
-// Constructor
 Parser::Parser(const std::vector<Lex>& t, bool verboseMode) : tokens(t), verbose(verboseMode) {}
 
 // Error handling
@@ -13,34 +17,26 @@ Parser::Parser(const std::vector<Lex>& t, bool verboseMode) : tokens(t), verbose
     throw std::runtime_error(oss.str());
 }
 
-// Verbose log
-void Parser::log(const std::string& message) {
-    if (verbose) {
-        std::cout << "[Parser] " << message << std::endl;
-    }
-}
+// Verbose log: message arguments are only evaluated when verbose mode is on
+#define PARSER_LOG(...) COMPILER_LOG(verbose, LogCategory::Parser, __VA_ARGS__)
 
 // Token helpers
-Lex Parser::peek() {
-    if (current < tokens.size()) {
-        return tokens[current];
-    } else {
-        return Lex{"", Token::MISMATCH, -1};
-    }
+const Lex& Parser::peek() {
+    return tokens.peek();
 }
 
 Lex Parser::advance() {
-    if (current < tokens.size()) {
-        log("Advance token: " + tokens[current].word + " (line " + std::to_string(tokens[current].line) + ")");
-        return tokens[current++];
-    } else {
-        return Lex{"", Token::MISMATCH, -1};
+    Lex token = tokens.advance();
+    if (token.token != Token::MISMATCH) {
+        PARSER_LOG("Advance token: ", token.word, " (line ", token.line, ")");
     }
+    return token;
 }
 
 bool Parser::match(Token t) {
-    if (current < tokens.size() && tokens[current].token == t) {
-        log("Match token: " + tokens[current].word + " (line " + std::to_string(tokens[current].line) + ")");
+    const Lex& token = tokens.peek();
+    if (!tokens.atEnd() && token.token == t) {
+        PARSER_LOG("Match token: ", token.word, " (line ", token.line, ")");
         advance();
         return true;
     }
@@ -48,7 +44,7 @@ bool Parser::match(Token t) {
 }
 
 Lex Parser::expect(Token expected, const std::string& errorMsg) {
-    Lex token = peek();
+    const Lex& token = peek();
     if (token.token != expected) {
         error(errorMsg, token);
     }
@@ -57,22 +53,24 @@ Lex Parser::expect(Token expected, const std::string& errorMsg) {
 
 // Parse entry point
 std::unique_ptr<Program> Parser::parseProgram() {
-    log("Parsing program");
-    auto func = parseFunction();
+    PARSER_LOG("Parsing program");
+    auto program = std::make_unique<Program>();
+    arena = &program->arena;
+
+    program->function = parseFunction();
     if (peek().token != Token::MISMATCH) {
         error("Unexpected token after function", peek());
     }
-    log("Parsed program successfully");
-    return std::make_unique<Program>(std::move(func));
+    PARSER_LOG("Parsed program successfully");
+    return program;
 }
 
 // Parse function
-std::unique_ptr<Function> Parser::parseFunction() {
-    log("Parsing function");
+Function* Parser::parseFunction() {
+    PARSER_LOG("Parsing function");
 
     expect(Token::INT, "Expected 'int' at function start");
-    expect(Token::IDENTIFIER, "Expected function name");
-    std::string funcName = tokens[current - 1].word;
+    std::string_view funcName = expect(Token::IDENTIFIER, "Expected function name").word;
 
     expect(Token::OPARENTHESIS, "Expected '(' after function name");
     expect(Token::VOID, "Expected 'void' in parameter list");
@@ -80,15 +78,15 @@ std::unique_ptr<Function> Parser::parseFunction() {
 
     // Parse function body as a Block
     expect(Token::OBRACE, "Expected '{' to begin function body");
-    auto block = parseBlock();  // Now responsible for consuming the closing '}'
+    Block* block = parseBlock();  // Now responsible for consuming the closing '}'
 
-    log("Parsed function '" + funcName + "' successfully");
-    return std::make_unique<Function>(funcName, std::move(block));
+    PARSER_LOG("Parsed function '", funcName, "' successfully");
+    return arena->make<Function>(funcName, block);
 }
 
 //Parse block
-std::unique_ptr<Block> Parser::parseBlock() {
-    std::vector<std::unique_ptr<BlockItem>> items;
+Block* Parser::parseBlock() {
+    std::vector<BlockItem> items;
 
     while (!match(Token::CBRACE)) {
         if (isAtEnd()) {
@@ -98,54 +96,48 @@ std::unique_ptr<Block> Parser::parseBlock() {
         items.push_back(parseBlockItem());
     }
 
-    return std::make_unique<Block>(std::move(items));
+    return arena->make<Block>(arena->copyArray(items));
 }
 
 // Parse block item (statement or declaration)
-std::unique_ptr<BlockItem> Parser::parseBlockItem() {
+BlockItem Parser::parseBlockItem() {
     if (peek().token == Token::INT) {
         advance(); // consume 'int'
-        expect(Token::IDENTIFIER, "Expected identifier after 'int'");
-        std::string name = tokens[current - 1].word;
+        Lex name = expect(Token::IDENTIFIER, "Expected identifier after 'int'");
 
-        std::unique_ptr<Expression> init = nullptr;
+        Expression* init = nullptr;
         if (match(Token::ASSIGN)) {
             init = parseExpression(0);
         }
 
         expect(Token::SEMICOLON, "Expected ';' after declaration");
 
-        auto decl = std::make_unique<Declaration>(name, std::move(init));
-        return std::make_unique<BlockItem>(std::move(decl));
+        return BlockItem(arena->make<Declaration>(name.word, name.symbol, init));
     } else {
-        auto stmt = parseStatement();
-        return std::make_unique<BlockItem>(std::move(stmt));
+        return BlockItem(parseStatement());
     }
 }
 
 //Parse ForInit
-std::unique_ptr<ForInit> Parser::parseForInit() {
-    log("Parsing for-init");
+ForInit* Parser::parseForInit() {
+    PARSER_LOG("Parsing for-init");
 
     if (peek().token == Token::INT) {
         // Case: declaration (e.g., int x = 5;)
         advance();  // consume 'int'
-        expect(Token::IDENTIFIER, "Expected identifier in for-loop declaration");
+        Lex name = expect(Token::IDENTIFIER, "Expected identifier in for-loop declaration");
 
-        std::string name = tokens[current - 1].word;
-
-        std::unique_ptr<Expression> init = nullptr;
+        Expression* init = nullptr;
         if (match(Token::ASSIGN)) {
             init = parseExpression(0);
         }
 
         expect(Token::SEMICOLON, "Expected ';' after for-loop declaration");
 
-        auto decl = std::make_unique<Declaration>(name, std::move(init));
-        return std::make_unique<ForInit>(std::move(decl));
+        return arena->make<ForInit>(arena->make<Declaration>(name.word, name.symbol, init));
     } else {
         // Case: optional expression (e.g., i = 0;)
-        std::unique_ptr<Expression> expr = nullptr;
+        Expression* expr = nullptr;
 
         if (peek().token != Token::SEMICOLON) {
             expr = parseExpression(0);
@@ -153,119 +145,110 @@ std::unique_ptr<ForInit> Parser::parseForInit() {
 
         expect(Token::SEMICOLON, "Expected ';' after for-loop init expression");
 
-        return std::make_unique<ForInit>(std::move(expr));
+        return arena->make<ForInit>(expr);
     }
 }
 
 
 // Parse statement
-std::unique_ptr<Statement> Parser::parseStatement() {
-    log("Parsing statement");
+Statement* Parser::parseStatement() {
+    PARSER_LOG("Parsing statement");
 
     if (match(Token::RETURN)) {
-        auto expr = parseExpression(0);
+        Expression* expr = parseExpression(0);
         expect(Token::SEMICOLON, "Expected ';' after return expression");
-        log("Parsed return statement");
-        return std::make_unique<Statement>(std::move(expr), StatementType::RETURN);
+        PARSER_LOG("Parsed return statement");
+        return arena->make<ExpressionStatement>(expr, StatementType::RETURN);
     }
 
     if (match(Token::BREAK)) {
         expect(Token::SEMICOLON, "Expected ';' after 'break'");
-        log("Parsed break statement");
-        return Statement::makeBreak();
+        PARSER_LOG("Parsed break statement");
+        return arena->make<LoopControlStatement>(StatementType::BREAK);
     }
 
     if (match(Token::CONTINUE)) {
         expect(Token::SEMICOLON, "Expected ';' after 'continue'");
-        log("Parsed continue statement");
-        return Statement::makeContinue();
+        PARSER_LOG("Parsed continue statement");
+        return arena->make<LoopControlStatement>(StatementType::CONTINUE);
     }
 
     if (match(Token::IF)) {
         expect(Token::OPARENTHESIS, "Expected '(' after 'if'");
-        auto condition = parseExpression(0);
+        Expression* condition = parseExpression(0);
         expect(Token::CPARENTHESIS, "Expected ')' after condition");
 
-        auto thenStmt = parseStatement();
-        std::unique_ptr<Statement> elseStmt = nullptr;
+        Statement* thenStmt = parseStatement();
+        Statement* elseStmt = nullptr;
 
         if (match(Token::ELSE)) {
             elseStmt = parseStatement();
         }
 
-        log("Parsed if statement");
-        return std::make_unique<Statement>(
-            std::move(condition),
-            std::move(thenStmt),
-            std::move(elseStmt)
-        );
+        PARSER_LOG("Parsed if statement");
+        return arena->make<IfStatement>(condition, thenStmt, elseStmt);
     }
 
     if (match(Token::WHILE)) {
         expect(Token::OPARENTHESIS, "Expected '(' after 'while'");
-        auto condition = parseExpression(0);
+        Expression* condition = parseExpression(0);
         expect(Token::CPARENTHESIS, "Expected ')' after while condition");
 
-        auto body = parseStatement();
-        log("Parsed while loop");
-        return std::make_unique<Statement>(std::move(condition), std::move(body),StatementType::WHILE);
+        Statement* body = parseStatement();
+        PARSER_LOG("Parsed while loop");
+        return arena->make<WhileStatement>(condition, body, StatementType::WHILE);
     }
 
     if (match(Token::DO)) {
-        auto body = parseStatement();
+        Statement* body = parseStatement();
         expect(Token::WHILE, "Expected 'while' after 'do' body");
         expect(Token::OPARENTHESIS, "Expected '(' after 'while'");
-        auto condition = parseExpression(0);
+        Expression* condition = parseExpression(0);
         expect(Token::CPARENTHESIS, "Expected ')' after condition");
         expect(Token::SEMICOLON, "Expected ';' after do-while loop");
 
-        log("Parsed do-while loop");
-        return std::make_unique<Statement>(std::move(condition),std::move(body),StatementType::DO_WHILE);
+        PARSER_LOG("Parsed do-while loop");
+        return arena->make<WhileStatement>(condition, body, StatementType::DO_WHILE);
     }
 
     if (match(Token::FOR)) {
         expect(Token::OPARENTHESIS, "Expected '(' after 'for'");
-        auto init = parseForInit();
+        ForInit* init = parseForInit();
 
-        std::unique_ptr<Expression> condition = nullptr;
+        Expression* condition = nullptr;
         if (!match(Token::SEMICOLON)) {
             condition = parseExpression(0);
             expect(Token::SEMICOLON, "Expected ';' after for-loop condition");
         }
 
-        std::unique_ptr<Expression> post = nullptr;
+        Expression* post = nullptr;
         if (peek().token != Token::CPARENTHESIS) {
             post = parseExpression(0);
         }
 
         expect(Token::CPARENTHESIS, "Expected ')' after for-loop clauses");
-        auto body = parseStatement();
-
-        log("Parsed for loop");
-        return std::make_unique<Statement>(
-            std::move(init),
-            std::move(condition),
-            std::move(post),
-            std::move(body)
-        );
+        Statement* body = parseStatement();
+
+        PARSER_LOG("Parsed for loop");
+        return arena->make<ForStatement>(init, condition, post, body);
     }
 
     if (match(Token::OBRACE)) {
-        auto block = parseBlock();
-        log("Parsed compound block statement");
-        return std::make_unique<Statement>(std::move(block));
+        Block* block = parseBlock();
+        PARSER_LOG("Parsed compound block statement");
+        return arena->make<CompoundStatement>(block);
     }
 
     if (peek().token == Token::SEMICOLON) {
         advance();
-        log("Parsed empty statement");
-        return std::make_unique<Statement>(nullptr, StatementType::NULL_STMT);
+        PARSER_LOG("Parsed empty statement");
+        return arena->make<NullStatement>();
     }
 
-    auto expr = parseExpression(0);
+    Expression* expr = parseExpression(0);
     expect(Token::SEMICOLON, "Expected ';' after expression statement");
-    log("Parsed expression statement");
-    return std::make_unique<Statement>(std::move(expr), StatementType::EXPRESSION);
+    PARSER_LOG("Parsed expression statement");
+    return arena->make<ExpressionStatement>(expr, StatementType::EXPRESSION);
 }
 
 
@@ -323,96 +306,136 @@ UnaryOpast Parser::tokenToUnaryOp(Token token) {
     }
 }
 
-std::unique_ptr<Expression> Parser::parseExpression(int minPrecedence) {
-    log("Parsing expression with precedence >= " + std::to_string(minPrecedence));
+Expression* Parser::parseExpression(int minPrecedence) {
+    using Frame = ExpressionFrame;
+    std::vector<Frame>& stack = expressionStack;
+    const size_t base = stack.size();
 
-    std::unique_ptr<Expression> left = parseFactor();
+    // Opens an ‹exp›: its operand comes next, then the operators that bind at least `precedence`
+    auto open = [&](int precedence) {
+        PARSER_LOG("Parsing expression with precedence >= ", precedence);
+        Frame frame{Frame::Kind::Operators};
+        frame.minPrecedence = precedence;
+        stack.push_back(frame);
+    };
+    open(minPrecedence);
 
     while (true) {
-        Lex opToken = peek();
-        Token op = opToken.token;
-
-        // Special handling for conditional operator (ternary ?:)
-        if (op == Token::QUESTION_MARK) {
-            if (minPrecedence > getPrecedence(Token::QUESTION_MARK)) {
-                break;
+        // Reads a <factor> up to its first constant or identifier, stacking the prefix
+        // operators and parentheses in front of it
+        Expression* operand = nullptr;
+        while (!operand) {
+            PARSER_LOG("Parsing factor");
+            Lex currentToken = peek();
+
+            if (currentToken.token == Token::CONSTANT) {
+                advance();
+                int value = 0;
+                auto [end, ec] = std::from_chars(currentToken.word.data(),
+                                                 currentToken.word.data() + currentToken.word.size(), value);
+                if (ec != std::errc()) {
+                    error("Integer constant out of range: " + std::string(currentToken.word), currentToken);
+                }
+                PARSER_LOG("Parsed integer literal: ", value);
+                operand = arena->make<ConstantExpression>(value);
             }
-
-            advance();  // consume '?'
-            log("Parsing true branch of conditional expression");
-
-            std::unique_ptr<Expression> trueExpr = parseExpression(1); // higher than ?:
-
-            if (peek().token != Token::COLON) {
-                error("Expected ':' in conditional expression", peek());
+            else if (currentToken.token == Token::IDENTIFIER) {
+                advance();
+                PARSER_LOG("Parsed identifier: ", currentToken.word);
+                operand = arena->make<VarExpression>(currentToken.word, currentToken.symbol);
             }
-
-            advance();  // consume ':'
-            log("Parsing false branch of conditional expression");
-
-            std::unique_ptr<Expression> falseExpr = parseExpression(1); // same level as trueExpr
-
-            if (!left || !trueExpr || !falseExpr) {
-                error("Incomplete conditional expression", opToken);
+            else if (currentToken.token == Token::COMPLEMENT ||
+                     currentToken.token == Token::NEGATION ||
+                     currentToken.token == Token::NOT) {
+                advance();
+                Frame frame{Frame::Kind::Unary};
+                frame.op = currentToken.token;
+                frame.word = currentToken.word;
+                stack.push_back(frame);
+            }
+            else if (currentToken.token == Token::OPARENTHESIS) {
+                advance();
+                stack.push_back(Frame{Frame::Kind::Parenthesis});
+                open(0);
+            }
+            else {
+                error("Unexpected token in expression: " + std::string(currentToken.word), currentToken);
             }
-
-            left = std::make_unique<Expression>(std::move(left), std::move(trueExpr), std::move(falseExpr));
-            log("Parsed conditional expression");
-            continue;
         }
 
-        int precedence = getPrecedence(op);
-        if (precedence < minPrecedence) break;
-
-        advance();  // consume operator
-
-        if (op == Token::ASSIGN) {
-            std::unique_ptr<Expression> right = parseExpression(precedence);
-            left = std::make_unique<Expression>(std::move(left), std::move(right));
-        } else {
-            std::unique_ptr<Expression> right = parseExpression(precedence + 1);
-            left = std::make_unique<Expression>(tokenToBinaryOp(op), std::move(left), std::move(right));
+        // Hands the operand to the frames waiting for it until one needs another operand
+        bool needOperand = false;
+        while (!needOperand) {
+            Frame& frame = stack.back();
+            switch (frame.kind) {
+                case Frame::Kind::Unary:
+                    operand = arena->make<UnaryExpression>(tokenToUnaryOp(frame.op), operand);
+                    PARSER_LOG("Parsed unary operator: ", frame.word);
+                    stack.pop_back();
+                    break;
+
+                case Frame::Kind::Parenthesis:
+                    stack.pop_back();
+                    expect(Token::CPARENTHESIS, "Expected ')' after expression");
+                    PARSER_LOG("Parsed parenthesized expression");
+                    break;
+
+                case Frame::Kind::Binary:
+                    operand = arena->make<BinaryExpression>(tokenToBinaryOp(frame.op), frame.left, operand);
+                    stack.pop_back();
+                    break;
+
+                case Frame::Kind::Assignment:
+                    operand = arena->make<AssignmentExpression>(frame.left, operand);
+                    stack.pop_back();
+                    break;
+
+                case Frame::Kind::TrueBranch:
+                    if (peek().token != Token::COLON) {
+                        error("Expected ':' in conditional expression", peek());
+                    }
+                    advance();  // consume ':'
+                    PARSER_LOG("Parsing false branch of conditional expression");
+                    frame.kind = Frame::Kind::FalseBranch;
+                    frame.middle = operand;
+                    open(1);  // same level as the true branch
+                    needOperand = true;
+                    break;
+
+                case Frame::Kind::FalseBranch:
+                    operand = arena->make<ConditionalExpression>(frame.left, frame.middle, operand);
+                    PARSER_LOG("Parsed conditional expression");
+                    stack.pop_back();
+                    break;
+
+                case Frame::Kind::Operators: {
+                    // `operand` is the left side; take the next operator if it binds tightly enough
+                    Token op = peek().token;
+                    int precedence = getPrecedence(op);
+                    if (op == Token::QUESTION_MARK && frame.minPrecedence <= precedence) {
+                        advance();  // consume '?'
+                        PARSER_LOG("Parsing true branch of conditional expression");
+                        Frame branch{Frame::Kind::TrueBranch};
+                        branch.left = operand;
+                        stack.push_back(branch);
+                        open(1);  // higher than ?:
+                        needOperand = true;
+                    } else if (op != Token::QUESTION_MARK && precedence >= frame.minPrecedence) {
+                        advance();  // consume operator
+                        Frame pending{op == Token::ASSIGN ? Frame::Kind::Assignment : Frame::Kind::Binary};
+                        pending.op = op;
+                        pending.left = operand;
+                        stack.push_back(pending);
+                        // = is right-associative, the other binary operators left-associative
+                        open(op == Token::ASSIGN ? precedence : precedence + 1);
+                        needOperand = true;
+                    } else {
+                        stack.pop_back();
+                        if (stack.size() == base) return operand;
+                    }
+                    break;
+                }
+            }
         }
     }
-
-    return left;
-}
-
-// Parse factor
-std::unique_ptr<Expression> Parser::parseFactor() {
-    log("Parsing factor");
-    Lex currentToken = peek();
-
-    if (currentToken.token == Token::CONSTANT) {
-        advance();
-        int value = std::stoi(currentToken.word);
-        log("Parsed integer literal: " + std::to_string(value));
-        return std::make_unique<Expression>(value);
-    }
-    else if (currentToken.token == Token::IDENTIFIER) {
-        advance();
-        log("Parsed identifier: " + currentToken.word);
-        return std::make_unique<Expression>(currentToken.word);
-    }
-    else if (currentToken.token == Token::COMPLEMENT ||
-             currentToken.token == Token::NEGATION ||
-             currentToken.token == Token::NOT) {
-
-        UnaryOpast unop = tokenToUnaryOp(currentToken.token);
-        advance();
-        std::unique_ptr<Expression> operand = parseFactor();
-        log("Parsed unary operator: " + currentToken.word);
-        return std::make_unique<Expression>(unop, std::move(operand));
-    }
-    else if (currentToken.token == Token::OPARENTHESIS) {
-        advance();
-        std::unique_ptr<Expression> inner = parseExpression(0);
-        expect(Token::CPARENTHESIS, "Expected ')' after expression");
-        log("Parsed parenthesized expression");
-        return inner;
-    }
-    else {
-        error("Unexpected token in expression: " + currentToken.word, currentToken);
-        return nullptr;
-    }
 }
@@ -22,6 +22,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <memory>
 
@@ -37,9 +38,36 @@
  */
 class Parser {
 private:
-    std::vector<Lex> tokens;  /**< List of tokens to parse */
-    size_t current = 0;       /**< Current position in the tokens vector */
+    TokenStream tokens;       /**< Stream the tokens to parse are pulled from */
     bool verbose;             /**< Verbose mode flag to enable debug logs */
+    Arena* arena = nullptr;   /**< Arena of the Program being built; nodes are allocated here */
+
+    /**
+     * @brief Work that parseExpression resumes once the operand it is reading is complete.
+     *
+     * Expressions are parsed with an explicit stack of these instead of recursion, so that
+     * deeply nested input cannot overflow the call stack.
+     */
+    struct ExpressionFrame {
+        enum class Kind : uint8_t {
+            Operators,    /**< Operator loop of an ‹exp› whose operators bind at least minPrecedence */
+            Unary,        /**< Apply the prefix operator `op` */
+            Parenthesis,  /**< Expect the closing ')' */
+            Binary,       /**< Combine `left` and the operand with the binary operator `op` */
+            Assignment,   /**< Assign the operand to `left` */
+            TrueBranch,   /**< Expect ':' after the true branch of the conditional on `left` */
+            FalseBranch   /**< Build the conditional on `left` with true branch `middle` */
+        };
+
+        Kind kind;
+        int minPrecedence = 0;       /**< Operators only */
+        Token op = Token::MISMATCH;  /**< Unary and Binary only */
+        std::string_view word = {};  /**< Unary only: spelling of the operator, for the log */
+        Expression* left = nullptr;
+        Expression* middle = nullptr;
+    };
+
+    std::vector<ExpressionFrame> expressionStack;  /**< Kept to reuse its memory across expressions */
 
     /**
      * @brief Throws a runtime error with a detailed parse error message.
@@ -49,12 +77,6 @@ private:
      */
     [[noreturn]] void error(const std::string& message, const Lex& token);
 
-    /**
-     * @brief Logs messages to stdout if verbose mode is enabled.
-     * @param message Message to log.
-     */
-    void log(const std::string& message);
-
     /**
      * @brief Returns the precedence level of a binary operator token.
      *
@@ -72,8 +94,8 @@ private:
     /**
      * @brief Checks if we have reached the end of the token stream.
      */
-    bool isAtEnd() const {
-        return current >= tokens.size();
+    bool isAtEnd() {
+        return tokens.atEnd();
     }
 
 
@@ -104,8 +126,15 @@ private:
 
 public:
     /**
-     * @brief Constructs the parser with tokens and optional verbose mode.
-     * @param t Vector of tokens to parse.
+     * @brief Constructs the parser over a source buffer; tokens are lexed on demand.
+     * @param source Source buffer to parse. Must outlive the parser.
+     * @param verboseMode Enables verbose output if true (default false).
+     */
+    Parser(const SourceBuffer& source, bool verboseMode = false);
+
+    /**
+     * @brief Constructs the parser over tokens that were already lexed.
+     * @param t Vector of tokens to parse. Must outlive the parser.
      * @param verboseMode Enables verbose output if true (default false).
      */
     Parser(const std::vector<Lex>& t, bool verboseMode = false);
@@ -114,7 +143,7 @@ public:
      * @brief Returns the current token without consuming it.
      * @return The current token or a MISMATCH token if at end.
      */
-    Lex peek();
+    const Lex& peek();
 
     /**
      * @brief Consumes and returns the current token.
@@ -122,6 +151,11 @@ public:
      */
     Lex advance();
 
+    /**
+     * @brief Returns the number of tokens lexed so far.
+     */
+    size_t tokenCount() const { return tokens.tokenCount(); }
+
     /**
      * @brief Checks if the current token matches the given type and consumes it.
      * @param t Token type to match.
@@ -131,6 +165,9 @@ public:
 
     /**
      * @brief Parses a ‹program› according to the grammar.
+     *
+     * All nodes are allocated in the arena of the returned Program.
+     *
      * @return Unique pointer to the Program AST node.
      * @throws std::runtime_error If parsing fails.
      */
@@ -138,10 +175,10 @@ public:
 
     /**
      * @brief Parses a ‹function› according to the grammar.
-     * @return Unique pointer to the Function AST node.
+     * @return Pointer to the arena-allocated Function AST node.
      * @throws std::runtime_error If parsing fails.
      */
-    std::unique_ptr<Function> parseFunction();
+    Function* parseFunction();
 
     /**
      * @brief Parses a compound block of code.
@@ -153,9 +190,9 @@ public:
      * It will parse zero or more block items (statements or declarations)
      * until the closing brace '}' is encountered.
      *
-     * @return A unique pointer to the parsed Block node.
+     * @return Pointer to the parsed, arena-allocated Block node.
      */
-    std::unique_ptr<Block> parseBlock();
+    Block* parseBlock();
 
     /**
      * @brief Parses a ‹block-item› inside a function body.
@@ -166,10 +203,10 @@ public:
      *
      * Future extensions might allow variable declarations or compound statements.
      *
-     * @return Unique pointer to a BlockItem AST node.
+     * @return The BlockItem (stored by value in its Block).
      * @throws std::runtime_error If the block item is not recognized.
      */
-    std::unique_ptr<BlockItem> parseBlockItem();
+    BlockItem parseBlockItem();
 
     /**
      * @brief Parses the initializer portion of a 'for' loop.
@@ -183,42 +220,39 @@ public:
      * If the token is 'int', a declaration is parsed.
      * Otherwise, an optional expression is parsed (which can be null), followed by a required semicolon.
      *
-     * @return A unique_ptr to a ForInit node containing either a Declaration or an Expression.
+     * @return A pointer to a ForInit node containing either a Declaration or an Expression.
      *         Returns a non-null ForInit object even if the expression is empty (null).
      *         If invalid syntax is encountered, it throws a runtime_error with location info.
      */
-    std::unique_ptr<ForInit> parseForInit();
+    ForInit* parseForInit();
 
     /**
      * @brief Parses a ‹statement› according to the grammar.
-     * @return Unique pointer to the ReturnStatement AST node.
+     * @return Pointer to the Statement AST node.
      * @throws std::runtime_error If parsing fails.
      */
-    std::unique_ptr<Statement> parseStatement();
+    Statement* parseStatement();
 
     /**
      * @brief Parses an ‹exp› according to the grammar with default precedence.
-     * @return Unique pointer to the Expression AST node.
+     * @return Pointer to the Expression AST node.
      * @throws std::runtime_error If parsing fails.
      */
-    std::unique_ptr<Expression> parseExpression();
+    Expression* parseExpression();
 
     /**
      * @brief Parses an ‹exp› using precedence climbing algorithm.
      *
      * Used internally to correctly parse binary operations with varying precedence.
+     * Each pending operator, prefix operator or parenthesis is a frame on an explicit
+     * stack rather than a recursive call, so time and memory grow linearly with the size
+     * of the expression whatever its nesting depth.
      *
      * @param minPrecedence Minimum precedence level required to continue parsing.
-     * @return Unique pointer to the Expression AST node.
-     */
-    std::unique_ptr<Expression> parseExpression(int minPrecedence);
-
-    /**
-     * @brief Parses a <factor> according to the grammar.
-     * @return Unique pointer to the Expression AST node.
+     * @return Pointer to the Expression AST node.
      * @throws std::runtime_error If parsing fails.
      */
-    std::unique_ptr<Expression> parseFactor();
+    Expression* parseExpression(int minPrecedence);
 
     /**
      * @brief Ensures the current token matches the expected type, consumes it, and returns it.
@@ -0,0 +1,297 @@
+/**
+ * @file peephole.cpp
+ * @brief Implementation of the peephole rules and their driver.
+ */
+
+#include "peephole.hpp"
+
+namespace {
+
+bool sameOperand(const Operand* a, const Operand* b) {
+    return ::sameOperand(*a, *b);
+}
+
+bool isImm(const Operand* op, int value) {
+    auto imm = as<Imm>(op);
+    return imm && imm->getValue() == value;
+}
+
+bool isRegister(const Operand* op, Reg r) {
+    auto reg = as<Register>(op);
+    return reg && reg->getReg() == r;
+}
+
+/**
+ * @brief Condition that holds for `b ? a` when `cond` holds for `a ? b`.
+ */
+CondNode swapCondition(CondNode cond) {
+    switch (cond) {
+        case CondNode::G:  return CondNode::L;
+        case CondNode::GE: return CondNode::LE;
+        case CondNode::L:  return CondNode::G;
+        case CondNode::LE: return CondNode::GE;
+        default:           return cond;
+    }
+}
+
+CondNode negateCondition(CondNode cond) {
+    switch (cond) {
+        case CondNode::E:  return CondNode::NE;
+        case CondNode::NE: return CondNode::E;
+        case CondNode::G:  return CondNode::LE;
+        case CondNode::GE: return CondNode::L;
+        case CondNode::L:  return CondNode::GE;
+        case CondNode::LE: return CondNode::G;
+    }
+    return cond;
+}
+
+/**
+ * @brief Returns true if the flags are written before anything ahead reads them.
+ *
+ * Stops at labels and jumps, where the flags are assumed to be live.
+ */
+bool flagsDeadAhead(const PeepholeWindow& window) {
+    for (size_t k = 0; const Instruction* instr = window.ahead(k); ++k) {
+        switch (instr->kind()) {
+            case InstructionKind::SetCC:
+            case InstructionKind::Cmov:
+            case InstructionKind::JmpCC:
+            case InstructionKind::Jmp:
+            case InstructionKind::Label:
+                return false;
+            case InstructionKind::Cmp:
+            case InstructionKind::Binary:
+            case InstructionKind::Idiv:
+            case InstructionKind::Imul:
+            case InstructionKind::Ret:
+                return true;
+            case InstructionKind::Unary:
+                if (static_cast<const Unary*>(instr)->getOperator() == UnaryOperator::NEG) return true;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+// --- Rules ---
+
+bool removeEmptyFrame(PeepholeWindow& w) {
+    auto allocate = w.backAs<AllocateStack>(0);
+    if (!allocate || allocate->getValue() != 0) return false;
+    w.pop();
+    return true;
+}
+
+bool removeSelfMove(PeepholeWindow& w) {
+    auto mov = w.backAs<Mov>(0);
+    if (!mov || !sameOperand(mov->getSrc(), mov->getDst())) return false;
+    w.pop();
+    return true;
+}
+
+bool removeStoreReload(PeepholeWindow& w) {
+    auto first = w.backAs<Mov>(1);
+    auto second = w.backAs<Mov>(0);
+    if (!first || !second) return false;
+    if (!sameOperand(first->getSrc(), second->getDst()) || !sameOperand(first->getDst(), second->getSrc())) {
+        return false;
+    }
+    w.pop();
+    return true;
+}
+
+bool removeJumpToNext(PeepholeWindow& w) {
+    auto label = w.backAs<Label>(0);
+    if (!label) return false;
+    Symbol target = NoSymbol;
+    if (auto jmp = w.backAs<Jmp>(1)) target = jmp->getTarget();
+    if (auto jmpcc = w.backAs<JmpCC>(1)) target = jmpcc->getTarget();
+    if (target != label->getName()) return false;
+
+    auto kept = w.pop();
+    w.pop();
+    w.push(std::move(kept));
+    return true;
+}
+
+/**
+ * @brief Matches `movl $k, %r11d; cmpl x, %r11d` ending `back(reader + 1)`.
+ */
+bool isImmediateCompare(const PeepholeWindow& w, size_t reader) {
+    auto load = w.backAs<Mov>(reader + 2);
+    auto cmp = w.backAs<Cmp>(reader + 1);
+    return load && cmp && as<Imm>(load->getSrc()) && isRegister(load->getDst(), Reg::R11) &&
+           isRegister(cmp->getLHS(), Reg::R11) && !as<Imm>(cmp->getRHS());
+}
+
+bool reorderCompare(PeepholeWindow& w) {
+    if (auto jmpcc = w.backAs<JmpCC>(0)) {
+        if (!isImmediateCompare(w, 0)) return false;
+        CondNode cond = swapCondition(jmpcc->getCond());
+        Symbol target = jmpcc->getTarget();
+        w.pop();
+        auto cmp = w.pop();
+        auto load = w.pop();
+        auto imm = static_cast<Mov*>(load.get())->releaseSrc();
+        w.push(std::make_unique<Cmp>(static_cast<Cmp*>(cmp.get())->releaseRHS(), std::move(imm)));
+        w.push(std::make_unique<JmpCC>(cond, target));
+        return true;
+    }
+
+    if (auto cmov = w.backAs<Cmov>(0)) {
+        // Legalization may load the source or the destination of the cmov after the compare
+        size_t loads = 0;
+        while (loads < 2 && w.backAs<Mov>(loads + 1)) ++loads;
+        if (!isImmediateCompare(w, loads)) return false;
+        CondNode cond = swapCondition(cmov->getCond());
+        auto src = cmov->releaseSrc();
+        auto dst = cmov->releaseDst();
+        w.pop();
+        std::vector<std::unique_ptr<Instruction>> kept;
+        for (size_t k = 0; k < loads; ++k) kept.push_back(w.pop());
+        auto compare = w.pop();
+        auto load = w.pop();
+        w.push(std::make_unique<Cmp>(static_cast<Cmp*>(compare.get())->releaseRHS(),
+                                     static_cast<Mov*>(load.get())->releaseSrc()));
+        while (!kept.empty()) {
+            w.push(std::move(kept.back()));
+            kept.pop_back();
+        }
+        w.push(std::make_unique<Cmov>(cond, std::move(src), std::move(dst)));
+        return true;
+    }
+
+    auto setcc = w.backAs<SetCC>(0);
+    auto zero = w.backAs<Mov>(1);
+    if (!setcc || !zero || !isImmediateCompare(w, 1)) return false;
+
+    CondNode cond = swapCondition(setcc->getCond());
+    auto dst = setcc->releaseDst();
+    w.pop();
+    auto clear = w.pop();
+    auto compare = w.pop();
+    auto load = w.pop();
+    w.push(std::make_unique<Cmp>(static_cast<Cmp*>(compare.get())->releaseRHS(),
+                                 static_cast<Mov*>(load.get())->releaseSrc()));
+    w.push(std::move(clear));
+    w.push(std::make_unique<SetCC>(cond, std::move(dst)));
+    return true;
+}
+
+bool branchOnSetCC(PeepholeWindow& w) {
+    auto setcc = w.backAs<SetCC>(2);
+    auto test = w.backAs<Cmp>(1);
+    auto jmpcc = w.backAs<JmpCC>(0);
+    if (!setcc || !test || !jmpcc) return false;
+    if (!sameOperand(test->getLHS(), setcc->getDst()) || !isImm(test->getRHS(), 0)) return false;
+    if (jmpcc->getCond() != CondNode::E && jmpcc->getCond() != CondNode::NE) return false;
+
+    CondNode cond = jmpcc->getCond() == CondNode::NE ? setcc->getCond() : negateCondition(setcc->getCond());
+    Symbol target = jmpcc->getTarget();
+    w.pop();
+    w.pop();
+    w.push(std::make_unique<JmpCC>(cond, target));
+    return true;
+}
+
+bool zeroBeforeCompare(PeepholeWindow& w) {
+    auto cmp = w.backAs<Cmp>(2);
+    auto zero = w.backAs<Mov>(1);
+    auto setcc = w.backAs<SetCC>(0);
+    if (!cmp || !zero || !setcc || !isImm(zero->getSrc(), 0)) return false;
+    auto reg = as<Register>(zero->getDst());
+    if (!reg || !sameOperand(reg, setcc->getDst())) return false;
+    if (sameOperand(reg, cmp->getLHS()) || sameOperand(reg, cmp->getRHS())) return false;
+
+    Reg r = reg->getReg();
+    auto set = w.pop();
+    w.pop();
+    auto compare = w.pop();
+    w.push(std::make_unique<Binary>(BinaryOperator::XOR, std::make_unique<Register>(r),
+                                    std::make_unique<Register>(r)));
+    w.push(std::move(compare));
+    w.push(std::move(set));
+    return true;
+}
+
+bool useZeroIdiom(PeepholeWindow& w) {
+    auto mov = w.backAs<Mov>(0);
+    if (!mov || !isImm(mov->getSrc(), 0)) return false;
+    auto reg = as<Register>(mov->getDst());
+    if (!reg || reg->getReg() == Reg::R10 || reg->getReg() == Reg::R11) return false;
+    if (!flagsDeadAhead(w)) return false;
+
+    Reg r = reg->getReg();
+    w.pop();
+    w.push(std::make_unique<Binary>(BinaryOperator::XOR, std::make_unique<Register>(r),
+                                    std::make_unique<Register>(r)));
+    return true;
+}
+
+} // namespace
+
+// --- PeepholeOptimizer ---
+
+const std::vector<PeepholeRule>& PeepholeOptimizer::rules() {
+    static const std::vector<PeepholeRule> table = {
+        {"empty-frame", 1, removeEmptyFrame},
+        {"self-move", 1, removeSelfMove},
+        {"store-reload", 2, removeStoreReload},
+        {"jump-to-next", 2, removeJumpToNext},
+        {"compare-order", 3, reorderCompare},
+        {"setcc-branch", 3, branchOnSetCC},
+        {"zero-before-compare", 3, zeroBeforeCompare},
+        {"zero-idiom", 1, useZeroIdiom},
+    };
+    return table;
+}
+
+PeepholeOptimizer::PeepholeOptimizer()
+    : enabled(rules().size(), 1), hits(rules().size(), 0) {}
+
+bool PeepholeOptimizer::disableRule(const std::string& name) {
+    for (size_t r = 0; r < rules().size(); ++r) {
+        if (name == rules()[r].name) {
+            enabled[r] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PeepholeOptimizer::run(ASDLProgram& program) {
+    auto& instructions = program.getFunctionDefinition()->getInstructions();
+    std::vector<std::unique_ptr<Instruction>> out;
+    out.reserve(instructions.size());
+    PeepholeWindow window(out, instructions);
+    const auto& table = rules();
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        window.next = i + 1;
+        out.push_back(std::move(instructions[i]));
+
+        // Keep rewriting the end of the output until no rule matches it
+        bool fired = true;
+        while (fired) {
+            fired = false;
+            for (size_t r = 0; r < table.size(); ++r) {
+                if (enabled[r] && out.size() >= table[r].window && table[r].rewrite(window)) {
+                    ++hits[r];
+                    fired = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    instructions = std::move(out);
+}
+
+void PeepholeOptimizer::printStats(std::ostream& os) const {
+    for (size_t r = 0; r < rules().size(); ++r) {
+        os << "peephole " << rules()[r].name << ": " << hits[r] << (enabled[r] ? "" : " (disabled)") << "\n";
+    }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file peephole.hpp
+ * @brief Peephole optimizer over the final ASDL instruction stream.
+ *
+ * Runs after legalizeMovMemoryToMemory, when every operand is a register, a stack slot
+ * or an immediate. Instructions are read one at a time onto an output list; after each
+ * one, the rules of a table are tried on the end of that list, and a rule that matches
+ * rewrites it in place. Rewritten code is matched again, so rules can build on each
+ * other.
+ */
+
+#ifndef PEEPHOLE_HPP
+#define PEEPHOLE_HPP
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "asdl.hpp"
+
+/**
+ * @brief The instructions a peephole rule can see.
+ */
+class PeepholeWindow {
+    std::vector<std::unique_ptr<Instruction>>& out;
+    const std::vector<std::unique_ptr<Instruction>>& in;
+    size_t next = 0;
+
+    friend class PeepholeOptimizer;
+
+public:
+    PeepholeWindow(std::vector<std::unique_ptr<Instruction>>& out,
+                   const std::vector<std::unique_ptr<Instruction>>& in)
+        : out(out), in(in) {}
+
+    /**
+     * @brief Number of instructions already rewritten.
+     */
+    size_t size() const { return out.size(); }
+
+    /**
+     * @brief Returns the k-th rewritten instruction from the end (0 is the last one).
+     */
+    Instruction* back(size_t k) const { return out[out.size() - 1 - k].get(); }
+
+    /**
+     * @brief Returns back(k) if it is a T, else nullptr.
+     */
+    template <typename T>
+    T* backAs(size_t k) const { return k < out.size() ? as<T>(back(k)) : nullptr; }
+
+    /**
+     * @brief Returns the k-th instruction not read yet (0 is the next one), or nullptr.
+     */
+    const Instruction* ahead(size_t k) const {
+        return next + k < in.size() ? in[next + k].get() : nullptr;
+    }
+
+    std::unique_ptr<Instruction> pop() {
+        auto last = std::move(out.back());
+        out.pop_back();
+        return last;
+    }
+
+    void push(std::unique_ptr<Instruction> instr) { out.push_back(std::move(instr)); }
+};
+
+/**
+ * @brief A rewrite rule of the peephole optimizer.
+ */
+struct PeepholeRule {
+    const char* name;    ///< Name used by -fno-peephole= and the statistics
+    size_t window;       ///< Least number of rewritten instructions the rule looks at
+    bool (*rewrite)(PeepholeWindow& window);  ///< Rewrites the window; false if no match
+};
+
+/**
+ * @brief Applies the peephole rules and counts how often each one fires.
+ *
+ * The rules, in the order they are tried:
+ * - `empty-frame`: drops `subq $0, %rsp`;
+ * - `self-move`: drops `movl x, x`;
+ * - `store-reload`: drops `movl b, a` right after `movl a, b`;
+ * - `jump-to-next`: drops a jump to the label that follows it;
+ * - `compare-order`: `movl $k, %r11d; cmpl x, %r11d` becomes `cmpl $k, x`, with the
+ *   condition of the jmpcc, setcc or cmov that reads the flags swapped;
+ * - `setcc-branch`: `setcc t; cmpl $0, t; je/jne L` jumps on the condition of the setcc;
+ * - `zero-before-compare`: `cmpl; movl $0, r; setcc r` becomes `xorl r, r; cmpl; setcc r`;
+ * - `zero-idiom`: `movl $0, r` becomes `xorl r, r` when the flags are not read before
+ *   being written again. The scratch registers R10 and R11 are left to the rules above.
+ *
+ * Rewrites rely on two properties of the code generator: flags are only read by the
+ * jmpcc, setcc or cmov just after the compare that sets them (past the movs that load
+ * the operands of a cmov), and R10/R11 are only read by the instruction right after
+ * the one that loads them.
+ */
+class PeepholeOptimizer {
+    std::vector<char> enabled;
+    std::vector<size_t> hits;
+
+public:
+    PeepholeOptimizer();
+
+    /**
+     * @brief Returns the rule table.
+     */
+    static const std::vector<PeepholeRule>& rules();
+
+    /**
+     * @brief Turns off a rule by name.
+     * @return False if there is no rule with that name.
+     */
+    bool disableRule(const std::string& name);
+
+    /**
+     * @brief Rewrites the instructions of a program.
+     */
+    void run(ASDLProgram& program);
+
+    /**
+     * @brief Writes one line per rule with the number of times it fired.
+     */
+    void printStats(std::ostream& os) const;
+};
+
+#endif // PEEPHOLE_HPP
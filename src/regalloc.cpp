@@ -0,0 +1,566 @@
+/**
+ * @file regalloc.cpp
+ * @brief Implementation of the graph-coloring register and stack-slot allocators.
+ */
+
+#include "regalloc.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include "dataflow.hpp"
+
+using tacky::BitSet;
+
+namespace {
+
+/** Registers handed out by the allocator, in order of preference. */
+const Reg allocatable[] = {Reg::CX, Reg::SI, Reg::DI, Reg::R8, Reg::R9, Reg::DX, Reg::AX};
+
+/** Number of colors; nodes below it are the precolored hardware registers. */
+constexpr int K = sizeof(allocatable) / sizeof(allocatable[0]);
+
+/**
+ * Largest graph that is built and colored; its edge bit matrix takes n^2/16 bytes. Larger
+ * functions, whose graph could have that many edges, are allocated by linear scan.
+ */
+constexpr size_t MaxColoredNodes = 4096;
+
+/**
+ * Registers linear scan hands out: CX, SI, DI, R8 and R9, the first colors. No instruction
+ * names them, so unlike AX and DX they need no precolored intervals.
+ */
+constexpr int LinearScanRegisters = 5;
+
+int colorOf(Reg r) {
+    for (int i = 0; i < K; ++i) {
+        if (allocatable[i] == r) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Graph nodes an instruction reads and writes.
+ */
+struct Access {
+    int uses[4];
+    int useCount = 0;
+    int defs[2];
+    int defCount = 0;
+    int moveSrc = -1;  ///< For a Mov between two nodes, the source node
+};
+
+// --- Interference graph ---
+
+class InterferenceGraph {
+    std::vector<int> nodeOfSymbol;  ///< Node of each pseudo, indexed by symbol, or -1
+
+public:
+    std::vector<Symbol> pseudos;          ///< Symbol of each node from K on
+    std::vector<std::vector<int>> adjacent;
+    std::vector<std::vector<int>> moves;  ///< Nodes each node is moved to or from
+    std::vector<int> occurrences;         ///< Spill cost: number of operands naming the node
+    BitSet edgeBits;                      ///< Lower triangle of the adjacency matrix, once edges are added
+
+    InterferenceGraph() : nodeOfSymbol(symbols().size(), -1), pseudos(K, NoSymbol),
+                          adjacent(K), moves(K), occurrences(K, 0) {}
+
+    size_t size() const { return pseudos.size(); }
+
+    /**
+     * @brief Returns the node of a pseudo or allocatable register, or -1.
+     */
+    int node(const Operand* op) {
+        if (auto reg = as<Register>(op)) return colorOf(reg->getReg());
+        auto pseudo = as<Pseudo>(op);
+        if (!pseudo) return -1;
+
+        int& n = nodeOfSymbol[pseudo->getIdentifier()];
+        if (n < 0) {
+            n = static_cast<int>(pseudos.size());
+            pseudos.push_back(pseudo->getIdentifier());
+            adjacent.emplace_back();
+            moves.emplace_back();
+            occurrences.push_back(0);
+        }
+        return n;
+    }
+
+    int nodeOf(Symbol pseudo) const { return nodeOfSymbol[pseudo]; }
+
+    /**
+     * @brief Sizes the adjacency matrix; call once every node exists, before addEdge.
+     */
+    void startEdges() { edgeBits = BitSet(size() * (size() - 1) / 2); }
+
+    /**
+     * @brief Adds the edge a-b unless it is already there.
+     */
+    void addEdge(int a, int b) {
+        if (a == b || (a < K && b < K)) return;
+        size_t hi = static_cast<size_t>(std::max(a, b));
+        size_t bit = hi * (hi - 1) / 2 + static_cast<size_t>(std::min(a, b));
+        if (edgeBits.test(bit)) return;
+        edgeBits.set(bit);
+        adjacent[a].push_back(b);
+        adjacent[b].push_back(a);
+    }
+
+    void addMove(int a, int b) {
+        if (a == b) return;
+        moves[a].push_back(b);
+        moves[b].push_back(a);
+    }
+};
+
+Access collectAccess(Instruction* instr, InterferenceGraph& graph) {
+    Access access;
+    auto useReg = [&](Reg r) { access.uses[access.useCount++] = colorOf(r); };
+    auto defReg = [&](Reg r) { access.defs[access.defCount++] = colorOf(r); };
+
+    forEachOperand(*instr, [&](std::unique_ptr<Operand>& operand, OperandRole role) {
+        int n = graph.node(operand.get());
+        if (n < 0) return;
+        if (role != OperandRole::Write) access.uses[access.useCount++] = n;
+        if (role != OperandRole::Read) access.defs[access.defCount++] = n;
+        if (n >= K) ++graph.occurrences[n];
+    });
+
+    switch (instr->kind()) {
+        case InstructionKind::Mov:
+            if (access.useCount == 1 && access.defCount == 1) {
+                access.moveSrc = access.uses[0];
+                graph.addMove(access.defs[0], access.uses[0]);
+            }
+            break;
+        case InstructionKind::Idiv:
+            useReg(Reg::AX);
+            useReg(Reg::DX);
+            defReg(Reg::AX);
+            defReg(Reg::DX);
+            break;
+        case InstructionKind::Imul:
+            useReg(Reg::AX);
+            defReg(Reg::AX);
+            defReg(Reg::DX);
+            break;
+        case InstructionKind::Cdq:
+            useReg(Reg::AX);
+            defReg(Reg::DX);
+            break;
+        case InstructionKind::Ret:
+            useReg(Reg::AX);
+            break;
+        default:
+            break;
+    }
+    return access;
+}
+
+// --- Liveness ---
+
+/**
+ * @brief Basic blocks of the instruction stream, as index ranges.
+ */
+struct Blocks {
+    std::vector<size_t> begin;
+    std::vector<size_t> end;
+    std::vector<std::vector<int>> succs;
+};
+
+Blocks splitBlocks(const std::vector<std::unique_ptr<Instruction>>& instructions) {
+    Blocks blocks;
+    std::vector<int> labelBlock(symbols().size(), -1);
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        Instruction* instr = instructions[i].get();
+        bool startsBlock = i == 0 || instr->kind() == InstructionKind::Label;
+        if (i > 0 && !startsBlock) {
+            InstructionKind prev = instructions[i - 1]->kind();
+            startsBlock = prev == InstructionKind::Jmp || prev == InstructionKind::JmpCC ||
+                          prev == InstructionKind::Ret;
+        }
+        if (startsBlock) {
+            if (!blocks.begin.empty()) blocks.end.push_back(i);
+            blocks.begin.push_back(i);
+        }
+        if (auto label = as<Label>(instr)) {
+            labelBlock[label->getName()] = static_cast<int>(blocks.begin.size() - 1);
+        }
+    }
+    if (!blocks.begin.empty()) blocks.end.push_back(instructions.size());
+
+    size_t count = blocks.begin.size();
+    blocks.succs.resize(count);
+    for (size_t b = 0; b < count; ++b) {
+        Instruction* last = instructions[blocks.end[b] - 1].get();
+        bool fallsThrough = true;
+        switch (last->kind()) {
+            case InstructionKind::Jmp:
+                blocks.succs[b].push_back(labelBlock[static_cast<Jmp*>(last)->getTarget()]);
+                fallsThrough = false;
+                break;
+            case InstructionKind::JmpCC:
+                blocks.succs[b].push_back(labelBlock[static_cast<JmpCC*>(last)->getTarget()]);
+                break;
+            case InstructionKind::Ret:
+                fallsThrough = false;
+                break;
+            default:
+                break;
+        }
+        if (fallsThrough && b + 1 < count) blocks.succs[b].push_back(static_cast<int>(b + 1));
+    }
+    return blocks;
+}
+
+/**
+ * @brief Nodes live on entry to and on exit from each block, as sorted lists.
+ */
+tacky::BlockLiveness computeLiveness(const Blocks& blocks, const std::vector<Access>& accesses, size_t nodeCount) {
+    size_t count = blocks.begin.size();
+    std::vector<tacky::RegisterList> uses(count);
+    std::vector<tacky::RegisterList> defs(count);
+    std::vector<char> used(nodeCount, 0);
+    std::vector<char> defined(nodeCount, 0);
+
+    for (size_t b = 0; b < count; ++b) {
+        for (size_t i = blocks.begin[b]; i < blocks.end[b]; ++i) {
+            const Access& access = accesses[i];
+            for (int u = 0; u < access.useCount; ++u) {
+                int n = access.uses[u];
+                if (defined[n] || used[n]) continue;
+                used[n] = 1;
+                uses[b].push_back(static_cast<uint32_t>(n));
+            }
+            for (int d = 0; d < access.defCount; ++d) {
+                int n = access.defs[d];
+                if (defined[n]) continue;
+                defined[n] = 1;
+                defs[b].push_back(static_cast<uint32_t>(n));
+            }
+        }
+        for (uint32_t n : uses[b]) used[n] = 0;
+        for (uint32_t n : defs[b]) defined[n] = 0;
+        std::sort(uses[b].begin(), uses[b].end());
+        std::sort(defs[b].begin(), defs[b].end());
+    }
+
+    std::vector<int> order(count);
+    for (size_t b = 0; b < count; ++b) order[b] = static_cast<int>(b);
+    return tacky::solveLiveness(blocks.succs, uses, defs, order);
+}
+
+// --- Coloring ---
+
+/**
+ * @brief Colors the pseudo nodes; uncolorable nodes get -1.
+ */
+std::vector<int> colorGraph(const InterferenceGraph& graph) {
+    size_t n = graph.size();
+    std::vector<int> degree(n, 0);
+    std::vector<char> removed(n, 0);
+    std::vector<int> lowDegree;
+    std::vector<int> order;
+    order.reserve(n - K);
+
+    for (size_t i = K; i < n; ++i) {
+        degree[i] = static_cast<int>(graph.adjacent[i].size());
+        if (degree[i] < K) lowDegree.push_back(static_cast<int>(i));
+    }
+
+    auto remove = [&](int x) {
+        removed[x] = 1;
+        order.push_back(x);
+        for (int y : graph.adjacent[x]) {
+            if (y >= K && !removed[y] && --degree[y] == K - 1) lowDegree.push_back(y);
+        }
+    };
+
+    // Spill candidates, cheapest first: fewest occurrences per degree, then lowest node.
+    // Degrees only drop, which makes a node dearer, so an entry whose degree is out of
+    // date is pushed again with the current one when it comes out on top
+    struct Candidate {
+        int node;
+        int degree;
+    };
+    auto dearer = [&](const Candidate& a, const Candidate& b) {
+        int64_t costA = static_cast<int64_t>(graph.occurrences[a.node]) * b.degree;
+        int64_t costB = static_cast<int64_t>(graph.occurrences[b.node]) * a.degree;
+        return costA != costB ? costA > costB : a.node > b.node;
+    };
+    std::priority_queue<Candidate, std::vector<Candidate>, decltype(dearer)> candidates(dearer);
+    for (size_t i = K; i < n; ++i) {
+        if (degree[i] >= K) candidates.push({static_cast<int>(i), degree[i]});
+    }
+
+    // Simplify: remove nodes that can always be colored; when none is left, remove the
+    // one that is cheapest to spill and hope it still gets a color
+    while (order.size() < n - K) {
+        if (!lowDegree.empty()) {
+            int x = lowDegree.back();
+            lowDegree.pop_back();
+            if (!removed[x]) remove(x);
+            continue;
+        }
+        Candidate best = candidates.top();
+        candidates.pop();
+        if (removed[best.node]) continue;
+        if (best.degree != degree[best.node]) {
+            candidates.push({best.node, degree[best.node]});
+            continue;
+        }
+        remove(best.node);
+    }
+
+    // Select: color in reverse order of removal, preferring the color of move partners
+    std::vector<int> color(n, -1);
+    for (int i = 0; i < K; ++i) color[i] = i;
+
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        int x = *it;
+        uint32_t taken = 0;
+        for (int y : graph.adjacent[x]) {
+            if (color[y] >= 0) taken |= 1u << color[y];
+        }
+        for (int partner : graph.moves[x]) {
+            if (color[partner] >= 0 && !(taken & (1u << color[partner]))) {
+                color[x] = color[partner];
+                break;
+            }
+        }
+        for (int c = 0; c < K && color[x] < 0; ++c) {
+            if (!(taken & (1u << c))) color[x] = c;
+        }
+    }
+    return color;
+}
+
+/**
+ * @brief Adds the interference edges of a function to a graph that has all its nodes.
+ */
+void addInterferences(InterferenceGraph& graph, const Blocks& blocks, const std::vector<Access>& accesses,
+                      const tacky::BlockLiveness& liveness) {
+    graph.startEdges();
+
+    // A node written by an instruction interferes with everything live after it, except
+    // for the source of a move, which may share its location. At the start of the block
+    // the live set is its live-in set again, which is cleared before the next block
+    BitSet live(graph.size());
+    for (size_t b = 0; b < blocks.begin.size(); ++b) {
+        for (uint32_t n : liveness.liveOut[b]) live.set(n);
+        for (size_t i = blocks.end[b]; i-- > blocks.begin[b];) {
+            const Access& access = accesses[i];
+            for (int d = 0; d < access.defCount; ++d) {
+                int def = access.defs[d];
+                live.forEach([&](size_t n) {
+                    if (static_cast<int>(n) != access.moveSrc) graph.addEdge(def, static_cast<int>(n));
+                });
+            }
+            for (int d = 0; d < access.defCount; ++d) live.reset(access.defs[d]);
+            for (int u = 0; u < access.useCount; ++u) live.set(access.uses[u]);
+        }
+        for (uint32_t n : liveness.liveIn[b]) live.reset(n);
+    }
+}
+
+// --- Linear scan ---
+
+/**
+ * @brief Program points where a node may be live, as a hull: point 2i is where
+ * instruction i reads its operands and 2i+1 where it writes them.
+ */
+struct Interval {
+    int start = INT_MAX;
+    int end = -1;
+};
+
+std::vector<Interval> liveIntervals(const Blocks& blocks, const std::vector<Access>& accesses,
+                                    const tacky::BlockLiveness& liveness, size_t nodeCount) {
+    std::vector<Interval> intervals(nodeCount);
+    auto extend = [&](size_t n, int point) {
+        intervals[n].start = std::min(intervals[n].start, point);
+        intervals[n].end = std::max(intervals[n].end, point);
+    };
+
+    for (size_t b = 0; b < blocks.begin.size(); ++b) {
+        int entry = static_cast<int>(2 * blocks.begin[b]);
+        int exit = static_cast<int>(2 * blocks.end[b] - 1);
+        for (uint32_t n : liveness.liveIn[b]) extend(n, entry);
+        for (uint32_t n : liveness.liveOut[b]) extend(n, exit);
+    }
+    for (size_t i = 0; i < accesses.size(); ++i) {
+        const Access& access = accesses[i];
+        for (int u = 0; u < access.useCount; ++u) extend(access.uses[u], static_cast<int>(2 * i));
+        for (int d = 0; d < access.defCount; ++d) extend(access.defs[d], static_cast<int>(2 * i + 1));
+    }
+    return intervals;
+}
+
+/**
+ * @brief Numbers the intervals of `nodes` (sorted by start) so that overlapping ones
+ * differ, reusing the lowest number that is free again.
+ *
+ * Only numbers below `limit` are handed out. When none is free, whichever of the node
+ * and the current holders ends last gets -1, and the node takes its number if it was a
+ * holder.
+ */
+std::vector<int> scanIntervals(const std::vector<int>& nodes, const std::vector<Interval>& intervals,
+                               int limit) {
+    std::vector<int> number(intervals.size(), -1);
+    std::set<std::pair<int, int>> active;  // (end, node) of the nodes holding a number
+    std::priority_queue<int, std::vector<int>, std::greater<int>> released;
+    int handedOut = 0;
+
+    for (int x : nodes) {
+        while (!active.empty() && active.begin()->first < intervals[x].start) {
+            released.push(number[active.begin()->second]);
+            active.erase(active.begin());
+        }
+
+        if (!released.empty()) {
+            number[x] = released.top();
+            released.pop();
+        } else if (handedOut < limit) {
+            number[x] = handedOut++;
+        } else if (!active.empty() && std::prev(active.end())->first > intervals[x].end) {
+            int y = std::prev(active.end())->second;
+            active.erase(std::prev(active.end()));
+            number[x] = number[y];
+            number[y] = -1;
+        } else {
+            continue;
+        }
+        active.insert({intervals[x].end, x});
+    }
+    return number;
+}
+
+/**
+ * @brief Allocates the pseudos of a function too large to color by linear scan.
+ *
+ * Pseudos get up to `registers` of the first colors, in order of their live intervals;
+ * the others then share stack slots the same way.
+ */
+void linearScan(const Blocks& blocks, const std::vector<Access>& accesses, const tacky::BlockLiveness& liveness,
+                size_t nodeCount, int registers, std::vector<int>& color, std::vector<int>& slot) {
+    std::vector<Interval> intervals = liveIntervals(blocks, accesses, liveness, nodeCount);
+    std::vector<int> nodes;
+    nodes.reserve(nodeCount - K);
+    for (size_t n = K; n < nodeCount; ++n) nodes.push_back(static_cast<int>(n));
+    std::sort(nodes.begin(), nodes.end(), [&](int a, int b) {
+        return intervals[a].start != intervals[b].start ? intervals[a].start < intervals[b].start : a < b;
+    });
+
+    color = scanIntervals(nodes, intervals, registers);
+    for (int i = 0; i < K; ++i) color[i] = i;
+
+    std::vector<int> spilled;
+    for (int n : nodes) {
+        if (color[n] < 0) spilled.push_back(n);
+    }
+    slot = scanIntervals(spilled, intervals, INT_MAX);
+}
+
+/**
+ * @brief Gives each uncolored pseudo the first stack slot no interfering pseudo uses.
+ * @return Slot number of each node, or -1 for colored nodes.
+ */
+std::vector<int> assignStackSlots(const InterferenceGraph& graph, const std::vector<int>& color) {
+    std::vector<int> slot(graph.size(), -1);
+    std::vector<size_t> takenBy;  // last node that found each slot taken
+
+    for (size_t x = K; x < graph.size(); ++x) {
+        if (color[x] >= 0) continue;
+        for (int y : graph.adjacent[x]) {
+            if (slot[y] >= 0) takenBy[slot[y]] = x;
+        }
+        int s = 0;
+        while (s < static_cast<int>(takenBy.size()) && takenBy[s] == x) ++s;
+        if (s == static_cast<int>(takenBy.size())) takenBy.push_back(0);
+        slot[x] = s;
+    }
+    return slot;
+}
+
+/**
+ * @brief Replaces every Pseudo with its register or stack slot (colored nodes have no slot).
+ * @return Number of bytes of stack used by the slots.
+ */
+int rewritePseudos(std::vector<std::unique_ptr<Instruction>>& instructions, const InterferenceGraph& graph,
+                   const std::vector<int>& color, const std::vector<int>& slot) {
+    int slotCount = 0;
+
+    std::vector<std::unique_ptr<Instruction>> rewritten;
+    rewritten.reserve(instructions.size());
+    for (auto& instr : instructions) {
+        forEachOperand(*instr, [&](std::unique_ptr<Operand>& operand, OperandRole) {
+            auto pseudo = as<Pseudo>(operand.get());
+            if (!pseudo) return;
+            int n = graph.nodeOf(pseudo->getIdentifier());
+            if (color[n] >= 0) {
+                operand = std::make_unique<Register>(allocatable[color[n]]);
+            } else {
+                slotCount = std::max(slotCount, slot[n] + 1);
+                operand = std::make_unique<Stack>(-4 * (slot[n] + 1));
+            }
+        });
+
+        auto mov = as<Mov>(instr.get());
+        if (mov && sameOperand(*mov->getSrc(), *mov->getDst())) continue;
+        rewritten.push_back(std::move(instr));
+    }
+    instructions = std::move(rewritten);
+
+    return 4 * slotCount;
+}
+
+/**
+ * @brief Colors the pseudos of a function with `registers` colors, then gives stack
+ * slots to the others: by graph coloring, or by linear scan past MaxColoredNodes nodes.
+ * @return Number of bytes of stack used by the slots.
+ */
+int allocate(std::vector<std::unique_ptr<Instruction>>& instructions, int registers) {
+    InterferenceGraph graph;
+    std::vector<Access> accesses;
+    accesses.reserve(instructions.size());
+    for (auto& instr : instructions) accesses.push_back(collectAccess(instr.get(), graph));
+
+    Blocks blocks = splitBlocks(instructions);
+    tacky::BlockLiveness liveness = computeLiveness(blocks, accesses, graph.size());
+
+    std::vector<int> color;
+    std::vector<int> slot;
+    if (graph.size() > MaxColoredNodes) {
+        linearScan(blocks, accesses, liveness, graph.size(), std::min(registers, LinearScanRegisters), color, slot);
+    } else {
+        addInterferences(graph, blocks, accesses, liveness);
+        if (registers > 0) {
+            color = colorGraph(graph);
+        } else {
+            color.assign(graph.size(), -1);
+            for (int i = 0; i < K; ++i) color[i] = i;
+        }
+        slot = assignStackSlots(graph, color);
+    }
+    return rewritePseudos(instructions, graph, color, slot);
+}
+
+} // namespace
+
+// --- allocateRegisters ---
+
+int allocateRegisters(ASDLProgram& program) {
+    return allocate(program.getFunctionDefinition()->getInstructions(), K);
+}
+
+// --- colorStackSlots ---
+
+int colorStackSlots(ASDLProgram& program) {
+    return allocate(program.getFunctionDefinition()->getInstructions(), 0);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file regalloc.hpp
+ * @brief Register allocation over the ASDL instruction stream.
+ *
+ * Both allocators run in place of replacePseudosWithStack, before insertAllocateStack
+ * and legalizeMovMemoryToMemory.
+ */
+
+#ifndef REGALLOC_HPP
+#define REGALLOC_HPP
+
+#include "asdl.hpp"
+
+/**
+ * @brief Replaces Pseudo operands with hardware registers, spilling to the stack only
+ * when the registers run out.
+ *
+ * The allocator computes liveness over the basic blocks of the function and builds an
+ * interference graph of pseudos and hardware registers, which it colors with the
+ * caller-saved registers CX, SI, DI, R8, R9, DX and AX (simplify/select with optimistic
+ * coloring). R10 and R11 stay free for legalizeMovMemoryToMemory.
+ *
+ * AX and DX are precolored nodes: Cdq, Idiv, Ret and the moves to AX and DX read or
+ * write them. A pseudo that is live across one of those instructions therefore never
+ * gets AX or DX. A pseudo moved to or from another one is given the same register when
+ * possible, and the resulting `movl %r, %r` are removed.
+ *
+ * Pseudos that cannot be colored go to 4-byte stack slots, shared as in colorStackSlots.
+ *
+ * Liveness is kept as sorted lists of the nodes live at each block boundary. A function
+ * with more than a few thousand pseudos could have a graph quadratic in their number; it
+ * is allocated by linear scan over live intervals built from those lists instead, with
+ * CX, SI, DI, R8 and R9 only.
+ *
+ * @param program The ASDL program to transform.
+ * @return Number of bytes of stack used by spilled pseudos.
+ */
+int allocateRegisters(ASDLProgram& program);
+
+/**
+ * @brief Replaces every Pseudo operand with a stack slot, sharing slots between pseudos
+ * whose live ranges do not overlap.
+ *
+ * Uses the same interference graph as allocateRegisters, without registers: each pseudo
+ * takes the lowest-numbered slot that no interfering pseudo has taken, so the frame is
+ * as small as the number of values live at the same time allows (with a greedy choice
+ * in order of first appearance). Moves between two pseudos that end up in the same slot
+ * are removed. Past the size where allocateRegisters uses linear scan, slots are shared
+ * between pseudos whose live intervals do not overlap.
+ *
+ * @param program The ASDL program to transform.
+ * @return Number of bytes of stack used by the slots.
+ */
+int colorStackSlots(ASDLProgram& program);
+
+#endif // REGALLOC_HPP
@@ -0,0 +1,149 @@
+/**
+ * @file stats.cpp
+ * @brief Implementation of phase timings and compilation reports.
+ */
+
+#include "stats.hpp"
+
+#include <cstdio>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <time.h>
+#define STATS_HAVE_POSIX
+#endif
+
+double threadCpuMilliseconds() {
+#if defined(STATS_HAVE_POSIX) && defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+        return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+    }
+#endif
+    // Process time: only right when a single compilation runs at a time
+    return std::clock() * 1e3 / CLOCKS_PER_SEC;
+}
+
+uint64_t peakResidentKilobytes() {
+#ifdef STATS_HAVE_POSIX
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024;  // bytes on macOS
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    }
+#endif
+    return 0;
+}
+
+// --- PhaseTimer ---
+
+PhaseTimer::PhaseTimer(CompileReport& report, const char* name) : report(report), name(nullptr) {
+    start(name);
+}
+
+void PhaseTimer::start(const char* phase) {
+    if (!report.timePasses) return;
+    name = phase;
+    wallStart = std::chrono::steady_clock::now();
+    cpuStart = threadCpuMilliseconds();
+}
+
+void PhaseTimer::stop() {
+    if (!name) return;
+    double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    report.phases.push_back({name, wall, threadCpuMilliseconds() - cpuStart});
+    name = nullptr;
+}
+
+// --- CompileReport ---
+
+namespace {
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+void printJsonString(std::ostream& os, const std::string& text) {
+    os << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            os << escape;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+/**
+ * @brief Formats milliseconds with three decimals.
+ */
+std::string milliseconds(double ms) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ms);
+    return text;
+}
+
+} // namespace
+
+void CompileReport::print(std::ostream& os, const std::string& file) const {
+    if (!enabled()) return;
+    double totalWall = 0;
+    double totalCpu = 0;
+    for (const Phase& phase : phases) {
+        totalWall += phase.wallMs;
+        totalCpu += phase.cpuMs;
+    }
+
+    if (json) {
+        os << "{\"file\":";
+        printJsonString(os, file);
+        if (timePasses) {
+            os << ",\"phases\":[";
+            for (size_t i = 0; i < phases.size(); ++i) {
+                os << (i ? "," : "") << "{\"name\":\"" << phases[i].name << "\",\"wall_ms\":"
+                   << milliseconds(phases[i].wallMs) << ",\"cpu_ms\":" << milliseconds(phases[i].cpuMs) << "}";
+            }
+            os << "],\"total_wall_ms\":" << milliseconds(totalWall) << ",\"total_cpu_ms\":" << milliseconds(totalCpu)
+               << ",\"peak_rss_kb\":" << peakResidentKilobytes();
+        }
+        if (stats) {
+            os << ",\"stats\":{";
+            for (size_t i = 0; i < counters.size(); ++i) {
+                os << (i ? "," : "") << "\"" << counters[i].first << "\":" << counters[i].second;
+            }
+            os << "}";
+        }
+        os << "}\n";
+        return;
+    }
+
+    char line[96];
+    if (timePasses) {
+        os << "time-passes for " << file << ":\n";
+        std::snprintf(line, sizeof(line), "  %-16s %10s %10s\n", "phase", "wall ms", "cpu ms");
+        os << line;
+        for (const Phase& phase : phases) {
+            std::snprintf(line, sizeof(line), "  %-16s %10.3f %10.3f\n", phase.name, phase.wallMs, phase.cpuMs);
+            os << line;
+        }
+        std::snprintf(line, sizeof(line), "  %-16s %10.3f %10.3f\n", "total", totalWall, totalCpu);
+        os << line;
+        os << "  peak RSS: " << peakResidentKilobytes() << " KB\n";
+    }
+    if (stats) {
+        os << "stats for " << file << ":\n";
+        for (const auto& counter : counters) {
+            std::snprintf(line, sizeof(line), "  %-30s %12llu\n", counter.first,
+                          static_cast<unsigned long long>(counter.second));
+            os << line;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * @file stats.hpp
+ * @brief Phase timings (--time-passes) and size counters (--stats) of a compilation.
+ *
+ * The driver opens a PhaseTimer around each phase it runs and records counters as the
+ * program moves through the pipeline; the report is printed at the end of the
+ * compilation, as text or as one JSON object per source file.
+ */
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Returns the CPU time used by the calling thread, in milliseconds.
+ */
+double threadCpuMilliseconds();
+
+/**
+ * @brief Returns the peak resident set size of the process, in kilobytes (0 if unknown).
+ */
+uint64_t peakResidentKilobytes();
+
+/**
+ * @brief What --time-passes and --stats collected during one compilation.
+ */
+class CompileReport {
+public:
+    /**
+     * @brief Time spent in one phase.
+     */
+    struct Phase {
+        const char* name;
+        double wallMs;
+        double cpuMs;
+    };
+
+    bool timePasses = false;  ///< Record phase timings
+    bool stats = false;       ///< Record counters
+    bool json = false;        ///< Print as JSON instead of text
+
+    std::vector<Phase> phases;                                 ///< Phases in the order they ran
+    std::vector<std::pair<const char*, uint64_t>> counters;    ///< Counters in the order they were set
+
+    /**
+     * @brief Records a counter, if --stats is on.
+     */
+    void count(const char* name, uint64_t value) {
+        if (stats) counters.emplace_back(name, value);
+    }
+
+    /**
+     * @brief Returns true if there is anything to record.
+     */
+    bool enabled() const { return timePasses || stats; }
+
+    /**
+     * @brief Prints the report of the compilation of `file`, if anything was recorded.
+     */
+    void print(std::ostream& os, const std::string& file) const;
+};
+
+/**
+ * @brief Records the wall and CPU time of a phase in a report (when --time-passes is on),
+ * from its construction to stop(), next() or its destruction.
+ */
+class PhaseTimer {
+    CompileReport& report;
+    const char* name;
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart = 0;
+
+    void start(const char* phase);
+
+public:
+    PhaseTimer(CompileReport& report, const char* name);
+    ~PhaseTimer() { stop(); }
+
+    /**
+     * @brief Ends the current phase. Does nothing once the timer is stopped.
+     */
+    void stop();
+
+    /**
+     * @brief Ends the current phase and starts timing the next one.
+     */
+    void next(const char* phase) {
+        stop();
+        start(phase);
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+#endif // STATS_HPP
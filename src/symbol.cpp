@@ -0,0 +1,112 @@
+/**
+ * @file symbol.cpp
+ * @brief Implementation of the symbol table.
+ */
+
+#include "symbol.hpp"
+
+Symbol SymbolTable::intern(std::string_view text) {
+    auto found = interned.find(text);
+    if (found != interned.end()) {
+        return found->second;
+    }
+    Symbol symbol = static_cast<Symbol>(entries.size());
+    std::string_view copy = strings.copyString(text);
+    entries.push_back({Kind::Interned, '\0', NoSymbol, NoSymbol, 0, copy});
+    interned.emplace(copy, symbol);
+    return symbol;
+}
+
+Symbol SymbolTable::numbered(Symbol base, uint32_t number, char separator) {
+    Symbol symbol = static_cast<Symbol>(entries.size());
+    entries.push_back({Kind::Numbered, separator, base, NoSymbol, number, {}});
+    return symbol;
+}
+
+Symbol SymbolTable::derive(Symbol prefix, Symbol base) {
+    uint64_t key = (static_cast<uint64_t>(prefix) << 32) | base;
+    auto found = derived.find(key);
+    if (found != derived.end()) {
+        return found->second;
+    }
+    Symbol symbol = static_cast<Symbol>(entries.size());
+    entries.push_back({Kind::Derived, '\0', base, prefix, 0, {}});
+    derived.emplace(key, symbol);
+    return symbol;
+}
+
+void SymbolTable::appendName(std::string& out, Symbol symbol) const {
+    const Entry& entry = entries[symbol];
+    switch (entry.kind) {
+        case Kind::Interned:
+            out += entry.text;
+            break;
+        case Kind::Numbered:
+            appendName(out, entry.base);
+            if (entry.separator) out += entry.separator;
+            out += std::to_string(entry.number);
+            break;
+        case Kind::Derived:
+            appendName(out, entry.prefix);
+            out += '_';
+            appendName(out, entry.base);
+            break;
+    }
+}
+
+void SymbolTable::writeName(std::ostream& os, Symbol symbol) const {
+    const Entry& entry = entries[symbol];
+    switch (entry.kind) {
+        case Kind::Interned:
+            os << entry.text;
+            break;
+        case Kind::Numbered:
+            writeName(os, entry.base);
+            if (entry.separator) os << entry.separator;
+            os << entry.number;
+            break;
+        case Kind::Derived:
+            writeName(os, entry.prefix);
+            os << '_';
+            writeName(os, entry.base);
+            break;
+    }
+}
+
+void SymbolTable::clear() {
+    entries.clear();
+    interned.clear();
+    derived.clear();
+    strings.reset();
+}
+
+std::string SymbolTable::name(Symbol symbol) const {
+    std::string out;
+    appendName(out, symbol);
+    return out;
+}
+
+namespace {
+
+thread_local SymbolTable* currentTable = nullptr;
+
+} // namespace
+
+SymbolTable& symbols() {
+    if (currentTable) return *currentTable;
+    thread_local SymbolTable table;
+    return table;
+}
+
+SymbolTableScope::SymbolTableScope() : previous(currentTable) {
+    currentTable = &ownTable;
+}
+
+SymbolTableScope::SymbolTableScope(SymbolTable& reused) : previous(currentTable) {
+    reused.clear();
+    currentTable = &reused;
+}
+
+SymbolTableScope::~SymbolTableScope() {
+    currentTable = previous;
+}
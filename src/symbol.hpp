@@ -0,0 +1,143 @@
+/**
+ * @file symbol.hpp
+ * @brief Interned names shared by every phase of the compiler.
+ *
+ * Identifiers, temporaries and labels are represented by 32-bit Symbol IDs instead of
+ * strings. Equal source names intern to the same ID, so later phases compare and look
+ * names up with integer operations and can index dense tables by symbol. Generated names
+ * (numbered temporaries, loop labels) are recorded structurally and only spelled out when
+ * a printer asks for their text.
+ */
+
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+
+/**
+ * @typedef Symbol
+ * @brief Dense ID of a name in a SymbolTable.
+ */
+using Symbol = uint32_t;
+
+/**
+ * @brief Marks the absence of a symbol.
+ */
+constexpr Symbol NoSymbol = UINT32_MAX;
+
+/**
+ * @class SymbolTable
+ * @brief Maps symbols to names and interns source names.
+ *
+ * Symbols are handed out in increasing order starting at 0, so `size()` bounds every
+ * symbol issued so far and can size a vector indexed by symbol.
+ */
+class SymbolTable {
+    enum class Kind : uint8_t {
+        Interned,  /**< Name stored as text */
+        Numbered,  /**< base + separator + number */
+        Derived    /**< prefix + "_" + base */
+    };
+
+    struct Entry {
+        Kind kind;
+        char separator;          /**< Numbered: character between base and number, or '\0' */
+        Symbol base;             /**< Numbered, Derived: symbol the name is built from */
+        Symbol prefix;           /**< Derived: interned prefix */
+        uint32_t number;         /**< Numbered: suffix */
+        std::string_view text;   /**< Interned: the name itself */
+    };
+
+    std::vector<Entry> entries;                           /**< Entry per symbol */
+    std::unordered_map<std::string_view, Symbol> interned; /**< Text of every interned symbol */
+    std::unordered_map<uint64_t, Symbol> derived;          /**< (prefix, base) of every derived symbol */
+    Arena strings{4096};                                   /**< Copies of interned text */
+
+public:
+    SymbolTable() = default;
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    /**
+     * @brief Returns the symbol of a name, creating it on first use.
+     */
+    Symbol intern(std::string_view text);
+
+    /**
+     * @brief Creates a new symbol spelled `base`, `separator`, `number` (e.g. "x_3", "%tmp0").
+     *
+     * The caller is responsible for choosing numbers that keep the spelling unique.
+     * @param separator Character between base and number, or '\0' for none.
+     */
+    Symbol numbered(Symbol base, uint32_t number, char separator = '_');
+
+    /**
+     * @brief Returns the symbol spelled `prefix` + "_" + `base` (e.g. "break_loop_2").
+     *
+     * Asking twice for the same pair returns the same symbol.
+     */
+    Symbol derive(Symbol prefix, Symbol base);
+
+    /**
+     * @brief Appends the name of a symbol to a string.
+     */
+    void appendName(std::string& out, Symbol symbol) const;
+
+    /**
+     * @brief Writes the name of a symbol to a stream.
+     */
+    void writeName(std::ostream& os, Symbol symbol) const;
+
+    /**
+     * @brief Returns the name of a symbol.
+     */
+    std::string name(Symbol symbol) const;
+
+    /**
+     * @brief Returns the number of symbols issued so far.
+     */
+    size_t size() const { return entries.size(); }
+
+    /**
+     * @brief Forgets every symbol, keeping the allocated memory for the next ones.
+     */
+    void clear();
+};
+
+/**
+ * @brief Returns the symbol table used by the current thread.
+ *
+ * This is the table of the innermost SymbolTableScope alive on the thread, or a
+ * per-thread default table outside of any scope.
+ */
+SymbolTable& symbols();
+
+/**
+ * @class SymbolTableScope
+ * @brief Gives one compilation its own symbol table.
+ *
+ * While the scope is alive, symbols() on the creating thread returns an empty table: a
+ * new one, or a table passed in and cleared so that its memory is reused. The previous
+ * table is current again when the scope is destroyed. Symbols from one scope must not
+ * be used in another.
+ */
+class SymbolTableScope {
+    SymbolTable ownTable;
+    SymbolTable* previous;
+
+public:
+    SymbolTableScope();
+    explicit SymbolTableScope(SymbolTable& reused);
+    ~SymbolTableScope();
+    SymbolTableScope(const SymbolTableScope&) = delete;
+    SymbolTableScope& operator=(const SymbolTableScope&) = delete;
+};
+
+#endif // SYMBOL_HPP
@@ -1,5 +1,6 @@
 #include "tacky.hpp"
 #include <sstream>
+#include <stdexcept>
 #include <iostream>
 
 namespace tacky {
@@ -49,7 +50,7 @@ std::string Constant::toString() const {
 }
 
 std::string Var::toString() const {
-    return "Var(" + name + ")";
+    return "Var(" + symbols().name(name) + ")";
 }
 
 // ======== toString methods for Instruction types ========
@@ -81,24 +82,37 @@ std::string Copy::toString() const {
     return oss.str();
 }
 
+std::string CopyIfNotZero::toString() const {
+    std::ostringstream oss;
+    oss << "CopyIfNotZero(" << condition->toString() << ", " << src->toString() << ", " << dst->toString() << ")";
+    return oss.str();
+}
+
 std::string Jump::toString() const {
-    return "Jump(" + target + ")";
+    return "Jump(" + symbols().name(target) + ")";
 }
 
 std::string JumpIfZero::toString() const {
     std::ostringstream oss;
-    oss << "JumpIfZero(" << condition->toString() << ", " << target << ")";
+    oss << "JumpIfZero(" << condition->toString() << ", " << symbols().name(target) << ")";
     return oss.str();
 }
 
 std::string JumpIfNotZero::toString() const {
     std::ostringstream oss;
-    oss << "JumpIfNotZero(" << condition->toString() << ", " << target << ")";
+    oss << "JumpIfNotZero(" << condition->toString() << ", " << symbols().name(target) << ")";
+    return oss.str();
+}
+
+std::string JumpIfCompare::toString() const {
+    std::ostringstream oss;
+    oss << "JumpIfCompare(" << tacky::toString(op) << ", " << src1->toString() << ", "
+        << src2->toString() << ", " << symbols().name(target) << ")";
     return oss.str();
 }
 
 std::string Label::toString() const {
-    return "Label(" + name + ")";
+    return "Label(" + symbols().name(name) + ")";
 }
 
 // ======== toString for Function ========
@@ -122,6 +136,86 @@ std::string Program::toString() const {
     return oss.str();
 }
 
+// ======== Conditional jumps ========
+
+BinaryOp negateRelation(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::EQUAL:       return BinaryOp::NOTEQUAL;
+        case BinaryOp::NOTEQUAL:    return BinaryOp::EQUAL;
+        case BinaryOp::LESSTHAN:    return BinaryOp::GREATEREQ;
+        case BinaryOp::LESSEQ:      return BinaryOp::GREATERTHAN;
+        case BinaryOp::GREATERTHAN: return BinaryOp::LESSEQ;
+        case BinaryOp::GREATEREQ:   return BinaryOp::LESSTHAN;
+        default: throw std::runtime_error("Not a relational operator: " + toString(op));
+    }
+}
+
+void invertJump(Instr& jump) {
+    switch (jump.op) {
+        case Opcode::JumpIfZero:    jump.op = Opcode::JumpIfNotZero; break;
+        case Opcode::JumpIfNotZero: jump.op = Opcode::JumpIfZero; break;
+        case Opcode::JumpIfCompare:
+            jump.subop = static_cast<uint8_t>(negateRelation(jump.binaryOp()));
+            break;
+        default: throw std::runtime_error("Not a conditional jump");
+    }
+}
+
+// ======== Debug view of the flat IR ========
+
+static std::unique_ptr<Val> toVal(const FlatFunction& fn, Value v) {
+    if (v.isImm()) {
+        return std::make_unique<Constant>(v.immValue());
+    }
+    return std::make_unique<Var>(fn.registers[v.regIndex()]);
+}
+
+std::unique_ptr<Program> toProgram(const FlatProgram& program) {
+    const FlatFunction& fn = program.function;
+    auto func = std::make_unique<Function>(fn.name);
+
+    for (const Instr& instr : fn.code) {
+        switch (instr.op) {
+            case Opcode::Return:
+                func->body.push_back(std::make_unique<Return>(toVal(fn, instr.src1)));
+                break;
+            case Opcode::Unary:
+                func->body.push_back(std::make_unique<Unary>(
+                    instr.unaryOp(), toVal(fn, instr.src1), toVal(fn, instr.dst)));
+                break;
+            case Opcode::Binary:
+                func->body.push_back(std::make_unique<Binary>(
+                    instr.binaryOp(), toVal(fn, instr.src1), toVal(fn, instr.src2), toVal(fn, instr.dst)));
+                break;
+            case Opcode::Copy:
+                func->body.push_back(std::make_unique<Copy>(toVal(fn, instr.src1), toVal(fn, instr.dst)));
+                break;
+            case Opcode::CopyIfNotZero:
+                func->body.push_back(std::make_unique<CopyIfNotZero>(
+                    toVal(fn, instr.src1), toVal(fn, instr.src2), toVal(fn, instr.dst)));
+                break;
+            case Opcode::Jump:
+                func->body.push_back(std::make_unique<Jump>(instr.label));
+                break;
+            case Opcode::JumpIfZero:
+                func->body.push_back(std::make_unique<JumpIfZero>(toVal(fn, instr.src1), instr.label));
+                break;
+            case Opcode::JumpIfNotZero:
+                func->body.push_back(std::make_unique<JumpIfNotZero>(toVal(fn, instr.src1), instr.label));
+                break;
+            case Opcode::JumpIfCompare:
+                func->body.push_back(std::make_unique<JumpIfCompare>(
+                    instr.binaryOp(), toVal(fn, instr.src1), toVal(fn, instr.src2), instr.label));
+                break;
+            case Opcode::Label:
+                func->body.push_back(std::make_unique<Label>(instr.label));
+                break;
+        }
+    }
+
+    return std::make_unique<Program>(std::move(func));
+}
+
 // ======== Optional debug print functions (stdout only) ========
 
 void printVal(const Val* val) {
@@ -4,6 +4,10 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <type_traits>
+
+#include "symbol.hpp"
 
 namespace tacky {
 
@@ -39,13 +43,13 @@ struct Constant : Val {
  * @brief Represents a variable by its name.
  */
 struct Var : Val {
-    std::string name;
+    Symbol name;
 
     /**
      * @brief Constructs a Var with a given identifier.
      * @param id The name of the variable.
      */
-    Var(const std::string& id) : name(id) {}
+    Var(Symbol id) : name(id) {}
 
     std::string toString() const override;
 };
@@ -163,14 +167,30 @@ struct Copy : Instruction {
     std::string toString() const override;
 };
 
+/**
+ * @brief Copies only if a condition holds: `if (condition != 0) dst = src`.
+ *
+ * Otherwise dst keeps its previous value, which the instruction therefore reads.
+ */
+struct CopyIfNotZero : Instruction {
+    std::unique_ptr<Val> condition;
+    std::unique_ptr<Val> src;
+    std::unique_ptr<Val> dst;
+
+    CopyIfNotZero(std::unique_ptr<Val> c, std::unique_ptr<Val> s, std::unique_ptr<Val> d)
+        : condition(std::move(c)), src(std::move(s)), dst(std::move(d)) {}
+
+    std::string toString() const override;
+};
+
 struct Jump : Instruction {
-    std::string target;
+    Symbol target;
 
     /**
      * @brief Constructs a Jump instruction.
      * @param t name of the target
      */
-    Jump(std::string t) 
+    Jump(Symbol t) 
         : target(t) {}
     
     std::string toString() const override;
@@ -178,9 +198,9 @@ struct Jump : Instruction {
 
 struct JumpIfZero : Instruction {
     std::unique_ptr<Val> condition;
-    std::string target;
+    Symbol target;
 
-    JumpIfZero(std::unique_ptr<Val> c, std::string t)
+    JumpIfZero(std::unique_ptr<Val> c, Symbol t)
         : condition(std::move(c)), target(t) {}
     
     std::string toString() const override;
@@ -188,18 +208,33 @@ struct JumpIfZero : Instruction {
 
 struct JumpIfNotZero : Instruction {
     std::unique_ptr<Val> condition;
-    std::string target;
+    Symbol target;
 
-    JumpIfNotZero(std::unique_ptr<Val> c, std::string t)
+    JumpIfNotZero(std::unique_ptr<Val> c, Symbol t)
         : condition(std::move(c)), target(t) {}
     
     std::string toString() const override;
 };
 
+/**
+ * @brief Jumps if a comparison holds: `if (src1 op src2) goto target`.
+ */
+struct JumpIfCompare : Instruction {
+    BinaryOp op;                      ///< A relational operator
+    std::unique_ptr<Val> src1;
+    std::unique_ptr<Val> src2;
+    Symbol target;
+
+    JumpIfCompare(BinaryOp o, std::unique_ptr<Val> s1, std::unique_ptr<Val> s2, Symbol t)
+        : op(o), src1(std::move(s1)), src2(std::move(s2)), target(t) {}
+
+    std::string toString() const override;
+};
+
 struct Label : Instruction {
-    std::string name;
+    Symbol name;
 
-    Label(const std::string& n) : name(n) {}
+    Label(Symbol n) : name(n) {}
 
     std::string toString() const override;
 };
@@ -243,6 +278,157 @@ struct Program {
     std::string toString() const;
 };
 
+// ======== Flat IR ========
+//
+// The form the compiler actually works on: one contiguous vector of fixed-size, plain
+// instructions per function. Operands are stored inline as an immediate or the index of a
+// virtual register, so building or copying an instruction never allocates. The pointer
+// classes above are only built from it as a debug view (see toProgram()).
+
+/**
+ * @brief Opcode of a flat instruction.
+ */
+enum class Opcode : uint8_t {
+    Return,         ///< return src1
+    Unary,          ///< dst = op src1
+    Binary,         ///< dst = src1 op src2
+    Copy,           ///< dst = src1
+    CopyIfNotZero,  ///< if (src1 != 0) dst = src2; dst is also read
+    Jump,           ///< goto label
+    JumpIfZero,     ///< if (src1 == 0) goto label
+    JumpIfNotZero,  ///< if (src1 != 0) goto label
+    JumpIfCompare,  ///< if (src1 op src2) goto label, op being a relational BinaryOp
+    Label           ///< label:
+};
+
+/**
+ * @brief Operand of a flat instruction: an immediate or a virtual register.
+ */
+struct Value {
+    enum class Kind : uint8_t {
+        None,  ///< Unused operand slot
+        Imm,   ///< Integer constant
+        Reg    ///< Virtual register index
+    };
+
+    Kind kind = Kind::None;
+    uint32_t payload = 0;
+
+    static Value imm(int32_t v) { return {Kind::Imm, static_cast<uint32_t>(v)}; }
+    static Value reg(uint32_t r) { return {Kind::Reg, r}; }
+
+    bool isImm() const { return kind == Kind::Imm; }
+    bool isReg() const { return kind == Kind::Reg; }
+    int32_t immValue() const { return static_cast<int32_t>(payload); }
+    uint32_t regIndex() const { return payload; }
+
+    bool operator==(const Value& other) const { return kind == other.kind && payload == other.payload; }
+    bool operator!=(const Value& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief A flat TACKY instruction.
+ *
+ * Which fields are meaningful depends on the opcode (see Opcode); unused operands are
+ * Kind::None and an unused label is NoSymbol.
+ */
+struct Instr {
+    Opcode op;
+    uint8_t subop = 0;        ///< UnaryOp or BinaryOp for Unary / Binary
+    Value src1;
+    Value src2;
+    Value dst;
+    Symbol label = NoSymbol;  ///< Target of jumps, name of labels
+
+    UnaryOp unaryOp() const { return static_cast<UnaryOp>(subop); }
+    BinaryOp binaryOp() const { return static_cast<BinaryOp>(subop); }
+
+    bool operator==(const Instr& other) const {
+        return op == other.op && subop == other.subop && src1 == other.src1 &&
+               src2 == other.src2 && dst == other.dst && label == other.label;
+    }
+    bool operator!=(const Instr& other) const { return !(*this == other); }
+
+    static Instr ret(Value v) { return {Opcode::Return, 0, v, {}, {}, NoSymbol}; }
+    static Instr unary(UnaryOp o, Value s, Value d) {
+        return {Opcode::Unary, static_cast<uint8_t>(o), s, {}, d, NoSymbol};
+    }
+    static Instr binary(BinaryOp o, Value s1, Value s2, Value d) {
+        return {Opcode::Binary, static_cast<uint8_t>(o), s1, s2, d, NoSymbol};
+    }
+    static Instr copy(Value s, Value d) { return {Opcode::Copy, 0, s, {}, d, NoSymbol}; }
+    static Instr copyIfNotZero(Value c, Value s, Value d) {
+        return {Opcode::CopyIfNotZero, 0, c, s, d, NoSymbol};
+    }
+    static Instr jump(Symbol t) { return {Opcode::Jump, 0, {}, {}, {}, t}; }
+    static Instr jumpIfZero(Value c, Symbol t) { return {Opcode::JumpIfZero, 0, c, {}, {}, t}; }
+    static Instr jumpIfNotZero(Value c, Symbol t) { return {Opcode::JumpIfNotZero, 0, c, {}, {}, t}; }
+    static Instr jumpIfCompare(BinaryOp o, Value a, Value b, Symbol t) {
+        return {Opcode::JumpIfCompare, static_cast<uint8_t>(o), a, b, {}, t};
+    }
+    static Instr labelAt(Symbol n) { return {Opcode::Label, 0, {}, {}, {}, n}; }
+};
+
+static_assert(std::is_trivially_copyable_v<Instr>, "flat instructions are plain data");
+
+/**
+ * @brief Returns true for the jumps that fall through when their condition fails.
+ */
+inline bool isConditionalJump(Opcode op) {
+    return op == Opcode::JumpIfZero || op == Opcode::JumpIfNotZero || op == Opcode::JumpIfCompare;
+}
+
+/**
+ * @brief Returns true for ==, !=, <, <=, > and >=.
+ */
+inline bool isRelational(BinaryOp op) {
+    return op >= BinaryOp::EQUAL && op <= BinaryOp::GREATEREQ;
+}
+
+/**
+ * @brief Returns the relational operator that holds exactly when `op` does not.
+ */
+BinaryOp negateRelation(BinaryOp op);
+
+/**
+ * @brief Negates the condition of a conditional jump, so that it jumps when it used to
+ * fall through.
+ */
+void invertJump(Instr& jump);
+
+/**
+ * @brief A function in the flat IR.
+ */
+struct FlatFunction {
+    std::string name;                ///< Name of the function
+    std::vector<Instr> code;         ///< Instructions in order
+    std::vector<Symbol> registers;   ///< Name of each virtual register
+
+    /**
+     * @brief Creates a virtual register.
+     * @param n The name the register is printed with.
+     * @return The register index.
+     */
+    uint32_t newRegister(Symbol n) {
+        registers.push_back(n);
+        return static_cast<uint32_t>(registers.size() - 1);
+    }
+};
+
+/**
+ * @brief The top-level program in the flat IR.
+ */
+struct FlatProgram {
+    FlatFunction function;
+};
+
+/**
+ * @brief Builds the pointer-based view of a flat program, used to print it.
+ * @param program The flat program.
+ * @return An equivalent tacky::Program.
+ */
+std::unique_ptr<Program> toProgram(const FlatProgram& program);
+
 } // namespace tacky
 
 #endif // TACKY_HPP
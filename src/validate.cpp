@@ -4,174 +4,218 @@
  */
 
 #include "validate.hpp"
+#include "log.hpp"
 #include <stdexcept>
 #include <iostream>
 
-bool validate_verbose = false;
+// Message arguments are only evaluated when ctx.verbose is set
+#define VALIDATE_LOG(...) COMPILER_LOG(ctx.verbose, LogCategory::Validate, __VA_ARGS__)
 
-void log(const std::string& msg) {
-    if (validate_verbose) {
-        std::cout << "[Validate] " << msg << std::endl;
+[[noreturn]] void error(const std::string& msg) {
+    throw std::runtime_error("Semantic error: " + msg);
+}
+
+// --- Scopes ---
+
+void ScopeStack::exitScope() {
+    size_t mark = marks.back();
+    marks.pop_back();
+    while (undoLog.size() > mark) {
+        bindings[undoLog.back().name] = undoLog.back().previous;
+        undoLog.pop_back();
     }
 }
 
-[[noreturn]] void error(const std::string& msg) {
-    throw std::runtime_error("Semantic error: " + msg);
+bool ScopeStack::declare(Symbol name, Symbol variable) {
+    int depth = static_cast<int>(marks.size());
+    if (name >= bindings.size()) {
+        bindings.resize(symbols().size());
+    }
+    Binding& binding = bindings[name];
+    if (binding.variable != NoSymbol && binding.depth == depth) {
+        return false;
+    }
+    undoLog.push_back({name, binding});
+    binding = {variable, depth};
+    return true;
 }
 
-std::string resolve_variable_name(const std::string& name, const std::vector<VarMap>& scopes) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end()) {
-            return found->second;
-        }
+// --- Unique names ---
+
+Symbol generateUniqueName(ValidationContext& ctx, Symbol baseName) {
+    return symbols().numbered(baseName, ctx.uniqueNameCounter++);
+}
+
+// --- Resolution ---
+
+static void resolve_variable(VarExpression* var, const ScopeStack& scopes) {
+    Symbol variable = scopes.lookup(var->symbol);
+    if (variable == NoSymbol) {
+        error("Use of undeclared variable '" + std::string(var->identifier) + "'");
     }
-    error("Use of undeclared variable '" + name + "'");
+    var->symbol = variable;
 }
 
-std::unique_ptr<Expression> resolve_exp(const Expression* expr, const std::vector<VarMap>& scopes) {
-    switch (expr->type) {
-        case ExpressionType::CONSTANT:
-            return std::make_unique<Expression>(expr->value);
+void resolve_exp(Expression* expr, ValidationContext& ctx) {
+    // Pre-order walk over an explicit stack: children are pushed last to first so that
+    // they are visited in source order, as a recursive walk would
+    std::vector<Expression*>& pending = ctx.pendingExpressions;
+    const size_t base = pending.size();
+    pending.push_back(expr);
 
-        case ExpressionType::VAR: {
-            std::string uniqueName = resolve_variable_name(expr->identifier, scopes);
-            log("Resolved variable '" + expr->identifier + "' to '" + uniqueName + "'");
-            return std::make_unique<Expression>(uniqueName);
-        }
+    while (pending.size() > base) {
+        expr = pending.back();
+        pending.pop_back();
 
-        case ExpressionType::UNARY: {
-            auto sub = resolve_exp(expr->operand.get(), scopes);
-            return std::make_unique<Expression>(expr->un_op, std::move(sub));
-        }
+        switch (expr->type) {
+            case ExpressionType::CONSTANT:
+                break;
 
-        case ExpressionType::BINARY: {
-            auto left = resolve_exp(expr->operand1.get(), scopes);
-            auto right = resolve_exp(expr->operand2.get(), scopes);
-            return std::make_unique<Expression>(expr->bin_op, std::move(left), std::move(right));
-        }
+            case ExpressionType::VAR: {
+                auto var = expr->as<VarExpression>();
+                resolve_variable(var, ctx.scopes);
+                VALIDATE_LOG("Resolved variable '", var->identifier, "' to '", symbols().name(var->symbol), "'");
+                break;
+            }
+
+            case ExpressionType::UNARY:
+                pending.push_back(expr->as<UnaryExpression>()->operand);
+                break;
 
-        case ExpressionType::ASSIGNMENT: {
-            if (!expr->exp1 || expr->exp1->type != ExpressionType::VAR) {
-                error("Left-hand side of assignment must be a variable");
+            case ExpressionType::BINARY: {
+                auto binary = expr->as<BinaryExpression>();
+                pending.push_back(binary->operand2);
+                pending.push_back(binary->operand1);
+                break;
             }
-            std::string uniqueName = resolve_variable_name(expr->exp1->identifier, scopes);
-            log("Resolved assignment to '" + uniqueName + "'");
-            auto lhs = std::make_unique<Expression>(uniqueName);
-            auto rhs = resolve_exp(expr->exp2.get(), scopes);
-            return std::make_unique<Expression>(std::move(lhs), std::move(rhs));
-        }
 
-        case ExpressionType::CONDITIONAL: {
-            auto cond = resolve_exp(expr->condition.get(), scopes);
-            auto thenExpr = resolve_exp(expr->trueExpr.get(), scopes);
-            auto elseExpr = resolve_exp(expr->falseExpr.get(), scopes);
-            return std::make_unique<Expression>(std::move(cond), std::move(thenExpr), std::move(elseExpr));
-        }
+            case ExpressionType::ASSIGNMENT: {
+                auto assign = expr->as<AssignmentExpression>();
+                if (!assign->exp1 || assign->exp1->type != ExpressionType::VAR) {
+                    error("Left-hand side of assignment must be a variable");
+                }
+                auto lhs = assign->exp1->as<VarExpression>();
+                resolve_variable(lhs, ctx.scopes);
+                VALIDATE_LOG("Resolved assignment to '", symbols().name(lhs->symbol), "'");
+                pending.push_back(assign->exp2);
+                break;
+            }
 
-        default:
-            error("Unknown expression type in semantic validation");
+            case ExpressionType::CONDITIONAL: {
+                auto cond = expr->as<ConditionalExpression>();
+                pending.push_back(cond->falseExpr);
+                pending.push_back(cond->trueExpr);
+                pending.push_back(cond->condition);
+                break;
+            }
+
+            default:
+                error("Unknown expression type in semantic validation");
+        }
     }
 }
 
-void resolve_declaration(Declaration* decl, std::vector<VarMap>& scopes) {
-    const std::string& name = decl->name;
-    VarMap& current = scopes.back();
-
-    if (current.find(name) != current.end()) {
-        error("Variable '" + name + "' is already declared in this scope");
+void resolve_declaration(Declaration* decl, ValidationContext& ctx) {
+    Symbol variable = generateUniqueName(ctx, decl->symbol);
+    if (!ctx.scopes.declare(decl->symbol, variable)) {
+        error("Variable '" + std::string(decl->name) + "' is already declared in this scope");
     }
+    decl->symbol = variable;
 
-    std::string uniqueName = generateUniqueName(name);
-
-    current[name] = uniqueName;
+    VALIDATE_LOG("Declared variable '", decl->name, "' as '", symbols().name(variable), "'");
 
-    log("Declared variable '" + name + "' as '" + uniqueName + "'");
-    decl->name = uniqueName;
-    
     if (decl->initializer) {
-        decl->initializer = resolve_exp(decl->initializer.get(), scopes);
-        log("Resolved initializer for '" + uniqueName + "'");
+        resolve_exp(decl->initializer, ctx);
+        VALIDATE_LOG("Resolved initializer for '", symbols().name(variable), "'");
     }
 }
 
-void resolve_statement(Statement* stmt, std::vector<VarMap>& scopes, const std::string& currentLoopLabel) {
+void resolve_statement(Statement* stmt, ValidationContext& ctx, Symbol currentLoopLabel) {
     switch (stmt->type) {
-        case StatementType::RETURN:
-            log("Resolving return statement");
-            stmt->expression = resolve_exp(stmt->expression.get(), scopes);
+        case StatementType::RETURN: {
+            VALIDATE_LOG("Resolving return statement");
+            auto ret = stmt->as<ExpressionStatement>();
+            resolve_exp(ret->expression, ctx);
             break;
+        }
 
-        case StatementType::EXPRESSION:
-            log("Resolving expression statement");
-            stmt->expression = resolve_exp(stmt->expression.get(), scopes);
+        case StatementType::EXPRESSION: {
+            VALIDATE_LOG("Resolving expression statement");
+            auto exprStmt = stmt->as<ExpressionStatement>();
+            resolve_exp(exprStmt->expression, ctx);
             break;
+        }
 
         case StatementType::NULL_STMT:
-            log("Empty/null statement");
+            VALIDATE_LOG("Empty/null statement");
             break;
 
-        case StatementType::IF:
-            log("Resolving if statement");
-            stmt->condition = resolve_exp(stmt->condition.get(), scopes);
-            resolve_statement(stmt->thenBranch.get(), scopes, currentLoopLabel);
-            if (stmt->elseBranch) {
-                resolve_statement(stmt->elseBranch.get(), scopes, currentLoopLabel);
+        case StatementType::IF: {
+            VALIDATE_LOG("Resolving if statement");
+            auto ifStmt = stmt->as<IfStatement>();
+            resolve_exp(ifStmt->condition, ctx);
+            resolve_statement(ifStmt->thenBranch, ctx, currentLoopLabel);
+            if (ifStmt->elseBranch) {
+                resolve_statement(ifStmt->elseBranch, ctx, currentLoopLabel);
             }
             break;
+        }
 
         case StatementType::COMPOUND:
-            log("Resolving compound statement (block)");
-            resolve_block(stmt->block.get(), scopes, currentLoopLabel);
+            VALIDATE_LOG("Resolving compound statement (block)");
+            resolve_block(stmt->as<CompoundStatement>()->block, ctx, currentLoopLabel);
             break;
 
         case StatementType::WHILE:
-        case StatementType::DO_WHILE:
+        case StatementType::DO_WHILE: {
+            auto loop = stmt->as<WhileStatement>();
+            loop->label = generateUniqueName(ctx, symbols().intern("loop"));
+            VALIDATE_LOG("Generated loop label: '", symbols().name(loop->label), "'");
+
+            VALIDATE_LOG("Resolving ", (stmt->type == StatementType::WHILE ? "while" : "do-while"), " loop");
+            resolve_exp(loop->condition, ctx);
+            resolve_statement(loop->body, ctx, loop->label);
+            break;
+        }
+
         case StatementType::FOR: {
-            std::string loopLabel = generateUniqueName("loop");
-            stmt->label = loopLabel;
-            log("Generated loop label: '" + loopLabel + "'");
-
-            if (stmt->type == StatementType::WHILE || stmt->type == StatementType::DO_WHILE) {
-                log("Resolving " + std::string(stmt->type == StatementType::WHILE ? "while" : "do-while") + " loop");
-                stmt->condition = resolve_exp(stmt->condition.get(), scopes);
-                resolve_statement(stmt->body.get(), scopes, loopLabel);
-            } else { // FOR
-                log("Resolving for loop");
-
-                scopes.push_back(VarMap{});
-
-                if (stmt->forInit) {
-                    if (stmt->forInit->type == ForInitType::INIT_DECL) {
-                        resolve_declaration(stmt->forInit->decl.get(), scopes);
-                    } else if (stmt->forInit->type == ForInitType::INIT_EXP && stmt->forInit->expr) {
-                        stmt->forInit->setExpression(resolve_exp(stmt->forInit->expr.get(), scopes));
-                    }
-                }
+            auto loop = stmt->as<ForStatement>();
+            loop->label = generateUniqueName(ctx, symbols().intern("loop"));
+            VALIDATE_LOG("Generated loop label: '", symbols().name(loop->label), "'");
 
-                if (stmt->condition) {
-                    stmt->condition = resolve_exp(stmt->condition.get(), scopes);
-                }
+            VALIDATE_LOG("Resolving for loop");
+
+            ctx.scopes.enterScope();
 
-                if (stmt->postExpr) {
-                    stmt->postExpr = resolve_exp(stmt->postExpr.get(), scopes);
+            if (loop->forInit) {
+                if (loop->forInit->type == ForInitType::INIT_DECL) {
+                    resolve_declaration(loop->forInit->decl, ctx);
+                } else if (loop->forInit->type == ForInitType::INIT_EXP && loop->forInit->expr) {
+                    resolve_exp(loop->forInit->expr, ctx);
                 }
+            }
 
-                resolve_statement(stmt->body.get(), scopes, loopLabel);
+            if (loop->condition) {
+                resolve_exp(loop->condition, ctx);
+            }
 
-                scopes.pop_back();
+            if (loop->postExpr) {
+                resolve_exp(loop->postExpr, ctx);
             }
+
+            resolve_statement(loop->body, ctx, loop->label);
+
+            ctx.scopes.exitScope();
             break;
         }
 
         case StatementType::BREAK:
         case StatementType::CONTINUE:
-            if (currentLoopLabel.empty()) {
+            if (currentLoopLabel == NoSymbol) {
                 error("break/continue used outside of a loop");
             }
-            stmt->label = currentLoopLabel;
-            log("Assigned loop label '" + currentLoopLabel + "' to " + 
-                (stmt->type == StatementType::BREAK ? "break" : "continue") + " statement");
+            stmt->as<LoopControlStatement>()->label = currentLoopLabel;
+            VALIDATE_LOG("Assigned loop label '", symbols().name(currentLoopLabel), "' to ", (stmt->type == StatementType::BREAK ? "break" : "continue"), " statement");
             break;
 
         default:
@@ -179,14 +223,14 @@ void resolve_statement(Statement* stmt, std::vector<VarMap>& scopes, const std::
     }
 }
 
-void resolve_block_item(BlockItem* item, std::vector<VarMap>& scopes) {
+void resolve_block_item(BlockItem* item, ValidationContext& ctx) {
     switch (item->type) {
         case BlockItemType::DECLARATION:
-            resolve_declaration(item->declaration.get(), scopes);
+            resolve_declaration(item->declaration, ctx);
             break;
 
         case BlockItemType::STATEMENT:
-            resolve_statement(item->statement.get(), scopes);
+            resolve_statement(item->statement, ctx);
             break;
 
         default:
@@ -194,36 +238,36 @@ void resolve_block_item(BlockItem* item, std::vector<VarMap>& scopes) {
     }
 }
 
-void resolve_block(Block* block, std::vector<VarMap>& scopes, const std::string& currentLoopLabel) {
-    scopes.push_back(VarMap{}); // Enter new scope
+void resolve_block(Block* block, ValidationContext& ctx, Symbol currentLoopLabel) {
+    ctx.scopes.enterScope();
     for (auto& item : block->items) {
-        switch (item->type) {
+        switch (item.type) {
             case BlockItemType::DECLARATION:
-                resolve_declaration(item->declaration.get(), scopes);
+                resolve_declaration(item.declaration, ctx);
                 break;
             case BlockItemType::STATEMENT:
-                resolve_statement(item->statement.get(), scopes, currentLoopLabel);
+                resolve_statement(item.statement, ctx, currentLoopLabel);
                 break;
             default:
                 error("Invalid block item type");
         }
     }
-    scopes.pop_back(); // Exit scope
+    ctx.scopes.exitScope();
 }
 
-void resolve_function(Function* fn) {
-    log("Resolving function '" + fn->name + "'");
-    std::vector<VarMap> scopes;
-    scopes.emplace_back();  // global scope for this function
+void resolve_function(Function* fn, ValidationContext& ctx) {
+    VALIDATE_LOG("Resolving function '", fn->name, "'");
+    ctx.scopes.enterScope();  // global scope for this function
 
-    resolve_block(fn->body.get(), scopes, "");
+    resolve_block(fn->body, ctx);
+    ctx.scopes.exitScope();
 
-    log("Finished resolving function '" + fn->name + "'");
+    VALIDATE_LOG("Finished resolving function '", fn->name, "'");
 }
 
-void resolve_program(Program* program) {
+void resolve_program(Program* program, ValidationContext& ctx) {
     if (!program || !program->function) {
         error("Program is missing a function definition");
     }
-    resolve_function(program->function.get());
+    resolve_function(program->function, ctx);
 }
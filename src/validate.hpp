@@ -17,64 +17,109 @@
 #include "ast.hpp"
 
 /**
- * @typedef VarMap
- * @brief Maps user-defined variable names to internal unique names within a single scope.
- */
-using VarMap = std::unordered_map<std::string, std::string>;
-
-/**
- * @typedef VarMapStack
- * @brief Stack of VarMaps representing nested variable scopes.
+ * @class ScopeStack
+ * @brief Flat stack of nested variable scopes with an undo log.
  *
- * The back of the vector is the current (innermost) scope.
+ * A single table, indexed by the symbol of a source name, binds every name to the unique
+ * variable it currently refers to. Declaring a name records the binding it shadows in an
+ * undo log; leaving a scope replays the log back to the scope's mark and restores the
+ * shadowed bindings.
  */
-using VarMapStack = std::vector<VarMap>;
+class ScopeStack {
+    struct Binding {
+        Symbol variable = NoSymbol;  /**< Unique variable the name refers to, if any */
+        int depth = -1;              /**< Scope depth of the declaration */
+    };
+
+    struct UndoEntry {
+        Symbol name;       /**< Name whose binding changed */
+        Binding previous;  /**< Binding to restore on scope exit */
+    };
+
+    std::vector<Binding> bindings;   /**< Current binding per source symbol */
+    std::vector<UndoEntry> undoLog;  /**< Shadowed bindings */
+    std::vector<size_t> marks;       /**< Undo log size at each scope entry */
+
+public:
+    /**
+     * @brief Opens a nested scope.
+     */
+    void enterScope() { marks.push_back(undoLog.size()); }
+
+    /**
+     * @brief Closes the innermost scope, restoring the bindings it shadowed.
+     */
+    void exitScope();
+
+    /**
+     * @brief Binds a name in the innermost scope to a new variable.
+     * @param name The source name.
+     * @param variable The unique name of the new variable.
+     * @return False if the name is already declared in this scope.
+     */
+    bool declare(Symbol name, Symbol variable);
+
+    /**
+     * @brief Finds the variable a name currently refers to.
+     * @return The unique variable, or NoSymbol if the name is not declared in any open scope.
+     */
+    Symbol lookup(Symbol name) const {
+        return name < bindings.size() ? bindings[name].variable : NoSymbol;
+    }
+};
 
 /**
- * @brief Global flag to enable verbose logging during validation.
+ * @brief State of one validation run.
+ *
+ * Everything the resolver changes lives here rather than in globals, so compilations on
+ * different threads never share validation state.
  */
-extern bool validate_verbose;
+struct ValidationContext {
+    ScopeStack scopes;               /**< Variables visible at the current point */
+    uint32_t uniqueNameCounter = 0;  /**< Suffix of the next generated name */
+    bool verbose = false;            /**< Log each resolution step */
+    std::vector<Expression*> pendingExpressions;  /**< Work list of resolve_exp, kept to reuse its memory */
+};
 
 /**
- * @brief Generates a unique internal name for a given variable.
+ * @brief Generates a unique internal name for a given variable or loop.
  *
  * Used to avoid naming collisions during code generation or further analysis.
+ * Names are unique within one validation context.
  *
+ * @param ctx State of the validation run.
  * @param baseName The original variable name as defined in the source code.
- * @return A unique internal name.
+ * @return A new symbol spelled `baseName_N`.
  */
-inline std::string generateUniqueName(const std::string& baseName) {
-    static int counter = 0;
-    return baseName + "_" + std::to_string(counter++);
-}
+Symbol generateUniqueName(ValidationContext& ctx, Symbol baseName);
 
 /**
- * @brief Resolves and validates an expression node.
+ * @brief Resolves and validates an expression node in place.
  *
- * This function replaces variable references with their unique names,
- * validates expressions recursively, and checks for correct usage
- * of assignment and operator types.
+ * This function renames variable references to their unique names and
+ * records their symbol ID, validates subexpressions in source order, and checks
+ * for correct usage of assignment and operator types. The walk uses a work list
+ * instead of recursion, so arbitrarily deep expressions do not exhaust the stack.
  *
  * @param expr The expression node to resolve.
- * @param varStack Stack of variable scopes, from outermost to innermost.
- * @return A new resolved and validated expression.
+ * @param ctx State of the validation run.
  * @throws std::runtime_error If a semantic error is found.
  */
-std::unique_ptr<Expression> resolve_exp(const Expression* expr, const VarMapStack& varStack);
+void resolve_exp(Expression* expr, ValidationContext& ctx);
 
 /**
  * @brief Validates and resolves a variable declaration.
  *
  * This includes:
  * - Duplicate declaration checking in the current (innermost) scope
- * - Unique name generation
+ * - Unique name generation and symbol assignment
  * - Initializer expression resolution
  *
  * @param decl Pointer to the Declaration node.
- * @param varStack Stack of variable scopes.
+ * @param ctx State of the validation run.
  * @throws std::runtime_error On duplicate declarations.
  */
-void resolve_declaration(Declaration* decl, VarMapStack& varStack);
+void resolve_declaration(Declaration* decl, ValidationContext& ctx);
 
 /**
  * @brief Validates and resolves a statement node with optional loop context.
@@ -87,12 +132,12 @@ void resolve_declaration(Declaration* decl, VarMapStack& varStack);
  * - Control flow (`break`, `continue`) within loops
  *
  * @param stmt Pointer to the Statement node.
- * @param varStack Stack of variable scopes.
+ * @param ctx State of the validation run.
  * @param currentLoopLabel Label of the nearest enclosing loop for control flow handling.
  *                         Leave empty if not inside a loop.
  * @throws std::runtime_error On semantic errors such as invalid control flow usage.
  */
-void resolve_statement(Statement* stmt, VarMapStack& varStack, const std::string& currentLoopLabel = "");
+void resolve_statement(Statement* stmt, ValidationContext& ctx, Symbol currentLoopLabel = NoSymbol);
 
 /**
  * @brief Resolves all semantics within a compound block statement.
@@ -103,11 +148,11 @@ void resolve_statement(Statement* stmt, VarMapStack& varStack, const std::string
  * - Propagation of loop context for proper handling of break/continue
  *
  * @param block Pointer to the Block node representing the compound statement.
- * @param varStack Reference to the stack of variable scopes.
+ * @param ctx State of the validation run.
  * @param currentLoopLabel Label of the nearest enclosing loop (if any),
  *                         used to validate break/continue statements.
  */
-void resolve_block(Block* block, VarMapStack& varStack, const std::string& currentLoopLabel = "");
+void resolve_block(Block* block, ValidationContext& ctx, Symbol currentLoopLabel = NoSymbol);
 
 /**
  * @brief Resolves a block item, which can be either a declaration or a statement.
@@ -115,9 +160,9 @@ void resolve_block(Block* block, VarMapStack& varStack, const std::string& curre
  * Used during function body resolution to handle mixed code blocks.
  *
  * @param item Pointer to the BlockItem node.
- * @param varStack Stack of variable scopes.
+ * @param ctx State of the validation run.
  */
-void resolve_block_item(BlockItem* item, VarMapStack& varStack);
+void resolve_block_item(BlockItem* item, ValidationContext& ctx);
 
 /**
  * @brief Resolves all semantics within a function body.
@@ -126,8 +171,9 @@ void resolve_block_item(BlockItem* item, VarMapStack& varStack);
  * and maintains proper scoping rules.
  *
  * @param fn Pointer to the Function node to validate.
+ * @param ctx State of the validation run.
  */
-void resolve_function(Function* fn);
+void resolve_function(Function* fn, ValidationContext& ctx);
 
 /**
  * @brief Resolves and validates the entire program AST.
@@ -135,8 +181,9 @@ void resolve_function(Function* fn);
  * This should be called on the root Program node after parsing.
  *
  * @param program Pointer to the root Program node.
+ * @param ctx State of the validation run.
  * @throws std::runtime_error On any semantic validation failure.
  */
-void resolve_program(Program* program);
+void resolve_program(Program* program, ValidationContext& ctx);
 
 #endif // VALIDATE_HPP
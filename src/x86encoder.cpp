@@ -0,0 +1,418 @@
+/**
+ * @file x86encoder.cpp
+ * @brief Implementation of the x86-64 encoder.
+ */
+
+#include "x86encoder.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+/** Hardware number of a register, as used in ModRM and REX. */
+int regNumber(Reg r) {
+    switch (r) {
+        case Reg::AX:  return 0;
+        case Reg::CX:  return 1;
+        case Reg::DX:  return 2;
+        case Reg::SI:  return 6;
+        case Reg::DI:  return 7;
+        case Reg::R8:  return 8;
+        case Reg::R9:  return 9;
+        case Reg::R10: return 10;
+        case Reg::R11: return 11;
+    }
+    throw std::runtime_error("Unknown register");
+}
+
+/** Low nibble of the Jcc and SETcc opcodes. */
+uint8_t conditionCode(CondNode cond) {
+    switch (cond) {
+        case CondNode::E:  return 0x4;
+        case CondNode::NE: return 0x5;
+        case CondNode::L:  return 0xC;
+        case CondNode::GE: return 0xD;
+        case CondNode::LE: return 0xE;
+        case CondNode::G:  return 0xF;
+    }
+    throw std::runtime_error("Unknown condition");
+}
+
+constexpr int RBP = 5;
+constexpr int RSP = 4;
+
+bool fitsInt8(int64_t v) { return v >= -128 && v <= 127; }
+
+/**
+ * @brief Encodes the instructions of one function.
+ *
+ * Code is written without the jumps, whose size is only known once every label has an
+ * address; each jump is recorded with its position and inserted by finish().
+ */
+class X86Encoder {
+    struct Jump {
+        size_t offset;  ///< Position in `code` (jumps themselves are not counted)
+        int cond;       ///< Condition nibble, or -1 for jmp
+        int label;      ///< Index in `labels`
+        bool isLong = false;
+    };
+    struct LabelPos {
+        size_t offset = 0;
+        size_t jumpsBefore = 0;
+        bool bound = false;
+    };
+
+    std::vector<uint8_t> code;
+    std::vector<Jump> jumps;
+    std::vector<LabelPos> labels;
+    std::vector<int> labelOfSymbol;
+
+    void byte(uint8_t b) { code.push_back(b); }
+
+    void imm32(int32_t v) {
+        uint32_t u = static_cast<uint32_t>(v);
+        for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(u >> (8 * i)));
+    }
+
+    int labelIndex(Symbol name) {
+        if (name >= labelOfSymbol.size()) labelOfSymbol.resize(name + 1, -1);
+        int& index = labelOfSymbol[name];
+        if (index < 0) {
+            index = static_cast<int>(labels.size());
+            labels.emplace_back();
+        }
+        return index;
+    }
+
+    /**
+     * @brief Writes an optional REX prefix, the opcode and the ModRM (plus displacement)
+     * for `reg` and a register or stack operand `rm`.
+     *
+     * @param byteRegs The operand is an 8-bit register: SIL and DIL need a REX prefix.
+     */
+    void rmInstr(std::initializer_list<uint8_t> opcode, int reg, const Operand* rm,
+                 bool wide = false, bool byteRegs = false) {
+        int base = RBP;
+        bool isReg = false;
+        if (auto r = as<Register>(rm)) {
+            base = regNumber(r->getReg());
+            isReg = true;
+        } else if (!as<Stack>(rm)) {
+            throw std::runtime_error("Cannot encode operand " + rm->toString());
+        }
+
+        uint8_t rex = 0x40 | (wide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (isReg && base >= 8 ? 0x01 : 0);
+        if (rex != 0x40 || (byteRegs && isReg && base >= 4)) byte(rex);
+        for (uint8_t op : opcode) byte(op);
+
+        if (isReg) {
+            byte(static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (base & 7)));
+            return;
+        }
+        int disp = as<Stack>(rm)->getValue();
+        if (fitsInt8(disp)) {
+            byte(static_cast<uint8_t>(0x40 | ((reg & 7) << 3) | RBP));
+            byte(static_cast<uint8_t>(disp));
+        } else {
+            byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | RBP));
+            imm32(disp);
+        }
+    }
+
+    static int registerOf(const Operand* op) {
+        auto r = as<Register>(op);
+        if (!r) throw std::runtime_error("Expected a register, got " + op->toString());
+        return regNumber(r->getReg());
+    }
+
+    /**
+     * @brief Encodes an ALU instruction `dst op= src` (add, sub, xor, cmp).
+     * @param mrOpcode Opcode of the `r/m, reg` form; the `reg, r/m` form is mrOpcode + 2.
+     * @param ext ModRM extension of the immediate forms (0x81 / 0x83).
+     */
+    void alu(uint8_t mrOpcode, int ext, const Operand* src, const Operand* dst) {
+        if (auto imm = as<Imm>(src)) {
+            if (fitsInt8(imm->getValue())) {
+                rmInstr({0x83}, ext, dst);
+                byte(static_cast<uint8_t>(imm->getValue()));
+            } else {
+                rmInstr({0x81}, ext, dst);
+                imm32(imm->getValue());
+            }
+        } else if (as<Register>(src)) {
+            rmInstr({mrOpcode}, registerOf(src), dst);
+        } else {
+            rmInstr({static_cast<uint8_t>(mrOpcode + 2)}, registerOf(dst), src);
+        }
+    }
+
+    /**
+     * @brief Encodes a shift of `dst` by an immediate count (shl, shr, sar).
+     * @param ext ModRM extension of the shift in the 0xC1 / 0xD1 group.
+     */
+    void shift(int ext, const Operand* count, const Operand* dst) {
+        auto imm = as<Imm>(count);
+        if (!imm) throw std::runtime_error("Expected a shift count, got " + count->toString());
+        if (imm->getValue() == 1) {
+            rmInstr({0xD1}, ext, dst);
+        } else {
+            rmInstr({0xC1}, ext, dst);
+            byte(static_cast<uint8_t>(imm->getValue()));
+        }
+    }
+
+    /**
+     * @brief Encodes `leal (base,index,scale), dst` with a SIB byte and no displacement.
+     *
+     * None of the registers is RSP/R12 or RBP/R13, whose SIB encodings differ.
+     */
+    void encodeLea(Lea* lea) {
+        int base = registerOf(lea->getBase());
+        int index = registerOf(lea->getIndex());
+        int dst = registerOf(lea->getDst());
+        uint8_t scaleBits = 0;
+        switch (lea->getScale()) {
+            case 1: scaleBits = 0; break;
+            case 2: scaleBits = 1; break;
+            case 4: scaleBits = 2; break;
+            case 8: scaleBits = 3; break;
+            default: throw std::runtime_error("Invalid lea scale " + std::to_string(lea->getScale()));
+        }
+
+        uint8_t rex = 0x40 | (dst >= 8 ? 0x04 : 0) | (index >= 8 ? 0x02 : 0) | (base >= 8 ? 0x01 : 0);
+        if (rex != 0x40) byte(rex);
+        byte(0x8D);
+        byte(static_cast<uint8_t>(((dst & 7) << 3) | RSP));
+        byte(static_cast<uint8_t>((scaleBits << 6) | ((index & 7) << 3) | (base & 7)));
+    }
+
+    void encodeMov(Mov* mov) {
+        const Operand* src = mov->getSrc();
+        const Operand* dst = mov->getDst();
+        if (auto imm = as<Imm>(src)) {
+            if (auto r = as<Register>(dst)) {
+                int n = regNumber(r->getReg());
+                if (n >= 8) byte(0x41);
+                byte(static_cast<uint8_t>(0xB8 + (n & 7)));
+            } else {
+                rmInstr({0xC7}, 0, dst);
+            }
+            imm32(imm->getValue());
+        } else if (as<Register>(src)) {
+            rmInstr({0x89}, registerOf(src), dst);
+        } else {
+            rmInstr({0x8B}, registerOf(dst), src);
+        }
+    }
+
+    void encodeBinary(Binary* binary) {
+        const Operand* src = binary->getSrc();
+        const Operand* dst = binary->getDst();
+        switch (binary->getBinaryOperator()) {
+            case BinaryOperator::ADD:  alu(0x01, 0, src, dst); break;
+            case BinaryOperator::SUB:  alu(0x29, 5, src, dst); break;
+            case BinaryOperator::XOR:  alu(0x31, 6, src, dst); break;
+            case BinaryOperator::AND:  alu(0x21, 4, src, dst); break;
+            case BinaryOperator::SHL:  shift(4, src, dst); break;
+            case BinaryOperator::SHR:  shift(5, src, dst); break;
+            case BinaryOperator::SAR:  shift(7, src, dst); break;
+            case BinaryOperator::MULT:
+                if (auto imm = as<Imm>(src)) {
+                    int r = registerOf(dst);
+                    if (fitsInt8(imm->getValue())) {
+                        rmInstr({0x6B}, r, dst);
+                        byte(static_cast<uint8_t>(imm->getValue()));
+                    } else {
+                        rmInstr({0x69}, r, dst);
+                        imm32(imm->getValue());
+                    }
+                } else {
+                    rmInstr({0x0F, 0xAF}, registerOf(dst), src);
+                }
+                break;
+        }
+    }
+
+    void encodeCmp(Cmp* cmp) {
+        // Cmp(lhs, rhs) is `cmpl rhs, lhs`: flags from lhs - rhs
+        alu(0x39, 7, cmp->getRHS(), cmp->getLHS());
+    }
+
+    void jump(int cond, Symbol target) {
+        jumps.push_back({code.size(), cond, labelIndex(target)});
+    }
+
+    void bind(Symbol name) {
+        LabelPos& label = labels[labelIndex(name)];
+        label.offset = code.size();
+        label.jumpsBefore = jumps.size();
+        label.bound = true;
+    }
+
+    void epilogue() {
+        byte(0x48); byte(0x89); byte(0xEC);  // movq %rbp, %rsp
+        byte(0x5D);                          // popq %rbp
+    }
+
+public:
+    void encode(Instruction* instr) {
+        switch (instr->kind()) {
+            case InstructionKind::Mov:
+                encodeMov(static_cast<Mov*>(instr));
+                break;
+            case InstructionKind::Unary: {
+                auto unary = static_cast<Unary*>(instr);
+                rmInstr({0xF7}, unary->getOperator() == UnaryOperator::NEG ? 3 : 2, unary->getDst());
+                break;
+            }
+            case InstructionKind::Binary:
+                encodeBinary(static_cast<Binary*>(instr));
+                break;
+            case InstructionKind::Cmp:
+                encodeCmp(static_cast<Cmp*>(instr));
+                break;
+            case InstructionKind::Idiv:
+                rmInstr({0xF7}, 7, static_cast<Idiv*>(instr)->getDst());
+                break;
+            case InstructionKind::Imul:
+                rmInstr({0xF7}, 5, static_cast<Imul*>(instr)->getSrc());
+                break;
+            case InstructionKind::Lea:
+                encodeLea(static_cast<Lea*>(instr));
+                break;
+            case InstructionKind::Cdq:
+                byte(0x99);
+                break;
+            case InstructionKind::Jmp:
+                jump(-1, static_cast<Jmp*>(instr)->getTarget());
+                break;
+            case InstructionKind::JmpCC: {
+                auto jmpcc = static_cast<JmpCC*>(instr);
+                jump(conditionCode(jmpcc->getCond()), jmpcc->getTarget());
+                break;
+            }
+            case InstructionKind::SetCC: {
+                auto setcc = static_cast<SetCC*>(instr);
+                uint8_t op = static_cast<uint8_t>(0x90 | conditionCode(setcc->getCond()));
+                rmInstr({0x0F, op}, 0, setcc->getDst(), false, true);
+                break;
+            }
+            case InstructionKind::Cmov: {
+                auto cmov = static_cast<Cmov*>(instr);
+                uint8_t op = static_cast<uint8_t>(0x40 | conditionCode(cmov->getCond()));
+                rmInstr({0x0F, op}, registerOf(cmov->getDst()), cmov->getSrc());
+                break;
+            }
+            case InstructionKind::Label:
+                bind(static_cast<Label*>(instr)->getName());
+                break;
+            case InstructionKind::AllocateStack: {
+                int size = static_cast<AllocateStack*>(instr)->getValue();
+                byte(0x48);  // subq $size, %rsp
+                if (fitsInt8(size)) {
+                    byte(0x83); byte(0xC0 | (5 << 3) | RSP); byte(static_cast<uint8_t>(size));
+                } else {
+                    byte(0x81); byte(0xC0 | (5 << 3) | RSP); imm32(size);
+                }
+                break;
+            }
+            case InstructionKind::Ret:
+                epilogue();
+                byte(0xC3);
+                break;
+        }
+    }
+
+    void prologue() {
+        byte(0x55);                          // pushq %rbp
+        byte(0x48); byte(0x89); byte(0xE5);  // movq %rsp, %rbp
+    }
+
+    void returnZero() {
+        epilogue();
+        byte(0xB8); imm32(0);  // movl $0, %eax
+        byte(0xC3);
+    }
+
+    /**
+     * @brief Chooses the jump sizes and returns the final code.
+     */
+    std::vector<uint8_t> finish() {
+        for (const Jump& j : jumps) {
+            if (!labels[j.label].bound) throw std::runtime_error("Jump to an undefined label");
+        }
+
+        auto size = [](const Jump& j) -> size_t { return j.isLong ? (j.cond < 0 ? 5 : 6) : 2; };
+
+        // Addresses only grow as jumps become long, so this stops
+        std::vector<size_t> jumpAddress(jumps.size());
+        std::vector<size_t> grownBefore(jumps.size() + 1);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            size_t grown = 0;
+            for (size_t i = 0; i < jumps.size(); ++i) {
+                grownBefore[i] = grown;
+                jumpAddress[i] = jumps[i].offset + grown;
+                grown += size(jumps[i]);
+            }
+            grownBefore[jumps.size()] = grown;
+
+            for (size_t i = 0; i < jumps.size(); ++i) {
+                if (jumps[i].isLong) continue;
+                const LabelPos& label = labels[jumps[i].label];
+                int64_t target = static_cast<int64_t>(label.offset + grownBefore[label.jumpsBefore]);
+                int64_t next = static_cast<int64_t>(jumpAddress[i] + size(jumps[i]));
+                if (!fitsInt8(target - next)) {
+                    jumps[i].isLong = true;
+                    changed = true;
+                }
+            }
+        }
+
+        std::vector<uint8_t> out;
+        out.reserve(code.size() + grownBefore[jumps.size()]);
+        size_t copied = 0;
+        for (size_t i = 0; i < jumps.size(); ++i) {
+            const Jump& j = jumps[i];
+            out.insert(out.end(), code.begin() + copied, code.begin() + j.offset);
+            copied = j.offset;
+
+            const LabelPos& label = labels[j.label];
+            int64_t target = static_cast<int64_t>(label.offset + grownBefore[label.jumpsBefore]);
+            int64_t next = static_cast<int64_t>(out.size() + size(j));
+            int32_t disp = static_cast<int32_t>(target - next);
+            if (!j.isLong) {
+                out.push_back(j.cond < 0 ? 0xEB : static_cast<uint8_t>(0x70 | j.cond));
+                out.push_back(static_cast<uint8_t>(disp));
+                continue;
+            }
+            if (j.cond < 0) {
+                out.push_back(0xE9);
+            } else {
+                out.push_back(0x0F);
+                out.push_back(static_cast<uint8_t>(0x80 | j.cond));
+            }
+            uint32_t u = static_cast<uint32_t>(disp);
+            for (int k = 0; k < 4; ++k) out.push_back(static_cast<uint8_t>(u >> (8 * k)));
+        }
+        out.insert(out.end(), code.begin() + copied, code.end());
+        return out;
+    }
+};
+
+} // namespace
+
+MachineCode encodeProgram(const ASDLProgram& program) {
+    const FunctionDefinition* fn = program.getFunctionDefinition();
+    const auto& instructions = fn->getInstructions();
+
+    X86Encoder encoder;
+    encoder.prologue();
+    for (const auto& instr : instructions) encoder.encode(instr.get());
+    if (instructions.empty() || instructions.back()->kind() != InstructionKind::Ret) {
+        encoder.returnZero();
+    }
+
+    return {fn->getName(), encoder.finish()};
+}
@@ -0,0 +1,38 @@
+/**
+ * @file x86encoder.hpp
+ * @brief Encoding of legalized ASDL programs into x86-64 machine code.
+ *
+ * The encoder produces the same code as the assembly printed by emit(): the prologue,
+ * every instruction, and the return-0 epilogue when the function does not end with a
+ * Ret. Jumps only target labels of the same function, so the code needs no relocations.
+ */
+
+#ifndef X86ENCODER_HPP
+#define X86ENCODER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "asdl.hpp"
+
+/**
+ * @brief Machine code of one function.
+ */
+struct MachineCode {
+    std::string name;           ///< Function name, without the platform's symbol prefix
+    std::vector<uint8_t> text;  ///< Code bytes, starting at the function's entry point
+};
+
+/**
+ * @brief Encodes a program after legalizeMovMemoryToMemory.
+ *
+ * Jumps use the 2-byte rel8 forms when their target is close enough and the rel32
+ * forms otherwise (sizes are recomputed until every displacement fits).
+ *
+ * @throws std::runtime_error For operands that were not legalized (e.g. two memory
+ * operands) or a jump to an unknown label.
+ */
+MachineCode encodeProgram(const ASDLProgram& program);
+
+#endif // X86ENCODER_HPP